@@ -23,7 +23,40 @@ SOURCES += main.cpp\
     helper.cpp \
     audiowidget.cpp \
     audioinputsurface.cpp \
-    audiooutputsurface.cpp
+    audiooutputsurface.cpp \
+    frame.cpp \
+    framepool.cpp \
+    simd.cpp \
+    colorconversion.cpp \
+    benchmark.cpp \
+    framemailbox.cpp \
+    glcameraview.cpp \
+    framestage.cpp \
+    imagestages.cpp \
+    framepipeline.cpp \
+    framedifference.cpp \
+    motionstage.cpp \
+    sequentialwriter.cpp \
+    recorder.cpp \
+    syntheticcamera.cpp \
+    latencyhistogram.cpp \
+    camerastatistics.cpp \
+    viewfindernegotiation.cpp \
+    prerollbuffer.cpp \
+    imagestatistics.cpp \
+    statisticsstage.cpp \
+    framescale.cpp \
+    mosaiccompositor.cpp \
+    devicewatcher.cpp \
+    framebroker.cpp \
+    backgroundmodel.cpp \
+    backgroundstage.cpp \
+    audiolevels.cpp \
+    audioconversion.cpp \
+    audioring.cpp \
+    fft.cpp \
+    spectrumanalyzer.cpp \
+    spectrumwidget.cpp
 
 HEADERS  += singular.h \
     camerasurface.h \
@@ -36,6 +69,40 @@ HEADERS  += singular.h \
     helper.h \
     audiowidget.h \
     audioinputsurface.h \
-    audiooutputsurface.h
+    audiooutputsurface.h \
+    frame.h \
+    framepool.h \
+    simd.h \
+    colorconversion.h \
+    benchmark.h \
+    framemailbox.h \
+    glcameraview.h \
+    framestage.h \
+    imagestages.h \
+    framepipeline.h \
+    framedifference.h \
+    motionstage.h \
+    sequentialwriter.h \
+    recorder.h \
+    syntheticcamera.h \
+    latencyhistogram.h \
+    camerastatistics.h \
+    viewfindernegotiation.h \
+    prerollbuffer.h \
+    imagestatistics.h \
+    statisticsstage.h \
+    framescale.h \
+    mosaiccompositor.h \
+    devicewatcher.h \
+    frameconsumer.h \
+    framebroker.h \
+    backgroundmodel.h \
+    backgroundstage.h \
+    audiolevels.h \
+    audioconversion.h \
+    audioring.h \
+    fft.h \
+    spectrumanalyzer.h \
+    spectrumwidget.h
 
 FORMS    += singular.ui
@@ -0,0 +1,669 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "audioconversion.h"
+#include "simd.h"
+
+#include <cstring>
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Kernels
+ *      The integer converters are templates on the size, the sign and the byte order of the sample.
+ *      A sample is assembled in the top bits of a 32 bit integer, the sign bit is flipped for unsigned samples, and the
+ *      arithmetic shift down extends the sign. The vector converters do the same with shifts and shuffles, then
+ *      convert to float and multiply by the scale, a power of two, so the result is exact for up to 24 bits.
+ *      SSE2 has no byte shuffle, its 24 bit converter is the scalar one.
+ *      The AVX2 kernels clear the upper halves of the registers before handing the rest of the buffer to the SSE2 kernel.
+ */
+namespace
+{
+    template<int bytes, bool is_signed, bool big_endian>
+    inline qint32 integer_sample(const uchar *data)
+    {
+        quint32 value = 0;
+
+        for(int i = 0; i < bytes; i++)
+        {
+            value |= static_cast<quint32>(data[big_endian ? i : bytes - 1 - i]) << ((bytes - 1 - i + 4 - bytes) * 8);
+        }
+
+        if(!is_signed)
+        {
+            value ^= 0x80000000u;
+        }
+
+        return static_cast<qint32>(value) >> ((4 - bytes) * 8);
+    }
+
+    template<int bytes>
+    inline float scale()
+    {
+        return 1.0f / static_cast<float>(1u << (bytes * 8 - 1));
+    }
+
+    template<int bytes, bool is_signed, bool big_endian>
+    void convert_scalar(const uchar *data, const int start, const int samples, float *destination)
+    {
+        for(int i = start; i < samples; i++)
+        {
+            destination[i] = static_cast<float>(integer_sample<bytes, is_signed, big_endian>(data + i * bytes)) * scale<bytes>();
+        }
+    }
+
+    template<bool big_endian>
+    void convert_float_scalar(const uchar *data, const int start, const int samples, float *destination)
+    {
+        if(!big_endian)
+        {
+            std::memcpy(destination + start, data + start * 4, (samples - start) * sizeof(float));
+            return;
+        }
+
+        for(int i = start; i < samples; i++)
+        {
+            const quint32 value = static_cast<quint32>(integer_sample<4, true, true>(data + i * 4));
+            std::memcpy(destination + i, &value, sizeof(float));
+        }
+    }
+
+#if defined(simd_x86)
+    inline __m128i swap16_sse2(const __m128i value)
+    {
+        return _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+    }
+
+    inline __m128i swap32_sse2(const __m128i value)
+    {
+        const __m128i swapped = swap16_sse2(value);
+        return _mm_shufflehi_epi16(_mm_shufflelo_epi16(swapped, 0xB1), 0xB1);
+    }
+
+    /**
+     * 8 centered 16 bit samples, for 8 and 16 bit formats.
+     */
+    template<int bytes, bool is_signed, bool big_endian>
+    inline __m128i load16_sse2(const uchar *data)
+    {
+        if(bytes == 1)
+        {
+            const __m128i value = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data));
+
+            if(is_signed)
+            {
+                return _mm_srai_epi16(_mm_unpacklo_epi8(_mm_setzero_si128(), value), 8);
+            }
+
+            return _mm_sub_epi16(_mm_unpacklo_epi8(value, _mm_setzero_si128()), _mm_set1_epi16(128));
+        }
+
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+
+        if(big_endian)
+        {
+            value = swap16_sse2(value);
+        }
+
+        if(!is_signed)
+        {
+            value = _mm_xor_si128(value, _mm_set1_epi16(-32768));
+        }
+
+        return value;
+    }
+
+    template<int bytes, bool is_signed, bool big_endian>
+    void convert_sse2(const uchar *data, const int start, const int samples, float *destination)
+    {
+        const __m128 factor = _mm_set1_ps(scale<bytes>());
+        int i = start;
+
+        if(bytes == 1 || bytes == 2)
+        {
+            for(; i + 8 <= samples; i += 8)
+            {
+                const __m128i value = load16_sse2<bytes, is_signed, big_endian>(data + i * bytes);
+
+                //The sample in the top half of each 32 bit lane, shifted down with its sign.
+                const __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), value), 16);
+                const __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), value), 16);
+
+                _mm_storeu_ps(destination + i, _mm_mul_ps(_mm_cvtepi32_ps(low), factor));
+                _mm_storeu_ps(destination + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), factor));
+            }
+        }
+        else if(bytes == 4)
+        {
+            for(; i + 4 <= samples; i += 4)
+            {
+                __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 4));
+
+                if(big_endian)
+                {
+                    value = swap32_sse2(value);
+                }
+
+                if(!is_signed)
+                {
+                    value = _mm_xor_si128(value, _mm_set1_epi32(static_cast<int>(0x80000000u)));
+                }
+
+                _mm_storeu_ps(destination + i, _mm_mul_ps(_mm_cvtepi32_ps(value), factor));
+            }
+        }
+
+        convert_scalar<bytes, is_signed, big_endian>(data, i, samples, destination);
+    }
+
+    template<bool big_endian>
+    void convert_float_sse2(const uchar *data, const int start, const int samples, float *destination)
+    {
+        int i = start;
+
+        if(big_endian)
+        {
+            for(; i + 4 <= samples; i += 4)
+            {
+                const __m128i value = swap32_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 4)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), value);
+            }
+        }
+
+        convert_float_scalar<big_endian>(data, i, samples, destination);
+    }
+
+    simd_avx2_target inline __m256i swap32_avx2(const __m256i value)
+    {
+        const __m256i order = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                               3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        return _mm256_shuffle_epi8(value, order);
+    }
+
+    /**
+     * 8 samples per iteration as 32 bit integers. The 24 bit loads read 4 bytes past the 8 samples, 2 more samples are kept in the buffer.
+     */
+    template<int bytes, bool is_signed, bool big_endian>
+    simd_avx2_target void convert_avx2(const uchar *data, const int start, const int samples, float *destination)
+    {
+        const __m256 factor = _mm256_set1_ps(scale<bytes>());
+        const int margin = bytes == 3 ? 2 : 0;
+        int i = start;
+
+        for(; i + 8 + margin <= samples; i += 8)
+        {
+            const uchar *source = data + i * bytes;
+            __m256i value;
+
+            if(bytes == 1)
+            {
+                const __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source));
+
+                value = is_signed ? _mm256_cvtepi8_epi32(packed) : _mm256_sub_epi32(_mm256_cvtepu8_epi32(packed), _mm256_set1_epi32(128));
+            }
+            else if(bytes == 2)
+            {
+                __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+
+                if(big_endian)
+                {
+                    packed = swap16_sse2(packed);
+                }
+
+                if(!is_signed)
+                {
+                    packed = _mm_xor_si128(packed, _mm_set1_epi16(-32768));
+                }
+
+                value = _mm256_cvtepi16_epi32(packed);
+            }
+            else if(bytes == 3)
+            {
+                //4 samples in the first 12 bytes of each half, moved to the top 3 bytes of the lanes.
+                const __m256i packed = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source))),
+                                                               _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 12)), 1);
+
+                const __m256i order = big_endian ?
+                                      _mm256_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9,
+                                                       -1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9) :
+                                      _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                                       -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+
+                value = _mm256_shuffle_epi8(packed, order);
+
+                if(!is_signed)
+                {
+                    value = _mm256_xor_si256(value, _mm256_set1_epi32(static_cast<int>(0x80000000u)));
+                }
+
+                value = _mm256_srai_epi32(value, 8);
+            }
+            else
+            {
+                value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+
+                if(big_endian)
+                {
+                    value = swap32_avx2(value);
+                }
+
+                if(!is_signed)
+                {
+                    value = _mm256_xor_si256(value, _mm256_set1_epi32(static_cast<int>(0x80000000u)));
+                }
+            }
+
+            _mm256_storeu_ps(destination + i, _mm256_mul_ps(_mm256_cvtepi32_ps(value), factor));
+        }
+
+        _mm256_zeroupper();
+        convert_sse2<bytes, is_signed, big_endian>(data, i, samples, destination);
+    }
+
+    template<bool big_endian>
+    simd_avx2_target void convert_float_avx2(const uchar *data, const int start, const int samples, float *destination)
+    {
+        int i = start;
+
+        if(big_endian)
+        {
+            for(; i + 8 <= samples; i += 8)
+            {
+                const __m256i value = swap32_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i * 4)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i), value);
+            }
+        }
+
+        _mm256_zeroupper();
+        convert_float_sse2<big_endian>(data, i, samples, destination);
+    }
+#endif
+
+    template<int bytes, bool is_signed, bool big_endian>
+    void convert(const uchar *data, const int samples, float *destination)
+    {
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                convert_avx2<bytes, is_signed, big_endian>(data, 0, samples, destination);
+                return;
+            }
+            case Simd::SSE2:
+            {
+                convert_sse2<bytes, is_signed, big_endian>(data, 0, samples, destination);
+                return;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        convert_scalar<bytes, is_signed, big_endian>(data, 0, samples, destination);
+    }
+
+    template<bool big_endian>
+    void convert_float(const uchar *data, const int samples, float *destination)
+    {
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                convert_float_avx2<big_endian>(data, 0, samples, destination);
+                return;
+            }
+            case Simd::SSE2:
+            {
+                convert_float_sse2<big_endian>(data, 0, samples, destination);
+                return;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        convert_float_scalar<big_endian>(data, 0, samples, destination);
+    }
+}
+
+/**
+ * @brief AudioConversion::format
+ *      The sample format of a device format, only PCM is supported.
+ * @param audio_format
+ *      The format of the device.
+ * @return
+ *      The sample format, Unsupported if there is no converter for it.
+ */
+AudioConversion::Format AudioConversion::format(const QAudioFormat &audio_format)
+{
+    if(audio_format.codec() != "audio/pcm")
+    {
+        return Unsupported;
+    }
+
+    const bool big_endian = audio_format.byteOrder() == QAudioFormat::BigEndian;
+
+    switch(audio_format.sampleType())
+    {
+        case QAudioFormat::UnSignedInt:
+        {
+            switch(audio_format.sampleSize())
+            {
+                case 8:
+                {
+                    return UnsignedInt8;
+                }
+                case 16:
+                {
+                    return big_endian ? UnsignedInt16BE : UnsignedInt16LE;
+                }
+                case 24:
+                {
+                    return big_endian ? UnsignedInt24BE : UnsignedInt24LE;
+                }
+                case 32:
+                {
+                    return big_endian ? UnsignedInt32BE : UnsignedInt32LE;
+                }
+            }
+            break;
+        }
+        case QAudioFormat::SignedInt:
+        {
+            switch(audio_format.sampleSize())
+            {
+                case 8:
+                {
+                    return SignedInt8;
+                }
+                case 16:
+                {
+                    return big_endian ? SignedInt16BE : SignedInt16LE;
+                }
+                case 24:
+                {
+                    return big_endian ? SignedInt24BE : SignedInt24LE;
+                }
+                case 32:
+                {
+                    return big_endian ? SignedInt32BE : SignedInt32LE;
+                }
+            }
+            break;
+        }
+        case QAudioFormat::Float:
+        {
+            if(audio_format.sampleSize() == 32)
+            {
+                return big_endian ? Float32BE : Float32LE;
+            }
+            break;
+        }
+        case QAudioFormat::Unknown:
+        {
+            break;
+        }
+    }
+
+    return Unsupported;
+}
+
+/**
+ * @brief AudioConversion::converter
+ *      The converter of a format to the canonical format, it picks the instruction set on each call.
+ * @param format
+ *      The sample format.
+ * @return
+ *      The converter, 0 if the format is not supported.
+ *      Its arguments are the buffer, the number of samples of all the channels, and the float output.
+ */
+AudioConversion::Converter AudioConversion::converter(const Format format)
+{
+    switch(format)
+    {
+        case UnsignedInt8:
+        {
+            return convert<1, false, false>;
+        }
+        case SignedInt8:
+        {
+            return convert<1, true, false>;
+        }
+        case UnsignedInt16LE:
+        {
+            return convert<2, false, false>;
+        }
+        case UnsignedInt16BE:
+        {
+            return convert<2, false, true>;
+        }
+        case SignedInt16LE:
+        {
+            return convert<2, true, false>;
+        }
+        case SignedInt16BE:
+        {
+            return convert<2, true, true>;
+        }
+        case UnsignedInt24LE:
+        {
+            return convert<3, false, false>;
+        }
+        case UnsignedInt24BE:
+        {
+            return convert<3, false, true>;
+        }
+        case SignedInt24LE:
+        {
+            return convert<3, true, false>;
+        }
+        case SignedInt24BE:
+        {
+            return convert<3, true, true>;
+        }
+        case UnsignedInt32LE:
+        {
+            return convert<4, false, false>;
+        }
+        case UnsignedInt32BE:
+        {
+            return convert<4, false, true>;
+        }
+        case SignedInt32LE:
+        {
+            return convert<4, true, false>;
+        }
+        case SignedInt32BE:
+        {
+            return convert<4, true, true>;
+        }
+        case Float32LE:
+        {
+            return convert_float<false>;
+        }
+        case Float32BE:
+        {
+            return convert_float<true>;
+        }
+        case Unsupported:
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief AudioConversion::sample_bytes
+ * @param format
+ *      The sample format.
+ * @return
+ *      Bytes per sample, 0 if the format is not supported.
+ */
+int AudioConversion::sample_bytes(const Format format)
+{
+    switch(format)
+    {
+        case UnsignedInt8:
+        case SignedInt8:
+        {
+            return 1;
+        }
+        case UnsignedInt16LE:
+        case UnsignedInt16BE:
+        case SignedInt16LE:
+        case SignedInt16BE:
+        {
+            return 2;
+        }
+        case UnsignedInt24LE:
+        case UnsignedInt24BE:
+        case SignedInt24LE:
+        case SignedInt24BE:
+        {
+            return 3;
+        }
+        case UnsignedInt32LE:
+        case UnsignedInt32BE:
+        case SignedInt32LE:
+        case SignedInt32BE:
+        case Float32LE:
+        case Float32BE:
+        {
+            return 4;
+        }
+        case Unsupported:
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief AudioConversion::full_scale
+ * @param format
+ *      The sample format.
+ * @return
+ *      Magnitude of the most negative integer sample, the largest peak of the format. 0 for float and unsupported formats.
+ */
+int AudioConversion::full_scale(const Format format)
+{
+    const int bytes = sample_bytes(format);
+
+    if(format == Float32LE || format == Float32BE || bytes == 0 || bytes == 4)
+    {
+        //The full scale of a 32 bit format does not fit in an int, those are measured in float.
+        return 0;
+    }
+
+    return 1 << (bytes * 8 - 1);
+}
+
+/**
+ * @brief AudioConversion::format_name
+ * @param format
+ *      The sample format.
+ * @return
+ *      Short name of the format, for example "S24LE".
+ */
+QString AudioConversion::format_name(const Format format)
+{
+    switch(format)
+    {
+        case UnsignedInt8:
+        {
+            return "U8";
+        }
+        case SignedInt8:
+        {
+            return "S8";
+        }
+        case UnsignedInt16LE:
+        {
+            return "U16LE";
+        }
+        case UnsignedInt16BE:
+        {
+            return "U16BE";
+        }
+        case SignedInt16LE:
+        {
+            return "S16LE";
+        }
+        case SignedInt16BE:
+        {
+            return "S16BE";
+        }
+        case UnsignedInt24LE:
+        {
+            return "U24LE";
+        }
+        case UnsignedInt24BE:
+        {
+            return "U24BE";
+        }
+        case SignedInt24LE:
+        {
+            return "S24LE";
+        }
+        case SignedInt24BE:
+        {
+            return "S24BE";
+        }
+        case UnsignedInt32LE:
+        {
+            return "U32LE";
+        }
+        case UnsignedInt32BE:
+        {
+            return "U32BE";
+        }
+        case SignedInt32LE:
+        {
+            return "S32LE";
+        }
+        case SignedInt32BE:
+        {
+            return "S32BE";
+        }
+        case Float32LE:
+        {
+            return "F32LE";
+        }
+        case Float32BE:
+        {
+            return "F32BE";
+        }
+        case Unsupported:
+        {
+            break;
+        }
+    }
+
+    return "Unsupported";
+}
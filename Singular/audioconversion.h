@@ -0,0 +1,68 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIOCONVERSION_H
+#define AUDIOCONVERSION_H
+
+#include <QtGlobal>
+#include <QAudioFormat>
+
+/**
+ * @brief The AudioConversion namespace
+ *      Sample formats of the audio devices and their conversion to the canonical format: interleaved float32, full scale at 1.0.
+ *      There is one converter per format, picked once with 'converter' when the format is known.
+ *      The scalar and vector versions give the same results.
+ * @remarks
+ *      Integer samples are centered and divided by the magnitude of their most negative value, so they fall in [-1, 1).
+ *      The conversion of 32 bit integers rounds to the 24 bits of a float, the same way in every version.
+ *      Float samples are only swapped to the byte order of the CPU.
+ */
+namespace AudioConversion
+{
+    enum Format
+    {
+        Unsupported = 0,
+        UnsignedInt8,
+        SignedInt8,
+        UnsignedInt16LE,
+        UnsignedInt16BE,
+        SignedInt16LE,
+        SignedInt16BE,
+        UnsignedInt24LE,
+        UnsignedInt24BE,
+        SignedInt24LE,
+        SignedInt24BE,
+        UnsignedInt32LE,
+        UnsignedInt32BE,
+        SignedInt32LE,
+        SignedInt32BE,
+        Float32LE,
+        Float32BE
+    };
+
+    typedef void (*Converter)(const uchar *data, const int samples, float *destination);
+
+    Format format(const QAudioFormat &audio_format);
+    Converter converter(const Format format);
+
+    int sample_bytes(const Format format);
+    int full_scale(const Format format);
+    QString format_name(const Format format);
+}
+
+#endif // AUDIOCONVERSION_H
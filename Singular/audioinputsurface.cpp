@@ -18,23 +18,47 @@
 
 #include "audioinputsurface.h"
 #include "output.h"
+#include "settingsmanager.h"
+#include "helper.h"
+#include "frame.h"
 
-#include <QtEndian>
+#include <QCoreApplication>
+
+#include <cmath>
+#include <limits>
 
 /**
  * @brief AudioInputSurface::AudioInputSurface
- *      This starts the audioinput info and format with the settings passed by the parent.
+ *      Negotiates the format of the device and prepares the ring, the audio input itself is only created by 'start',
+ *      in the thread of the surface.
+ * @param new_id
+ *      The ID of this microphone.
+ * @param new_device_info
+ *      The device.
+ * @param new_device_format
+ *      The format requested, the nearest supported one is used otherwise.
  * @param parent
+ *      To parent this class. Leave it empty when the surface is moved to the audio thread, the owner connects the signals and slots.
  */
 AudioInputSurface::AudioInputSurface(const int new_id, const QAudioDeviceInfo new_device_info, const QAudioFormat new_device_format, QObject *parent)
     : QIODevice(parent),
       id(new_id),
+      nearest_format(false),
+      reported_overruns(0),
+      reported_glitches(0),
+      pending_level(0),
+      pending_rms(0),
+      last_level_time(0),
+      last_write_time(0),
+      glitch_gap(0),
+      audio_input(0),
       device_info(new_device_info),
-      device_format(new_device_format)
+      device_format(new_device_format),
+      ring(0),
+      glitch_count(0),
+      longest_gap(0),
+      realtime(0)
 {
-    connect(this, SIGNAL(console(QString)), parent, SIGNAL(console(QString)));
-    connect(this, SIGNAL(microphone_data(int, const char*, int)), parent, SLOT(microphone_data(int, const char*, int)));
-
 //    Automatic device settings
 //    device_info = QAudioDeviceInfo::defaultInputDevice();
 //    device_format = device_info.preferredFormat();
@@ -49,33 +73,85 @@ AudioInputSurface::AudioInputSurface(const int new_id, const QAudioDeviceInfo ne
 
     if (!device_info.isFormatSupported(device_format))
     {
-        output("Audio format not supported, trying to use nearest.", 1);
+        nearest_format = true;
         device_format = device_info.nearestFormat(device_format);
     }
 
-    audio_input = new QAudioInput(device_info, device_format, this);
-    connect(audio_input, SIGNAL(notify()), SLOT(notify()));
-    connect(audio_input, SIGNAL(stateChanged(QAudio::State)), SLOT(stateChanged(QAudio::State)));
-
-    set_amplitude();
-    device_print();
+    //The levels go to the GUI at most every "Audio/LevelInterval" milliseconds, the loudest of the buffers in between.
+    level_interval = qMax(0, SettingsManager::read("Audio/LevelInterval", 33).toInt());
 
-    output("Audio-in device started: " + device_info.deviceName(), 1);
+    set_format();
 }
 
+/**
+ * @brief AudioInputSurface::~AudioInputSurface
+ *      The consumer of the ring must be detached before.
+ */
 AudioInputSurface::~AudioInputSurface()
 {
-
+    delete ring;
 }
 
 /**
  * @brief AudioInputSurface::start
- *      Opens this device and starts the audio.
+ *      Creates the audio input, opens this device and starts the audio, in the thread of the surface.
+ *      When the surface has its own thread, that thread is moved to the real-time scheduler with the priority
+ *      "Audio/RealtimePriority", 0 keeps the normal scheduler. The GUI thread is never changed.
+ *      The scratch samples are allocated here for the buffer of the device, so the callback does not allocate.
  */
 void AudioInputSurface::start()
 {
+    if (nearest_format)
+    {
+        output("Audio format not supported, trying to use nearest.", 1);
+    }
+
+    if (converter == 0)
+    {
+        output("Audio sample format not supported, the microphone is not measured.", 1);
+    }
+    else
+    {
+        output("Sample format: " + AudioConversion::format_name(sample_format), 3);
+    }
+
+    device_print();
+
+    const int priority = SettingsManager::read("Audio/RealtimePriority", 50).toInt();
+
+    if (priority > 0 && thread() != QCoreApplication::instance()->thread())
+    {
+        if (Helper::set_realtime_priority(priority))
+        {
+            realtime.storeRelease(1);
+            output("Audio-in thread of microphone " + QString::number(id) + " is real-time, priority " + QString::number(priority), 3);
+        }
+        else
+        {
+            output("Audio-in thread of microphone " + QString::number(id) + " could not be made real-time, missing permission?", 2);
+        }
+    }
+
+    audio_input = new QAudioInput(device_info, device_format, this);
+    connect(audio_input, SIGNAL(notify()), SLOT(notify()));
+    connect(audio_input, SIGNAL(stateChanged(QAudio::State)), SLOT(stateChanged(QAudio::State)));
+
     open(QIODevice::WriteOnly | QIODevice::Truncate);
     audio_input->start(this);
+
+    //The device buffer is known once started, the callback gets at most that much. A longer gap than the buffer lost samples.
+    const int buffer_frames = audio_input->bufferSize() / frame_bytes;
+
+    if (buffer_frames > 0 && ring != 0)
+    {
+        samples.resize(buffer_frames * ring->get_channels());
+    }
+
+    glitch_gap = buffer_frames > 0 && device_format.sampleRate() > 0 ?
+                static_cast<qint64>(buffer_frames) * 1000000000 / device_format.sampleRate() : 100000000;
+    last_write_time = 0;
+
+    output("Audio-in device started: " + device_info.deviceName(), 1);
 }
 
 /**
@@ -84,10 +160,68 @@ void AudioInputSurface::start()
  */
 void AudioInputSurface::stop()
 {
-    audio_input->stop();
+    if (audio_input != 0)
+    {
+        audio_input->stop();
+    }
+
     close();
 }
 
+/**
+ * @brief AudioInputSurface::get_ring
+ *      The samples of the microphone in the canonical format, for one consumer thread. Attach to it to receive them.
+ * @return
+ *      The ring, owned by the surface. 0 if the format is not supported.
+ */
+AudioRing *AudioInputSurface::get_ring() const
+{
+    return ring;
+}
+
+/**
+ * @brief AudioInputSurface::get_sample_rate
+ * @return
+ *      Samples per second of the format in use, the one of the ring.
+ */
+int AudioInputSurface::get_sample_rate() const
+{
+    return device_format.sampleRate();
+}
+
+/**
+ * @brief AudioInputSurface::get_glitch_count
+ *      Safe from any thread.
+ * @return
+ *      The number of times the device callback came later than the device buffer lasts, every one lost samples.
+ */
+int AudioInputSurface::get_glitch_count() const
+{
+    return glitch_count.loadAcquire();
+}
+
+/**
+ * @brief AudioInputSurface::get_longest_gap
+ *      Safe from any thread.
+ * @return
+ *      The longest time between two device callbacks, in microseconds.
+ */
+int AudioInputSurface::get_longest_gap() const
+{
+    return longest_gap.loadAcquire();
+}
+
+/**
+ * @brief AudioInputSurface::is_realtime
+ *      Safe from any thread.
+ * @return
+ *      If the thread of the surface runs on the real-time scheduler.
+ */
+bool AudioInputSurface::is_realtime() const
+{
+    return realtime.loadAcquire() != 0;
+}
+
 /**
  * @brief AudioInputSurface::readData
  *      This is a microphone device, so there is no need to implement a read function.
@@ -105,8 +239,12 @@ qint64 AudioInputSurface::readData(char *data, qint64 maxSize)
 
 /**
  * @brief AudioInputSurface::writeData
- *      Receives the data from the device, consumes the data by looping all the samples independently and
- *      converts it to a unsigned type, independently for the device preferences.
+ *      Receives the data from the device and converts it once to the canonical float samples, which go to the ring.
+ *      The peak and the RMS of each channel are measured with the integer kernel of the format, or on the float samples when
+ *      the format has none, and the levels of the loudest channel are sent to the widget. Only the levels leave the surface
+ *      by signal, the data of the device is not valid after this returns.
+ *      This runs in the audio thread and does not allocate, unless the device hands a larger buffer than it announced.
+ *      The time since the last call is measured, a gap longer than the device buffer is counted as a glitch.
  * @param data
  *      RAW data from the audio-in analog signal.
  * @param maxSize
@@ -120,126 +258,132 @@ qint64 AudioInputSurface::readData(char *data, qint64 maxSize)
  */
 qint64 AudioInputSurface::writeData(const char *data, qint64 maxSize)
 {
-    if (audio_peak_amplitude)
+    const int frames = static_cast<int>(maxSize / frame_bytes);
+    const qint64 now = Frame::clock();
+
+    if (last_write_time > 0)
     {
-        quint16 max_value = 0;
+        const qint64 gap = now - last_write_time;
+        const int gap_usecs = static_cast<int>(qMin(gap / 1000, static_cast<qint64>(std::numeric_limits<int>::max())));
 
-        const int sample_bytes = device_format.sampleSize() / 8;
-        const int channel_bytes = device_format.channelCount() * sample_bytes;        
-        const int total_samples = maxSize / channel_bytes;
+        if (gap > glitch_gap)
+        {
+            glitch_count.ref();
+        }
+
+        //Only this thread writes it.
+        if (gap_usecs > longest_gap.loadAcquire())
+        {
+            longest_gap.storeRelease(gap_usecs);
+        }
+    }
 
-        const unsigned char *data_ptr = reinterpret_cast<const unsigned char *>(data);
+    last_write_time = now;
 
-        //const char *data_copy = 0;
-        //memcpy(&data_ptr, &data_copy, maxSize);
+    if (converter != 0 && frames > 0)
+    {
+        const int channels = ring->get_channels();
+        const uchar *raw = reinterpret_cast<const uchar*>(data);
+        const bool convert = ring->is_attached() || levels_kernel == 0;
 
-        //Loops all the data, split by total size and number of channels.
-        for (int i = 0; i < total_samples; ++i)
+        //Allocated by start, only grows if the device hands more than its buffer.
+        if (convert && samples.size() < frames * channels)
         {
-            for (int j = 0; j < device_format.channelCount(); ++j)
+            samples.resize(frames * channels);
+        }
+
+        if (convert)
+        {
+            converter(raw, frames * channels, samples.data());
+            ring->write(samples.constData(), frames);
+        }
+
+        int level = 0;
+        int rms = 0;
+
+        if (levels_kernel != 0)
+        {
+            levels_kernel(raw, frames, channels, channel_peaks.data(), channel_squares.data());
+
+            quint32 peak = 0;
+            quint64 squares = 0;
+
+            for (int i = 0; i < channels; i++)
             {
-                quint16 value = 0;
-
-                if (device_format.sampleSize() == 8 && device_format.sampleType() == QAudioFormat::UnSignedInt)
-                {
-                    value = *reinterpret_cast<const quint8*>(data_ptr);
-                }
-                else if (device_format.sampleSize() == 8 && device_format.sampleType() == QAudioFormat::SignedInt)
-                {
-                    value = qAbs(*reinterpret_cast<const qint8*>(data_ptr));
-                }
-                else if (device_format.sampleSize() == 16 && device_format.sampleType() == QAudioFormat::UnSignedInt)
-                {
-                    if (device_format.byteOrder() == QAudioFormat::LittleEndian)
-                    {
-                        value = qFromLittleEndian<quint16>(data_ptr);
-                    }
-                    else
-                    {
-                        value = qFromBigEndian<quint16>(data_ptr);
-                    }
-                }
-                else if (device_format.sampleSize() == 16 && device_format.sampleType() == QAudioFormat::SignedInt)
-                {
-                    if (device_format.byteOrder() == QAudioFormat::LittleEndian)
-                    {
-                        value = qAbs(qFromLittleEndian<qint16>(data_ptr));
-                    }
-                    else
-                    {
-                        value = qAbs(qFromBigEndian<qint16>(data_ptr));
-                    }
-                }
-
-                max_value = qMax(value, max_value);
-                data_ptr += sample_bytes;
+                peak = qMax(peak, channel_peaks.at(i));
+                squares = qMax(squares, channel_squares.at(i));
             }
+
+            level = static_cast<int>(qMin(peak, static_cast<quint32>(full_scale)) * 100 / full_scale); // 100 - peak | X - value
+            rms = qRound(std::sqrt(static_cast<double>(squares) / frames) * 100 / full_scale);
+        }
+        else
+        {
+            AudioLevels::measure_float(samples.constData(), frames, channels, float_peaks.data(), float_squares.data());
+
+            float peak = 0.0f;
+            double squares = 0.0;
+
+            for (int i = 0; i < channels; i++)
+            {
+                peak = qMax(peak, float_peaks.at(i));
+                squares = qMax(squares, float_squares.at(i));
+            }
+
+            //Float samples can go over the full scale.
+            level = static_cast<int>(qMin(peak, 1.0f) * 100);
+            rms = qMin(100, qRound(std::sqrt(squares / frames) * 100));
         }
 
-        max_value = qMin(max_value, audio_peak_amplitude);
-        max_value = (max_value * 100) / audio_peak_amplitude; // 100 - peak | X - value
+        pending_level = qMax(pending_level, level);
+        pending_rms = qMax(pending_rms, rms);
 
-        emit microphone_data(id, data, max_value);
+        if (now - last_level_time >= static_cast<qint64>(level_interval) * 1000000)
+        {
+            //The widget repaints with the peak level, the RMS goes first.
+            emit microphone_rms(id, pending_rms);
+            emit microphone_data(id, pending_level);
+
+            pending_level = 0;
+            pending_rms = 0;
+            last_level_time = now;
+        }
     }
 
     return maxSize;
 }
 
 /**
- * @brief AudioInputSurface::set_amplitude
- *      Determine peak amplitude given the audio format.
- *      Each sample cannot be bigger than its amplitude, the amplitude is the maximum possible value for the given sample size.
- *      For example, an 8 bit audio sample has a maximum value of 255 because 11111111 (8 bits unsigned) is 255: 128 + 64 + 32 + 16 + 8 + 4 + 2 + 1.
+ * @brief AudioInputSurface::set_format
+ *      Picks the converter and the levels kernel of the audio format, once, so the loop over the samples does not look at the format.
+ *      The full scale is the largest magnitude of a centered sample, for example 128 for an 8 bit sample, from -128 to 127.
+ *      Formats without a converter are not measured. This runs in the constructor, so the ring exists before the surface moves to its thread.
  */
-void AudioInputSurface::set_amplitude()
+void AudioInputSurface::set_format()
 {
-    switch (device_format.sampleSize())
+    const int channels = qMax(1, device_format.channelCount());
+
+    sample_format = AudioConversion::format(device_format);
+    converter = AudioConversion::converter(sample_format);
+    levels_kernel = AudioLevels::kernel(sample_format);
+    full_scale = AudioConversion::full_scale(sample_format);
+    frame_bytes = channels * qMax(1, AudioConversion::sample_bytes(sample_format));
+
+    channel_peaks.resize(channels);
+    channel_squares.resize(channels);
+    float_peaks.resize(channels);
+    float_squares.resize(channels);
+
+    if (converter == 0)
     {
-        case 8:
-        {
-            switch (device_format.sampleType())
-            {
-                case QAudioFormat::UnSignedInt:
-                {
-                    audio_peak_amplitude = 255;
-                    break;
-                }
-                case QAudioFormat::SignedInt:
-                {
-                    audio_peak_amplitude = 127;
-                    break;
-                }
-                default:
-                {
-                    audio_peak_amplitude = 0;
-                    break;
-                }
-            }
-            break;
-        }
-        case 16:
-        {
-            switch (device_format.sampleType())
-            {
-                case QAudioFormat::UnSignedInt:
-                {
-                    audio_peak_amplitude = 65535;
-                    break;
-                }
-                case QAudioFormat::SignedInt:
-                {
-                    audio_peak_amplitude = 32767;
-                    break;
-                }
-                default:
-                {
-                    audio_peak_amplitude = 0;
-                    break;
-                }
-            }
-            break;
-        }
+        return;
     }
+
+    //The ring holds "Audio/RingMilliseconds" of samples, the longest a consumer can fall behind.
+    const int milliseconds = qMax(10, SettingsManager::read("Audio/RingMilliseconds", 500).toInt());
+
+    delete ring;
+    ring = new AudioRing(static_cast<int>(static_cast<qint64>(device_format.sampleRate()) * milliseconds / 1000), channels);
 }
 
 /**
@@ -291,10 +435,18 @@ void AudioInputSurface::device_print() const
 
 /**
  * @brief AudioInputSurface::notified
- *      Signal from the audio input thar shows the read data.
+ *      Signal from the audio input thar shows the read data, the new overruns of the ring and the new glitches are reported here.
  */
 void AudioInputSurface::notify()
 {
+    if (ring != 0 && ring->get_overrun_count() != reported_overruns)
+    {
+        reported_overruns = ring->get_overrun_count();
+
+        output("Audio ring of microphone " + QString::number(id) + " overran, " + QString::number(reported_overruns) + " overruns, " +
+               QString::number(ring->get_dropped_frames()) + " frames dropped.", 2);
+    }
+
     output("Bytes ready: " + QString::number(audio_input->bytesReady()), 3);
     output("Elapsed microseconds: " + QString::number(audio_input->elapsedUSecs()), 3);
     output("Processed microseconds: " + QString::number(audio_input->processedUSecs()), 3);
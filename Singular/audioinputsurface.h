@@ -23,8 +23,13 @@
 #include <QAudioInput>
 #include <QAudioFormat>
 #include <QAudioDeviceInfo>
+#include <QVector>
+#include <QAtomicInteger>
 
 #include "defines.h"
+#include "audioring.h"
+#include "audiolevels.h"
+#include "audioconversion.h"
 
 class AudioInputSurface : public QIODevice
 {
@@ -35,26 +40,55 @@ public_construct:
     ~AudioInputSurface();
 
 public_methods:
-    void start();
-    void stop();
+    AudioRing *get_ring() const;
+    int get_sample_rate() const;
+    int get_glitch_count() const;
+    int get_longest_gap() const;
+    bool is_realtime() const;
 
 protected_methods:
     qint64 readData(char *data, qint64 maxSize);
     qint64 writeData(const char *data, qint64 maxSize);
 
 private_methods:
-    void set_amplitude();
+    void set_format();
     void device_print() const;
     void output(const QString &message, const int verbose) const;
 
 private_members:
     int id;
-    quint16 audio_peak_amplitude;
+    int full_scale;
+    int frame_bytes;
+    bool nearest_format;
+    int reported_overruns;
+    int reported_glitches;
+    int level_interval;
+    int pending_level;
+    int pending_rms;
+    qint64 last_level_time;
+    qint64 last_write_time;
+    qint64 glitch_gap;
+    AudioConversion::Format sample_format;
+    AudioConversion::Converter converter;
+    AudioLevels::Kernel levels_kernel;
 
 private_data_members:
     QAudioInput *audio_input;
     QAudioDeviceInfo device_info;
     QAudioFormat device_format;
+    QVector<quint32> channel_peaks;
+    QVector<quint64> channel_squares;
+    QVector<float> float_peaks;
+    QVector<double> float_squares;
+    QVector<float> samples;
+    AudioRing *ring;
+    QAtomicInteger<int> glitch_count;
+    QAtomicInteger<int> longest_gap;
+    QAtomicInteger<int> realtime;
+
+public slots:
+    void start();
+    void stop();
 
 private slots:
     void notify();
@@ -62,7 +96,8 @@ private slots:
 
 signals:
     void console(const QString &message) const;
-    void microphone_data(const int id, const char *data, const int level) const;
+    void microphone_data(const int id, const int level) const;
+    void microphone_rms(const int id, const int level) const;
 
 };
 
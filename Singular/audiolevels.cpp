@@ -0,0 +1,674 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "audiolevels.h"
+#include "simd.h"
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Kernels
+ *      Every format is loaded as centered 16 bit samples, the rest of the kernel is shared.
+ *      The vector kernels keep the maximum, the minimum and the 64 bit sum of squares of each lane. A block of
+ *      'period' registers spans a whole number of frames, so a lane always holds the same channel and the lanes are
+ *      only folded into the channels at the end. Channel counts with a period above the limit use the scalar kernel.
+ *      The squares are widened to 32 bits by pairing each sample with a zero, madd then gives s * s + 0 * 0.
+ *      The AVX2 kernels clear the upper halves of the registers before handing the rest of the buffer to the SSE2 kernel.
+ */
+namespace
+{
+    const int maximum_period = 16;
+
+    template<AudioConversion::Format format>
+    int sample(const uchar *data);
+
+    template<>
+    inline int sample<AudioConversion::UnsignedInt8>(const uchar *data)
+    {
+        return data[0] - 128;
+    }
+
+    template<>
+    inline int sample<AudioConversion::SignedInt8>(const uchar *data)
+    {
+        return static_cast<qint8>(data[0]);
+    }
+
+    template<>
+    inline int sample<AudioConversion::UnsignedInt16LE>(const uchar *data)
+    {
+        return (data[0] | (data[1] << 8)) - 32768;
+    }
+
+    template<>
+    inline int sample<AudioConversion::UnsignedInt16BE>(const uchar *data)
+    {
+        return ((data[0] << 8) | data[1]) - 32768;
+    }
+
+    template<>
+    inline int sample<AudioConversion::SignedInt16LE>(const uchar *data)
+    {
+        return static_cast<qint16>(data[0] | (data[1] << 8));
+    }
+
+    template<>
+    inline int sample<AudioConversion::SignedInt16BE>(const uchar *data)
+    {
+        return static_cast<qint16>((data[0] << 8) | data[1]);
+    }
+
+    template<AudioConversion::Format format>
+    inline int bytes()
+    {
+        return format == AudioConversion::UnsignedInt8 || format == AudioConversion::SignedInt8 ? 1 : 2;
+    }
+
+    /**
+     * Samples from 'start' to 'samples', start is the first sample of a frame.
+     */
+    template<AudioConversion::Format format>
+    void measure_scalar(const uchar *data, const int start, const int samples, const int channels, quint32 *peaks, quint64 *squares)
+    {
+        int channel = 0;
+
+        for(int i = start; i < samples; i++)
+        {
+            const int value = sample<format>(data + i * bytes<format>());
+
+            peaks[channel] = qMax(peaks[channel], static_cast<quint32>(qAbs(value)));
+            squares[channel] += static_cast<quint64>(value * value);
+
+            if(++channel == channels)
+            {
+                channel = 0;
+            }
+        }
+    }
+
+    int greatest_common_divisor(int a, int b)
+    {
+        while(b != 0)
+        {
+            const int remainder = a % b;
+            a = b;
+            b = remainder;
+        }
+
+        return a;
+    }
+
+    /**
+     * Folds the lanes of a block into the channels. 'lanes' is the number of 16 bit lanes of a register, the squares
+     * of register k hold the samples k * 2 and k * 2 + 1 of each 128 bit half.
+     */
+    void fold(const qint16 *maxima, const qint16 *minima, const quint64 *lane_squares, const int lanes, const int period,
+              const int channels, quint32 *peaks, quint64 *squares)
+    {
+        for(int i = 0; i < period * lanes; i++)
+        {
+            const int channel = i % channels;
+            peaks[channel] = qMax(peaks[channel], static_cast<quint32>(qMax(static_cast<int>(maxima[i]), -static_cast<int>(minima[i]))));
+        }
+
+        for(int r = 0; r < period; r++)
+        {
+            for(int k = 0; k < 4; k++)
+            {
+                for(int j = 0; j < lanes / 4; j++)
+                {
+                    const int index = r * lanes + k * 2 + (j & 1) + (j >> 1) * 8;
+                    squares[index % channels] += lane_squares[(r * 4 + k) * (lanes / 4) + j];
+                }
+            }
+        }
+    }
+
+#if defined(simd_x86)
+    template<AudioConversion::Format format>
+    __m128i load_sse2(const uchar *data);
+
+    inline __m128i swap_sse2(const __m128i value)
+    {
+        return _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+    }
+
+    template<>
+    inline __m128i load_sse2<AudioConversion::UnsignedInt8>(const uchar *data)
+    {
+        return _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data)), _mm_setzero_si128()), _mm_set1_epi16(128));
+    }
+
+    template<>
+    inline __m128i load_sse2<AudioConversion::SignedInt8>(const uchar *data)
+    {
+        return _mm_srai_epi16(_mm_unpacklo_epi8(_mm_setzero_si128(), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data))), 8);
+    }
+
+    template<>
+    inline __m128i load_sse2<AudioConversion::UnsignedInt16LE>(const uchar *data)
+    {
+        return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), _mm_set1_epi16(-32768));
+    }
+
+    template<>
+    inline __m128i load_sse2<AudioConversion::UnsignedInt16BE>(const uchar *data)
+    {
+        return _mm_xor_si128(swap_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data))), _mm_set1_epi16(-32768));
+    }
+
+    template<>
+    inline __m128i load_sse2<AudioConversion::SignedInt16LE>(const uchar *data)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    }
+
+    template<>
+    inline __m128i load_sse2<AudioConversion::SignedInt16BE>(const uchar *data)
+    {
+        return swap_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+    }
+
+    /**
+     * 8 samples per register.
+     */
+    template<AudioConversion::Format format>
+    void measure_sse2(const uchar *data, const int start, const int samples, const int channels, quint32 *peaks, quint64 *squares)
+    {
+        const int period = channels / greatest_common_divisor(channels, 8);
+
+        if(period > maximum_period)
+        {
+            measure_scalar<format>(data, start, samples, channels, peaks, squares);
+            return;
+        }
+
+        const __m128i zero = _mm_setzero_si128();
+
+        __m128i maxima[maximum_period];
+        __m128i minima[maximum_period];
+        __m128i lane_squares[maximum_period * 4];
+
+        for(int r = 0; r < period; r++)
+        {
+            maxima[r] = _mm_set1_epi16(-32768);
+            minima[r] = _mm_set1_epi16(32767);
+
+            for(int k = 0; k < 4; k++)
+            {
+                lane_squares[r * 4 + k] = zero;
+            }
+        }
+
+        const int block = period * 8;
+        int i = start;
+
+        for(; i + block <= samples; i += block)
+        {
+            for(int r = 0; r < period; r++)
+            {
+                const __m128i value = load_sse2<format>(data + (i + r * 8) * bytes<format>());
+
+                maxima[r] = _mm_max_epi16(maxima[r], value);
+                minima[r] = _mm_min_epi16(minima[r], value);
+
+                const __m128i low = _mm_unpacklo_epi16(value, zero);
+                const __m128i high = _mm_unpackhi_epi16(value, zero);
+                const __m128i squares_low = _mm_madd_epi16(low, low);
+                const __m128i squares_high = _mm_madd_epi16(high, high);
+
+                lane_squares[r * 4] = _mm_add_epi64(lane_squares[r * 4], _mm_unpacklo_epi32(squares_low, zero));
+                lane_squares[r * 4 + 1] = _mm_add_epi64(lane_squares[r * 4 + 1], _mm_unpackhi_epi32(squares_low, zero));
+                lane_squares[r * 4 + 2] = _mm_add_epi64(lane_squares[r * 4 + 2], _mm_unpacklo_epi32(squares_high, zero));
+                lane_squares[r * 4 + 3] = _mm_add_epi64(lane_squares[r * 4 + 3], _mm_unpackhi_epi32(squares_high, zero));
+            }
+        }
+
+        if(i > start)
+        {
+            qint16 lane_maxima[maximum_period * 8];
+            qint16 lane_minima[maximum_period * 8];
+            quint64 lane_sums[maximum_period * 8];
+
+            for(int r = 0; r < period; r++)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_maxima + r * 8), maxima[r]);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_minima + r * 8), minima[r]);
+
+                for(int k = 0; k < 4; k++)
+                {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_sums + (r * 4 + k) * 2), lane_squares[r * 4 + k]);
+                }
+            }
+
+            fold(lane_maxima, lane_minima, lane_sums, 8, period, channels, peaks, squares);
+        }
+
+        measure_scalar<format>(data, i, samples, channels, peaks, squares);
+    }
+
+    template<AudioConversion::Format format>
+    __m256i load_avx2(const uchar *data);
+
+    template<>
+    simd_avx2_target inline __m256i load_avx2<AudioConversion::UnsignedInt8>(const uchar *data)
+    {
+        return _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data))), _mm256_set1_epi16(128));
+    }
+
+    template<>
+    simd_avx2_target inline __m256i load_avx2<AudioConversion::SignedInt8>(const uchar *data)
+    {
+        return _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+    }
+
+    template<>
+    simd_avx2_target inline __m256i load_avx2<AudioConversion::UnsignedInt16LE>(const uchar *data)
+    {
+        return _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data)), _mm256_set1_epi16(-32768));
+    }
+
+    template<>
+    simd_avx2_target inline __m256i load_avx2<AudioConversion::UnsignedInt16BE>(const uchar *data)
+    {
+        const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        return _mm256_xor_si256(_mm256_or_si256(_mm256_slli_epi16(value, 8), _mm256_srli_epi16(value, 8)), _mm256_set1_epi16(-32768));
+    }
+
+    template<>
+    simd_avx2_target inline __m256i load_avx2<AudioConversion::SignedInt16LE>(const uchar *data)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    }
+
+    template<>
+    simd_avx2_target inline __m256i load_avx2<AudioConversion::SignedInt16BE>(const uchar *data)
+    {
+        const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        return _mm256_or_si256(_mm256_slli_epi16(value, 8), _mm256_srli_epi16(value, 8));
+    }
+
+    /**
+     * 16 samples per register, the unpacks work on each 128 bit half, see 'fold'.
+     */
+    template<AudioConversion::Format format>
+    simd_avx2_target void measure_avx2(const uchar *data, const int start, const int samples, const int channels, quint32 *peaks, quint64 *squares)
+    {
+        const int period = channels / greatest_common_divisor(channels, 16);
+
+        if(period > maximum_period)
+        {
+            measure_sse2<format>(data, start, samples, channels, peaks, squares);
+            return;
+        }
+
+        const __m256i zero = _mm256_setzero_si256();
+
+        __m256i maxima[maximum_period];
+        __m256i minima[maximum_period];
+        __m256i lane_squares[maximum_period * 4];
+
+        for(int r = 0; r < period; r++)
+        {
+            maxima[r] = _mm256_set1_epi16(-32768);
+            minima[r] = _mm256_set1_epi16(32767);
+
+            for(int k = 0; k < 4; k++)
+            {
+                lane_squares[r * 4 + k] = zero;
+            }
+        }
+
+        const int block = period * 16;
+        int i = start;
+
+        for(; i + block <= samples; i += block)
+        {
+            for(int r = 0; r < period; r++)
+            {
+                const __m256i value = load_avx2<format>(data + (i + r * 16) * bytes<format>());
+
+                maxima[r] = _mm256_max_epi16(maxima[r], value);
+                minima[r] = _mm256_min_epi16(minima[r], value);
+
+                const __m256i low = _mm256_unpacklo_epi16(value, zero);
+                const __m256i high = _mm256_unpackhi_epi16(value, zero);
+                const __m256i squares_low = _mm256_madd_epi16(low, low);
+                const __m256i squares_high = _mm256_madd_epi16(high, high);
+
+                lane_squares[r * 4] = _mm256_add_epi64(lane_squares[r * 4], _mm256_unpacklo_epi32(squares_low, zero));
+                lane_squares[r * 4 + 1] = _mm256_add_epi64(lane_squares[r * 4 + 1], _mm256_unpackhi_epi32(squares_low, zero));
+                lane_squares[r * 4 + 2] = _mm256_add_epi64(lane_squares[r * 4 + 2], _mm256_unpacklo_epi32(squares_high, zero));
+                lane_squares[r * 4 + 3] = _mm256_add_epi64(lane_squares[r * 4 + 3], _mm256_unpackhi_epi32(squares_high, zero));
+            }
+        }
+
+        if(i > start)
+        {
+            qint16 lane_maxima[maximum_period * 16];
+            qint16 lane_minima[maximum_period * 16];
+            quint64 lane_sums[maximum_period * 16];
+
+            for(int r = 0; r < period; r++)
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_maxima + r * 16), maxima[r]);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_minima + r * 16), minima[r]);
+
+                for(int k = 0; k < 4; k++)
+                {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_sums + (r * 4 + k) * 4), lane_squares[r * 4 + k]);
+                }
+            }
+
+            fold(lane_maxima, lane_minima, lane_sums, 16, period, channels, peaks, squares);
+        }
+
+        _mm256_zeroupper();
+        measure_sse2<format>(data, i, samples, channels, peaks, squares);
+    }
+#endif
+
+    void measure_float_scalar(const float *samples, const int start, const int count, const int channels, float *peaks, double *squares)
+    {
+        int channel = 0;
+
+        for(int i = start; i < count; i++)
+        {
+            const float value = samples[i];
+
+            peaks[channel] = qMax(peaks[channel], qAbs(value));
+            squares[channel] += static_cast<double>(value) * value;
+
+            if(++channel == channels)
+            {
+                channel = 0;
+            }
+        }
+    }
+
+    /**
+     * The lanes of a block are in the order of the samples, for the maxima and for the squares.
+     */
+    void fold_float(const float *maxima, const double *lane_squares, const int lanes, const int period, const int channels,
+                    float *peaks, double *squares)
+    {
+        for(int i = 0; i < period * lanes; i++)
+        {
+            const int channel = i % channels;
+
+            peaks[channel] = qMax(peaks[channel], maxima[i]);
+            squares[channel] += lane_squares[i];
+        }
+    }
+
+#if defined(simd_x86)
+    /**
+     * 4 samples per register, the squares in two registers of doubles.
+     */
+    void measure_float_sse2(const float *samples, const int start, const int count, const int channels, float *peaks, double *squares)
+    {
+        const int period = channels / greatest_common_divisor(channels, 4);
+
+        if(period > maximum_period)
+        {
+            measure_float_scalar(samples, start, count, channels, peaks, squares);
+            return;
+        }
+
+        const __m128 sign = _mm_set1_ps(-0.0f);
+
+        __m128 maxima[maximum_period];
+        __m128d lane_squares[maximum_period * 2];
+
+        for(int r = 0; r < period; r++)
+        {
+            maxima[r] = _mm_setzero_ps();
+            lane_squares[r * 2] = _mm_setzero_pd();
+            lane_squares[r * 2 + 1] = _mm_setzero_pd();
+        }
+
+        const int block = period * 4;
+        int i = start;
+
+        for(; i + block <= count; i += block)
+        {
+            for(int r = 0; r < period; r++)
+            {
+                const __m128 value = _mm_loadu_ps(samples + i + r * 4);
+
+                //A NaN keeps the maximum, as in the scalar kernel.
+                maxima[r] = _mm_max_ps(_mm_andnot_ps(sign, value), maxima[r]);
+
+                const __m128d low = _mm_cvtps_pd(value);
+                const __m128d high = _mm_cvtps_pd(_mm_movehl_ps(value, value));
+
+                lane_squares[r * 2] = _mm_add_pd(lane_squares[r * 2], _mm_mul_pd(low, low));
+                lane_squares[r * 2 + 1] = _mm_add_pd(lane_squares[r * 2 + 1], _mm_mul_pd(high, high));
+            }
+        }
+
+        if(i > start)
+        {
+            float lane_maxima[maximum_period * 4];
+            double lane_sums[maximum_period * 4];
+
+            for(int r = 0; r < period; r++)
+            {
+                _mm_storeu_ps(lane_maxima + r * 4, maxima[r]);
+                _mm_storeu_pd(lane_sums + r * 4, lane_squares[r * 2]);
+                _mm_storeu_pd(lane_sums + r * 4 + 2, lane_squares[r * 2 + 1]);
+            }
+
+            fold_float(lane_maxima, lane_sums, 4, period, channels, peaks, squares);
+        }
+
+        measure_float_scalar(samples, i, count, channels, peaks, squares);
+    }
+
+    /**
+     * 8 samples per register, the squares in two registers of doubles.
+     */
+    simd_avx2_target void measure_float_avx2(const float *samples, const int start, const int count, const int channels, float *peaks, double *squares)
+    {
+        const int period = channels / greatest_common_divisor(channels, 8);
+
+        if(period > maximum_period)
+        {
+            measure_float_sse2(samples, start, count, channels, peaks, squares);
+            return;
+        }
+
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+
+        __m256 maxima[maximum_period];
+        __m256d lane_squares[maximum_period * 2];
+
+        for(int r = 0; r < period; r++)
+        {
+            maxima[r] = _mm256_setzero_ps();
+            lane_squares[r * 2] = _mm256_setzero_pd();
+            lane_squares[r * 2 + 1] = _mm256_setzero_pd();
+        }
+
+        const int block = period * 8;
+        int i = start;
+
+        for(; i + block <= count; i += block)
+        {
+            for(int r = 0; r < period; r++)
+            {
+                const __m256 value = _mm256_loadu_ps(samples + i + r * 8);
+
+                maxima[r] = _mm256_max_ps(_mm256_andnot_ps(sign, value), maxima[r]);
+
+                const __m256d low = _mm256_cvtps_pd(_mm256_castps256_ps128(value));
+                const __m256d high = _mm256_cvtps_pd(_mm256_extractf128_ps(value, 1));
+
+                lane_squares[r * 2] = _mm256_add_pd(lane_squares[r * 2], _mm256_mul_pd(low, low));
+                lane_squares[r * 2 + 1] = _mm256_add_pd(lane_squares[r * 2 + 1], _mm256_mul_pd(high, high));
+            }
+        }
+
+        if(i > start)
+        {
+            float lane_maxima[maximum_period * 8];
+            double lane_sums[maximum_period * 8];
+
+            for(int r = 0; r < period; r++)
+            {
+                _mm256_storeu_ps(lane_maxima + r * 8, maxima[r]);
+                _mm256_storeu_pd(lane_sums + r * 8, lane_squares[r * 2]);
+                _mm256_storeu_pd(lane_sums + r * 8 + 4, lane_squares[r * 2 + 1]);
+            }
+
+            fold_float(lane_maxima, lane_sums, 8, period, channels, peaks, squares);
+        }
+
+        _mm256_zeroupper();
+        measure_float_sse2(samples, i, count, channels, peaks, squares);
+    }
+#endif
+
+    template<AudioConversion::Format format>
+    void measure(const uchar *data, const int frames, const int channels, quint32 *peaks, quint64 *squares)
+    {
+        for(int channel = 0; channel < channels; channel++)
+        {
+            peaks[channel] = 0;
+            squares[channel] = 0;
+        }
+
+        const int samples = frames * channels;
+
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                measure_avx2<format>(data, 0, samples, channels, peaks, squares);
+                return;
+            }
+            case Simd::SSE2:
+            {
+                measure_sse2<format>(data, 0, samples, channels, peaks, squares);
+                return;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        measure_scalar<format>(data, 0, samples, channels, peaks, squares);
+    }
+}
+
+/**
+ * @brief AudioLevels::kernel
+ *      The kernel of a format, it picks the instruction set on each call.
+ * @param format
+ *      The sample format.
+ * @return
+ *      The kernel, 0 if the format has none, see measure_float.
+ *      Its arguments are the buffer, the number of frames and of channels, and the outputs, one peak and one sum of squares per channel.
+ */
+AudioLevels::Kernel AudioLevels::kernel(const AudioConversion::Format format)
+{
+    switch(format)
+    {
+        case AudioConversion::UnsignedInt8:
+        {
+            return measure<AudioConversion::UnsignedInt8>;
+        }
+        case AudioConversion::SignedInt8:
+        {
+            return measure<AudioConversion::SignedInt8>;
+        }
+        case AudioConversion::UnsignedInt16LE:
+        {
+            return measure<AudioConversion::UnsignedInt16LE>;
+        }
+        case AudioConversion::UnsignedInt16BE:
+        {
+            return measure<AudioConversion::UnsignedInt16BE>;
+        }
+        case AudioConversion::SignedInt16LE:
+        {
+            return measure<AudioConversion::SignedInt16LE>;
+        }
+        case AudioConversion::SignedInt16BE:
+        {
+            return measure<AudioConversion::SignedInt16BE>;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief AudioLevels::measure_float
+ *      Peak and squares of each channel of canonical float samples, see AudioConversion.
+ * @param samples
+ *      Interleaved samples, full scale at 1.0.
+ * @param frames
+ *      Number of frames, a frame is one sample of each channel.
+ * @param channels
+ *      Number of channels.
+ * @param peaks
+ *      Output, largest magnitude of each channel, NaN samples are ignored.
+ * @param squares
+ *      Output, sum of the squared samples of each channel.
+ */
+void AudioLevels::measure_float(const float *samples, const int frames, const int channels, float *peaks, double *squares)
+{
+    for(int channel = 0; channel < channels; channel++)
+    {
+        peaks[channel] = 0.0f;
+        squares[channel] = 0.0;
+    }
+
+    const int count = frames * channels;
+
+#if defined(simd_x86)
+    switch(Simd::get_level())
+    {
+        case Simd::AVX2:
+        {
+            measure_float_avx2(samples, 0, count, channels, peaks, squares);
+            return;
+        }
+        case Simd::SSE2:
+        {
+            measure_float_sse2(samples, 0, count, channels, peaks, squares);
+            return;
+        }
+        case Simd::Scalar:
+        {
+            break;
+        }
+    }
+#endif
+
+    measure_float_scalar(samples, 0, count, channels, peaks, squares);
+}
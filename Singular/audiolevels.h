@@ -0,0 +1,47 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIOLEVELS_H
+#define AUDIOLEVELS_H
+
+#include <QtGlobal>
+
+#include "audioconversion.h"
+
+/**
+ * @brief The AudioLevels namespace
+ *      Peak and RMS per channel of a buffer of interleaved samples.
+ *      There is one kernel per 8 and 16 bit sample format, picked once with 'kernel' when the format is known, so the loop
+ *      over the samples never looks at the format. The other formats are measured on the canonical float samples.
+ *      The scalar and vector versions of the integer kernels give the same results.
+ * @remarks
+ *      Samples are centered first, an unsigned sample is taken relative to the middle of its range.
+ *      The peak of a channel is the largest magnitude, at most AudioConversion::full_scale. The squares are the sum of the
+ *      squared samples of the channel, the RMS is sqrt(squares / frames).
+ *      The float squares are summed in double, the vector versions add them in another order and may differ in the last bits.
+ */
+namespace AudioLevels
+{
+    typedef void (*Kernel)(const uchar *data, const int frames, const int channels, quint32 *peaks, quint64 *squares);
+
+    Kernel kernel(const AudioConversion::Format format);
+
+    void measure_float(const float *samples, const int frames, const int channels, float *peaks, double *squares);
+}
+
+#endif // AUDIOLEVELS_H
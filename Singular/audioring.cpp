@@ -0,0 +1,208 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "audioring.h"
+
+#include <cstring>
+
+/**
+ * @brief AudioRing::AudioRing
+ *      Allocates the ring, the capacity is rounded up to a power of two.
+ * @param new_capacity
+ *      Minimum number of frames the ring holds.
+ * @param new_channels
+ *      Interleaved channels of a frame.
+ */
+AudioRing::AudioRing(const int new_capacity, const int new_channels)
+    : capacity(1),
+      channels(qMax(1, new_channels)),
+      write_position(0),
+      read_position(0),
+      attached(0),
+      overrun_count(0),
+      dropped_frames(0)
+{
+    while(capacity < new_capacity && capacity < (1 << 24))
+    {
+        capacity <<= 1;
+    }
+
+    buffer = static_cast<float*>(qMallocAligned(capacity * channels * sizeof(float), 64));
+
+    if(buffer != 0)
+    {
+        std::memset(buffer, 0, capacity * channels * sizeof(float));
+    }
+}
+
+/**
+ * @brief AudioRing::~AudioRing
+ *      The consumer must be detached and done with its spans.
+ */
+AudioRing::~AudioRing()
+{
+    qFreeAligned(buffer);
+}
+
+/**
+ * @brief AudioRing::write
+ *      Appends frames, called from the producer thread. Never blocks.
+ *      When the ring is full the frames that do not fit are dropped, the ones that fit are still written,
+ *      so the consumer gets the stream without a gap up to the overrun.
+ * @param samples
+ *      Interleaved samples.
+ * @param frames
+ *      Number of frames.
+ * @return
+ *      Number of frames written, 0 when no consumer is attached.
+ */
+int AudioRing::write(const float *samples, const int frames)
+{
+    if(attached.loadAcquire() == 0 || buffer == 0 || frames <= 0)
+    {
+        return 0;
+    }
+
+    const quint32 write = write_position.load();
+    const quint32 read = read_position.loadAcquire();
+
+    const int space = capacity - static_cast<int>(write - read);
+    const int count = qMin(frames, space);
+
+    const int offset = static_cast<int>(write & (capacity - 1));
+    const int first = qMin(count, capacity - offset);
+
+    std::memcpy(buffer + offset * channels, samples, first * channels * sizeof(float));
+    std::memcpy(buffer, samples + first * channels, (count - first) * channels * sizeof(float));
+
+    write_position.storeRelease(write + count);
+
+    if(count < frames)
+    {
+        overrun_count.ref();
+        dropped_frames.fetchAndAddRelaxed(frames - count);
+    }
+
+    return count;
+}
+
+/**
+ * @brief AudioRing::attach
+ *      Starts the delivery to the consumer, from the next frame written. Called from the consumer thread.
+ */
+void AudioRing::attach()
+{
+    read_position.storeRelease(write_position.loadAcquire());
+    attached.storeRelease(1);
+}
+
+/**
+ * @brief AudioRing::detach
+ *      Stops the delivery, the producer stops writing and the frames left are not read.
+ */
+void AudioRing::detach()
+{
+    attached.storeRelease(0);
+}
+
+/**
+ * @brief AudioRing::is_attached
+ * @return
+ *      True while a consumer is attached.
+ */
+bool AudioRing::is_attached() const
+{
+    return attached.loadAcquire() != 0;
+}
+
+/**
+ * @brief AudioRing::readable
+ *      The frames written and not released yet, oldest first, called from the consumer thread.
+ *      The spans stay valid until they are released, the producer does not write over them.
+ * @param first
+ *      Output, the frames up to the end of the ring.
+ * @param second
+ *      Output, the frames that wrapped to the beginning, if any.
+ * @return
+ *      Number of frames in both spans.
+ */
+int AudioRing::readable(Span &first, Span &second) const
+{
+    const quint32 read = read_position.load();
+    const int available = static_cast<int>(write_position.loadAcquire() - read);
+    const int offset = static_cast<int>(read & (capacity - 1));
+
+    first.samples = buffer + offset * channels;
+    first.frames = qMin(available, capacity - offset);
+
+    second.samples = buffer;
+    second.frames = available - first.frames;
+
+    return available;
+}
+
+/**
+ * @brief AudioRing::release
+ *      Gives the oldest frames back to the producer, called from the consumer thread.
+ * @param frames
+ *      Number of frames, at most what 'readable' returned.
+ */
+void AudioRing::release(const int frames)
+{
+    read_position.storeRelease(read_position.load() + static_cast<quint32>(frames));
+}
+
+/**
+ * @brief AudioRing::get_capacity
+ * @return
+ *      Number of frames the ring holds.
+ */
+int AudioRing::get_capacity() const
+{
+    return capacity;
+}
+
+/**
+ * @brief AudioRing::get_channels
+ * @return
+ *      Interleaved channels of a frame.
+ */
+int AudioRing::get_channels() const
+{
+    return channels;
+}
+
+/**
+ * @brief AudioRing::get_overrun_count
+ * @return
+ *      Number of writes that did not fit.
+ */
+int AudioRing::get_overrun_count() const
+{
+    return overrun_count.load();
+}
+
+/**
+ * @brief AudioRing::get_dropped_frames
+ * @return
+ *      Number of frames dropped by the overruns.
+ */
+int AudioRing::get_dropped_frames() const
+{
+    return dropped_frames.load();
+}
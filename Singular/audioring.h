@@ -0,0 +1,85 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIORING_H
+#define AUDIORING_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+#include "defines.h"
+
+/**
+ * @brief The AudioRing class
+ *      Fixed size ring of canonical float samples, see AudioConversion, between the surface of a microphone and one consumer thread.
+ *      The producer never waits, frames that do not fit are dropped and counted as an overrun.
+ *      The consumer reads the samples in place, as at most two contiguous spans, and releases them when it is done.
+ * @remarks
+ *      Lock-free single producer and single consumer. The positions are frame counters that only grow and wrap at 2^32,
+ *      the capacity is a power of two so the wrap does not move the offsets. Each side writes only its own position,
+ *      with release ordering, and reads the other one with acquire ordering.
+ *      The producer only writes while a consumer is attached, so a ring nobody reads does not count overruns.
+ */
+class AudioRing
+{
+
+public_construct:
+    explicit AudioRing(const int new_capacity, const int new_channels);
+    ~AudioRing();
+
+public_data_members:
+    /**
+     * @brief The Span struct
+     *      Contiguous frames of the ring, read in place.
+     */
+    struct Span
+    {
+        const float *samples;
+        int frames;
+    };
+
+public_methods:
+    int write(const float *samples, const int frames);
+
+    void attach();
+    void detach();
+    bool is_attached() const;
+
+    int readable(Span &first, Span &second) const;
+    void release(const int frames);
+
+    int get_capacity() const;
+    int get_channels() const;
+    int get_overrun_count() const;
+    int get_dropped_frames() const;
+
+private_members:
+    int capacity;
+    int channels;
+    QAtomicInteger<quint32> write_position;
+    QAtomicInteger<quint32> read_position;
+    QAtomicInt attached;
+    QAtomicInt overrun_count;
+    QAtomicInt dropped_frames;
+
+private_data_members:
+    float *buffer;
+
+};
+
+#endif // AUDIORING_H
@@ -35,6 +35,7 @@ AudioWidget::AudioWidget(QWidget *parent) :
     setAutoFillBackground(true);
 
     level = 0;
+    rms = 0;
     setMinimumHeight(30);
     setMinimumWidth(200);
 }
@@ -51,6 +52,17 @@ void AudioWidget::update_level(const int level)
     update();
 }
 
+/**
+ * @brief AudioWidget::update_rms
+ *      Saves the new RMS level, it is drawn with the next volume level.
+ * @param level
+ *      The new RMS level from the surface, on the same scale as the volume level.
+ */
+void AudioWidget::update_rms(const int level)
+{
+    rms = level;
+}
+
 /**
  * @brief AudioWidget::paintEvent
  *      Paints the widget with the volume set in the set_level function.
@@ -75,6 +87,13 @@ void AudioWidget::paintEvent(QPaintEvent *event)
 
         painter.fillRect(1, 1, volume, painter.viewport().height() - 2, Qt::red);
     }
+
+    if (rms > 0 && rms < 100)
+    {
+        int average = (rms * painter.viewport().width() - 1) / 100;
+
+        painter.fillRect(1, 1, average, painter.viewport().height() - 2, Qt::darkRed);
+    }
 }
 
 /**
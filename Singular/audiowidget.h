@@ -33,6 +33,7 @@ public_construct:
 
 public_methods:
     void update_level(const int level);
+    void update_rms(const int level);
 
 protected_methods:
     void paintEvent(QPaintEvent *event);
@@ -42,6 +43,7 @@ private_methods:
 
 private_members:
     int level;
+    int rms;
 
 signals:
     void console(const QString &message) const;
@@ -0,0 +1,281 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "backgroundmodel.h"
+#include "simd.h"
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Kernels
+ *      The model of a pixel is updated in place, the mask gets 255 for the foreground and 0 for the background.
+ *      The threshold is the variance, clamped to [minimum, largest useful], times the squared deviations.
+ *      The largest useful variance keeps the product in 16 bits, any larger one would never classify a pixel as foreground anyway.
+ *      The AVX2 kernels clear the upper halves of the registers before handing the rest of the row to the SSE2 kernel.
+ */
+namespace
+{
+    typedef int (*UpdateRow)(const uchar *luma, qint16 *mean, qint16 *variance, uchar *mask, const int start, const int width,
+                             const BackgroundModel::Parameters &parameters, const int maximum_variance);
+
+    const int maximum_distance = 127;
+
+    int update_row_scalar(const uchar *luma, qint16 *mean, qint16 *variance, uchar *mask, const int start, const int width,
+                          const BackgroundModel::Parameters &parameters, const int maximum_variance)
+    {
+        const int squared_deviations = parameters.deviations * parameters.deviations;
+        int count = 0;
+
+        for(int x = start; x < width; x++)
+        {
+            const int difference = (luma[x] << 4) - mean[x];
+            const int distance = qMin(qAbs(difference) >> 4, maximum_distance);
+            const int squared_distance = distance * distance;
+            const int threshold = qBound(parameters.minimum_variance, static_cast<int>(variance[x]), maximum_variance) * squared_deviations;
+            const bool foreground = squared_distance > threshold;
+            const int shift = foreground ? parameters.foreground_shift : parameters.shift;
+
+            mask[x] = foreground ? 255 : 0;
+            mean[x] = static_cast<qint16>(mean[x] + (difference >> shift));
+            variance[x] = static_cast<qint16>(variance[x] + ((squared_distance - variance[x]) >> shift));
+
+            count += foreground ? 1 : 0;
+        }
+
+        return count;
+    }
+
+#if defined(simd_x86)
+    /**
+     * 8 pixels per iteration, the foreground lanes are all ones and are subtracted from the counter.
+     */
+    int update_row_sse2(const uchar *luma, qint16 *mean, qint16 *variance, uchar *mask, const int start, const int width,
+                        const BackgroundModel::Parameters &parameters, const int maximum_variance)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i cap = _mm_set1_epi16(maximum_distance);
+        const __m128i minimum = _mm_set1_epi16(static_cast<short>(parameters.minimum_variance));
+        const __m128i maximum = _mm_set1_epi16(static_cast<short>(maximum_variance));
+        const __m128i squared_deviations = _mm_set1_epi16(static_cast<short>(parameters.deviations * parameters.deviations));
+        const __m128i shift = _mm_cvtsi32_si128(parameters.shift);
+        const __m128i foreground_shift = _mm_cvtsi32_si128(parameters.foreground_shift);
+
+        __m128i counts = zero;
+        int x = start;
+
+        for(; x + 8 <= width; x += 8)
+        {
+            const __m128i value = _mm_slli_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(luma + x)), zero), 4);
+            const __m128i old_mean = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mean + x));
+            const __m128i old_variance = _mm_loadu_si128(reinterpret_cast<const __m128i*>(variance + x));
+
+            const __m128i difference = _mm_sub_epi16(value, old_mean);
+            const __m128i distance = _mm_min_epi16(_mm_srli_epi16(_mm_max_epi16(difference, _mm_sub_epi16(zero, difference)), 4), cap);
+            const __m128i squared_distance = _mm_mullo_epi16(distance, distance);
+            const __m128i threshold = _mm_mullo_epi16(_mm_min_epi16(_mm_max_epi16(old_variance, minimum), maximum), squared_deviations);
+            const __m128i foreground = _mm_cmpgt_epi16(squared_distance, threshold);
+
+            const __m128i mean_step = _mm_or_si128(_mm_and_si128(foreground, _mm_sra_epi16(difference, foreground_shift)),
+                                                   _mm_andnot_si128(foreground, _mm_sra_epi16(difference, shift)));
+
+            const __m128i variance_difference = _mm_sub_epi16(squared_distance, old_variance);
+            const __m128i variance_step = _mm_or_si128(_mm_and_si128(foreground, _mm_sra_epi16(variance_difference, foreground_shift)),
+                                                       _mm_andnot_si128(foreground, _mm_sra_epi16(variance_difference, shift)));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(mean + x), _mm_add_epi16(old_mean, mean_step));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(variance + x), _mm_add_epi16(old_variance, variance_step));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(mask + x), _mm_packs_epi16(foreground, foreground));
+
+            counts = _mm_sub_epi16(counts, foreground);
+        }
+
+        //At most width / 8 per lane, far below the 16 bit limit for any frame.
+        counts = _mm_madd_epi16(counts, _mm_set1_epi16(1));
+        counts = _mm_add_epi32(counts, _mm_srli_si128(counts, 8));
+        counts = _mm_add_epi32(counts, _mm_srli_si128(counts, 4));
+
+        return _mm_cvtsi128_si32(counts) + update_row_scalar(luma, mean, variance, mask, x, width, parameters, maximum_variance);
+    }
+
+    /**
+     * 16 pixels per iteration, the packed mask is put back in order across the 128 bit halves.
+     */
+    simd_avx2_target int update_row_avx2(const uchar *luma, qint16 *mean, qint16 *variance, uchar *mask, const int start, const int width,
+                                         const BackgroundModel::Parameters &parameters, const int maximum_variance)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i cap = _mm256_set1_epi16(maximum_distance);
+        const __m256i minimum = _mm256_set1_epi16(static_cast<short>(parameters.minimum_variance));
+        const __m256i maximum = _mm256_set1_epi16(static_cast<short>(maximum_variance));
+        const __m256i squared_deviations = _mm256_set1_epi16(static_cast<short>(parameters.deviations * parameters.deviations));
+        const __m128i shift = _mm_cvtsi32_si128(parameters.shift);
+        const __m128i foreground_shift = _mm_cvtsi32_si128(parameters.foreground_shift);
+
+        __m256i counts = zero;
+        int x = start;
+
+        for(; x + 16 <= width; x += 16)
+        {
+            const __m256i value = _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(luma + x))), 4);
+            const __m256i old_mean = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mean + x));
+            const __m256i old_variance = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(variance + x));
+
+            const __m256i difference = _mm256_sub_epi16(value, old_mean);
+            const __m256i distance = _mm256_min_epi16(_mm256_srli_epi16(_mm256_abs_epi16(difference), 4), cap);
+            const __m256i squared_distance = _mm256_mullo_epi16(distance, distance);
+            const __m256i threshold = _mm256_mullo_epi16(_mm256_min_epi16(_mm256_max_epi16(old_variance, minimum), maximum), squared_deviations);
+            const __m256i foreground = _mm256_cmpgt_epi16(squared_distance, threshold);
+
+            const __m256i mean_step = _mm256_blendv_epi8(_mm256_sra_epi16(difference, shift), _mm256_sra_epi16(difference, foreground_shift), foreground);
+
+            const __m256i variance_difference = _mm256_sub_epi16(squared_distance, old_variance);
+            const __m256i variance_step = _mm256_blendv_epi8(_mm256_sra_epi16(variance_difference, shift),
+                                                             _mm256_sra_epi16(variance_difference, foreground_shift), foreground);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(mean + x), _mm256_add_epi16(old_mean, mean_step));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(variance + x), _mm256_add_epi16(old_variance, variance_step));
+
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(foreground, foreground), 0xD8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(mask + x), _mm256_castsi256_si128(packed));
+
+            counts = _mm256_sub_epi16(counts, foreground);
+        }
+
+        counts = _mm256_madd_epi16(counts, _mm256_set1_epi16(1));
+        __m128i halves = _mm_add_epi32(_mm256_castsi256_si128(counts), _mm256_extracti128_si256(counts, 1));
+        halves = _mm_add_epi32(halves, _mm_srli_si128(halves, 8));
+        halves = _mm_add_epi32(halves, _mm_srli_si128(halves, 4));
+
+        const int count = _mm_cvtsi128_si32(halves);
+
+        _mm256_zeroupper();
+        return count + update_row_sse2(luma, mean, variance, mask, x, width, parameters, maximum_variance);
+    }
+#endif
+
+    UpdateRow update_row()
+    {
+        UpdateRow row = update_row_scalar;
+
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                row = update_row_avx2;
+                break;
+            }
+            case Simd::SSE2:
+            {
+                row = update_row_sse2;
+                break;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        return row;
+    }
+}
+
+/**
+ * @brief BackgroundModel::initialize
+ *      Starts a model from a frame, every pixel is background with the initial variance.
+ * @param luma
+ *      Luma input.
+ * @param luma_stride
+ *      Bytes per line of the input, the model and the mask are packed, 'width' values per line.
+ * @param width
+ *      Width in pixels.
+ * @param height
+ *      Height in pixels.
+ * @param mean
+ *      Mean of each pixel, in 1/16 of a level.
+ * @param variance
+ *      Variance of each pixel, in squared levels.
+ * @param initial_variance
+ *      Variance of the new model, clamped to the largest distance.
+ */
+void BackgroundModel::initialize(const uchar *luma, const int luma_stride, const int width, const int height,
+                                 qint16 *mean, qint16 *variance, const int initial_variance)
+{
+    const qint16 start_variance = static_cast<qint16>(qBound(0, initial_variance, maximum_distance * maximum_distance));
+
+    for(int i = 0; i < height; i++)
+    {
+        for(int x = 0; x < width; x++)
+        {
+            mean[i * width + x] = static_cast<qint16>(luma[i * luma_stride + x] << 4);
+            variance[i * width + x] = start_variance;
+        }
+    }
+}
+
+/**
+ * @brief BackgroundModel::update
+ *      Classifies the pixels of a frame and updates the model with it.
+ * @param luma
+ *      Luma input.
+ * @param luma_stride
+ *      Bytes per line of the input, the model is packed, 'width' values per line.
+ * @param width
+ *      Width in pixels.
+ * @param height
+ *      Height in pixels, this can be a band of the model with the pointers moved to its first line.
+ * @param mean
+ *      Mean of each pixel, in 1/16 of a level.
+ * @param variance
+ *      Variance of each pixel, in squared levels.
+ * @param mask
+ *      Output, 255 for the foreground and 0 for the background.
+ * @param mask_stride
+ *      Bytes per line of the mask.
+ * @param parameters
+ *      Rates, deviations and noise of the model, the shifts are clamped to [0, 15].
+ * @return
+ *      Number of foreground pixels.
+ */
+int BackgroundModel::update(const uchar *luma, const int luma_stride, const int width, const int height,
+                            qint16 *mean, qint16 *variance, uchar *mask, const int mask_stride, const Parameters &parameters)
+{
+    const UpdateRow row = update_row();
+
+    Parameters clamped = parameters;
+    clamped.shift = qBound(0, parameters.shift, 15);
+    clamped.foreground_shift = qBound(0, parameters.foreground_shift, 15);
+    clamped.deviations = qBound(1, parameters.deviations, maximum_distance);
+
+    //Any variance above this one is never exceeded by a distance of at most 127 levels, and the threshold stays in 16 bits.
+    const int squared_deviations = clamped.deviations * clamped.deviations;
+    const int maximum_variance = qMin(maximum_distance * maximum_distance / squared_deviations + 1, 32767 / squared_deviations);
+
+    clamped.minimum_variance = qBound(0, parameters.minimum_variance, maximum_variance);
+
+    int count = 0;
+
+    for(int i = 0; i < height; i++)
+    {
+        count += row(luma + i * luma_stride, mean + i * width, variance + i * width, mask + i * mask_stride, 0, width, clamped, maximum_variance);
+    }
+
+    return count;
+}
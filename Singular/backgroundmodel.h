@@ -0,0 +1,57 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BACKGROUNDMODEL_H
+#define BACKGROUNDMODEL_H
+
+#include <QtGlobal>
+
+/**
+ * @brief The BackgroundModel namespace
+ *      Kernels of the background subtraction: a running Gaussian per pixel of an 8 bit luma image.
+ *      A pixel is foreground when its squared distance to the mean is above the variance times the squared deviations,
+ *      the mean and the variance then follow the pixel, slower for the foreground so a person standing still is not absorbed at once.
+ *      The scalar and vector versions give the same results.
+ * @remarks
+ *      Everything fits in 16 bit lanes: the mean is in 1/16 of a luma level, the distance is capped at 127 levels so
+ *      its square is below 2^14, and the variance, in squared levels, stays between 0 and that square.
+ *      The rows are independent, a model can be updated in bands from several threads.
+ */
+namespace BackgroundModel
+{
+    /**
+     * @brief The Parameters struct
+     *      The mean and the variance move by 1 / 2^shift of the difference per frame, 1 / 2^foreground_shift for the foreground.
+     *      Variances below the minimum are taken as the minimum, it is the noise of the sensor.
+     */
+    struct Parameters
+    {
+        int shift;
+        int foreground_shift;
+        int deviations;
+        int minimum_variance;
+    };
+
+    void initialize(const uchar *luma, const int luma_stride, const int width, const int height,
+                    qint16 *mean, qint16 *variance, const int initial_variance);
+
+    int update(const uchar *luma, const int luma_stride, const int width, const int height,
+               qint16 *mean, qint16 *variance, uchar *mask, const int mask_stride, const Parameters &parameters);
+}
+
+#endif // BACKGROUNDMODEL_H
@@ -0,0 +1,297 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "backgroundstage.h"
+#include "framedifference.h"
+#include "settingsmanager.h"
+
+#include <QThread>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QSharedPointer>
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Bands
+ *      The bands of one update are taken in order from a counter by the pipeline worker and the helper tasks.
+ *      The worker waits until every band is done, whoever ran it. A helper that starts after the last band was taken
+ *      finds nothing left and only touches the shared context, which it holds, so it may run after the frame is gone.
+ *      The helpers do not use the pipeline pool, a pipeline worker waiting for tasks queued behind it would deadlock.
+ */
+namespace
+{
+    struct BandContext
+    {
+        const uchar *luma;
+        qint16 *mean;
+        qint16 *variance;
+        uchar *mask;
+        int mask_stride;
+        int width;
+        int height;
+        int band_rows;
+        int band_count;
+        BackgroundModel::Parameters parameters;
+
+        QAtomicInt next_band;
+        QAtomicInt foreground;
+        QSemaphore done;
+    };
+
+    void run_bands(BandContext *context)
+    {
+        forever
+        {
+            const int band = context->next_band.fetchAndAddOrdered(1);
+
+            if(band >= context->band_count)
+            {
+                break;
+            }
+
+            const int first_row = band * context->band_rows;
+            const int rows = qMin(context->band_rows, context->height - first_row);
+            const int offset = first_row * context->width;
+
+            const int count = BackgroundModel::update(context->luma + offset, context->width, context->width, rows,
+                                                      context->mean + offset, context->variance + offset,
+                                                      context->mask + first_row * context->mask_stride, context->mask_stride,
+                                                      context->parameters);
+
+            context->foreground.fetchAndAddOrdered(count);
+            context->done.release();
+        }
+    }
+
+    class BandTask : public QRunnable
+    {
+
+    public_construct:
+        explicit BandTask(const QSharedPointer<BandContext> &new_context)
+            : context(new_context)
+        {
+        }
+
+    public_methods:
+        void run()
+        {
+            run_bands(context.data());
+        }
+
+    private_data_members:
+        QSharedPointer<BandContext> context;
+
+    };
+
+    QThreadPool *band_pool()
+    {
+        static QThreadPool pool;
+        static bool initialized = false;
+
+        if(!initialized)
+        {
+            const int threads = SettingsManager::read("Background/Threads", QThread::idealThreadCount()).toInt();
+            pool.setMaxThreadCount(qMax(1, threads));
+            initialized = true;
+        }
+
+        return &pool;
+    }
+}
+
+/**
+ * @brief BackgroundStage::BackgroundStage
+ *      Reads the model settings, shared by all the cameras.
+ * @param new_id
+ *      The ID of the camera, sent with the presence signal.
+ * @param parent
+ *      The pipeline.
+ */
+BackgroundStage::BackgroundStage(const int new_id, QObject *parent)
+    : FrameStage("background", View, parent),
+      id(new_id),
+      present(false)
+{
+    //The model follows the background with a weight of 1 / 2^shift per frame, and the foreground much slower.
+    parameters.shift = qBound(0, SettingsManager::read("Background/Shift", 6).toInt(), 15);
+    parameters.foreground_shift = qBound(0, SettingsManager::read("Background/ForegroundShift", 10).toInt(), 15);
+
+    //A pixel further than this many deviations from its mean is foreground.
+    parameters.deviations = qBound(1, SettingsManager::read("Background/Deviations", 3).toInt(), 127);
+
+    //Deviations in luma levels, below the minimum is sensor noise.
+    const int minimum_deviation = qBound(0, SettingsManager::read("Background/MinDeviation", 4).toInt(), 127);
+    const int initial_deviation = qBound(0, SettingsManager::read("Background/InitialDeviation", 8).toInt(), 127);
+
+    parameters.minimum_variance = minimum_deviation * minimum_deviation;
+    initial_variance = initial_deviation * initial_deviation;
+
+    //Thousandths of the frame in the foreground for a presence.
+    presence_threshold = qBound(1, SettingsManager::read("Background/PresenceThreshold", 10).toInt(), 1000);
+
+    //Rows of the reduced frame per band, the smallest piece of work given to a thread.
+    band_rows = qMax(1, SettingsManager::read("Background/BandRows", 16).toInt());
+
+    band_pool();
+}
+
+/**
+ * @brief BackgroundStage::process
+ *      The first frame, and the first after a change of size, only initializes the model.
+ * @param frame
+ *      The frame, the mask is attached as 'foreground'.
+ * @return
+ *      False if the frame is too small to be analyzed.
+ */
+bool BackgroundStage::process(Frame &frame, FramePool *pool)
+{
+    Q_UNUSED(pool);
+
+    const bool same_size = size == QSize(frame.image.width() / 4, frame.image.height() / 4) && !mean.isEmpty();
+
+    if(!downsample(frame.image))
+    {
+        return false;
+    }
+
+    if(!same_size)
+    {
+        mean.resize(current.size());
+        variance.resize(current.size());
+
+        BackgroundModel::initialize(current.constData(), size.width(), size.width(), size.height(),
+                                    mean.data(), variance.data(), initial_variance);
+
+        present = false;
+        return true;
+    }
+
+    //A new image per frame, the consumers may still hold the previous one.
+    QImage mask(size, QImage::Format_Grayscale8);
+
+    if(mask.isNull())
+    {
+        return false;
+    }
+
+    const int foreground = static_cast<int>(update(mask) * Q_INT64_C(1000) / current.size());
+
+    frame.foreground = mask;
+
+    if((foreground >= presence_threshold) != present)
+    {
+        present = !present;
+        emit presence(id, present, foreground);
+
+        output("Presence " + QString(present ? "started" : "stopped") + " on camera " + QString::number(id) + ".", 2);
+    }
+
+    return true;
+}
+
+/**
+ * @brief BackgroundStage::downsample
+ *      Fills 'current' with the luma of the frame reduced by 4.
+ *      RGB32 and grayscale frames are read directly, other formats are converted first.
+ * @param image
+ *      The frame.
+ * @return
+ *      False if the reduced frame would be empty.
+ */
+bool BackgroundStage::downsample(const QImage &image)
+{
+    const QSize new_size(image.width() / 4, image.height() / 4);
+
+    if(new_size.isEmpty())
+    {
+        return false;
+    }
+
+    if(new_size != size)
+    {
+        size = new_size;
+        current.resize(size.width() * size.height());
+    }
+
+    switch(image.format())
+    {
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32:
+        {
+            FrameDifference::downsample_rgb32(image.constBits(), image.bytesPerLine(), image.width(), image.height(),
+                                              current.data(), size.width());
+            break;
+        }
+        case QImage::Format_Grayscale8:
+        {
+            FrameDifference::downsample_grayscale(image.constBits(), image.bytesPerLine(), image.width(), image.height(),
+                                                  current.data(), size.width());
+            break;
+        }
+        default:
+        {
+            const QImage converted = image.convertToFormat(QImage::Format_RGB32);
+
+            FrameDifference::downsample_rgb32(converted.constBits(), converted.bytesPerLine(), converted.width(), converted.height(),
+                                              current.data(), size.width());
+            break;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief BackgroundStage::update
+ *      Classifies 'current' and updates the model, the bands are shared with the helper threads.
+ *      One helper is started per band after the first, up to the size of the pool.
+ * @param mask
+ *      Output, the foreground mask, the size of the reduced frame.
+ * @return
+ *      Number of foreground pixels.
+ */
+int BackgroundStage::update(QImage &mask)
+{
+    QSharedPointer<BandContext> context(new BandContext);
+    context->luma = current.constData();
+    context->mean = mean.data();
+    context->variance = variance.data();
+    context->mask = mask.bits();
+    context->mask_stride = mask.bytesPerLine();
+    context->width = size.width();
+    context->height = size.height();
+    context->band_rows = band_rows;
+    context->band_count = (size.height() + band_rows - 1) / band_rows;
+    context->parameters = parameters;
+
+    const int helpers = qMin(context->band_count - 1, band_pool()->maxThreadCount());
+
+    for(int i = 0; i < helpers; i++)
+    {
+        band_pool()->start(new BandTask(context));
+    }
+
+    run_bands(context.data());
+
+    context->done.acquire(context->band_count);
+
+    return context->foreground.load();
+}
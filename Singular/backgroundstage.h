@@ -0,0 +1,72 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BACKGROUNDSTAGE_H
+#define BACKGROUNDSTAGE_H
+
+#include <QSize>
+#include <QVector>
+
+#include "defines.h"
+#include "framestage.h"
+#include "backgroundmodel.h"
+
+/**
+ * @brief The BackgroundStage class
+ *      Background subtraction for presence detection. The frame is reduced by 4 in both directions to luma and classified
+ *      against a running Gaussian of each pixel, see BackgroundModel. The foreground mask is attached to the frame.
+ *      A view stage, it reads the pixels and only adds the mask to the frame.
+ * @remarks
+ *      The model is updated in bands of rows, run by a pool of threads of its own and by the pipeline worker itself,
+ *      so one camera with a large frame does not hold a pipeline worker for the whole update.
+ *      'presence' is emitted when the part of the frame in the foreground crosses "Background/PresenceThreshold".
+ */
+class BackgroundStage : public FrameStage
+{
+    Q_OBJECT
+
+public_construct:
+    explicit BackgroundStage(const int new_id, QObject *parent = 0);
+
+public_methods:
+    bool process(Frame &frame, FramePool *pool);
+
+private_methods:
+    bool downsample(const QImage &image);
+    int update(QImage &mask);
+
+private_members:
+    int id;
+    int initial_variance;
+    int presence_threshold;
+    int band_rows;
+    bool present;
+    QSize size;
+    BackgroundModel::Parameters parameters;
+
+private_data_members:
+    QVector<uchar> current;
+    QVector<qint16> mean;
+    QVector<qint16> variance;
+
+signals:
+    void presence(const int id, const bool present, const int foreground) const;
+
+};
+
+#endif // BACKGROUNDSTAGE_H
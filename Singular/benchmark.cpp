@@ -0,0 +1,788 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "benchmark.h"
+#include "simd.h"
+#include "framepool.h"
+#include "colorconversion.h"
+#include "framedifference.h"
+#include "imagestatistics.h"
+#include "framescale.h"
+#include "backgroundmodel.h"
+#include "audiolevels.h"
+#include "audioconversion.h"
+#include "fft.h"
+#include "spectrumanalyzer.h"
+
+#include <QVector>
+#include <QtEndian>
+#include <QAudioFormat>
+#include <QElapsedTimer>
+
+#include <cmath>
+#include <cstring>
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ */
+namespace
+{
+    QVector<uchar> pattern(const int size)
+    {
+        QVector<uchar> data(size);
+
+        for(int i = 0; i < size; i++)
+        {
+            data[i] = static_cast<uchar>((i * 7) ^ (i >> 5));
+        }
+
+        return data;
+    }
+
+    QString result(const QString &name, const int width, const int height, const Simd::Level level, const int iterations, const qint64 nanoseconds)
+    {
+        const double seconds = qMax(nanoseconds, Q_INT64_C(1)) / 1000000000.0;
+        const double fps = iterations / seconds;
+        const double megapixels = (static_cast<double>(width) * height * iterations) / seconds / 1000000.0;
+
+        return name + " " + QString::number(width) + "x" + QString::number(height) + " " + Simd::level_name(level) + ": " +
+               QString::number(fps, 'f', 1) + " fps, " + QString::number(megapixels, 'f', 1) + " Mpixel/s";
+    }
+
+    /**
+     * The peak loop AudioInputSurface::writeData had before the levels kernels, the format is checked for every sample.
+     */
+    quint16 legacy_peak(const QAudioFormat &format, const char *data, const qint64 size)
+    {
+        quint16 max_value = 0;
+
+        const int sample_bytes = format.sampleSize() / 8;
+        const int channel_bytes = format.channelCount() * sample_bytes;
+        const int total_samples = size / channel_bytes;
+
+        const unsigned char *data_ptr = reinterpret_cast<const unsigned char *>(data);
+
+        for (int i = 0; i < total_samples; ++i)
+        {
+            for (int j = 0; j < format.channelCount(); ++j)
+            {
+                quint16 value = 0;
+
+                if (format.sampleSize() == 8 && format.sampleType() == QAudioFormat::UnSignedInt)
+                {
+                    value = *reinterpret_cast<const quint8*>(data_ptr);
+                }
+                else if (format.sampleSize() == 8 && format.sampleType() == QAudioFormat::SignedInt)
+                {
+                    value = qAbs(*reinterpret_cast<const qint8*>(data_ptr));
+                }
+                else if (format.sampleSize() == 16 && format.sampleType() == QAudioFormat::UnSignedInt)
+                {
+                    if (format.byteOrder() == QAudioFormat::LittleEndian)
+                    {
+                        value = qFromLittleEndian<quint16>(data_ptr);
+                    }
+                    else
+                    {
+                        value = qFromBigEndian<quint16>(data_ptr);
+                    }
+                }
+                else if (format.sampleSize() == 16 && format.sampleType() == QAudioFormat::SignedInt)
+                {
+                    if (format.byteOrder() == QAudioFormat::LittleEndian)
+                    {
+                        value = qAbs(qFromLittleEndian<qint16>(data_ptr));
+                    }
+                    else
+                    {
+                        value = qAbs(qFromBigEndian<qint16>(data_ptr));
+                    }
+                }
+
+                max_value = qMax(value, max_value);
+                data_ptr += sample_bytes;
+            }
+        }
+
+        return max_value;
+    }
+
+    QString audio_result(const QString &name, const QString &variant, const int sample_rate, const int channels, const int seconds, const qint64 nanoseconds)
+    {
+        const double elapsed = qMax(nanoseconds, Q_INT64_C(1)) / 1000000000.0;
+        const double megasamples = static_cast<double>(sample_rate) * channels * seconds / elapsed / 1000000.0;
+
+        return name + " " + QString::number(sample_rate) + " Hz x" + QString::number(channels) + " " + variant + ": " +
+               QString::number(megasamples, 'f', 1) + " Msample/s, " + QString::number(seconds / elapsed, 'f', 0) + "x real time";
+    }
+}
+
+/**
+ * @brief Benchmark::run
+ *      Runs all the benchmarks with the default sizes.
+ * @return
+ *      One line per result.
+ */
+QStringList Benchmark::run()
+{
+    QStringList results;
+
+    results.append(color_conversion(1920, 1080, 100));
+    results.append(motion_detection(1920, 1080, 100));
+    results.append(image_statistics(1920, 1080, 100));
+    results.append(downscale(1920, 1080, 4, 100));
+    results.append(region_of_interest(3840, 2160, 960, 540, 50));
+    results.append(background_model(1920, 1080, 100));
+    results.append(audio_levels(48000, 2, 10));
+    results.append(audio_levels(48000, 8, 10));
+    results.append(audio_levels(192000, 8, 10));
+    results.append(audio_conversion(48000, 8, 10));
+    results.append(spectrum(48000, 1, 2048, 75, 10));
+    results.append(spectrum(48000, 8, 2048, 75, 10));
+
+    return results;
+}
+
+/**
+ * @brief Benchmark::color_conversion
+ *      Measures the throughput of the YUV to RGB32 conversions.
+ * @param width
+ *      Width of the frames.
+ * @param height
+ *      Height of the frames.
+ * @param iterations
+ *      Number of frames converted per format and instruction set.
+ * @return
+ *      One line per format and instruction set.
+ */
+QStringList Benchmark::color_conversion(const int width, const int height, const int iterations)
+{
+    QStringList results;
+
+    const int chroma_width = (width + 1) / 2;
+    const int chroma_height = (height + 1) / 2;
+    const int destination_stride = FramePool::aligned_bytes_per_line(width * 4);
+
+    const QVector<uchar> y_plane = pattern(width * height);
+    const QVector<uchar> u_plane = pattern(chroma_width * chroma_height);
+    const QVector<uchar> v_plane = pattern(chroma_width * chroma_height);
+    const QVector<uchar> uv_plane = pattern(chroma_width * 2 * chroma_height);
+    const QVector<uchar> packed = pattern(chroma_width * 4 * height);
+    QVector<uchar> destination(destination_stride * height);
+
+    for(int level = Simd::Scalar; level <= Simd::get_supported_level(); level++)
+    {
+        Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+        QElapsedTimer timer;
+
+        timer.start();
+        for(int i = 0; i < iterations; i++)
+        {
+            ColorConversion::yuv420p_to_rgb32(y_plane.constData(), width, u_plane.constData(), v_plane.constData(), chroma_width,
+                                              destination.data(), destination_stride, width, height);
+        }
+        results.append(result("YUV420P", width, height, static_cast<Simd::Level>(level), iterations, timer.nsecsElapsed()));
+
+        timer.restart();
+        for(int i = 0; i < iterations; i++)
+        {
+            ColorConversion::nv12_to_rgb32(y_plane.constData(), width, uv_plane.constData(), chroma_width * 2, false,
+                                           destination.data(), destination_stride, width, height);
+        }
+        results.append(result("NV12", width, height, static_cast<Simd::Level>(level), iterations, timer.nsecsElapsed()));
+
+        timer.restart();
+        for(int i = 0; i < iterations; i++)
+        {
+            ColorConversion::yuyv_to_rgb32(packed.constData(), chroma_width * 4, false,
+                                           destination.data(), destination_stride, width, height);
+        }
+        results.append(result("YUYV", width, height, static_cast<Simd::Level>(level), iterations, timer.nsecsElapsed()));
+    }
+
+    Simd::set_level_limit(Simd::AVX2);
+
+    return results;
+}
+
+/**
+ * @brief Benchmark::motion_detection
+ *      Measures the motion detector kernels on a frame with a moving block, the scene is scrolled by one line per frame.
+ *      The region sums of every instruction set are compared with the scalar ones.
+ * @param width
+ *      Width of the frames.
+ * @param height
+ *      Height of the frames.
+ * @param iterations
+ *      Number of frames analyzed per instruction set.
+ * @return
+ *      One line per instruction set, plus one if the results differ.
+ */
+QStringList Benchmark::motion_detection(const int width, const int height, const int iterations)
+{
+    QStringList results;
+
+    const int stride = FramePool::aligned_bytes_per_line(width * 4);
+    const int small_width = width / 4;
+    const int small_height = height / 4;
+    const int columns = 8;
+    const int rows = 6;
+
+    QVector<uchar> frame = pattern(stride * (height + iterations));
+
+    //A bright block, the part of the scene that moves.
+    for(int i = height / 3; i < height / 3 + height / 4; i++)
+    {
+        for(int j = (width / 2) * 4; j < (width / 2 + width / 5) * 4; j++)
+        {
+            frame[i * stride + j] = 255;
+        }
+    }
+
+    QVector<uchar> current(small_width * small_height);
+    QVector<uchar> background(small_width * small_height);
+    QVector<qint64> sums(columns * rows);
+    QVector<qint64> reference;
+
+    for(int level = Simd::Scalar; level <= Simd::get_supported_level(); level++)
+    {
+        Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+        FrameDifference::downsample_rgb32(frame.constData(), stride, width, height, background.data(), small_width);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        for(int i = 0; i < iterations; i++)
+        {
+            FrameDifference::downsample_rgb32(frame.constData() + (i + 1) * stride, stride, width, height, current.data(), small_width);
+            FrameDifference::difference(current.constData(), background.constData(), small_width, small_width, small_height, 12, columns, rows, sums.data());
+            FrameDifference::update_background(current.constData(), background.data(), small_width, small_width, small_height, 4);
+        }
+
+        results.append(result("Motion", width, height, static_cast<Simd::Level>(level), iterations, timer.nsecsElapsed()));
+
+        if(level == Simd::Scalar)
+        {
+            reference = sums;
+        }
+        else if(sums != reference)
+        {
+            results.append("Motion " + Simd::level_name(static_cast<Simd::Level>(level)) + ": results differ from scalar.");
+        }
+    }
+
+    Simd::set_level_limit(Simd::AVX2);
+
+    return results;
+}
+
+/**
+ * @brief Benchmark::image_statistics
+ *      Measures the histograms, exposure and focus of a frame, on the same pattern as the other benchmarks.
+ *      The results of every instruction set are compared with the scalar ones.
+ * @param width
+ *      Width of the frames.
+ * @param height
+ *      Height of the frames.
+ * @param iterations
+ *      Number of frames analyzed per instruction set.
+ * @return
+ *      One line per instruction set, plus one if the results differ.
+ */
+QStringList Benchmark::image_statistics(const int width, const int height, const int iterations)
+{
+    QStringList results;
+
+    const int stride = FramePool::aligned_bytes_per_line(width * 4);
+    QVector<uchar> frame = pattern(stride * height);
+
+    const QImage image(frame.constData(), width, height, stride, QImage::Format_RGB32);
+
+    QVector<uchar> lines;
+    ImageStatistics statistics;
+    ImageStatistics reference;
+
+    for(int level = Simd::Scalar; level <= Simd::get_supported_level(); level++)
+    {
+        Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+        QElapsedTimer timer;
+        timer.start();
+
+        for(int i = 0; i < iterations; i++)
+        {
+            statistics.compute(image, lines);
+        }
+
+        results.append(result("Statistics", width, height, static_cast<Simd::Level>(level), iterations, timer.nsecsElapsed()));
+
+        if(level == Simd::Scalar)
+        {
+            reference = statistics;
+        }
+        else if(std::memcmp(statistics.luma, reference.luma, sizeof(statistics.luma)) != 0 ||
+                statistics.sharpness != reference.sharpness)
+        {
+            results.append("Statistics " + Simd::level_name(static_cast<Simd::Level>(level)) + ": results differ from scalar.");
+        }
+    }
+
+    Simd::set_level_limit(Simd::AVX2);
+
+    return results;
+}
+
+/**
+ * @brief Benchmark::downscale
+ *      Measures the mosaic downscaling of one frame into its tile, the output of every instruction set is compared with the scalar one.
+ * @param width
+ *      Width of the frames.
+ * @param height
+ *      Height of the frames.
+ * @param tiles
+ *      Tiles per row and column of the mosaic, 4 is a mosaic of 16 cameras.
+ * @param iterations
+ *      Number of frames downscaled per instruction set.
+ * @return
+ *      One line per instruction set, plus one if the results differ.
+ */
+QStringList Benchmark::downscale(const int width, const int height, const int tiles, const int iterations)
+{
+    QStringList results;
+
+    const int stride = FramePool::aligned_bytes_per_line(width * 4);
+    const int tile_width = width / tiles;
+    const int tile_height = height / tiles;
+
+    const QVector<uchar> frame = pattern(stride * height);
+
+    QVector<uchar> output(stride * height);
+    QVector<uchar> reference;
+    QVector<uchar> line(width * 4);
+    QVector<int> columns(tile_width);
+
+    FrameScale::sample_positions(width, tile_width, columns.data());
+
+    for(int level = Simd::Scalar; level <= Simd::get_supported_level(); level++)
+    {
+        Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+        QElapsedTimer timer;
+        timer.start();
+
+        for(int i = 0; i < iterations; i++)
+        {
+            FrameScale::downscale_rgb32(frame.constData(), stride, width, height, output.data(), stride,
+                                        tile_width, tile_height, columns.constData(), line.data());
+        }
+
+        results.append(result("Downscale 1/" + QString::number(tiles), width, height, static_cast<Simd::Level>(level), iterations, timer.nsecsElapsed()));
+
+        if(level == Simd::Scalar)
+        {
+            reference = output;
+        }
+        else if(output != reference)
+        {
+            results.append("Downscale " + Simd::level_name(static_cast<Simd::Level>(level)) + ": results differ from scalar.");
+        }
+    }
+
+    Simd::set_level_limit(Simd::AVX2);
+
+    return results;
+}
+
+/**
+ * @brief Benchmark::region_of_interest
+ *      Measures the YUV420P conversion of a whole frame against the conversion of a region of interest,
+ *      the same crop the camera surface does, see CameraSurface::copy_frame.
+ *      The bandwidth is what the conversion reads from the frame and writes to the pool slot.
+ * @param width
+ *      Width of the frames.
+ * @param height
+ *      Height of the frames.
+ * @param roi_width
+ *      Width of the region, centered in the frame.
+ * @param roi_height
+ *      Height of the region.
+ * @param iterations
+ *      Number of frames converted per instruction set, for both the frame and the region.
+ * @return
+ *      One line per instruction set, plus the bytes moved per frame.
+ */
+QStringList Benchmark::region_of_interest(const int width, const int height, const int roi_width, const int roi_height, const int iterations)
+{
+    QStringList results;
+
+    const int chroma_width = (width + 1) / 2;
+    const int chroma_height = (height + 1) / 2;
+    const int stride = FramePool::aligned_bytes_per_line(width * 4);
+    const int roi_stride = FramePool::aligned_bytes_per_line(roi_width * 4);
+
+    //Aligned to the chroma, as the surface does.
+    const int left = ((width - roi_width) / 2) & ~1;
+    const int top = ((height - roi_height) / 2) & ~1;
+    const int chroma_offset = (top / 2) * chroma_width + left / 2;
+
+    const QVector<uchar> y_plane = pattern(width * height);
+    const QVector<uchar> u_plane = pattern(chroma_width * chroma_height);
+    const QVector<uchar> v_plane = pattern(chroma_width * chroma_height);
+    QVector<uchar> destination(stride * height);
+
+    const qint64 frame_bytes = static_cast<qint64>(width) * height + 2 * chroma_width * chroma_height + static_cast<qint64>(stride) * height;
+    const qint64 roi_bytes = static_cast<qint64>(roi_width) * roi_height + 2 * ((roi_width + 1) / 2) * ((roi_height + 1) / 2) +
+                             static_cast<qint64>(roi_stride) * roi_height;
+
+    for(int level = Simd::Scalar; level <= Simd::get_supported_level(); level++)
+    {
+        Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+        QElapsedTimer timer;
+
+        timer.start();
+        for(int i = 0; i < iterations; i++)
+        {
+            ColorConversion::yuv420p_to_rgb32(y_plane.constData(), width, u_plane.constData(), v_plane.constData(), chroma_width,
+                                              destination.data(), stride, width, height);
+        }
+        const qint64 frame_nsecs = qMax(timer.nsecsElapsed(), Q_INT64_C(1));
+
+        timer.restart();
+        for(int i = 0; i < iterations; i++)
+        {
+            ColorConversion::yuv420p_to_rgb32(y_plane.constData() + top * width + left, width,
+                                              u_plane.constData() + chroma_offset, v_plane.constData() + chroma_offset, chroma_width,
+                                              destination.data(), roi_stride, roi_width, roi_height);
+        }
+        const qint64 roi_nsecs = qMax(timer.nsecsElapsed(), Q_INT64_C(1));
+
+        results.append("ROI " + QString::number(roi_width) + "x" + QString::number(roi_height) + " of " +
+                       QString::number(width) + "x" + QString::number(height) + " " + Simd::level_name(static_cast<Simd::Level>(level)) + ": " +
+                       QString::number(frame_nsecs / 1000000.0 / iterations, 'f', 2) + " ms per frame, " +
+                       QString::number(roi_nsecs / 1000000.0 / iterations, 'f', 2) + " ms per region, " +
+                       QString::number(frame_bytes * iterations * 1000.0 / frame_nsecs, 'f', 0) + " MB/s");
+    }
+
+    results.append("ROI bytes moved per frame: " + QString::number(frame_bytes) + " whole, " + QString::number(roi_bytes) + " region, " +
+                   QString::number(100.0 - roi_bytes * 100.0 / frame_bytes, 'f', 1) + "% saved");
+
+    Simd::set_level_limit(Simd::AVX2);
+
+    return results;
+}
+
+/**
+ * @brief Benchmark::background_model
+ *      Measures the background model on the same scrolling scene as the motion detector, in one band.
+ *      The model and the mask of every instruction set are compared with the scalar ones.
+ * @param width
+ *      Width of the frames, the model is a quarter of it.
+ * @param height
+ *      Height of the frames, the model is a quarter of it.
+ * @param iterations
+ *      Number of frames classified per instruction set.
+ * @return
+ *      One line per instruction set, plus one if the results differ.
+ */
+QStringList Benchmark::background_model(const int width, const int height, const int iterations)
+{
+    QStringList results;
+
+    const int stride = FramePool::aligned_bytes_per_line(width * 4);
+    const int small_width = width / 4;
+    const int small_height = height / 4;
+
+    const QVector<uchar> frame = pattern(stride * (height + iterations));
+
+    const BackgroundModel::Parameters parameters = {6, 10, 3, 16};
+
+    QVector<uchar> current(small_width * small_height);
+    QVector<qint16> mean(small_width * small_height);
+    QVector<qint16> variance(small_width * small_height);
+    QVector<uchar> mask(small_width * small_height);
+    QVector<qint16> reference_mean;
+    QVector<uchar> reference_mask;
+    int foreground = 0;
+    int reference_foreground = 0;
+
+    for(int level = Simd::Scalar; level <= Simd::get_supported_level(); level++)
+    {
+        Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+        FrameDifference::downsample_rgb32(frame.constData(), stride, width, height, current.data(), small_width);
+        BackgroundModel::initialize(current.constData(), small_width, small_width, small_height, mean.data(), variance.data(), 64);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        for(int i = 0; i < iterations; i++)
+        {
+            FrameDifference::downsample_rgb32(frame.constData() + (i + 1) * stride, stride, width, height, current.data(), small_width);
+            foreground = BackgroundModel::update(current.constData(), small_width, small_width, small_height,
+                                                 mean.data(), variance.data(), mask.data(), small_width, parameters);
+        }
+
+        results.append(result("Background", width, height, static_cast<Simd::Level>(level), iterations, timer.nsecsElapsed()));
+
+        if(level == Simd::Scalar)
+        {
+            reference_mean = mean;
+            reference_mask = mask;
+            reference_foreground = foreground;
+        }
+        else if(mean != reference_mean || mask != reference_mask || foreground != reference_foreground)
+        {
+            results.append("Background " + Simd::level_name(static_cast<Simd::Level>(level)) + ": results differ from scalar.");
+        }
+    }
+
+    Simd::set_level_limit(Simd::AVX2);
+
+    return results;
+}
+
+/**
+ * @brief Benchmark::audio_levels
+ *      Measures the peak and RMS kernels on 16 bit little endian audio, in buffers of 10 ms as a device delivers them,
+ *      against the per sample loop of the old AudioInputSurface::writeData, which only found the peak.
+ *      The results of every instruction set are compared with the scalar ones.
+ * @param sample_rate
+ *      Samples per second of each channel.
+ * @param channels
+ *      Interleaved channels.
+ * @param seconds
+ *      Length of the audio measured per kernel.
+ * @return
+ *      One line for the old loop and one per instruction set, plus one if the results differ.
+ */
+QStringList Benchmark::audio_levels(const int sample_rate, const int channels, const int seconds)
+{
+    QStringList results;
+
+    const int frames = qMax(1, sample_rate / 100);
+    const int buffers = seconds * 100;
+    const int buffer_bytes = frames * channels * 2;
+
+    const QVector<uchar> data = pattern(buffer_bytes * 10);
+
+    QAudioFormat format;
+    format.setSampleRate(sample_rate);
+    format.setChannelCount(channels);
+    format.setSampleSize(16);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    quint16 legacy = 0;
+
+    for(int i = 0; i < buffers; i++)
+    {
+        legacy = qMax(legacy, legacy_peak(format, reinterpret_cast<const char*>(data.constData()) + (i % 10) * buffer_bytes, buffer_bytes));
+    }
+
+    results.append(audio_result("Audio levels", "per sample loop (peak " + QString::number(legacy) + ")", sample_rate, channels, seconds, timer.nsecsElapsed()));
+
+    const AudioLevels::Kernel kernel = AudioLevels::kernel(AudioConversion::SignedInt16LE);
+
+    QVector<quint32> peaks(channels);
+    QVector<quint64> squares(channels);
+    QVector<quint32> reference_peaks;
+    QVector<quint64> reference_squares;
+
+    for(int level = Simd::Scalar; level <= Simd::get_supported_level(); level++)
+    {
+        Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+        timer.restart();
+
+        for(int i = 0; i < buffers; i++)
+        {
+            kernel(data.constData() + (i % 10) * buffer_bytes, frames, channels, peaks.data(), squares.data());
+        }
+
+        results.append(audio_result("Audio levels", Simd::level_name(static_cast<Simd::Level>(level)), sample_rate, channels, seconds, timer.nsecsElapsed()));
+
+        if(level == Simd::Scalar)
+        {
+            reference_peaks = peaks;
+            reference_squares = squares;
+        }
+        else if(peaks != reference_peaks || squares != reference_squares)
+        {
+            results.append("Audio levels " + Simd::level_name(static_cast<Simd::Level>(level)) + ": results differ from scalar.");
+        }
+    }
+
+    Simd::set_level_limit(Simd::AVX2);
+
+    return results;
+}
+
+/**
+ * @brief Benchmark::audio_conversion
+ *      Measures the conversion of the device formats to the canonical float samples, in buffers of 10 ms.
+ *      The samples of every instruction set are compared with the scalar ones.
+ * @param sample_rate
+ *      Samples per second of each channel.
+ * @param channels
+ *      Interleaved channels.
+ * @param seconds
+ *      Length of the audio converted per format and instruction set.
+ * @return
+ *      One line per format and instruction set, plus one if the results differ.
+ */
+QStringList Benchmark::audio_conversion(const int sample_rate, const int channels, const int seconds)
+{
+    QStringList results;
+
+    const AudioConversion::Format formats[] = {AudioConversion::SignedInt16LE, AudioConversion::SignedInt24LE,
+                                               AudioConversion::SignedInt32BE, AudioConversion::Float32BE};
+
+    const int samples = qMax(1, sample_rate / 100) * channels;
+    const int buffers = seconds * 100;
+    const QVector<uchar> data = pattern(samples * 4 * 10);
+
+    QVector<float> destination(samples);
+    QVector<float> reference;
+
+    for(uint f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+    {
+        const AudioConversion::Converter converter = AudioConversion::converter(formats[f]);
+        const int buffer_bytes = samples * AudioConversion::sample_bytes(formats[f]);
+        const QString name = AudioConversion::format_name(formats[f]);
+
+        for(int level = Simd::Scalar; level <= Simd::get_supported_level(); level++)
+        {
+            Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+            QElapsedTimer timer;
+            timer.start();
+
+            for(int i = 0; i < buffers; i++)
+            {
+                converter(data.constData() + (i % 10) * buffer_bytes, samples, destination.data());
+            }
+
+            results.append(audio_result("Audio to float " + name, Simd::level_name(static_cast<Simd::Level>(level)),
+                                        sample_rate, channels, seconds, timer.nsecsElapsed()));
+
+            //Compared as bits, a float pattern can hold NaNs.
+            if(level == Simd::Scalar)
+            {
+                reference = destination;
+            }
+            else if(std::memcmp(destination.constData(), reference.constData(), samples * sizeof(float)) != 0)
+            {
+                results.append("Audio to float " + name + " " + Simd::level_name(static_cast<Simd::Level>(level)) + ": results differ from scalar.");
+            }
+        }
+    }
+
+    Simd::set_level_limit(Simd::AVX2);
+
+    return results;
+}
+
+/**
+ * @brief Benchmark::spectrum
+ *      Measures the spectrum of several mono inputs as SpectrumAnalyzer computes it, one windowed FFT per hop and the bands,
+ *      all on this thread. "x real time" above 1 means one core keeps up with all the inputs.
+ *      The spectra of every instruction set are compared with the scalar ones.
+ * @param sample_rate
+ *      Samples per second of each input.
+ * @param inputs
+ *      Number of inputs.
+ * @param size
+ *      Samples per transform.
+ * @param overlap
+ *      Percentage of each window shared with the next.
+ * @param seconds
+ *      Length of the audio analyzed per instruction set.
+ * @return
+ *      One line per instruction set, plus one if the results differ.
+ */
+QStringList Benchmark::spectrum(const int sample_rate, const int inputs, const int size, const int overlap, const int seconds)
+{
+    QStringList results;
+
+    Fft fft(size);
+
+    const int hop = qMax(1, fft.get_size() * (100 - qBound(0, overlap, 95)) / 100);
+    const int transforms = static_cast<int>(static_cast<qint64>(sample_rate) * seconds / hop);
+    const int bands = 32;
+    const QVector<uchar> noise = pattern(fft.get_size() * 4);
+    const QString name = "Spectrum " + QString::number(fft.get_size()) + " points " + QString::number(overlap) + "% overlap";
+
+    //A sine over some noise, long enough that the windows of the hops differ.
+    QVector<float> signal(noise.size());
+
+    for(int i = 0; i < signal.size(); i++)
+    {
+        signal[i] = 0.5f * static_cast<float>(std::sin(i * 0.05)) + (noise.at(i) - 128) / 1024.0f;
+    }
+
+    QVector<int> edges(bands + 1);
+    SpectrumAnalyzer::band_edges(fft.get_size(), sample_rate, bands, 40.0, 16000.0, edges.data());
+
+    QVector<float> power(fft.get_bins());
+    QVector<float> levels(bands);
+    QVector<float> reference;
+
+    const int windows = signal.size() - fft.get_size();
+
+    for(int level = Simd::Scalar; level <= Simd::get_supported_level(); level++)
+    {
+        Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+        QElapsedTimer timer;
+        timer.start();
+
+        for(int input = 0; input < inputs; input++)
+        {
+            levels.fill(-120.0f);
+
+            for(int i = 0; i < transforms; i++)
+            {
+                fft.power(signal.constData() + (static_cast<qint64>(i) * hop + input * 7) % windows, power.data());
+                SpectrumAnalyzer::band_levels(power.constData(), edges.constData(), bands, levels.data());
+            }
+        }
+
+        results.append(audio_result(name, Simd::level_name(static_cast<Simd::Level>(level)), sample_rate, inputs, seconds, timer.nsecsElapsed()));
+
+        if(level == Simd::Scalar)
+        {
+            reference = power;
+        }
+        else if(std::memcmp(power.constData(), reference.constData(), power.size() * sizeof(float)) != 0)
+        {
+            results.append(name + " " + Simd::level_name(static_cast<Simd::Level>(level)) + ": results differ from scalar.");
+        }
+    }
+
+    Simd::set_level_limit(Simd::AVX2);
+
+    return results;
+}
@@ -0,0 +1,45 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QStringList>
+
+/**
+ * @brief The Benchmark namespace
+ *      Micro benchmarks of the frame and sample kernels, run on synthetic data.
+ *      Every kernel is measured on each instruction set the CPU supports, so the results can be compared between them.
+ *      Enabled with the "Debug/Benchmark" setting, the results are printed to the console.
+ */
+namespace Benchmark
+{
+    QStringList run();
+
+    QStringList color_conversion(const int width, const int height, const int iterations);
+    QStringList motion_detection(const int width, const int height, const int iterations);
+    QStringList image_statistics(const int width, const int height, const int iterations);
+    QStringList downscale(const int width, const int height, const int tiles, const int iterations);
+    QStringList region_of_interest(const int width, const int height, const int roi_width, const int roi_height, const int iterations);
+    QStringList background_model(const int width, const int height, const int iterations);
+    QStringList audio_levels(const int sample_rate, const int channels, const int seconds);
+    QStringList audio_conversion(const int sample_rate, const int channels, const int seconds);
+    QStringList spectrum(const int sample_rate, const int inputs, const int size, const int overlap, const int seconds);
+}
+
+#endif // BENCHMARK_H
@@ -0,0 +1,172 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "camerastatistics.h"
+
+/**
+ * @brief CameraStatistics::CameraStatistics
+ * @param new_id
+ *      The ID of the camera.
+ */
+CameraStatistics::CameraStatistics(const int new_id)
+    : id(new_id),
+      captured_count(0),
+      delivered_count(0),
+      painted_count(0),
+      dropped_count(0)
+{
+    for(int i = 0; i < 2; i++)
+    {
+        samples[i].captured = 0;
+        samples[i].painted = 0;
+        samples[i].capture_fps = 0;
+        samples[i].paint_fps = 0;
+        samples[i].timer.start();
+    }
+}
+
+/**
+ * @brief CameraStatistics::frame_captured
+ *      A frame arrived from the driver, delivered or not.
+ */
+void CameraStatistics::frame_captured()
+{
+    captured_count.ref();
+}
+
+/**
+ * @brief CameraStatistics::frame_converted
+ *      Time to copy, and convert, the frame into the pool.
+ * @param nanoseconds
+ *      The duration.
+ */
+void CameraStatistics::frame_converted(const qint64 nanoseconds)
+{
+    conversion.record(nanoseconds);
+}
+
+/**
+ * @brief CameraStatistics::frame_processed
+ *      The frame is ready to be delivered, after the conversion and the pipeline, if any.
+ * @param frame
+ *      The frame, with its capture and processed times.
+ */
+void CameraStatistics::frame_processed(const Frame &frame)
+{
+    processing.record(frame.processed_time - frame.capture_time);
+}
+
+/**
+ * @brief CameraStatistics::frame_delivered
+ *      The frame reached the widget.
+ * @param frame
+ *      The frame, with its capture and delivered times.
+ */
+void CameraStatistics::frame_delivered(const Frame &frame)
+{
+    delivered_count.ref();
+    delivery.record(frame.delivered_time - frame.capture_time);
+}
+
+/**
+ * @brief CameraStatistics::frame_painted
+ *      The frame was painted, this is the end to end latency.
+ * @param frame
+ *      The frame, with its capture time.
+ */
+void CameraStatistics::frame_painted(const Frame &frame)
+{
+    painted_count.ref();
+    display.record(Frame::clock() - frame.capture_time);
+}
+
+/**
+ * @brief CameraStatistics::frame_dropped
+ *      A frame was lost on the way: no free pool slot, replaced by a newer frame, or failed in the pipeline.
+ */
+void CameraStatistics::frame_dropped()
+{
+    dropped_count.ref();
+}
+
+/**
+ * @brief CameraStatistics::sample
+ *      Updates the capture and paint rates of a window since its previous sample. GUI thread only.
+ * @param window
+ *      The overlay for get_summary, the export for to_json.
+ */
+void CameraStatistics::sample(const Window window)
+{
+    Sample &sample = samples[window];
+    const double seconds = sample.timer.nsecsElapsed() / 1000000000.0;
+
+    if(seconds <= 0)
+    {
+        return;
+    }
+
+    const int captured = captured_count.load();
+    const int painted = painted_count.load();
+
+    sample.capture_fps = (captured - sample.captured) / seconds;
+    sample.paint_fps = (painted - sample.painted) / seconds;
+
+    sample.captured = captured;
+    sample.painted = painted;
+    sample.timer.restart();
+}
+
+/**
+ * @brief CameraStatistics::get_summary
+ * @return
+ *      Two lines for the overlay of the camera widget.
+ */
+QString CameraStatistics::get_summary() const
+{
+    const Sample &sample = samples[Overlay];
+
+    return QString::number(sample.paint_fps, 'f', 1) + " fps (capture " + QString::number(sample.capture_fps, 'f', 1) + "), " +
+           QString::number(dropped_count.load()) + " dropped\n" +
+           "latency p50 " + QString::number(display.percentile(50) / 1000000.0, 'f', 1) + " ms, p99 " +
+           QString::number(display.percentile(99) / 1000000.0, 'f', 1) + " ms, conversion " +
+           QString::number(conversion.get_mean() / 1000000.0, 'f', 2) + " ms";
+}
+
+/**
+ * @brief CameraStatistics::to_json
+ * @return
+ *      All the counters and histograms, for the statistics export.
+ */
+QJsonObject CameraStatistics::to_json() const
+{
+    QJsonObject object;
+
+    object.insert("id", id);
+    object.insert("captured", captured_count.load());
+    object.insert("delivered", delivered_count.load());
+    object.insert("painted", painted_count.load());
+    object.insert("dropped", dropped_count.load());
+    object.insert("capture_fps", samples[Export].capture_fps);
+    object.insert("paint_fps", samples[Export].paint_fps);
+    object.insert("conversion", conversion.to_json());
+    object.insert("processing", processing.to_json());
+    object.insert("delivery", delivery.to_json());
+    object.insert("display", display.to_json());
+
+    return object;
+}
@@ -0,0 +1,94 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAMERASTATISTICS_H
+#define CAMERASTATISTICS_H
+
+#include <QString>
+#include <QAtomicInt>
+#include <QJsonObject>
+#include <QElapsedTimer>
+
+#include "defines.h"
+#include "frame.h"
+#include "latencyhistogram.h"
+
+/**
+ * @brief The CameraStatistics class
+ *      Counters and latency histograms of one camera, shared by the threads the frames go through.
+ *      Each thread records its own step: the camera thread the capture and conversion, the pipeline the processing,
+ *      the camera widget the delivery and the paint. All the latencies are measured from the capture.
+ * @remarks
+ *      Recording is lock-free. 'sample' computes the rates since the previous sample of the same window and is only called
+ *      from the GUI thread. The widget overlay and the export each have their own window, so they do not reset each other.
+ */
+class CameraStatistics
+{
+
+public_enums:
+    enum Window
+    {
+        Overlay,
+        Export
+    };
+
+public_construct:
+    explicit CameraStatistics(const int new_id);
+
+public_methods:
+    void frame_captured();
+    void frame_converted(const qint64 nanoseconds);
+    void frame_processed(const Frame &frame);
+    void frame_delivered(const Frame &frame);
+    void frame_painted(const Frame &frame);
+    void frame_dropped();
+
+    void sample(const Window window);
+    QString get_summary() const;
+    QJsonObject to_json() const;
+
+private_members:
+    int id;
+    QAtomicInt captured_count;
+    QAtomicInt delivered_count;
+    QAtomicInt painted_count;
+    QAtomicInt dropped_count;
+
+private_data_members:
+    /**
+     * @brief The Sample struct
+     *      Counters at the previous sample of a window, and the rates since the one before.
+     */
+    struct Sample
+    {
+        int captured;
+        int painted;
+        double capture_fps;
+        double paint_fps;
+        QElapsedTimer timer;
+    };
+
+    Sample samples[2];
+    LatencyHistogram conversion;
+    LatencyHistogram processing;
+    LatencyHistogram delivery;
+    LatencyHistogram display;
+
+};
+
+#endif // CAMERASTATISTICS_H
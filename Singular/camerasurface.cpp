@@ -18,39 +18,268 @@
 
 #include "camerasurface.h"
 #include "output.h"
+#include "settingsmanager.h"
+#include "colorconversion.h"
+#include "viewfindernegotiation.h"
+
+#include <QBuffer>
+#include <QImageReader>
+
+#include <cstring>
 
 /**
  * @brief CameraSurface::CameraSurface
- *      Connect this surface with the console and camera widget.
+ *      Prepares the surface, the camera itself is only created by 'start'.
  * @param new_id
  *      The ID of this camera.
+ * @param new_camera_info
+ *      The device, a null camera info creates a synthetic camera, see SyntheticCamera.
  * @param parent
- *      To parent this class and to use signals and slots.
+ *      To parent this class. Leave it empty when the surface is moved to a worker thread, in that case
+ *      the owner connects the signals and slots.
  */
 CameraSurface::CameraSurface(const int new_id, QCameraInfo new_camera_info, QObject *parent)
     : QAbstractVideoSurface(parent),
       id(new_id),
-      camera_info(new_camera_info)
+      sequence(0),
+      dropped_count(0),
+      visible(false),
+      recording(false),
+      start_pending(false),
+      processing_nsecs(0),
+      processed_frames(0),
+      skipped_frames(0),
+      pixel_bytes(0),
+      jpeg_scale(1),
+      camera(0),
+      synthetic(0),
+      camera_info(new_camera_info),
+      compressed_pool(0),
+      statistics(0),
+      preroll(0)
 {
-    connect(this, SIGNAL(image_data(int, QImage)), parent, SLOT(image_data(int, QImage)));
-    connect(this, SIGNAL(console(QString)), parent, SIGNAL(console(QString)));
+    //Frames are copied once into the pool and shared from there, the consumers hold the slots while they need them.
+    int slots = SettingsManager::read("Camera/FramePoolSlots", 4).toInt();
+
+    //The recorder queue holds frames of this pool as well.
+    if(SettingsManager::read("Camera/" + QString::number(id) + "/Record", SettingsManager::read("Recorder/Enabled", false)).toBool())
+    {
+        slots += SettingsManager::read("Recorder/QueueFrames", 3).toInt();
+    }
+
+    //And so does the pre-roll queue, the frames are compressed into its arena before the pipeline changes them.
+    if(SettingsManager::read("Camera/" + QString::number(id) + "/PreRoll", SettingsManager::read("PreRoll/Enabled", false)).toBool())
+    {
+        slots += SettingsManager::read("PreRoll/QueueFrames", 2).toInt();
+
+        preroll = new PreRollBuffer(id);
+        connect(preroll, SIGNAL(console(QString)), this, SIGNAL(console(QString)));
+        preroll->start();
+    }
+
+    //The mosaic mailbox holds up to two frames.
+    const bool mosaic = SettingsManager::read("Mosaic/Enabled", false).toBool();
 
-    //Initializes the camera.
-    camera = new QCamera(camera_info, this);
-    connect(camera, SIGNAL(stateChanged(QCamera::State)), SLOT(stateChanged(QCamera::State)));
+    if(mosaic)
+    {
+        slots += 2;
+    }
+
+    frame_pool = new FramePool(slots);
+
+    //MJPEG frames are decoded at 1/2, 1/4 or 1/8 of their size when set, directly by the JPEG decoder.
+    jpeg_scale = qBound(1, SettingsManager::read("Camera/" + QString::number(id) + "/JpegScale", SettingsManager::read("Camera/JpegScale", 1)).toInt(), 8);
+
+    //While hidden, one frame per interval is still delivered, 0 stops the delivery completely.
+    keep_alive_interval = SettingsManager::read("Camera/KeepAliveInterval", 1000).toInt();
+
+    //Only this region of the frame is copied, as "x,y,width,height" in pixels of the camera frame.
+    const QStringList roi_values = SettingsManager::read("Camera/" + QString::number(id) + "/Roi", "").toString().split(',');
+
+    if(roi_values.size() == 4)
+    {
+        roi = QRect(roi_values.at(0).toInt(), roi_values.at(1).toInt(), roi_values.at(2).toInt(), roi_values.at(3).toInt());
+    }
 
-    camera->setViewfinder(this);
+    //The mosaic shows the hidden cameras as well, they deliver at its frame rate.
+    if(mosaic)
+    {
+        const int mosaic_interval = 1000 / qBound(1, SettingsManager::read("Mosaic/FrameRate", 15).toInt(), 120);
+        keep_alive_interval = keep_alive_interval > 0 ? qMin(keep_alive_interval, mosaic_interval) : mosaic_interval;
+    }
+
+    //The stages run in the worker pool, the frames are delivered by the pipeline from there.
+    pipeline = new FramePipeline(id, this);
+    pipeline->load(SettingsManager::read("Camera/" + QString::number(id) + "/Pipeline", "").toString());
+
+    connect(pipeline, SIGNAL(console(QString)), this, SIGNAL(console(QString)));
+    connect(pipeline, SIGNAL(image_data(int,Frame)), this, SIGNAL(image_data(int,Frame)), Qt::DirectConnection);
+    connect(pipeline, SIGNAL(motion(int,QVector<int>,QRect)), this, SIGNAL(motion(int,QVector<int>,QRect)), Qt::DirectConnection);
+    connect(pipeline, SIGNAL(presence(int,bool,int)), this, SIGNAL(presence(int,bool,int)), Qt::DirectConnection);
+
+    if(preroll != 0 && SettingsManager::read("PreRoll/MotionTrigger", true).toBool())
+    {
+        connect(this, SIGNAL(motion(int,QVector<int>,QRect)), preroll, SLOT(motion_detected(int,QVector<int>,QRect)), Qt::DirectConnection);
+        connect(this, SIGNAL(presence(int,bool,int)), preroll, SLOT(presence_detected(int,bool,int)), Qt::DirectConnection);
+    }
+}
+
+/**
+ * @brief CameraSurface::~CameraSurface
+ *      Releases the frame pool, it is only freed once the consumers release the frames they still hold.
+ *      The pipeline is deleted first, it waits for the frame in flight, which is delivered through the signals of the surface.
+ *      The pre-roll buffer closes its event, if any, before its queue frames are released.
+ */
+CameraSurface::~CameraSurface()
+{
+    delete pipeline;
+    delete preroll;
+    frame_pool->release();
+
+    if(compressed_pool != 0)
+    {
+        compressed_pool->release();
+    }
 }
 
 /**
  * @brief CameraSurface::start
- *      Starts the camera interface.
+ *      Initializes and starts the camera interface.
+ *      The camera is created here and not in the constructor, so that it belongs to the thread of the surface.
+ *      Without camera info the surface is fed by a SyntheticCamera instead of a device.
+ *      When the surface lives in a worker thread, call this with a queued connection after moving it.
  */
-void CameraSurface::start() const
+void CameraSurface::start()
 {
+    keep_alive_timer.start();
+    hidden_timer.start();
+
+    if(camera_info.isNull())
+    {
+        if(synthetic == 0)
+        {
+            synthetic = new SyntheticCamera(id, this, this);
+            connect(synthetic, SIGNAL(console(QString)), this, SIGNAL(console(QString)));
+        }
+
+        synthetic->start();
+        return;
+    }
+
+    if(camera == 0)
+    {
+        camera = new QCamera(camera_info, this);
+        connect(camera, SIGNAL(stateChanged(QCamera::State)), SLOT(stateChanged(QCamera::State)));
+
+        camera->setViewfinder(this);
+    }
+
     if(camera->error() == QCamera::NoError)
     {
-        camera->start();
+        //The supported viewfinder settings are only known once the camera is loaded, it starts after the negotiation.
+        if(camera->state() == QCamera::UnloadedState)
+        {
+            start_pending = true;
+            camera->load();
+        }
+        else
+        {
+            camera->start();
+        }
+    }
+}
+
+/**
+ * @brief CameraSurface::negotiate_format
+ *      Chooses the resolution, frame rate and pixel format of the camera among the ones it supports.
+ *      The choice is saved per device, it is reused on the next start unless "Viewfinder/Renegotiate" is set
+ *      or the device no longer supports it. The cost of every candidate is logged.
+ * @remarks
+ *      "Viewfinder/Policy" is "fps" (default), "cost" or "resolution", see ViewfinderNegotiation.
+ *      "Viewfinder/TargetResolution" (default 1280x720) and "Viewfinder/MinimumFrameRate" (default 25) constrain the policies.
+ */
+void CameraSurface::negotiate_format()
+{
+    const QList<QVideoFrame::PixelFormat> pixel_formats = supportedPixelFormats();
+    QList<QCameraViewfinderSettings> candidates;
+
+    foreach(const QCameraViewfinderSettings &settings, camera->supportedViewfinderSettings())
+    {
+        if(pixel_formats.contains(settings.pixelFormat()) && !settings.resolution().isEmpty())
+        {
+            candidates.append(settings);
+        }
+    }
+
+    if(candidates.isEmpty())
+    {
+        output("The camera does not list its viewfinder settings, using its default.", 2);
+        return;
+    }
+
+    const QString key = "Camera/" + QString(camera_info.deviceName()).replace('/', '_').replace('\\', '_') + "/Viewfinder";
+    const QCameraViewfinderSettings saved = ViewfinderNegotiation::from_string(SettingsManager::read(key, "").toString());
+
+    QCameraViewfinderSettings chosen;
+
+    if(!saved.isNull() && !SettingsManager::read("Viewfinder/Renegotiate", false).toBool())
+    {
+        foreach(const QCameraViewfinderSettings &candidate, candidates)
+        {
+            if(candidate.resolution() == saved.resolution() && candidate.pixelFormat() == saved.pixelFormat() &&
+               qAbs(candidate.maximumFrameRate() - saved.maximumFrameRate()) < 0.5)
+            {
+                chosen = candidate;
+                break;
+            }
+        }
+    }
+
+    if(chosen.isNull())
+    {
+        const QString policy = SettingsManager::read("Viewfinder/Policy", "fps").toString().toLower();
+        const QStringList target_text = SettingsManager::read("Viewfinder/TargetResolution", "1280x720").toString().split('x');
+        const QSize target = target_text.size() == 2 ? QSize(target_text.at(0).toInt(), target_text.at(1).toInt()) : QSize();
+        const double minimum_frame_rate = SettingsManager::read("Viewfinder/MinimumFrameRate", 25).toDouble();
+
+        foreach(const QCameraViewfinderSettings &candidate, candidates)
+        {
+            const double cost = ViewfinderNegotiation::cost(candidate);
+
+            output("Viewfinder candidate " + ViewfinderNegotiation::to_string(candidate) + ": " +
+                   QString::number(cost / 1000000.0, 'f', 1) + " ms of CPU per second (" +
+                   QString::number(cost / 10000000.0, 'f', 1) + "% of a core).", 3);
+        }
+
+        chosen = ViewfinderNegotiation::choose(candidates, policy, target, minimum_frame_rate);
+        SettingsManager::write(key, ViewfinderNegotiation::to_string(chosen));
+
+        output("Viewfinder negotiated with policy " + policy + ": " + ViewfinderNegotiation::to_string(chosen) + ".", 2);
+    }
+    else
+    {
+        output("Viewfinder restored: " + ViewfinderNegotiation::to_string(chosen) + ".", 2);
+    }
+
+    camera->setViewfinderSettings(chosen);
+}
+
+/**
+ * @brief CameraSurface::set_affinity
+ *      Pins the thread of this surface to a CPU core.
+ *      This must run in the thread of the surface, call it with a queued connection.
+ * @param core
+ *      The core number, starting at 0.
+ */
+void CameraSurface::set_affinity(const int core) const
+{
+    if(Helper::set_thread_affinity(core))
+    {
+        output("Camera thread pinned to core " + QString::number(core) + ".", 3);
+    }
+    else
+    {
+        output("Could not pin the camera thread to core " + QString::number(core) + ".", 1);
     }
 }
 
@@ -72,6 +301,17 @@ bool CameraSurface::start(const QVideoSurfaceFormat &format)
         output("Starting video surface.", 1);
         QAbstractVideoSurface::start(format);
 
+        const QImage::Format image_format = QVideoFrame::imageFormatFromPixelFormat(format.pixelFormat());
+
+        //Bytes per pixel of the formats copied as they are, used to crop them. Formats below a byte per pixel are never cropped.
+        pixel_bytes = image_format != QImage::Format_Invalid ? QImage(1, 1, image_format).depth() / 8 : 0;
+
+        //The JPEGs have slots of their own, as many as the frames, since a frame can hold both.
+        if(format.pixelFormat() == QVideoFrame::Format_Jpeg && compressed_pool == 0)
+        {
+            compressed_pool = new FramePool(frame_pool->get_slot_count());
+        }
+
         result = true;
     }
     else
@@ -91,13 +331,28 @@ void CameraSurface::stop()
 {
     output("Stopping video surface.", 1);
     QAbstractVideoSurface::stop();
-    camera->stop();
+
+    if(camera != 0)
+    {
+        camera->stop();
+    }
+
+    if(synthetic != 0)
+    {
+        synthetic->stop();
+    }
 }
 
 /**
  * @brief CameraSurface::present
  *      Present the current frame.
  *      This function is called internally by the QCamera class.
+ *      The frame is copied once from the driver into a pool slot, and only then unmapped. The consumers share the slot,
+ *      so the data remains valid for as long as any of them holds the frame, whatever the connection type.
+ *      If all the slots are in use the consumers are behind, so the frame is dropped instead of allocating a new one.
+ *      When the camera has a pipeline the frame is submitted to it, and delivered by the pipeline once processed.
+ *      The frame is timestamped on arrival, the driver presentation time is kept as well.
+ *      With a region of interest only that region is copied and converted, so everything after it scales with its size.
  * @param frame
  *      The frame to be presented.
  * @return
@@ -107,22 +362,77 @@ bool CameraSurface::present(const QVideoFrame &frame)
  {
     bool result = false;
 
+    const qint64 capture_time = Frame::clock();
+
     if (frame.isValid() && surfaceFormat().pixelFormat() == frame.pixelFormat() && surfaceFormat().frameSize() == frame.size())
     {
         QVideoFrame clone_frame(frame);
 
-        if(clone_frame.map(QAbstractVideoBuffer::ReadOnly))
+        if(statistics != 0)
+        {
+            statistics->frame_captured();
+        }
+
+        if(skip_frame(capture_time))
+        {
+            result = true;
+        }
+        else if(clone_frame.map(QAbstractVideoBuffer::ReadOnly))
         {
+            Frame new_frame;
+            new_frame.capture_time = capture_time;
+            new_frame.start_time = clone_frame.startTime();
+
+            QElapsedTimer timer;
+            timer.start();
+
+            const bool copied = copy_frame(clone_frame, new_frame);
+            const qint64 conversion_nsecs = timer.nsecsElapsed();
+
+            processing_nsecs += conversion_nsecs;
+            processed_frames++;
+
+            if(statistics != 0)
+            {
+                statistics->frame_converted(conversion_nsecs);
+            }
 
-            QImage image(clone_frame.bits(),
-                         clone_frame.width(),
-                         clone_frame.height(),
-                         QVideoFrame::imageFormatFromPixelFormat(clone_frame.pixelFormat()));
+            if(copied)
+            {
+                clone_frame.unmap();
+                new_frame.sequence = ++sequence;
 
-            //Process image, if needed, before signal.
+                if(preroll != 0)
+                {
+                    preroll->submit(new_frame);
+                }
 
-            emit image_data(id, image);
-            clone_frame.unmap();
+                if(pipeline->is_empty())
+                {
+                    new_frame.processed_time = Frame::clock();
+
+                    if(statistics != 0)
+                    {
+                        statistics->frame_processed(new_frame);
+                    }
+
+                    emit image_data(id, new_frame);
+                }
+                else
+                {
+                    pipeline->submit(new_frame);
+                }
+            }
+            else
+            {
+                clone_frame.unmap();
+                dropped_count.ref();
+
+                if(statistics != 0)
+                {
+                    statistics->frame_dropped();
+                }
+            }
 
             result = true;
         }
@@ -137,9 +447,326 @@ bool CameraSurface::present(const QVideoFrame &frame)
     return result;
  }
 
+/**
+ * @brief CameraSurface::skip_frame
+ *      While the camera is not visible the frames are not mapped nor converted, except one per keep-alive interval.
+ *      A camera being recorded or with a pipeline always delivers every frame, so the analysis runs at the rate of the camera,
+ *      one with a pre-roll buffer delivers the frames the buffer keeps.
+ *      The camera keeps running, so it shows again without waiting for the device to restart.
+ * @param capture_time
+ *      The capture time of the frame.
+ * @return
+ *      True if the frame should be skipped.
+ */
+bool CameraSurface::skip_frame(const qint64 capture_time)
+{
+    bool result = false;
+
+    if(!visible && !recording && pipeline->is_empty() && (preroll == 0 || !preroll->is_due(capture_time)))
+    {
+        if(keep_alive_interval <= 0 || keep_alive_timer.elapsed() < keep_alive_interval)
+        {
+            skipped_frames++;
+            result = true;
+        }
+        else
+        {
+            keep_alive_timer.restart();
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief CameraSurface::copy_frame
+ *      Copies the mapped frame into a pool slot, this is the only copy of the frame.
+ *      The YUV formats are converted to RGB32 on the way, so the slot holds the display image and the driver memory is still only read once.
+ *      Only the region of interest is read, the planes are simply offset to its top left corner.
+ * @param mapped_frame
+ *      The frame, mapped for reading.
+ * @param new_frame
+ *      The frame to fill.
+ * @return
+ *      Success = true; Failed = false, all the pool slots are in use.
+ */
+bool CameraSurface::copy_frame(const QVideoFrame &mapped_frame, Frame &new_frame)
+{
+    const QVideoFrame::PixelFormat pixel_format = mapped_frame.pixelFormat();
+
+    if(pixel_format == QVideoFrame::Format_Jpeg)
+    {
+        return copy_jpeg(mapped_frame, new_frame);
+    }
+
+    const QRect region = crop_region(pixel_format, mapped_frame.width(), mapped_frame.height());
+    const int left = region.left();
+    const int top = region.top();
+    const int width = region.width();
+    const int height = region.height();
+
+    FrameBuffer buffer;
+
+    if(is_yuv(pixel_format))
+    {
+        const int stride = FramePool::aligned_bytes_per_line(width * 4);
+        buffer = frame_pool->acquire(stride * height);
+
+        if(!buffer.is_null())
+        {
+            //The region is aligned to the chroma, see crop_region.
+            const uchar *y_plane = mapped_frame.bits(0) + top * mapped_frame.bytesPerLine(0) + left;
+            const int chroma_offset = (top / 2) * mapped_frame.bytesPerLine(1) + left / 2;
+
+            switch(pixel_format)
+            {
+                case QVideoFrame::Format_YUV420P:
+                {
+                    ColorConversion::yuv420p_to_rgb32(y_plane, mapped_frame.bytesPerLine(0),
+                                                      mapped_frame.bits(1) + chroma_offset, mapped_frame.bits(2) + chroma_offset, mapped_frame.bytesPerLine(1),
+                                                      buffer.data(), stride, width, height);
+                    break;
+                }
+                case QVideoFrame::Format_YV12:
+                {
+                    ColorConversion::yuv420p_to_rgb32(y_plane, mapped_frame.bytesPerLine(0),
+                                                      mapped_frame.bits(2) + chroma_offset, mapped_frame.bits(1) + chroma_offset, mapped_frame.bytesPerLine(1),
+                                                      buffer.data(), stride, width, height);
+                    break;
+                }
+                case QVideoFrame::Format_NV12:
+                case QVideoFrame::Format_NV21:
+                {
+                    ColorConversion::nv12_to_rgb32(y_plane, mapped_frame.bytesPerLine(0),
+                                                   mapped_frame.bits(1) + (top / 2) * mapped_frame.bytesPerLine(1) + left, mapped_frame.bytesPerLine(1),
+                                                   pixel_format == QVideoFrame::Format_NV21,
+                                                   buffer.data(), stride, width, height);
+                    break;
+                }
+                case QVideoFrame::Format_YUYV:
+                case QVideoFrame::Format_UYVY:
+                {
+                    ColorConversion::yuyv_to_rgb32(mapped_frame.bits() + top * mapped_frame.bytesPerLine() + left * 2, mapped_frame.bytesPerLine(),
+                                                   pixel_format == QVideoFrame::Format_UYVY,
+                                                   buffer.data(), stride, width, height);
+                    break;
+                }
+                default:
+                {
+                    break;
+                }
+            }
+
+            new_frame.image = buffer.image(width, height, stride, QImage::Format_RGB32);
+        }
+    }
+    else if(region.size() == mapped_frame.size())
+    {
+        buffer = frame_pool->acquire(mapped_frame.mappedBytes());
+
+        if(!buffer.is_null())
+        {
+            std::memcpy(buffer.data(), mapped_frame.bits(), mapped_frame.mappedBytes());
+
+            new_frame.image = buffer.image(width,
+                                           height,
+                                           mapped_frame.bytesPerLine(),
+                                           QVideoFrame::imageFormatFromPixelFormat(pixel_format));
+        }
+    }
+    else
+    {
+        const QImage::Format image_format = QVideoFrame::imageFormatFromPixelFormat(pixel_format);
+        const int line_bytes = width * pixel_bytes;
+        const int stride = FramePool::aligned_bytes_per_line(line_bytes);
+
+        buffer = frame_pool->acquire(stride * height);
+
+        if(!buffer.is_null())
+        {
+            const uchar *source = mapped_frame.bits() + top * mapped_frame.bytesPerLine() + left * pixel_bytes;
+
+            for(int i = 0; i < height; i++)
+            {
+                std::memcpy(buffer.data() + i * stride, source + i * mapped_frame.bytesPerLine(), line_bytes);
+            }
+
+            new_frame.image = buffer.image(width, height, stride, image_format);
+        }
+    }
+
+    new_frame.buffer = buffer;
+    new_frame.region = region;
+
+    return !buffer.is_null();
+}
+
+/**
+ * @brief CameraSurface::copy_jpeg
+ *      Copies the JPEG of an MJPEG camera as it is into a slot of the compressed pool, and decodes it only if a consumer needs the pixels.
+ *      The recorder and the pre-roll buffer store the JPEG itself, so a camera that is only recorded never decodes.
+ * @param mapped_frame
+ *      The frame, mapped for reading.
+ * @param new_frame
+ *      The frame to fill.
+ * @return
+ *      Success = true; Failed = false, all the slots are in use or the JPEG could not be decoded.
+ */
+bool CameraSurface::copy_jpeg(const QVideoFrame &mapped_frame, Frame &new_frame)
+{
+    const int bytes = mapped_frame.mappedBytes();
+
+    FrameBuffer buffer = compressed_pool != 0 ? compressed_pool->acquire(bytes) : FrameBuffer();
+
+    if(buffer.is_null())
+    {
+        return false;
+    }
+
+    std::memcpy(buffer.data(), mapped_frame.bits(), bytes);
+
+    //Points into the slot, which the frame keeps alive.
+    new_frame.compressed = QByteArray::fromRawData(reinterpret_cast<const char*>(buffer.data()), bytes);
+    new_frame.compressed_buffer = buffer;
+    new_frame.region = crop_region(QVideoFrame::Format_Jpeg, mapped_frame.width(), mapped_frame.height());
+
+    return !decode_needed() || decode_jpeg(new_frame);
+}
+
+/**
+ * @brief CameraSurface::decode_jpeg
+ *      Decodes the JPEG of the frame into a slot of the frame pool.
+ *      Only the region of interest is decoded, and with "Camera/<id>/JpegScale" the decoder itself scales the image down (DCT scaling),
+ *      which skips most of the decoding work instead of scaling afterwards.
+ * @remarks
+ *      The image given to the reader already wraps the slot, the JPEG handler of Qt decodes into it when the size and format match.
+ *      Grayscale JPEGs get an image of their own.
+ * @param new_frame
+ *      The frame, with its JPEG.
+ * @return
+ *      Success = true; Failed = false, all the pool slots are in use or the JPEG is corrupt.
+ */
+bool CameraSurface::decode_jpeg(Frame &new_frame)
+{
+    QByteArray data(new_frame.compressed);
+    QBuffer device(&data);
+    device.open(QIODevice::ReadOnly);
+
+    QImageReader reader(&device, "jpeg");
+
+    const QRect &region = new_frame.region;
+    const QSize size(qMax(1, region.width() / jpeg_scale), qMax(1, region.height() / jpeg_scale));
+
+    if(region.size() != surfaceFormat().frameSize())
+    {
+        reader.setClipRect(region);
+    }
+
+    if(jpeg_scale > 1)
+    {
+        reader.setScaledSize(size);
+    }
+
+    const int stride = FramePool::aligned_bytes_per_line(size.width() * 4);
+    FrameBuffer buffer = frame_pool->acquire(stride * size.height());
+
+    if(buffer.is_null())
+    {
+        return false;
+    }
+
+    QImage image = buffer.image(size.width(), size.height(), stride, QImage::Format_RGB32);
+
+    if(!reader.read(&image))
+    {
+        output("JPEG decoding failed: " + reader.errorString(), 3);
+        return false;
+    }
+
+    new_frame.image = image;
+
+    if(image.constBits() == buffer.data())
+    {
+        new_frame.buffer = buffer;
+    }
+
+    return true;
+}
+
+/**
+ * @brief CameraSurface::decode_needed
+ *      An MJPEG frame is decoded when the camera is shown, when it has a pipeline, or when it is only delivered to be shown,
+ *      see skip_frame. A camera that is recorded or has a pre-roll buffer while hidden decodes one frame per keep-alive interval.
+ * @return
+ *      True if the frame needs its pixels.
+ */
+bool CameraSurface::decode_needed()
+{
+    bool result = visible || !pipeline->is_empty() || (!recording && preroll == 0);
+
+    if(!result && keep_alive_interval > 0 && keep_alive_timer.elapsed() >= keep_alive_interval)
+    {
+        keep_alive_timer.restart();
+        result = true;
+    }
+
+    return result;
+}
+
+/**
+ * @brief CameraSurface::crop_region
+ *      The region of interest clipped to the frame, the whole frame without one.
+ *      For the YUV formats it is aligned to even pixels, so it starts and ends on a chroma sample.
+ *      JPEGs are clipped by the decoder, any region works.
+ * @param pixel_format
+ *      The format of the camera.
+ * @param width
+ *      Width of the camera frame.
+ * @param height
+ *      Height of the camera frame.
+ * @return
+ *      The region to copy, in pixels of the camera frame.
+ */
+QRect CameraSurface::crop_region(const QVideoFrame::PixelFormat pixel_format, const int width, const int height) const
+{
+    const QRect frame_rect(0, 0, width, height);
+    QRect region = roi.intersected(frame_rect);
+
+    if(is_yuv(pixel_format))
+    {
+        region.setCoords(region.left() & ~1, region.top() & ~1, region.right() | 1, region.bottom() | 1);
+        region = region.intersected(frame_rect);
+    }
+    else if(pixel_bytes == 0 && pixel_format != QVideoFrame::Format_Jpeg)
+    {
+        region = QRect();
+    }
+
+    return region.isEmpty() ? frame_rect : region;
+}
+
+/**
+ * @brief CameraSurface::is_yuv
+ *      The YUV formats that are converted by the surface.
+ * @param pixel_format
+ *      The format of the camera.
+ * @return
+ *      True if the format is converted by ColorConversion.
+ */
+bool CameraSurface::is_yuv(const QVideoFrame::PixelFormat pixel_format)
+{
+    return pixel_format == QVideoFrame::Format_YUV420P ||
+           pixel_format == QVideoFrame::Format_YV12 ||
+           pixel_format == QVideoFrame::Format_NV12 ||
+           pixel_format == QVideoFrame::Format_NV21 ||
+           pixel_format == QVideoFrame::Format_YUYV ||
+           pixel_format == QVideoFrame::Format_UYVY;
+}
+
 /**
  * @brief CameraSurface::isFormatSupported
- *      The camera is only supported if there is a correspondent QImage format.
+ *      The camera is only supported if there is a correspondent QImage format, or if it is a YUV format converted by the surface,
+ *      or MJPEG.
  *      This function is called internally by the QCamera class.
  * @param format
  *      The format of the camera.
@@ -153,7 +780,7 @@ bool CameraSurface::isFormatSupported(const QVideoSurfaceFormat &format) const
     const QImage::Format image_format = QVideoFrame::imageFormatFromPixelFormat(format.pixelFormat());
     const QSize size = format.frameSize();
 
-    if(image_format != QImage::Format_Invalid && !size.isEmpty() && format.handleType() == QAbstractVideoBuffer::NoHandle)
+    if((image_format != QImage::Format_Invalid || is_yuv(format.pixelFormat()) || format.pixelFormat() == QVideoFrame::Format_Jpeg) && !size.isEmpty() && format.handleType() == QAbstractVideoBuffer::NoHandle)
     {
         result = true;
     }
@@ -177,6 +804,17 @@ QList<QVideoFrame::PixelFormat> CameraSurface::supportedPixelFormats(QAbstractVi
 
     if(handleType == QAbstractVideoBuffer::NoHandle)
     {
+        //Native formats of most cameras, converted by the surface. These come first so the driver does not convert them.
+        formats.append(QVideoFrame::Format_YUYV);
+        formats.append(QVideoFrame::Format_UYVY);
+        formats.append(QVideoFrame::Format_NV12);
+        formats.append(QVideoFrame::Format_NV21);
+        formats.append(QVideoFrame::Format_YUV420P);
+        formats.append(QVideoFrame::Format_YV12);
+
+        //Compressed, many USB cameras only reach their full resolution and frame rate in MJPEG. Decoded only when needed.
+        formats.append(QVideoFrame::Format_Jpeg);
+
         //Formats that have a QImage format equivalent.
         formats.append(QVideoFrame::Format_ARGB32);
         formats.append(QVideoFrame::Format_ARGB32_Premultiplied);
@@ -197,19 +835,12 @@ QList<QVideoFrame::PixelFormat> CameraSurface::supportedPixelFormats(QAbstractVi
 //        formats.append(QVideoFrame::Format_AYUV444);
 //        formats.append(QVideoFrame::Format_AYUV444_Premultiplied);
 //        formats.append(QVideoFrame::Format_YUV444);
-//        formats.append(QVideoFrame::Format_YUV420P);
-//        formats.append(QVideoFrame::Format_YV12);
-//        formats.append(QVideoFrame::Format_UYVY);
-//        formats.append(QVideoFrame::Format_YUYV);
-//        formats.append(QVideoFrame::Format_NV12);
-//        formats.append(QVideoFrame::Format_NV21);
 //        formats.append(QVideoFrame::Format_IMC1);
 //        formats.append(QVideoFrame::Format_IMC2);
 //        formats.append(QVideoFrame::Format_IMC3);
 //        formats.append(QVideoFrame::Format_IMC4);
 //        formats.append(QVideoFrame::Format_Y8);
 //        formats.append(QVideoFrame::Format_Y16);
-//        formats.append(QVideoFrame::Format_Jpeg);
 //        formats.append(QVideoFrame::Format_CameraRaw);
 //        formats.append(QVideoFrame::Format_AdobeDng);
 //        formats.append(QVideoFrame::Format_User);
@@ -220,6 +851,109 @@ QList<QVideoFrame::PixelFormat> CameraSurface::supportedPixelFormats(QAbstractVi
     return formats;
 }
 
+/**
+ * @brief CameraSurface::set_visible
+ *      Pauses or resumes the delivery of frames, called when the widget of this camera is hidden or shown.
+ *      When shown again, prints an estimate of the CPU saved while hidden, based on the average processing time of a frame.
+ *      This must run in the thread of the surface, use a queued connection.
+ * @param new_visible
+ *      True if the camera is visible.
+ */
+void CameraSurface::set_visible(const bool new_visible)
+{
+    if(new_visible == visible)
+    {
+        return;
+    }
+
+    visible = new_visible;
+
+    if(!visible)
+    {
+        skipped_frames = 0;
+        hidden_timer.restart();
+        keep_alive_timer.restart();
+
+        output("Camera hidden, frame delivery paused.", 3);
+    }
+    else if(processed_frames > 0)
+    {
+        const qint64 hidden_nsecs = qMax(hidden_timer.nsecsElapsed(), Q_INT64_C(1));
+        const qint64 saved_nsecs = skipped_frames * (processing_nsecs / processed_frames);
+
+        output("Camera visible after " + QString::number(hidden_nsecs / 1000000000.0, 'f', 1) + " s, " +
+               QString::number(skipped_frames) + " frames skipped, " +
+               QString::number(saved_nsecs / 1000000.0, 'f', 1) + " ms of CPU saved (" +
+               QString::number(saved_nsecs * 100.0 / hidden_nsecs, 'f', 1) + "% of a core).", 3);
+    }
+}
+
+/**
+ * @brief CameraSurface::set_recording
+ *      Keeps the frames flowing while hidden, the recorder needs all of them.
+ *      This must run in the thread of the surface, use a queued connection.
+ * @param new_recording
+ *      True if the camera is being recorded.
+ */
+void CameraSurface::set_recording(const bool new_recording)
+{
+    recording = new_recording;
+}
+
+/**
+ * @brief CameraSurface::set_roi
+ *      Changes the region of interest, from the next frame on.
+ *      This must run in the thread of the surface, use a queued connection.
+ * @param new_roi
+ *      The region in pixels of the camera frame, an empty one for the whole frame.
+ */
+void CameraSurface::set_roi(const QRect &new_roi)
+{
+    roi = new_roi.normalized();
+
+    output(roi.isEmpty() ? QString("Region of interest cleared.") :
+                           "Region of interest " + QString::number(roi.width()) + "x" + QString::number(roi.height()) +
+                           " at " + QString::number(roi.x()) + "," + QString::number(roi.y()) + ".", 3);
+}
+
+/**
+ * @brief CameraSurface::trigger_preroll
+ *      Writes the pre-roll of the camera to disk and keeps recording for a while. Thread safe.
+ *      Does nothing if the camera has no pre-roll buffer, see "Camera/<id>/PreRoll".
+ * @param reason
+ *      What triggered it, shown in the console.
+ */
+void CameraSurface::trigger_preroll(const QString &reason)
+{
+    if(preroll != 0)
+    {
+        preroll->trigger(reason);
+    }
+}
+
+/**
+ * @brief CameraSurface::set_statistics
+ *      Counters and latencies of this camera, shared with the pipeline and the widget.
+ *      Call it before the surface is started.
+ * @param new_statistics
+ *      The statistics, not owned.
+ */
+void CameraSurface::set_statistics(CameraStatistics *new_statistics)
+{
+    statistics = new_statistics;
+    pipeline->set_statistics(new_statistics);
+}
+
+/**
+ * @brief CameraSurface::get_dropped_count
+ * @return
+ *      Number of frames dropped because every pool slot was still held by the consumers.
+ */
+int CameraSurface::get_dropped_count() const
+{
+    return dropped_count.load();
+}
+
 /**
  * @brief AudioInputSurface::stateChanged
  *      Signal that displays the current state of the device.
@@ -238,6 +972,13 @@ void CameraSurface::stateChanged(QCamera::State state)
         case QCamera::LoadedState:
         {
             output("Camera device state: LoadedState", 3);
+
+            if(start_pending)
+            {
+                start_pending = false;
+                negotiate_format();
+                camera->start();
+            }
             break;
         }
         case QCamera::ActiveState:
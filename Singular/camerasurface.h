@@ -23,9 +23,16 @@
 #include <QCameraInfo>
 #include <QVideoFrame>
 #include <QVideoSurfaceFormat>
+#include <QElapsedTimer>
 #include <QAbstractVideoSurface>
 
 #include "defines.h"
+#include "frame.h"
+#include "framepool.h"
+#include "framepipeline.h"
+#include "syntheticcamera.h"
+#include "prerollbuffer.h"
+#include "camerastatistics.h"
 
 class CameraSurface : public QAbstractVideoSurface
 {
@@ -33,10 +40,9 @@ class CameraSurface : public QAbstractVideoSurface
 
 public_construct:
     explicit CameraSurface(const int new_id, QCameraInfo new_camera_info, QObject *parent = 0);
+    ~CameraSurface();
 
 public_methods:
-    void start() const;
-
     bool start(const QVideoSurfaceFormat &format);
     void stop();
     bool present(const QVideoFrame &frame);
@@ -44,22 +50,64 @@ public_methods:
     bool isFormatSupported(const QVideoSurfaceFormat &format) const;
     QList<QVideoFrame::PixelFormat> supportedPixelFormats(QAbstractVideoBuffer::HandleType handleType = QAbstractVideoBuffer::NoHandle) const;
 
+    int get_dropped_count() const;
+    void set_statistics(CameraStatistics *new_statistics);
+    void trigger_preroll(const QString &reason);
+
 private_methods:
+    void negotiate_format();
+    bool skip_frame(const qint64 capture_time);
+    bool copy_frame(const QVideoFrame &mapped_frame, Frame &new_frame);
+    bool copy_jpeg(const QVideoFrame &mapped_frame, Frame &new_frame);
+    bool decode_jpeg(Frame &new_frame);
+    bool decode_needed();
+    QRect crop_region(const QVideoFrame::PixelFormat pixel_format, const int width, const int height) const;
+    static bool is_yuv(const QVideoFrame::PixelFormat pixel_format);
     void output(const QString &message, const int verbose) const;
 
 private_members:
     int id;
+    quint64 sequence;
+    QAtomicInt dropped_count;
+
+    bool visible;
+    bool recording;
+    bool start_pending;
+    int keep_alive_interval;
+    qint64 processing_nsecs;
+    qint64 processed_frames;
+    qint64 skipped_frames;
+    QElapsedTimer keep_alive_timer;
+    QElapsedTimer hidden_timer;
+    QRect roi;
+    int pixel_bytes;
+    int jpeg_scale;
 
 private_data_members:
     QCamera* camera;
+    SyntheticCamera* synthetic;
     QCameraInfo camera_info;
+    FramePool* frame_pool;
+    FramePool* compressed_pool;
+    FramePipeline* pipeline;
+    CameraStatistics* statistics;
+    PreRollBuffer* preroll;
+
+public slots:
+    void start();
+    void set_affinity(const int core) const;
+    void set_visible(const bool new_visible);
+    void set_recording(const bool new_recording);
+    void set_roi(const QRect &new_roi);
 
 private slots:
     void stateChanged(QCamera::State state);
 
 signals:
     void console(const QString &message) const;
-    void image_data(const int id, const QImage new_frame) const;
+    void image_data(const int id, const Frame &new_frame) const;
+    void motion(const int id, const QVector<int> &scores, const QRect &box) const;
+    void presence(const int id, const bool present, const int foreground) const;
 
 };
 
@@ -18,32 +18,321 @@
 
 #include "camerawidget.h"
 #include "output.h"
+#include "glcameraview.h"
+#include "settingsmanager.h"
 
+#include <QtMath>
+#include <QGridLayout>
+#include <QMouseEvent>
 #include <QResizeEvent>
 
 /**
  * @brief CameraWidget::CameraWidget
  *      Connect the widget with the console.
+ *      Selects the renderer from the "Camera/Renderer" setting, "painter" (default) or "opengl".
+ *      The "Camera/Overlay" setting shows the statistics of the camera over the frame.
+ *      Dragging over the frame selects a region of interest, double clicking goes back to the whole frame.
  * @param parent
  *      To parent this class and to use signals and slots.
  */
 CameraWidget::CameraWidget(QWidget *parent) :
-    QWidget(parent)
+    QWidget(parent),
+    repaint_pending(0),
+    gl_view(0),
+    statistics(0)
 {
     connect(this, SIGNAL(console(QString)), parent, SIGNAL(console(QString)));
+
+    QGridLayout *layout = new QGridLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+
+    //Frame rate, drops and latencies of the camera on top of the frame.
+    overlay = SettingsManager::read("Camera/Overlay", true).toBool();
+
+    if(SettingsManager::read("Camera/Renderer", "painter").toString() == "opengl")
+    {
+        set_renderer(OpenGL);
+    }
+
     output("Camera widget started.", 1);
 }
 
+/**
+ * @brief CameraWidget::~CameraWidget
+ *      Unsubscribes from the broker of the camera, so no frame is posted to the widget once it is gone.
+ */
+CameraWidget::~CameraWidget()
+{
+    if(broker != 0)
+    {
+        broker->unsubscribe(this);
+    }
+}
+
 /**
  * @brief CameraWidget::update_frame
- *      Saves the new frame and updates the widget.
+ *      Posts the new frame to the mailbox and schedules a repaint.
+ *      This is called from the camera thread. At most one repaint is queued at any time, if painting falls behind
+ *      the newer frame simply replaces the older one in the mailbox, so nothing piles up in the event loop.
  * @param new_frame
  *      The new frame from the surface.
  */
-void CameraWidget::update_frame(const QImage new_frame)
+void CameraWidget::update_frame(const Frame &new_frame)
+{
+    Frame delivered_frame(new_frame);
+    delivered_frame.delivered_time = Frame::clock();
+
+    const bool superseded = mailbox.post(delivered_frame);
+
+    if(statistics != 0)
+    {
+        statistics->frame_delivered(delivered_frame);
+
+        if(superseded)
+        {
+            statistics->frame_dropped();
+        }
+    }
+
+    if(repaint_pending.testAndSetOrdered(0, 1))
+    {
+        QMetaObject::invokeMethod(this, "repaint_frame", Qt::QueuedConnection);
+    }
+}
+
+/**
+ * @brief CameraWidget::consume
+ *      Frames from the broker of the camera, see update_frame.
+ * @param frame
+ *      The new frame.
+ */
+void CameraWidget::consume(const Frame &frame)
+{
+    update_frame(frame);
+}
+
+/**
+ * @brief CameraWidget::take_frame
+ *      Takes the newest frame from the mailbox, used by the renderers when painting.
+ *      The pending flag is cleared before taking the frame, so a frame posted from now on schedules another repaint.
+ *      The frame is counted as painted here, the renderers take it right before drawing.
+ * @param new_frame
+ *      Receives the frame, untouched if there is nothing new.
+ * @return
+ *      True if there was a new frame.
+ */
+bool CameraWidget::take_frame(Frame &new_frame)
+{
+    repaint_pending.storeRelease(0);
+
+    const bool result = mailbox.take(new_frame);
+
+    if(result && statistics != 0)
+    {
+        statistics->frame_painted(new_frame);
+    }
+
+    //Kept for the overlay, the OpenGL renderer releases the frame right after the upload.
+    if(result && !new_frame.image_statistics.isNull())
+    {
+        image_statistics = new_frame.image_statistics;
+    }
+
+    //Kept to map a selection to the camera frame, the shown image is that region stretched to the widget.
+    if(result && new_frame.is_valid())
+    {
+        frame_region = new_frame.region.isEmpty() ? new_frame.image.rect() : new_frame.region;
+    }
+
+    return result;
+}
+
+/**
+ * @brief CameraWidget::set_statistics
+ * @param new_statistics
+ *      Counters and latencies of the camera, not owned.
+ */
+void CameraWidget::set_statistics(CameraStatistics *new_statistics)
+{
+    statistics = new_statistics;
+}
+
+/**
+ * @brief CameraWidget::set_broker
+ *      The broker the widget is subscribed to, the widget unsubscribes when it is deleted. Not owned.
+ * @param new_broker
+ *      The broker of the camera.
+ */
+void CameraWidget::set_broker(FrameBroker *new_broker)
+{
+    broker = new_broker;
+}
+
+/**
+ * @brief CameraWidget::draw_overlay
+ *      Draws the statistics on the top left corner, used by both renderers after the frame.
+ *      The rates are sampled and the text rebuilt once per second, not on every frame.
+ *      When the frames carry image statistics, the exposure and focus are added to the text
+ *      and the luma histogram is drawn on the bottom left corner.
+ *      The region being selected with the mouse is drawn even without the overlay.
+ * @param painter
+ *      Painter of the renderer.
+ */
+void CameraWidget::draw_overlay(QPainter &painter)
+{
+    if(!selection.isEmpty())
+    {
+        painter.setBrush(Qt::NoBrush);
+        painter.setPen(QPen(Qt::yellow, 1, Qt::DashLine));
+        painter.drawRect(selection);
+    }
+
+    if(!overlay || (statistics == 0 && image_statistics.isNull()))
+    {
+        return;
+    }
+
+    if(!overlay_timer.isValid() || overlay_timer.elapsed() >= 1000)
+    {
+        overlay_text.clear();
+
+        if(statistics != 0)
+        {
+            statistics->sample(CameraStatistics::Overlay);
+            overlay_text = statistics->get_summary();
+        }
+
+        if(!image_statistics.isNull())
+        {
+            overlay_text += QString(overlay_text.isEmpty() ? "" : "\n") + "Exposure " + QString::number(image_statistics->mean, 'f', 1) +
+                            " +/- " + QString::number(qSqrt(image_statistics->variance), 'f', 1) +
+                            ", focus " + QString::number(image_statistics->sharpness, 'f', 0);
+        }
+
+        overlay_timer.start();
+    }
+
+    const QRect text_rect = painter.boundingRect(QRect(8, 8, width() - 16, height() - 16), Qt::AlignLeft | Qt::AlignTop, overlay_text);
+
+    painter.fillRect(text_rect.adjusted(-4, -4, 4, 4), QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+    painter.drawText(text_rect, Qt::AlignLeft | Qt::AlignTop, overlay_text);
+
+    if(!image_statistics.isNull())
+    {
+        draw_histogram(painter, QRect(8, height() - 72, 256, 64));
+    }
+}
+
+/**
+ * @brief CameraWidget::draw_histogram
+ *      Draws the luma histogram of the last image statistics, scaled to its highest bucket.
+ * @param painter
+ *      Painter of the renderer.
+ * @param area
+ *      Where to draw it, 256 pixels wide shows one bucket per pixel.
+ */
+void CameraWidget::draw_histogram(QPainter &painter, const QRect &area)
+{
+    quint32 highest = 1;
+
+    for(int i = 0; i < 256; i++)
+    {
+        highest = qMax(highest, image_statistics->luma[i]);
+    }
+
+    QPolygonF polygon;
+    polygon.reserve(258);
+    polygon.append(QPointF(area.left(), area.bottom()));
+
+    for(int i = 0; i < 256; i++)
+    {
+        polygon.append(QPointF(area.left() + i * area.width() / 255.0,
+                               area.bottom() - static_cast<double>(image_statistics->luma[i]) * area.height() / highest));
+    }
+
+    polygon.append(QPointF(area.right(), area.bottom()));
+
+    painter.fillRect(area.adjusted(-4, -4, 4, 4), QColor(0, 0, 0, 160));
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QColor(255, 255, 255, 200));
+    painter.drawPolygon(polygon);
+    painter.setBrush(Qt::NoBrush);
+}
+
+/**
+ * @brief CameraWidget::set_renderer
+ *      Switches between the painter and the OpenGL renderer, this can be done at any time.
+ *      The OpenGL renderer is a child view that covers the widget, the painter renderer is the widget itself.
+ * @param new_renderer
+ *      The renderer.
+ */
+void CameraWidget::set_renderer(const Renderer new_renderer)
+{
+    if(new_renderer == OpenGL && gl_view == 0)
+    {
+        gl_view = new GLCameraView(this);
+        connect(gl_view, SIGNAL(failed()), this, SLOT(renderer_failed()), Qt::QueuedConnection);
+
+        layout()->addWidget(gl_view);
+        output("Camera renderer: OpenGL", 3);
+    }
+    else if(new_renderer == Painter && gl_view != 0)
+    {
+        layout()->removeWidget(gl_view);
+        gl_view->deleteLater();
+        gl_view = 0;
+
+        output("Camera renderer: Painter", 3);
+    }
+
+    repaint_frame();
+}
+
+/**
+ * @brief CameraWidget::get_renderer
+ * @return
+ *      The renderer in use.
+ */
+CameraWidget::Renderer CameraWidget::get_renderer() const
 {
-    frame = new_frame;
-    update();
+    return gl_view != 0 ? OpenGL : Painter;
+}
+
+/**
+ * @brief CameraWidget::repaint_frame
+ *      Schedules a paint on the renderer in use.
+ */
+void CameraWidget::repaint_frame()
+{
+    if(gl_view != 0)
+    {
+        gl_view->update();
+    }
+    else
+    {
+        update();
+    }
+}
+
+/**
+ * @brief CameraWidget::renderer_failed
+ *      The OpenGL renderer could not start, falls back to the painter.
+ */
+void CameraWidget::renderer_failed()
+{
+    output("OpenGL renderer not available, using the painter.", 1);
+    set_renderer(Painter);
+}
+
+/**
+ * @brief CameraWidget::get_superseded_count
+ * @return
+ *      Number of frames that were replaced in the mailbox before being painted.
+ */
+int CameraWidget::get_superseded_count() const
+{
+    return mailbox.get_superseded_count();
 }
 
 /**
@@ -54,17 +343,127 @@ void CameraWidget::update_frame(const QImage new_frame)
  */
 void CameraWidget::paintEvent(QPaintEvent *event)
 {
+    //The OpenGL view covers the widget and paints the frames itself.
+    if(gl_view != 0)
+    {
+        return;
+    }
+
+    take_frame(frame);
+
+    const QImage &image = frame.image;
+
     QPainter painter(this);
 
     //Paints the frame and handles resize on the widget, not the frame.
-    painter.drawImage(event->rect(), frame);
+    painter.drawImage(event->rect(), image);
 
     //Shows a border with the true size of the frame.
     painter.setBrush(Qt::CrossPattern);
     painter.setPen(Qt::red);
-    painter.drawRect(0, 0, frame.width(), frame.height());
+    painter.drawRect(0, 0, image.width(), image.height());
+
+    draw_overlay(painter);
+}
+
+/**
+ * @brief CameraWidget::showEvent
+ *      The camera is shown, the surface resumes delivering every frame.
+ * @param event
+ */
+void CameraWidget::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    emit visibility_changed(true);
+}
+
+/**
+ * @brief CameraWidget::hideEvent
+ *      The camera is hidden, e.g. another camera was selected, the surface stops converting frames.
+ * @param event
+ */
+void CameraWidget::hideEvent(QHideEvent *event)
+{
+    QWidget::hideEvent(event);
+    emit visibility_changed(false);
+}
+
+/**
+ * @brief CameraWidget::mousePressEvent
+ *      Starts selecting a region of interest.
+ * @param event
+ */
+void CameraWidget::mousePressEvent(QMouseEvent *event)
+{
+    if(event->button() == Qt::LeftButton)
+    {
+        selection_start = event->pos();
+        selection = QRect();
+    }
+}
+
+/**
+ * @brief CameraWidget::mouseMoveEvent
+ *      Updates the region being selected.
+ * @param event
+ */
+void CameraWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    if(event->buttons() & Qt::LeftButton)
+    {
+        selection = QRect(selection_start, event->pos()).normalized().intersected(rect());
+        repaint_frame();
+    }
 }
 
+/**
+ * @brief CameraWidget::mouseReleaseEvent
+ *      Maps the selection to the camera frame and emits it, see CameraSurface::set_roi.
+ *      The selection is relative to the region shown, so a region can be narrowed down again.
+ *      Tiny selections are taken as clicks and ignored.
+ * @param event
+ */
+void CameraWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    if(event->button() != Qt::LeftButton)
+    {
+        return;
+    }
+
+    if(selection.width() >= 8 && selection.height() >= 8 && !frame_region.isEmpty())
+    {
+        const double scale_x = static_cast<double>(frame_region.width()) / width();
+        const double scale_y = static_cast<double>(frame_region.height()) / height();
+
+        const QRect roi(frame_region.left() + qRound(selection.left() * scale_x),
+                        frame_region.top() + qRound(selection.top() * scale_y),
+                        qMax(1, qRound(selection.width() * scale_x)),
+                        qMax(1, qRound(selection.height() * scale_y)));
+
+        emit roi_selected(roi);
+    }
+
+    selection = QRect();
+    repaint_frame();
+}
+
+/**
+ * @brief CameraWidget::mouseDoubleClickEvent
+ *      Clears the region of interest, the camera goes back to the whole frame.
+ * @param event
+ */
+void CameraWidget::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    if(event->button() == Qt::LeftButton)
+    {
+        emit roi_selected(QRect());
+    }
+}
+
+/**
+ * @brief CameraWidget::output
+ *      Generic function responsible for all the outputs.
+ */
 void CameraWidget::output(const QString &message, const int verbose) const
 {
     if(Output::get_verbose() >= verbose)
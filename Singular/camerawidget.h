@@ -21,31 +21,85 @@
 
 #include <QWidget>
 #include <QPainter>
+#include <QElapsedTimer>
+#include <QPointer>
 
 #include "defines.h"
-#include "camerasurface.h"
+#include "frame.h"
+#include "framemailbox.h"
+#include "frameconsumer.h"
+#include "camerastatistics.h"
+#include "framebroker.h"
 
-class CameraWidget : public QWidget
+class GLCameraView;
+
+class CameraWidget : public QWidget, public FrameConsumer
 {
     Q_OBJECT
 
+public_enums:
+    enum Renderer
+    {
+        Painter,
+        OpenGL
+    };
+
 public_construct:
     explicit CameraWidget(QWidget *parent = 0);
+    ~CameraWidget();
 
 public_methods:
-    void update_frame(const QImage new_frame);
+    void update_frame(const Frame &new_frame);
+    void consume(const Frame &frame);
+    bool take_frame(Frame &new_frame);
+
+    void set_renderer(const Renderer new_renderer);
+    Renderer get_renderer() const;
+
+    int get_superseded_count() const;
+
+    void set_statistics(CameraStatistics *new_statistics);
+    void set_broker(FrameBroker *new_broker);
+    void draw_overlay(QPainter &painter);
 
 protected_methods:
     void paintEvent(QPaintEvent *event);
+    void showEvent(QShowEvent *event);
+    void hideEvent(QHideEvent *event);
+    void mousePressEvent(QMouseEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
+    void mouseDoubleClickEvent(QMouseEvent *event);
 
 private_methods:
+    void draw_histogram(QPainter &painter, const QRect &area);
     void output(const QString &message, const int verbose) const;
 
+private_members:
+    QAtomicInt repaint_pending;
+    bool overlay;
+    QString overlay_text;
+    QElapsedTimer overlay_timer;
+    QRect frame_region;
+    QPoint selection_start;
+    QRect selection;
+
 private_data_members:
-    QImage frame;
+    Frame frame;
+    QSharedPointer<const ImageStatistics> image_statistics;
+    FrameMailbox mailbox;
+    GLCameraView *gl_view;
+    CameraStatistics *statistics;
+    QPointer<FrameBroker> broker;
+
+private slots:
+    void repaint_frame();
+    void renderer_failed();
 
 signals:
     void console(const QString &message) const;
+    void visibility_changed(const bool visible) const;
+    void roi_selected(const QRect &roi) const;
 
 };
 
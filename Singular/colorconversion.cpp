@@ -0,0 +1,543 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "colorconversion.h"
+#include "simd.h"
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Kernels
+ *      Each format has a row kernel per instruction set, the vector kernels convert 16 pixels per step
+ *      and leave the remaining pixels of the row to the scalar kernel.
+ *      R = (75 * (Y - 16) + 102 * (V - 128) + 32) >> 6
+ *      G = (75 * (Y - 16) - 25 * (U - 128) - 52 * (V - 128) + 32) >> 6
+ *      B = (75 * (Y - 16) + 129 * (U - 128) + 32) >> 6
+ */
+namespace
+{
+    typedef void (*PlanarRow)(const uchar *y, const uchar *u, const uchar *v, uchar *destination, const int start, const int width);
+    typedef void (*SemiPlanarRow)(const uchar *y, const uchar *uv, const bool swap_uv, uchar *destination, const int start, const int width);
+    typedef void (*PackedRow)(const uchar *source, const bool uyvy, uchar *destination, const int start, const int width);
+
+    inline uchar clamp(const int value)
+    {
+        return static_cast<uchar>(value < 0 ? 0 : (value > 255 ? 255 : value));
+    }
+
+    inline void pixel(const int y, const int u, const int v, uchar *destination)
+    {
+        const int luma = 75 * (y - 16) + 32;
+        const int cb = u - 128;
+        const int cr = v - 128;
+
+        destination[0] = clamp((luma + 129 * cb) >> 6);
+        destination[1] = clamp((luma - 25 * cb - 52 * cr) >> 6);
+        destination[2] = clamp((luma + 102 * cr) >> 6);
+        destination[3] = 255;
+    }
+
+    void planar_row_scalar(const uchar *y, const uchar *u, const uchar *v, uchar *destination, const int start, const int width)
+    {
+        for(int x = start; x < width; x++)
+        {
+            pixel(y[x], u[x / 2], v[x / 2], destination + x * 4);
+        }
+    }
+
+    void semi_planar_row_scalar(const uchar *y, const uchar *uv, const bool swap_uv, uchar *destination, const int start, const int width)
+    {
+        const int u_offset = swap_uv ? 1 : 0;
+        const int v_offset = swap_uv ? 0 : 1;
+
+        for(int x = start; x < width; x++)
+        {
+            const int chroma = (x / 2) * 2;
+            pixel(y[x], uv[chroma + u_offset], uv[chroma + v_offset], destination + x * 4);
+        }
+    }
+
+    void packed_row_scalar(const uchar *source, const bool uyvy, uchar *destination, const int start, const int width)
+    {
+        const int y_offset = uyvy ? 1 : 0;
+        const int u_offset = uyvy ? 0 : 1;
+        const int v_offset = uyvy ? 2 : 3;
+
+        for(int x = start; x < width; x++)
+        {
+            const uchar *macropixel = source + (x / 2) * 4;
+            pixel(source[x * 2 + y_offset], macropixel[u_offset], macropixel[v_offset], destination + x * 4);
+        }
+    }
+
+#if defined(simd_x86)
+    /**
+     * Converts 8 pixels, the inputs are 16 bit lanes with the chroma already centered on zero.
+     */
+    inline void store_sse2(const __m128i y, const __m128i u, const __m128i v, uchar *destination)
+    {
+        const __m128i luma = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)), _mm_set1_epi16(75)), _mm_set1_epi16(32));
+
+        const __m128i r = _mm_srai_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(v, _mm_set1_epi16(102))), 6);
+        const __m128i g = _mm_srai_epi16(_mm_subs_epi16(_mm_subs_epi16(luma, _mm_mullo_epi16(u, _mm_set1_epi16(25))),
+                                                        _mm_mullo_epi16(v, _mm_set1_epi16(52))), 6);
+        const __m128i b = _mm_srai_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(u, _mm_set1_epi16(129))), 6);
+
+        const __m128i br = _mm_packus_epi16(b, r);
+        const __m128i ga = _mm_packus_epi16(g, _mm_set1_epi16(255));
+        const __m128i bg = _mm_unpacklo_epi8(br, ga);
+        const __m128i ra = _mm_unpackhi_epi8(br, ga);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + 16), _mm_unpackhi_epi16(bg, ra));
+    }
+
+    void planar_row_sse2(const uchar *y, const uchar *u, const uchar *v, uchar *destination, const int start, const int width)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i bias = _mm_set1_epi16(128);
+
+        int x = start;
+        for(; x + 16 <= width; x += 16)
+        {
+            const __m128i luma = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+            __m128i cb = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x / 2));
+            __m128i cr = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x / 2));
+
+            cb = _mm_unpacklo_epi8(cb, cb);
+            cr = _mm_unpacklo_epi8(cr, cr);
+
+            store_sse2(_mm_unpacklo_epi8(luma, zero),
+                       _mm_sub_epi16(_mm_unpacklo_epi8(cb, zero), bias),
+                       _mm_sub_epi16(_mm_unpacklo_epi8(cr, zero), bias),
+                       destination + x * 4);
+
+            store_sse2(_mm_unpackhi_epi8(luma, zero),
+                       _mm_sub_epi16(_mm_unpackhi_epi8(cb, zero), bias),
+                       _mm_sub_epi16(_mm_unpackhi_epi8(cr, zero), bias),
+                       destination + x * 4 + 32);
+        }
+
+        planar_row_scalar(y, u, v, destination, x, width);
+    }
+
+    void semi_planar_row_sse2(const uchar *y, const uchar *uv, const bool swap_uv, uchar *destination, const int start, const int width)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i bias = _mm_set1_epi16(128);
+        const __m128i low_mask = _mm_set1_epi16(0x00ff);
+
+        int x = start;
+        for(; x + 16 <= width; x += 16)
+        {
+            const __m128i luma = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+            const __m128i chroma = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + x));
+
+            __m128i cb = _mm_sub_epi16(_mm_and_si128(chroma, low_mask), bias);
+            __m128i cr = _mm_sub_epi16(_mm_srli_epi16(chroma, 8), bias);
+
+            if(swap_uv)
+            {
+                const __m128i swap = cb;
+                cb = cr;
+                cr = swap;
+            }
+
+            store_sse2(_mm_unpacklo_epi8(luma, zero), _mm_unpacklo_epi16(cb, cb), _mm_unpacklo_epi16(cr, cr), destination + x * 4);
+            store_sse2(_mm_unpackhi_epi8(luma, zero), _mm_unpackhi_epi16(cb, cb), _mm_unpackhi_epi16(cr, cr), destination + x * 4 + 32);
+        }
+
+        semi_planar_row_scalar(y, uv, swap_uv, destination, x, width);
+    }
+
+    void packed_row_sse2(const uchar *source, const bool uyvy, uchar *destination, const int start, const int width)
+    {
+        const __m128i bias = _mm_set1_epi16(128);
+        const __m128i low_mask = _mm_set1_epi16(0x00ff);
+
+        int x = start;
+        for(; x + 16 <= width; x += 16)
+        {
+            for(int half = 0; half < 2; half++)
+            {
+                const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x * 2 + half * 16));
+
+                const __m128i luma = uyvy ? _mm_srli_epi16(pixels, 8) : _mm_and_si128(pixels, low_mask);
+                const __m128i chroma = _mm_sub_epi16(uyvy ? _mm_and_si128(pixels, low_mask) : _mm_srli_epi16(pixels, 8), bias);
+
+                //Chroma is U0 V0 U1 V1 U2 V2 U3 V3, each U and V is shared by two pixels.
+                const __m128i cb = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chroma, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+                const __m128i cr = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chroma, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+
+                store_sse2(luma, cb, cr, destination + x * 4 + half * 32);
+            }
+        }
+
+        packed_row_scalar(source, uyvy, destination, x, width);
+    }
+
+    /**
+     * Converts 16 pixels. The pack and unpack instructions work within each 128 bit lane, so the two
+     * halves are put back in order with a lane permute before the store.
+     */
+    simd_avx2_target inline void store_avx2(const __m256i y, const __m256i u, const __m256i v, uchar *destination)
+    {
+        const __m256i luma = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(16)), _mm256_set1_epi16(75)), _mm256_set1_epi16(32));
+
+        const __m256i r = _mm256_srai_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(v, _mm256_set1_epi16(102))), 6);
+        const __m256i g = _mm256_srai_epi16(_mm256_subs_epi16(_mm256_subs_epi16(luma, _mm256_mullo_epi16(u, _mm256_set1_epi16(25))),
+                                                              _mm256_mullo_epi16(v, _mm256_set1_epi16(52))), 6);
+        const __m256i b = _mm256_srai_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(u, _mm256_set1_epi16(129))), 6);
+
+        const __m256i br = _mm256_packus_epi16(b, r);
+        const __m256i ga = _mm256_packus_epi16(g, _mm256_set1_epi16(255));
+        const __m256i bg = _mm256_unpacklo_epi8(br, ga);
+        const __m256i ra = _mm256_unpackhi_epi8(br, ga);
+        const __m256i low = _mm256_unpacklo_epi16(bg, ra);
+        const __m256i high = _mm256_unpackhi_epi16(bg, ra);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), _mm256_permute2x128_si256(low, high, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + 32), _mm256_permute2x128_si256(low, high, 0x31));
+    }
+
+    simd_avx2_target void planar_row_avx2(const uchar *y, const uchar *u, const uchar *v, uchar *destination, const int start, const int width)
+    {
+        const __m256i bias = _mm256_set1_epi16(128);
+
+        int x = start;
+        for(; x + 16 <= width; x += 16)
+        {
+            const __m256i luma = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x)));
+            const __m128i cb = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x / 2));
+            const __m128i cr = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x / 2));
+
+            store_avx2(luma,
+                       _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cb, cb)), bias),
+                       _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cr, cr)), bias),
+                       destination + x * 4);
+        }
+
+        planar_row_scalar(y, u, v, destination, x, width);
+    }
+
+    simd_avx2_target void semi_planar_row_avx2(const uchar *y, const uchar *uv, const bool swap_uv, uchar *destination, const int start, const int width)
+    {
+        const __m256i bias = _mm256_set1_epi16(128);
+        const __m128i even = _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6, 8, 8, 10, 10, 12, 12, 14, 14);
+        const __m128i odd = _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15);
+        const __m128i u_mask = swap_uv ? odd : even;
+        const __m128i v_mask = swap_uv ? even : odd;
+
+        int x = start;
+        for(; x + 16 <= width; x += 16)
+        {
+            const __m256i luma = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x)));
+            const __m128i chroma = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + x));
+
+            store_avx2(luma,
+                       _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_shuffle_epi8(chroma, u_mask)), bias),
+                       _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_shuffle_epi8(chroma, v_mask)), bias),
+                       destination + x * 4);
+        }
+
+        semi_planar_row_scalar(y, uv, swap_uv, destination, x, width);
+    }
+
+    simd_avx2_target void packed_row_avx2(const uchar *source, const bool uyvy, uchar *destination, const int start, const int width)
+    {
+        const __m256i bias = _mm256_set1_epi16(128);
+        const __m128i y_mask = uyvy ? _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, -1, -1, -1, -1, -1, -1, -1, -1)
+                                    : _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i u_mask = uyvy ? _mm_setr_epi8(0, 0, 4, 4, 8, 8, 12, 12, -1, -1, -1, -1, -1, -1, -1, -1)
+                                    : _mm_setr_epi8(1, 1, 5, 5, 9, 9, 13, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i v_mask = uyvy ? _mm_setr_epi8(2, 2, 6, 6, 10, 10, 14, 14, -1, -1, -1, -1, -1, -1, -1, -1)
+                                    : _mm_setr_epi8(3, 3, 7, 7, 11, 11, 15, 15, -1, -1, -1, -1, -1, -1, -1, -1);
+
+        int x = start;
+        for(; x + 16 <= width; x += 16)
+        {
+            const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x * 2));
+            const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x * 2 + 16));
+
+            const __m128i luma = _mm_unpacklo_epi64(_mm_shuffle_epi8(first, y_mask), _mm_shuffle_epi8(second, y_mask));
+            const __m128i cb = _mm_unpacklo_epi64(_mm_shuffle_epi8(first, u_mask), _mm_shuffle_epi8(second, u_mask));
+            const __m128i cr = _mm_unpacklo_epi64(_mm_shuffle_epi8(first, v_mask), _mm_shuffle_epi8(second, v_mask));
+
+            store_avx2(_mm256_cvtepu8_epi16(luma),
+                       _mm256_sub_epi16(_mm256_cvtepu8_epi16(cb), bias),
+                       _mm256_sub_epi16(_mm256_cvtepu8_epi16(cr), bias),
+                       destination + x * 4);
+        }
+
+        packed_row_scalar(source, uyvy, destination, x, width);
+    }
+#endif
+
+    PlanarRow planar_row()
+    {
+        PlanarRow row = planar_row_scalar;
+
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                row = planar_row_avx2;
+                break;
+            }
+            case Simd::SSE2:
+            {
+                row = planar_row_sse2;
+                break;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        return row;
+    }
+
+    SemiPlanarRow semi_planar_row()
+    {
+        SemiPlanarRow row = semi_planar_row_scalar;
+
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                row = semi_planar_row_avx2;
+                break;
+            }
+            case Simd::SSE2:
+            {
+                row = semi_planar_row_sse2;
+                break;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        return row;
+    }
+
+    PackedRow packed_row()
+    {
+        PackedRow row = packed_row_scalar;
+
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                row = packed_row_avx2;
+                break;
+            }
+            case Simd::SSE2:
+            {
+                row = packed_row_sse2;
+                break;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        return row;
+    }
+}
+
+/**
+ * @brief ColorConversion::yuv420p_to_rgb32
+ *      Converts a planar 4:2:0 frame (YUV420P, or YV12 by swapping the chroma planes).
+ * @param y_plane
+ *      Luma plane.
+ * @param y_stride
+ *      Bytes per line of the luma plane.
+ * @param u_plane
+ *      Cb plane.
+ * @param v_plane
+ *      Cr plane.
+ * @param uv_stride
+ *      Bytes per line of the chroma planes.
+ * @param destination
+ *      RGB32 output.
+ * @param destination_stride
+ *      Bytes per line of the output.
+ * @param width
+ *      Width in pixels.
+ * @param height
+ *      Height in pixels.
+ */
+void ColorConversion::yuv420p_to_rgb32(const uchar *y_plane, const int y_stride,
+                                       const uchar *u_plane, const uchar *v_plane, const int uv_stride,
+                                       uchar *destination, const int destination_stride,
+                                       const int width, const int height)
+{
+    const PlanarRow row = planar_row();
+
+    for(int i = 0; i < height; i++)
+    {
+        row(y_plane + i * y_stride,
+            u_plane + (i / 2) * uv_stride,
+            v_plane + (i / 2) * uv_stride,
+            destination + i * destination_stride,
+            0, width);
+    }
+}
+
+/**
+ * @brief ColorConversion::nv12_to_rgb32
+ *      Converts a semi-planar 4:2:0 frame, the chroma plane has interleaved Cb and Cr (NV12) or Cr and Cb (NV21).
+ * @param y_plane
+ *      Luma plane.
+ * @param y_stride
+ *      Bytes per line of the luma plane.
+ * @param uv_plane
+ *      Interleaved chroma plane.
+ * @param uv_stride
+ *      Bytes per line of the chroma plane.
+ * @param swap_uv
+ *      True for NV21.
+ * @param destination
+ *      RGB32 output.
+ * @param destination_stride
+ *      Bytes per line of the output.
+ * @param width
+ *      Width in pixels.
+ * @param height
+ *      Height in pixels.
+ */
+void ColorConversion::nv12_to_rgb32(const uchar *y_plane, const int y_stride,
+                                    const uchar *uv_plane, const int uv_stride, const bool swap_uv,
+                                    uchar *destination, const int destination_stride,
+                                    const int width, const int height)
+{
+    const SemiPlanarRow row = semi_planar_row();
+
+    for(int i = 0; i < height; i++)
+    {
+        row(y_plane + i * y_stride,
+            uv_plane + (i / 2) * uv_stride,
+            swap_uv,
+            destination + i * destination_stride,
+            0, width);
+    }
+}
+
+/**
+ * @brief ColorConversion::yuyv_to_rgb32
+ *      Converts a packed 4:2:2 frame, Y0 U Y1 V (YUYV) or U Y0 V Y1 (UYVY).
+ * @param source
+ *      Packed frame.
+ * @param source_stride
+ *      Bytes per line of the frame.
+ * @param uyvy
+ *      True for UYVY.
+ * @param destination
+ *      RGB32 output.
+ * @param destination_stride
+ *      Bytes per line of the output.
+ * @param width
+ *      Width in pixels.
+ * @param height
+ *      Height in pixels.
+ */
+void ColorConversion::yuyv_to_rgb32(const uchar *source, const int source_stride, const bool uyvy,
+                                    uchar *destination, const int destination_stride,
+                                    const int width, const int height)
+{
+    const PackedRow row = packed_row();
+
+    for(int i = 0; i < height; i++)
+    {
+        row(source + i * source_stride, uyvy, destination + i * destination_stride, 0, width);
+    }
+}
+
+/**
+ * @brief ColorConversion::rgb32_to_yuv420p
+ *      Converts an RGB32 frame to planar 4:2:0, BT.601 limited range in 8 bit fixed point.
+ *      Each chroma sample is taken from the average of its 2x2 block, the last column and line are repeated when the size is odd.
+ *      Only used by the recorder thread, so it is not vectorized.
+ * @param source
+ *      RGB32 input.
+ * @param source_stride
+ *      Bytes per line of the input.
+ * @param y_plane
+ *      Luma output.
+ * @param y_stride
+ *      Bytes per line of the luma plane.
+ * @param u_plane
+ *      Cb output, (width + 1) / 2 by (height + 1) / 2.
+ * @param v_plane
+ *      Cr output, same size as Cb.
+ * @param uv_stride
+ *      Bytes per line of the chroma planes.
+ * @param width
+ *      Width in pixels.
+ * @param height
+ *      Height in pixels.
+ */
+void ColorConversion::rgb32_to_yuv420p(const uchar *source, const int source_stride,
+                                       uchar *y_plane, const int y_stride,
+                                       uchar *u_plane, uchar *v_plane, const int uv_stride,
+                                       const int width, const int height)
+{
+    for(int i = 0; i < height; i++)
+    {
+        const uchar *line = source + i * source_stride;
+        uchar *y = y_plane + i * y_stride;
+
+        for(int x = 0; x < width; x++)
+        {
+            const uchar *pixel = line + x * 4;
+            y[x] = static_cast<uchar>(((66 * pixel[2] + 129 * pixel[1] + 25 * pixel[0] + 128) >> 8) + 16);
+        }
+    }
+
+    for(int i = 0; i < (height + 1) / 2; i++)
+    {
+        const uchar *line0 = source + (2 * i) * source_stride;
+        const uchar *line1 = source + qMin(2 * i + 1, height - 1) * source_stride;
+        uchar *u = u_plane + i * uv_stride;
+        uchar *v = v_plane + i * uv_stride;
+
+        for(int x = 0; x < (width + 1) / 2; x++)
+        {
+            const int left = 2 * x * 4;
+            const int right = qMin(2 * x + 1, width - 1) * 4;
+
+            const int b = line0[left] + line0[right] + line1[left] + line1[right];
+            const int g = line0[left + 1] + line0[right + 1] + line1[left + 1] + line1[right + 1];
+            const int r = line0[left + 2] + line0[right + 2] + line1[left + 2] + line1[right + 2];
+
+            u[x] = static_cast<uchar>(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+            v[x] = static_cast<uchar>(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+        }
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLORCONVERSION_H
+#define COLORCONVERSION_H
+
+#include <QtGlobal>
+
+/**
+ * @brief The ColorConversion namespace
+ *      Converts the YUV formats delivered by the cameras to RGB32, written directly into the display buffer,
+ *      and RGB32 back to planar YUV for the recorder.
+ *      Uses BT.601 limited range, the same as the drivers, in 6 bit fixed point so the scalar and vector versions match.
+ * @remarks
+ *      The output is QImage::Format_RGB32, that is B, G, R, A in memory.
+ *      The chroma of the planar and semi-planar formats is subsampled by two in both directions (4:2:0),
+ *      the packed formats are subsampled by two horizontally (4:2:2).
+ */
+namespace ColorConversion
+{
+    void yuv420p_to_rgb32(const uchar *y_plane, const int y_stride,
+                          const uchar *u_plane, const uchar *v_plane, const int uv_stride,
+                          uchar *destination, const int destination_stride,
+                          const int width, const int height);
+
+    void nv12_to_rgb32(const uchar *y_plane, const int y_stride,
+                       const uchar *uv_plane, const int uv_stride, const bool swap_uv,
+                       uchar *destination, const int destination_stride,
+                       const int width, const int height);
+
+    void yuyv_to_rgb32(const uchar *source, const int source_stride, const bool uyvy,
+                       uchar *destination, const int destination_stride,
+                       const int width, const int height);
+
+    void rgb32_to_yuv420p(const uchar *source, const int source_stride,
+                          uchar *y_plane, const int y_stride,
+                          uchar *u_plane, uchar *v_plane, const int uv_stride,
+                          const int width, const int height);
+}
+
+#endif // COLORCONVERSION_H
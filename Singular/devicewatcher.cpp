@@ -0,0 +1,196 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "devicewatcher.h"
+#include "output.h"
+#include "settingsmanager.h"
+
+/**
+ * @brief DeviceWatcher::DeviceWatcher
+ *      Starts from the devices the owner already has, only the differences to them are reported.
+ * @param new_cameras
+ *      Device names of the cameras in use.
+ * @param new_microphones
+ *      Device names of the microphones listed.
+ * @param parent
+ *      To parent this class.
+ */
+DeviceWatcher::DeviceWatcher(const QStringList &new_cameras, const QStringList &new_microphones, QObject *parent)
+    : QObject(parent),
+      cameras(new_cameras),
+      microphones(new_microphones),
+      timer(0)
+{
+    interval = qMax(100, SettingsManager::read("Devices/PollInterval", 2000).toInt());
+}
+
+/**
+ * @brief DeviceWatcher::start
+ *      Starts polling. The timer is created here so it belongs to the thread of the watcher,
+ *      call this with a queued connection after moving it.
+ */
+void DeviceWatcher::start()
+{
+    if(timer == 0)
+    {
+        timer = new QTimer(this);
+        connect(timer, SIGNAL(timeout()), this, SLOT(poll()));
+    }
+
+    timer->start(interval);
+}
+
+/**
+ * @brief DeviceWatcher::stop
+ *      Stops polling.
+ */
+void DeviceWatcher::stop()
+{
+    if(timer != 0)
+    {
+        timer->stop();
+    }
+}
+
+/**
+ * @brief DeviceWatcher::take_changes
+ *      Takes the changes gathered so far, called by the owner after 'devices_changed'. Thread safe.
+ * @return
+ *      The changes, empty if there is nothing new.
+ */
+DeviceWatcher::Changes DeviceWatcher::take_changes()
+{
+    QMutexLocker locker(&mutex);
+
+    const Changes result = changes;
+    changes = Changes();
+
+    return result;
+}
+
+/**
+ * @brief DeviceWatcher::poll
+ *      Lists the devices and compares them with the previous list.
+ */
+void DeviceWatcher::poll()
+{
+    const QList<QCameraInfo> camera_list = QCameraInfo::availableCameras();
+    const QList<QAudioDeviceInfo> microphone_list = QAudioDeviceInfo::availableDevices(QAudio::AudioInput);
+
+    QStringList new_cameras;
+    QStringList new_microphones;
+
+    for(int i = 0; i < camera_list.size(); i++)
+    {
+        new_cameras.append(camera_list.at(i).deviceName());
+    }
+
+    for(int i = 0; i < microphone_list.size(); i++)
+    {
+        new_microphones.append(microphone_list.at(i).deviceName());
+    }
+
+    if(new_cameras == cameras && new_microphones == microphones)
+    {
+        return;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+
+        for(int i = 0; i < cameras.size(); i++)
+        {
+            if(!new_cameras.contains(cameras.at(i)))
+            {
+                output("Camera removed: " + cameras.at(i), 2);
+                changes.removed_cameras.append(cameras.at(i));
+
+                for(int j = changes.added_cameras.size() - 1; j >= 0; j--)
+                {
+                    if(changes.added_cameras.at(j).deviceName() == cameras.at(i))
+                    {
+                        changes.added_cameras.removeAt(j);
+                    }
+                }
+            }
+        }
+
+        for(int i = 0; i < camera_list.size(); i++)
+        {
+            if(!cameras.contains(new_cameras.at(i)))
+            {
+                output("Camera added: " + new_cameras.at(i), 2);
+                changes.added_cameras.append(camera_list.at(i));
+            }
+        }
+
+        for(int i = 0; i < microphones.size(); i++)
+        {
+            if(!new_microphones.contains(microphones.at(i)))
+            {
+                output("Microphone removed: " + microphones.at(i), 2);
+                changes.removed_microphones.append(microphones.at(i));
+
+                for(int j = changes.added_microphones.size() - 1; j >= 0; j--)
+                {
+                    if(changes.added_microphones.at(j).deviceName() == microphones.at(i))
+                    {
+                        changes.added_microphones.removeAt(j);
+                    }
+                }
+            }
+        }
+
+        for(int i = 0; i < microphone_list.size(); i++)
+        {
+            if(!microphones.contains(new_microphones.at(i)))
+            {
+                output("Microphone added: " + new_microphones.at(i), 2);
+                changes.added_microphones.append(microphone_list.at(i));
+            }
+        }
+    }
+
+    cameras = new_cameras;
+    microphones = new_microphones;
+
+    emit devices_changed();
+}
+
+/**
+ * @brief DeviceWatcher::output
+ *      Generic function responsible for all the outputs.
+ */
+void DeviceWatcher::output(const QString &message, const int verbose) const
+{
+    if(Output::get_verbose() >= verbose)
+    {
+        QVariantHash data;
+        data.insert("message", message);
+        data.insert("verbose", verbose);
+        data.insert("load_thread_id", true);
+
+        QString print = Output::builder(data);
+
+        if(!print.isEmpty())
+        {
+            emit console(print);
+        }
+    }
+}
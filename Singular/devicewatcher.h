@@ -0,0 +1,92 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DEVICEWATCHER_H
+#define DEVICEWATCHER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QMutex>
+#include <QStringList>
+#include <QCameraInfo>
+#include <QAudioDeviceInfo>
+
+#include "defines.h"
+
+/**
+ * @brief The DeviceWatcher class
+ *      Detects cameras and microphones that are plugged in or removed while running.
+ *      The devices are listed periodically on the thread of the watcher and compared with the previous list,
+ *      the enumeration can take a while and never runs on the GUI thread.
+ * @remarks
+ *      The changes are gathered until the owner takes them, 'devices_changed' only tells that there is something to take.
+ *      This way the device infos never travel through queued signals, and a device that was added and removed again
+ *      before the changes were taken is never created.
+ */
+class DeviceWatcher : public QObject
+{
+    Q_OBJECT
+
+public_construct:
+    explicit DeviceWatcher(const QStringList &new_cameras, const QStringList &new_microphones, QObject *parent = 0);
+
+public_data_members:
+    /**
+     * @brief The Changes struct
+     *      Devices added and removed since the last call to 'take_changes', the removed ones by device name.
+     *      Apply the removals first, a device that was replugged is in both.
+     */
+    struct Changes
+    {
+        QList<QCameraInfo> added_cameras;
+        QStringList removed_cameras;
+        QList<QAudioDeviceInfo> added_microphones;
+        QStringList removed_microphones;
+    };
+
+public_methods:
+    Changes take_changes();
+
+private_methods:
+    void output(const QString &message, const int verbose) const;
+
+private_members:
+    int interval;
+
+private_data_members:
+    QStringList cameras;
+    QStringList microphones;
+    QMutex mutex;
+    Changes changes;
+    QTimer *timer;
+
+public slots:
+    void start();
+    void stop();
+
+private slots:
+    void poll();
+
+signals:
+    void console(const QString &message) const;
+    void devices_changed() const;
+
+};
+
+#endif // DEVICEWATCHER_H
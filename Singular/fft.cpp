@@ -0,0 +1,417 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "fft.h"
+#include "simd.h"
+
+#include <QtMath>
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Butterflies
+ *      A stage of the transform combines pairs of points 'half' apart, in groups of 2 * half points.
+ *      The twiddles of a stage are stored at [half, 2 * half), so the ones of a group are contiguous and are loaded
+ *      like the points. The product with the twiddle is (br * wr - bi * wi, br * wi + bi * wr) in every version.
+ *      The AVX2 stage clears the upper halves of the registers before returning, the next stage can be SSE2.
+ *      The split into the real spectrum pairs bin k with N/2 - k, the vector versions load the mirrored points reversed,
+ *      and the AVX2 one hands the rest of the bins to the SSE2 one, which hands its rest to the scalar one.
+ */
+namespace
+{
+    void stage_scalar(float *real, float *imaginary, const float *twiddle_real, const float *twiddle_imaginary,
+                      const int points, const int half)
+    {
+        for(int group = 0; group < points; group += half * 2)
+        {
+            for(int j = 0; j < half; j++)
+            {
+                const int a = group + j;
+                const int b = a + half;
+
+                const float wr = twiddle_real[half + j];
+                const float wi = twiddle_imaginary[half + j];
+                const float tr = real[b] * wr - imaginary[b] * wi;
+                const float ti = real[b] * wi + imaginary[b] * wr;
+
+                real[b] = real[a] - tr;
+                imaginary[b] = imaginary[a] - ti;
+                real[a] = real[a] + tr;
+                imaginary[a] = imaginary[a] + ti;
+            }
+        }
+    }
+
+    void split_scalar(const float *real, const float *imaginary, const float *split_real, const float *split_imaginary,
+                      const int points, const float scale, float *spectrum, const int first, const int last)
+    {
+        for(int k = first; k <= last; k++)
+        {
+            const int a = k & (points - 1);
+            const int b = (points - k) & (points - 1);
+
+            const float even_real = (real[a] + real[b]) * 0.5f;
+            const float even_imaginary = (imaginary[a] - imaginary[b]) * 0.5f;
+            const float odd_real = (imaginary[a] + imaginary[b]) * 0.5f;
+            const float odd_imaginary = (real[b] - real[a]) * 0.5f;
+
+            const float bin_real = even_real + split_real[k] * odd_real - split_imaginary[k] * odd_imaginary;
+            const float bin_imaginary = even_imaginary + split_real[k] * odd_imaginary + split_imaginary[k] * odd_real;
+
+            spectrum[k] = (bin_real * bin_real + bin_imaginary * bin_imaginary) * scale;
+        }
+    }
+
+#if defined(simd_x86)
+    void stage_sse2(float *real, float *imaginary, const float *twiddle_real, const float *twiddle_imaginary,
+                    const int points, const int half)
+    {
+        for(int group = 0; group < points; group += half * 2)
+        {
+            for(int j = 0; j < half; j += 4)
+            {
+                float *ar = real + group + j;
+                float *ai = imaginary + group + j;
+                float *br = ar + half;
+                float *bi = ai + half;
+
+                const __m128 wr = _mm_loadu_ps(twiddle_real + half + j);
+                const __m128 wi = _mm_loadu_ps(twiddle_imaginary + half + j);
+                const __m128 xr = _mm_loadu_ps(br);
+                const __m128 xi = _mm_loadu_ps(bi);
+                const __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+                const __m128 ti = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+                const __m128 yr = _mm_loadu_ps(ar);
+                const __m128 yi = _mm_loadu_ps(ai);
+
+                _mm_storeu_ps(br, _mm_sub_ps(yr, tr));
+                _mm_storeu_ps(bi, _mm_sub_ps(yi, ti));
+                _mm_storeu_ps(ar, _mm_add_ps(yr, tr));
+                _mm_storeu_ps(ai, _mm_add_ps(yi, ti));
+            }
+        }
+    }
+
+    simd_avx2_target
+    void stage_avx2(float *real, float *imaginary, const float *twiddle_real, const float *twiddle_imaginary,
+                    const int points, const int half)
+    {
+        for(int group = 0; group < points; group += half * 2)
+        {
+            for(int j = 0; j < half; j += 8)
+            {
+                float *ar = real + group + j;
+                float *ai = imaginary + group + j;
+                float *br = ar + half;
+                float *bi = ai + half;
+
+                const __m256 wr = _mm256_loadu_ps(twiddle_real + half + j);
+                const __m256 wi = _mm256_loadu_ps(twiddle_imaginary + half + j);
+                const __m256 xr = _mm256_loadu_ps(br);
+                const __m256 xi = _mm256_loadu_ps(bi);
+                const __m256 tr = _mm256_sub_ps(_mm256_mul_ps(xr, wr), _mm256_mul_ps(xi, wi));
+                const __m256 ti = _mm256_add_ps(_mm256_mul_ps(xr, wi), _mm256_mul_ps(xi, wr));
+                const __m256 yr = _mm256_loadu_ps(ar);
+                const __m256 yi = _mm256_loadu_ps(ai);
+
+                _mm256_storeu_ps(br, _mm256_sub_ps(yr, tr));
+                _mm256_storeu_ps(bi, _mm256_sub_ps(yi, ti));
+                _mm256_storeu_ps(ar, _mm256_add_ps(yr, tr));
+                _mm256_storeu_ps(ai, _mm256_add_ps(yi, ti));
+            }
+        }
+
+        _mm256_zeroupper();
+    }
+
+    /**
+     * Bins 'first' to 'points', the first bin pairs Z[0] with itself and is scalar. The mirrored points are loaded reversed.
+     */
+    void split_sse2(const float *real, const float *imaginary, const float *split_real, const float *split_imaginary,
+                    const int points, const float scale, float *spectrum, const int first)
+    {
+        int k = first;
+
+        if(k == 0)
+        {
+            split_scalar(real, imaginary, split_real, split_imaginary, points, scale, spectrum, 0, 0);
+            k = 1;
+        }
+
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 factor = _mm_set1_ps(scale);
+
+        for(; k + 4 <= points; k += 4)
+        {
+            const __m128 ar = _mm_loadu_ps(real + k);
+            const __m128 ai = _mm_loadu_ps(imaginary + k);
+            const __m128 mirrored_real = _mm_loadu_ps(real + points - k - 3);
+            const __m128 mirrored_imaginary = _mm_loadu_ps(imaginary + points - k - 3);
+            const __m128 br = _mm_shuffle_ps(mirrored_real, mirrored_real, _MM_SHUFFLE(0, 1, 2, 3));
+            const __m128 bi = _mm_shuffle_ps(mirrored_imaginary, mirrored_imaginary, _MM_SHUFFLE(0, 1, 2, 3));
+            const __m128 sr = _mm_loadu_ps(split_real + k);
+            const __m128 si = _mm_loadu_ps(split_imaginary + k);
+
+            const __m128 even_real = _mm_mul_ps(_mm_add_ps(ar, br), half);
+            const __m128 even_imaginary = _mm_mul_ps(_mm_sub_ps(ai, bi), half);
+            const __m128 odd_real = _mm_mul_ps(_mm_add_ps(ai, bi), half);
+            const __m128 odd_imaginary = _mm_mul_ps(_mm_sub_ps(br, ar), half);
+
+            const __m128 bin_real = _mm_sub_ps(_mm_add_ps(even_real, _mm_mul_ps(sr, odd_real)), _mm_mul_ps(si, odd_imaginary));
+            const __m128 bin_imaginary = _mm_add_ps(_mm_add_ps(even_imaginary, _mm_mul_ps(sr, odd_imaginary)), _mm_mul_ps(si, odd_real));
+
+            _mm_storeu_ps(spectrum + k, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(bin_real, bin_real), _mm_mul_ps(bin_imaginary, bin_imaginary)), factor));
+        }
+
+        split_scalar(real, imaginary, split_real, split_imaginary, points, scale, spectrum, k, points);
+    }
+
+    simd_avx2_target
+    void split_avx2(const float *real, const float *imaginary, const float *split_real, const float *split_imaginary,
+                    const int points, const float scale, float *spectrum)
+    {
+        split_scalar(real, imaginary, split_real, split_imaginary, points, scale, spectrum, 0, 0);
+
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 factor = _mm256_set1_ps(scale);
+        const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+        int k = 1;
+
+        for(; k + 8 <= points; k += 8)
+        {
+            const __m256 ar = _mm256_loadu_ps(real + k);
+            const __m256 ai = _mm256_loadu_ps(imaginary + k);
+            const __m256 br = _mm256_permutevar8x32_ps(_mm256_loadu_ps(real + points - k - 7), reverse);
+            const __m256 bi = _mm256_permutevar8x32_ps(_mm256_loadu_ps(imaginary + points - k - 7), reverse);
+            const __m256 sr = _mm256_loadu_ps(split_real + k);
+            const __m256 si = _mm256_loadu_ps(split_imaginary + k);
+
+            const __m256 even_real = _mm256_mul_ps(_mm256_add_ps(ar, br), half);
+            const __m256 even_imaginary = _mm256_mul_ps(_mm256_sub_ps(ai, bi), half);
+            const __m256 odd_real = _mm256_mul_ps(_mm256_add_ps(ai, bi), half);
+            const __m256 odd_imaginary = _mm256_mul_ps(_mm256_sub_ps(br, ar), half);
+
+            const __m256 bin_real = _mm256_sub_ps(_mm256_add_ps(even_real, _mm256_mul_ps(sr, odd_real)), _mm256_mul_ps(si, odd_imaginary));
+            const __m256 bin_imaginary = _mm256_add_ps(_mm256_add_ps(even_imaginary, _mm256_mul_ps(sr, odd_imaginary)), _mm256_mul_ps(si, odd_real));
+
+            _mm256_storeu_ps(spectrum + k, _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(bin_real, bin_real), _mm256_mul_ps(bin_imaginary, bin_imaginary)), factor));
+        }
+
+        _mm256_zeroupper();
+
+        split_sse2(real, imaginary, split_real, split_imaginary, points, scale, spectrum, k);
+    }
+#endif
+
+    float *allocate(const int count)
+    {
+        return static_cast<float*>(qMallocAligned(qMax(1, count) * sizeof(float), 64));
+    }
+}
+
+/**
+ * @brief Fft::Fft
+ *      Computes the tables of the plan, in double precision, and allocates the work arrays.
+ * @param new_size
+ *      Number of real samples per transform, see 'valid_size'.
+ */
+Fft::Fft(const int new_size)
+    : size(valid_size(new_size)),
+      points(size / 2)
+{
+    reversal = static_cast<int*>(qMallocAligned(points * sizeof(int), 64));
+    window = allocate(size);
+    twiddle_real = allocate(points);
+    twiddle_imaginary = allocate(points);
+    split_real = allocate(points + 1);
+    split_imaginary = allocate(points + 1);
+    real = allocate(points);
+    imaginary = allocate(points);
+
+    int bits = 0;
+
+    while((1 << bits) < points)
+    {
+        bits++;
+    }
+
+    for(int i = 0; i < points; i++)
+    {
+        int reversed = 0;
+
+        for(int bit = 0; bit < bits; bit++)
+        {
+            reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+        }
+
+        reversal[i] = reversed;
+    }
+
+    //Periodic Hann window, the sum sets the scale so a full scale sine has a power of 1 in its bin.
+    double window_sum = 0.0;
+
+    for(int i = 0; i < size; i++)
+    {
+        window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * M_PI * i / size));
+        window_sum += window[i];
+    }
+
+    scale = static_cast<float>(4.0 / (window_sum * window_sum));
+
+    //The first entry is not used, the twiddles of a stage start at its half.
+    twiddle_real[0] = 1.0f;
+    twiddle_imaginary[0] = 0.0f;
+
+    for(int half = 1; half < points; half *= 2)
+    {
+        for(int j = 0; j < half; j++)
+        {
+            twiddle_real[half + j] = static_cast<float>(std::cos(M_PI * j / half));
+            twiddle_imaginary[half + j] = static_cast<float>(-std::sin(M_PI * j / half));
+        }
+    }
+
+    for(int k = 0; k <= points; k++)
+    {
+        split_real[k] = static_cast<float>(std::cos(2.0 * M_PI * k / size));
+        split_imaginary[k] = static_cast<float>(-std::sin(2.0 * M_PI * k / size));
+    }
+}
+
+/**
+ * @brief Fft::~Fft
+ */
+Fft::~Fft()
+{
+    qFreeAligned(reversal);
+    qFreeAligned(window);
+    qFreeAligned(twiddle_real);
+    qFreeAligned(twiddle_imaginary);
+    qFreeAligned(split_real);
+    qFreeAligned(split_imaginary);
+    qFreeAligned(real);
+    qFreeAligned(imaginary);
+}
+
+/**
+ * @brief Fft::power
+ *      Windows the samples and computes their power spectrum.
+ *      The even samples are the real parts and the odd ones the imaginary parts of the packed transform, loaded in bit reversed order.
+ *      Bin k of the real spectrum is (Z[k] + conj(Z[N/2 - k])) / 2 - i W^k (Z[k] - conj(Z[N/2 - k])) / 2, with W = e^(-2 pi i / N).
+ * @param samples
+ *      'get_size' real samples, oldest first.
+ * @param spectrum
+ *      Output, 'get_bins' powers, from 0 Hz to half the sample rate in steps of sample rate / size.
+ *      A full scale sine in the middle of a bin gives 1.
+ */
+void Fft::power(const float *samples, float *spectrum)
+{
+    for(int k = 0; k < points; k++)
+    {
+        real[reversal[k]] = samples[k * 2] * window[k * 2];
+        imaginary[reversal[k]] = samples[k * 2 + 1] * window[k * 2 + 1];
+    }
+
+#if defined(simd_x86)
+    const Simd::Level level = Simd::get_level();
+#endif
+
+    for(int half = 1; half < points; half *= 2)
+    {
+#if defined(simd_x86)
+        if(level == Simd::AVX2 && half >= 8)
+        {
+            stage_avx2(real, imaginary, twiddle_real, twiddle_imaginary, points, half);
+            continue;
+        }
+
+        if(level != Simd::Scalar && half >= 4)
+        {
+            stage_sse2(real, imaginary, twiddle_real, twiddle_imaginary, points, half);
+            continue;
+        }
+#endif
+
+        stage_scalar(real, imaginary, twiddle_real, twiddle_imaginary, points, half);
+    }
+
+#if defined(simd_x86)
+    switch(level)
+    {
+        case Simd::AVX2:
+        {
+            split_avx2(real, imaginary, split_real, split_imaginary, points, scale, spectrum);
+            return;
+        }
+        case Simd::SSE2:
+        {
+            split_sse2(real, imaginary, split_real, split_imaginary, points, scale, spectrum, 0);
+            return;
+        }
+        case Simd::Scalar:
+        {
+            break;
+        }
+    }
+#endif
+
+    split_scalar(real, imaginary, split_real, split_imaginary, points, scale, spectrum, 0, points);
+}
+
+/**
+ * @brief Fft::get_size
+ * @return
+ *      Number of real samples per transform.
+ */
+int Fft::get_size() const
+{
+    return size;
+}
+
+/**
+ * @brief Fft::get_bins
+ * @return
+ *      Number of bins of the spectrum, size / 2 + 1.
+ */
+int Fft::get_bins() const
+{
+    return points + 1;
+}
+
+/**
+ * @brief Fft::valid_size
+ *      The largest power of two up to the size, from 16 to 65536.
+ * @param size
+ *      Requested number of samples.
+ * @return
+ *      The size of the plan.
+ */
+int Fft::valid_size(const int size)
+{
+    int valid = 16;
+
+    while(valid * 2 <= size && valid < 65536)
+    {
+        valid *= 2;
+    }
+
+    return valid;
+}
@@ -0,0 +1,70 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <QtGlobal>
+
+#include "defines.h"
+
+/**
+ * @brief The Fft class
+ *      Plan of a windowed power spectrum of real samples, for one power of two size.
+ *      The bit reversal, the twiddles and the Hann window are computed once by the constructor, 'power' only runs the transform.
+ *      The N real samples are packed as N/2 complex samples, transformed with an iterative radix-2 FFT on separate real and
+ *      imaginary arrays, and split into the N/2 + 1 bins of the real spectrum.
+ * @remarks
+ *      The butterflies of a stage are vectorized when the stage is as wide as the vector, 8 floats with AVX2 and 4 with SSE2,
+ *      the first stages are scalar. Every version does the same operations in the same order, the results are the same.
+ *      The work arrays belong to the plan, use one plan per thread.
+ */
+class Fft
+{
+
+public_construct:
+    explicit Fft(const int new_size);
+    ~Fft();
+
+public_methods:
+    void power(const float *samples, float *spectrum);
+
+    int get_size() const;
+    int get_bins() const;
+
+    static int valid_size(const int size);
+
+private_members:
+    int size;
+    int points;
+    float scale;
+
+private_data_members:
+    int *reversal;
+    float *window;
+    float *twiddle_real;
+    float *twiddle_imaginary;
+    float *split_real;
+    float *split_imaginary;
+    float *real;
+    float *imaginary;
+
+};
+
+#endif // FFT_H
@@ -0,0 +1,65 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "frame.h"
+
+#include <chrono>
+
+/**
+ * @brief Frame::Frame
+ *      Creates an empty frame.
+ */
+Frame::Frame()
+    : sequence(0),
+      start_time(-1),
+      capture_time(0),
+      processed_time(0),
+      delivered_time(0)
+{
+}
+
+/**
+ * @brief Frame::is_valid
+ * @return
+ *      True if the frame has an image.
+ */
+bool Frame::is_valid() const
+{
+    return !image.isNull();
+}
+
+/**
+ * @brief Frame::is_compressed
+ * @return
+ *      True if the frame has the JPEG of an MJPEG camera.
+ */
+bool Frame::is_compressed() const
+{
+    return !compressed.isEmpty();
+}
+
+/**
+ * @brief Frame::clock
+ *      Monotonic clock shared by all the threads, used for the timestamps of the frames.
+ * @return
+ *      Nanoseconds since an arbitrary point.
+ */
+qint64 Frame::clock()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,79 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <QRect>
+#include <QImage>
+#include <QByteArray>
+#include <QMetaType>
+#include <QSharedPointer>
+
+#include "defines.h"
+#include "framepool.h"
+#include "imagestatistics.h"
+
+/**
+ * @brief The Frame class
+ *      A single camera frame as it travels from the surface to the consumers.
+ *      The image is backed by a FramePool slot, copies of a frame share the same pixels.
+ *      The buffer is the slot itself, it allows views on the frame (e.g. a crop) without copying.
+ * @remarks
+ *      The times are in nanoseconds of Frame::clock, set as the frame goes through the path, 0 when not reached yet.
+ *      The start time is the presentation time given by the driver in microseconds, -1 if unknown, it is not on the same clock.
+ *      The image statistics are set by a statistics stage, they are shared and never modified once attached.
+ *      The region is the part of the camera frame the image was cropped from, see "Camera/<id>/Roi", the whole frame without one.
+ *      The foreground is the mask of a background stage, a quarter of the size of the image, null without one.
+ *      Frames of an MJPEG camera carry the JPEG as it was delivered, backed by a slot of its own. Their image is only decoded
+ *      when a consumer needs the pixels, so such a frame can be compressed only, see CameraSurface::decode_needed.
+ */
+class Frame
+{
+
+public_construct:
+    Frame();
+
+public_methods:
+    bool is_valid() const;
+    bool is_compressed() const;
+
+    static qint64 clock();
+
+public_data_members:
+    QImage image;
+    FrameBuffer buffer;
+    quint64 sequence;
+    QRect region;
+    QImage foreground;
+
+    QByteArray compressed;
+    FrameBuffer compressed_buffer;
+
+    qint64 start_time;
+    qint64 capture_time;
+    qint64 processed_time;
+    qint64 delivered_time;
+
+    QSharedPointer<const ImageStatistics> image_statistics;
+
+};
+
+Q_DECLARE_METATYPE(Frame)
+
+#endif // FRAME_H
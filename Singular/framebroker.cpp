@@ -0,0 +1,319 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "framebroker.h"
+#include "output.h"
+#include "framescale.h"
+#include "settingsmanager.h"
+
+/**
+ * @brief FrameBroker::FrameBroker
+ *      Creates the pool of the conversions, its memory is only allocated when a consumer asks for one.
+ * @param new_id
+ *      The ID of the camera.
+ * @param parent
+ *      To parent this class.
+ */
+FrameBroker::FrameBroker(const int new_id, QObject *parent)
+    : QObject(parent),
+      id(new_id),
+      conversion_count(0),
+      shared_count(0)
+{
+    pool = new FramePool(qMax(1, SettingsManager::read("Broker/FramePoolSlots", 8).toInt()));
+}
+
+/**
+ * @brief FrameBroker::~FrameBroker
+ *      Releases the pool, it is only freed once the consumers release the conversions they still hold.
+ */
+FrameBroker::~FrameBroker()
+{
+    pool->release();
+}
+
+/**
+ * @brief FrameBroker::subscribe
+ *      Adds a consumer of the frames of the camera.
+ * @param consumer
+ *      The consumer, not owned. Unsubscribe it before it is deleted.
+ * @param consumer_name
+ *      Shown in the console.
+ * @param max_frame_rate
+ *      Frames per second at most, 0 for every frame.
+ * @param format
+ *      Pixel format the consumer needs, QImage::Format_Invalid for the format of the frame.
+ * @param max_size
+ *      Larger frames are scaled down to fit in it, keeping their aspect ratio. An empty size for the size of the frame.
+ * @param compressed
+ *      The consumer takes the JPEG of an MJPEG camera as it is, so it also gets the frames that were not decoded.
+ */
+void FrameBroker::subscribe(FrameConsumer *consumer, const QString &consumer_name, const int max_frame_rate,
+                            const QImage::Format format, const QSize &max_size, const bool compressed)
+{
+    Subscription subscription;
+    subscription.consumer = consumer;
+    subscription.name = consumer_name;
+    subscription.interval_nsecs = max_frame_rate > 0 ? Q_INT64_C(1000000000) / max_frame_rate : 0;
+    subscription.next_time = 0;
+    subscription.format = format;
+    subscription.max_size = max_size;
+    subscription.compressed = compressed;
+
+    {
+        QMutexLocker locker(&mutex);
+        subscriptions.append(subscription);
+    }
+
+    output("Camera " + QString::number(id) + ": " + consumer_name + " subscribed" +
+           (max_frame_rate > 0 ? ", at most " + QString::number(max_frame_rate) + " fps" : QString()) +
+           (!max_size.isEmpty() ? ", at most " + QString::number(max_size.width()) + "x" + QString::number(max_size.height()) : QString()) +
+           (compressed ? ", compressed frames as they are" : QString()) + ".", 3);
+}
+
+/**
+ * @brief FrameBroker::unsubscribe
+ *      Removes a consumer, waits for the frame being published, if any.
+ * @param consumer
+ *      The consumer.
+ */
+void FrameBroker::unsubscribe(FrameConsumer *consumer)
+{
+    QMutexLocker locker(&mutex);
+
+    for(int i = subscriptions.size() - 1; i >= 0; i--)
+    {
+        if(subscriptions.at(i).consumer == consumer)
+        {
+            subscriptions.removeAt(i);
+        }
+    }
+}
+
+/**
+ * @brief FrameBroker::publish
+ *      Hands a frame to every consumer that is due one.
+ *      A consumer that is due gets the frame itself if it matches what it asked for, a conversion otherwise.
+ *      The conversions of this frame are kept until every consumer had it, and released right after.
+ * @remarks
+ *      The frame of a rate limited consumer is due one interval after the previous one was due, not after it was delivered,
+ *      so a camera at 30 fps still gives about 20 fps to a consumer that wants 20. After a pause it starts over.
+ * @param frame
+ *      The frame, from the camera or its pipeline.
+ */
+void FrameBroker::publish(const Frame &frame)
+{
+    QMutexLocker locker(&mutex);
+
+    for(int i = 0; i < subscriptions.size(); i++)
+    {
+        Subscription &subscription = subscriptions[i];
+
+        const bool passthrough = subscription.compressed && frame.is_compressed();
+
+        if(!passthrough && !frame.is_valid())
+        {
+            continue;
+        }
+
+        if(subscription.interval_nsecs > 0)
+        {
+            if(frame.capture_time < subscription.next_time)
+            {
+                continue;
+            }
+
+            subscription.next_time = frame.capture_time - subscription.next_time < subscription.interval_nsecs ?
+                                     subscription.next_time + subscription.interval_nsecs :
+                                     frame.capture_time + subscription.interval_nsecs;
+        }
+
+        if(passthrough)
+        {
+            subscription.consumer->consume(frame);
+            continue;
+        }
+
+        const QImage::Format format = subscription.format != QImage::Format_Invalid ? subscription.format : frame.image.format();
+        const QSize size = fit(frame.image.size(), subscription.max_size);
+
+        if(format == frame.image.format() && size == frame.image.size())
+        {
+            subscription.consumer->consume(frame);
+            continue;
+        }
+
+        int index = -1;
+
+        for(int j = 0; j < conversions.size() && index < 0; j++)
+        {
+            if(conversions.at(j).format == format && conversions.at(j).size == size)
+            {
+                index = j;
+            }
+        }
+
+        if(index < 0)
+        {
+            Conversion conversion;
+            conversion.format = format;
+            conversion.size = size;
+            conversion.frame = convert(frame, format, size);
+
+            conversions.append(conversion);
+            conversion_count.ref();
+
+            index = conversions.size() - 1;
+        }
+        else
+        {
+            shared_count.ref();
+        }
+
+        if(conversions.at(index).frame.is_valid())
+        {
+            subscription.consumer->consume(conversions.at(index).frame);
+        }
+    }
+
+    conversions.clear();
+}
+
+/**
+ * @brief FrameBroker::convert
+ *      Scales and converts a frame. RGB32 frames are scaled with FrameScale into a slot of the pool,
+ *      the other formats, e.g. the grayscale of a pipeline, with QImage.
+ *      The converted frame keeps the timestamps and the statistics of the frame, but not its JPEG.
+ * @param frame
+ *      The frame.
+ * @param format
+ *      The pixel format.
+ * @param size
+ *      The size, never larger than the frame.
+ * @return
+ *      The converted frame.
+ */
+Frame FrameBroker::convert(const Frame &frame, const QImage::Format format, const QSize &size)
+{
+    Frame result(frame);
+    result.compressed = QByteArray();
+    result.compressed_buffer = FrameBuffer();
+
+    QImage image = frame.image;
+
+    if(size != image.size())
+    {
+        if(image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32)
+        {
+            const int stride = FramePool::aligned_bytes_per_line(size.width() * 4);
+            const FrameBuffer buffer = pool->acquire(stride * size.height());
+
+            QImage scaled = buffer.is_null() ? QImage(size, QImage::Format_RGB32) :
+                                               buffer.image(size.width(), size.height(), stride, QImage::Format_RGB32);
+
+            columns.resize(size.width());
+            line.resize(image.width() * 4);
+
+            FrameScale::sample_positions(image.width(), size.width(), columns.data());
+            FrameScale::downscale_rgb32(image.constBits(), image.bytesPerLine(), image.width(), image.height(),
+                                        scaled.bits(), scaled.bytesPerLine(), size.width(), size.height(),
+                                        columns.constData(), line.data());
+
+            image = scaled;
+            result.buffer = buffer;
+        }
+        else
+        {
+            image = image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            result.buffer = FrameBuffer();
+        }
+    }
+
+    if(format != image.format())
+    {
+        image = image.convertToFormat(format);
+        result.buffer = FrameBuffer();
+    }
+
+    result.image = image;
+
+    return result;
+}
+
+/**
+ * @brief FrameBroker::fit
+ * @param size
+ *      Size of the frame.
+ * @param max_size
+ *      The largest size allowed, empty for any size.
+ * @return
+ *      The size scaled down to fit in the largest size, with the same aspect ratio. Never larger than the frame.
+ */
+QSize FrameBroker::fit(const QSize &size, const QSize &max_size)
+{
+    if(max_size.isEmpty() || (size.width() <= max_size.width() && size.height() <= max_size.height()))
+    {
+        return size;
+    }
+
+    const double scale = qMin(static_cast<double>(max_size.width()) / size.width(), static_cast<double>(max_size.height()) / size.height());
+
+    return QSize(qMax(1, static_cast<int>(size.width() * scale)), qMax(1, static_cast<int>(size.height() * scale)));
+}
+
+/**
+ * @brief FrameBroker::get_conversion_count
+ * @return
+ *      Number of conversions done.
+ */
+int FrameBroker::get_conversion_count() const
+{
+    return conversion_count.load();
+}
+
+/**
+ * @brief FrameBroker::get_shared_count
+ * @return
+ *      Number of times a consumer got a conversion done for another consumer of the same frame.
+ */
+int FrameBroker::get_shared_count() const
+{
+    return shared_count.load();
+}
+
+/**
+ * @brief FrameBroker::output
+ *      Generic function responsible for all the outputs.
+ */
+void FrameBroker::output(const QString &message, const int verbose) const
+{
+    if(Output::get_verbose() >= verbose)
+    {
+        QVariantHash data;
+        data.insert("message", message);
+        data.insert("verbose", verbose);
+        data.insert("load_thread_id", true);
+
+        QString print = Output::builder(data);
+
+        if(!print.isEmpty())
+        {
+            emit console(print);
+        }
+    }
+}
@@ -0,0 +1,109 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEBROKER_H
+#define FRAMEBROKER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QVector>
+#include <QAtomicInt>
+
+#include "defines.h"
+#include "frame.h"
+#include "framepool.h"
+#include "frameconsumer.h"
+
+/**
+ * @brief The FrameBroker class
+ *      Hands the frames of one camera to any number of consumers, each with its own maximum frame rate, pixel format and resolution.
+ *      A frame is converted at most once per format and resolution, consumers that ask for the same one share the result.
+ * @remarks
+ *      'publish' is called from the thread that delivers the frames, the consumers are called from there in the order they subscribed.
+ *      Subscribing and unsubscribing is thread safe, once 'unsubscribe' returns the consumer is no longer called.
+ *      The conversions are written to a pool of the broker, "Broker/FramePoolSlots", and to the heap if all its slots are in use.
+ */
+class FrameBroker : public QObject
+{
+    Q_OBJECT
+
+public_construct:
+    explicit FrameBroker(const int new_id, QObject *parent = 0);
+    ~FrameBroker();
+
+public_methods:
+    void subscribe(FrameConsumer *consumer, const QString &consumer_name, const int max_frame_rate = 0,
+                   const QImage::Format format = QImage::Format_Invalid, const QSize &max_size = QSize(),
+                   const bool compressed = false);
+    void unsubscribe(FrameConsumer *consumer);
+    void publish(const Frame &frame);
+
+    int get_conversion_count() const;
+    int get_shared_count() const;
+
+private_methods:
+    Frame convert(const Frame &frame, const QImage::Format format, const QSize &size);
+    static QSize fit(const QSize &size, const QSize &max_size);
+    void output(const QString &message, const int verbose) const;
+
+private_members:
+    int id;
+    QAtomicInt conversion_count;
+    QAtomicInt shared_count;
+
+private_data_members:
+    /**
+     * @brief The Subscription struct
+     *      A consumer and what it asked for. An invalid format or an empty size keep those of the frame.
+     *      Only consumers of compressed frames get the frames of an MJPEG camera that were not decoded, and they get the JPEG as it is.
+     */
+    struct Subscription
+    {
+        FrameConsumer *consumer;
+        QString name;
+        qint64 interval_nsecs;
+        qint64 next_time;
+        QImage::Format format;
+        QSize max_size;
+        bool compressed;
+    };
+
+    /**
+     * @brief The Conversion struct
+     *      A conversion of the frame being published, shared by the consumers that asked for it.
+     */
+    struct Conversion
+    {
+        QImage::Format format;
+        QSize size;
+        Frame frame;
+    };
+
+    QMutex mutex;
+    QList<Subscription> subscriptions;
+    QList<Conversion> conversions;
+    FramePool *pool;
+    QVector<int> columns;
+    QVector<uchar> line;
+
+signals:
+    void console(const QString &message) const;
+
+};
+
+#endif // FRAMEBROKER_H
@@ -0,0 +1,43 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMECONSUMER_H
+#define FRAMECONSUMER_H
+
+#include "defines.h"
+#include "frame.h"
+
+/**
+ * @brief The FrameConsumer class
+ *      Anything that takes the frames of a camera through a FrameBroker, e.g. the widget, the recorder or the mosaic.
+ * @remarks
+ *      'consume' is called from the thread that delivers the frames, the camera thread or a worker of its pipeline,
+ *      one frame at a time. It must not block, a consumer that is behind drops frames or keeps only the newest one.
+ */
+class FrameConsumer
+{
+
+public_construct:
+    virtual ~FrameConsumer() {}
+
+public_methods:
+    virtual void consume(const Frame &frame) = 0;
+
+};
+
+#endif // FRAMECONSUMER_H
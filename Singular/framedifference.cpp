@@ -0,0 +1,472 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "framedifference.h"
+#include "simd.h"
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Kernels
+ *      Downsampling averages blocks of 4x4 pixels, first the 4 lines and then the 4 columns, each as a tree of averages.
+ *      The luma of the averaged pixel is (29 B + 150 G + 77 R) >> 8, BT.601.
+ *      The difference of a pixel is max(|current - background| - threshold, 0), the vector kernels sum it with SAD.
+ *      The AVX2 kernels clear the upper halves of the registers before handing the rest of the row to the SSE2 kernel,
+ *      otherwise every call pays for a transition between the two instruction encodings.
+ */
+namespace
+{
+    typedef void (*DownsampleRow)(const uchar *line0, const uchar *line1, const uchar *line2, const uchar *line3,
+                                  uchar *destination, const int start, const int width);
+    typedef qint64 (*DifferenceRow)(const uchar *current, const uchar *background, const int start, const int end, const int threshold);
+    typedef void (*BackgroundRow)(const uchar *current, uchar *background, const int start, const int width, const int shift);
+
+    inline int average(const int a, const int b)
+    {
+        return (a + b + 1) >> 1;
+    }
+
+    inline uchar luma(const uint pixel)
+    {
+        return static_cast<uchar>((29 * (pixel & 0xff) + 150 * ((pixel >> 8) & 0xff) + 77 * ((pixel >> 16) & 0xff)) >> 8);
+    }
+
+    /**
+     * Width is the output width, the lines hold 4 times as many RGB32 pixels.
+     */
+    void downsample_row_scalar(const uchar *line0, const uchar *line1, const uchar *line2, const uchar *line3,
+                               uchar *destination, const int start, const int width)
+    {
+        for(int x = start; x < width; x++)
+        {
+            uint pixel = 0;
+
+            for(int channel = 0; channel < 4; channel++)
+            {
+                int columns[4];
+
+                for(int i = 0; i < 4; i++)
+                {
+                    const int offset = (x * 4 + i) * 4 + channel;
+                    columns[i] = average(average(line0[offset], line1[offset]), average(line2[offset], line3[offset]));
+                }
+
+                pixel |= static_cast<uint>(average(average(columns[0], columns[1]), average(columns[2], columns[3]))) << (channel * 8);
+            }
+
+            destination[x] = luma(pixel);
+        }
+    }
+
+    qint64 difference_row_scalar(const uchar *current, const uchar *background, const int start, const int end, const int threshold)
+    {
+        qint64 sum = 0;
+
+        for(int x = start; x < end; x++)
+        {
+            const int difference = qAbs(current[x] - background[x]) - threshold;
+
+            if(difference > 0)
+            {
+                sum += difference;
+            }
+        }
+
+        return sum;
+    }
+
+    void background_row_scalar(const uchar *current, uchar *background, const int start, const int width, const int shift)
+    {
+        for(int x = start; x < width; x++)
+        {
+            int value = current[x];
+
+            for(int i = 0; i < shift; i++)
+            {
+                value = average(background[x], value);
+            }
+
+            background[x] = static_cast<uchar>(value);
+        }
+    }
+
+#if defined(simd_x86)
+    /**
+     * 4 RGB32 pixels of each line into one output pixel.
+     */
+    void downsample_row_sse2(const uchar *line0, const uchar *line1, const uchar *line2, const uchar *line3,
+                             uchar *destination, const int start, const int width)
+    {
+        int x = start;
+
+        for(; x < width; x++)
+        {
+            const int offset = x * 16;
+
+            const __m128i rows = _mm_avg_epu8(_mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(line0 + offset)),
+                                                           _mm_loadu_si128(reinterpret_cast<const __m128i*>(line1 + offset))),
+                                              _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(line2 + offset)),
+                                                           _mm_loadu_si128(reinterpret_cast<const __m128i*>(line3 + offset))));
+
+            const __m128i pairs = _mm_avg_epu8(rows, _mm_shuffle_epi32(rows, _MM_SHUFFLE(2, 3, 0, 1)));
+            const __m128i block = _mm_avg_epu8(pairs, _mm_shuffle_epi32(pairs, _MM_SHUFFLE(1, 0, 3, 2)));
+
+            destination[x] = luma(static_cast<uint>(_mm_cvtsi128_si32(block)));
+        }
+    }
+
+    qint64 difference_row_sse2(const uchar *current, const uchar *background, const int start, const int end, const int threshold)
+    {
+        const __m128i limit = _mm_set1_epi8(static_cast<char>(threshold));
+        __m128i sums = _mm_setzero_si128();
+
+        int x = start;
+
+        for(; x + 16 <= end; x += 16)
+        {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current + x));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(background + x));
+
+            const __m128i difference = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+            sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_subs_epu8(difference, limit), _mm_setzero_si128()));
+        }
+
+        const qint64 sum = _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+
+        return sum + difference_row_scalar(current, background, x, end, threshold);
+    }
+
+    void background_row_sse2(const uchar *current, uchar *background, const int start, const int width, const int shift)
+    {
+        int x = start;
+
+        for(; x + 16 <= width; x += 16)
+        {
+            const __m128i old_value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(background + x));
+            __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current + x));
+
+            for(int i = 0; i < shift; i++)
+            {
+                value = _mm_avg_epu8(old_value, value);
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(background + x), value);
+        }
+
+        background_row_scalar(current, background, x, width, shift);
+    }
+
+    /**
+     * 8 RGB32 pixels of each line into two output pixels, the shuffles work within each 128 bit half.
+     */
+    simd_avx2_target void downsample_row_avx2(const uchar *line0, const uchar *line1, const uchar *line2, const uchar *line3,
+                                              uchar *destination, const int start, const int width)
+    {
+        int x = start;
+
+        for(; x + 2 <= width; x += 2)
+        {
+            const int offset = x * 16;
+
+            const __m256i rows = _mm256_avg_epu8(_mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(line0 + offset)),
+                                                                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line1 + offset))),
+                                                 _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(line2 + offset)),
+                                                                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line3 + offset))));
+
+            const __m256i pairs = _mm256_avg_epu8(rows, _mm256_shuffle_epi32(rows, _MM_SHUFFLE(2, 3, 0, 1)));
+            const __m256i block = _mm256_avg_epu8(pairs, _mm256_shuffle_epi32(pairs, _MM_SHUFFLE(1, 0, 3, 2)));
+
+            destination[x] = luma(static_cast<uint>(_mm256_extract_epi32(block, 0)));
+            destination[x + 1] = luma(static_cast<uint>(_mm256_extract_epi32(block, 4)));
+        }
+
+        _mm256_zeroupper();
+        downsample_row_sse2(line0, line1, line2, line3, destination, x, width);
+    }
+
+    simd_avx2_target qint64 difference_row_avx2(const uchar *current, const uchar *background, const int start, const int end, const int threshold)
+    {
+        const __m256i limit = _mm256_set1_epi8(static_cast<char>(threshold));
+        __m256i sums = _mm256_setzero_si256();
+
+        int x = start;
+
+        for(; x + 32 <= end; x += 32)
+        {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + x));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(background + x));
+
+            const __m256i difference = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+            sums = _mm256_add_epi64(sums, _mm256_sad_epu8(_mm256_subs_epu8(difference, limit), _mm256_setzero_si256()));
+        }
+
+        const __m128i halves = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        const qint64 sum = _mm_cvtsi128_si32(halves) + _mm_cvtsi128_si32(_mm_srli_si128(halves, 8));
+
+        _mm256_zeroupper();
+        return sum + difference_row_sse2(current, background, x, end, threshold);
+    }
+
+    simd_avx2_target void background_row_avx2(const uchar *current, uchar *background, const int start, const int width, const int shift)
+    {
+        int x = start;
+
+        for(; x + 32 <= width; x += 32)
+        {
+            const __m256i old_value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(background + x));
+            __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + x));
+
+            for(int i = 0; i < shift; i++)
+            {
+                value = _mm256_avg_epu8(old_value, value);
+            }
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(background + x), value);
+        }
+
+        _mm256_zeroupper();
+        background_row_sse2(current, background, x, width, shift);
+    }
+#endif
+
+    DownsampleRow downsample_row()
+    {
+        DownsampleRow row = downsample_row_scalar;
+
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                row = downsample_row_avx2;
+                break;
+            }
+            case Simd::SSE2:
+            {
+                row = downsample_row_sse2;
+                break;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        return row;
+    }
+
+    DifferenceRow difference_row()
+    {
+        DifferenceRow row = difference_row_scalar;
+
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                row = difference_row_avx2;
+                break;
+            }
+            case Simd::SSE2:
+            {
+                row = difference_row_sse2;
+                break;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        return row;
+    }
+
+    BackgroundRow background_row()
+    {
+        BackgroundRow row = background_row_scalar;
+
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                row = background_row_avx2;
+                break;
+            }
+            case Simd::SSE2:
+            {
+                row = background_row_sse2;
+                break;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        return row;
+    }
+}
+
+/**
+ * @brief FrameDifference::downsample_rgb32
+ *      Reduces an RGB32 image by 4 in both directions and converts it to luma.
+ *      The pixels that do not fill a whole block on the right and bottom edges are ignored.
+ * @param source
+ *      RGB32 input.
+ * @param source_stride
+ *      Bytes per line of the input.
+ * @param width
+ *      Width of the input in pixels.
+ * @param height
+ *      Height of the input in pixels.
+ * @param destination
+ *      Luma output, (width / 4) x (height / 4).
+ * @param destination_stride
+ *      Bytes per line of the output.
+ */
+void FrameDifference::downsample_rgb32(const uchar *source, const int source_stride, const int width, const int height,
+                                       uchar *destination, const int destination_stride)
+{
+    const DownsampleRow row = downsample_row();
+
+    for(int i = 0; i < height / 4; i++)
+    {
+        const uchar *line = source + i * 4 * source_stride;
+
+        row(line, line + source_stride, line + 2 * source_stride, line + 3 * source_stride,
+            destination + i * destination_stride, 0, width / 4);
+    }
+}
+
+/**
+ * @brief FrameDifference::downsample_grayscale
+ *      Reduces a grayscale image by 4 in both directions, the same as downsample_rgb32.
+ *      Grayscale frames come from a convert stage and are already small, so this one is not vectorized.
+ * @param source
+ *      Grayscale input.
+ * @param source_stride
+ *      Bytes per line of the input.
+ * @param width
+ *      Width of the input in pixels.
+ * @param height
+ *      Height of the input in pixels.
+ * @param destination
+ *      Output, (width / 4) x (height / 4).
+ * @param destination_stride
+ *      Bytes per line of the output.
+ */
+void FrameDifference::downsample_grayscale(const uchar *source, const int source_stride, const int width, const int height,
+                                           uchar *destination, const int destination_stride)
+{
+    for(int i = 0; i < height / 4; i++)
+    {
+        const uchar *line0 = source + i * 4 * source_stride;
+        const uchar *line1 = line0 + source_stride;
+        const uchar *line2 = line1 + source_stride;
+        const uchar *line3 = line2 + source_stride;
+
+        for(int x = 0; x < width / 4; x++)
+        {
+            int columns[4];
+
+            for(int j = 0; j < 4; j++)
+            {
+                const int offset = x * 4 + j;
+                columns[j] = average(average(line0[offset], line1[offset]), average(line2[offset], line3[offset]));
+            }
+
+            destination[i * destination_stride + x] = static_cast<uchar>(average(average(columns[0], columns[1]), average(columns[2], columns[3])));
+        }
+    }
+}
+
+/**
+ * @brief FrameDifference::difference
+ *      Sums the difference above the noise threshold of each region of a grid.
+ * @param current
+ *      Luma of the current frame.
+ * @param background
+ *      Luma of the background, same size and stride.
+ * @param stride
+ *      Bytes per line of both images.
+ * @param width
+ *      Width in pixels.
+ * @param height
+ *      Height in pixels.
+ * @param threshold
+ *      Differences up to this value are noise and are not counted.
+ * @param columns
+ *      Columns of the grid.
+ * @param rows
+ *      Rows of the grid.
+ * @param sums
+ *      Receives columns * rows sums, row by row.
+ */
+void FrameDifference::difference(const uchar *current, const uchar *background, const int stride, const int width, const int height,
+                                 const int threshold, const int columns, const int rows, qint64 *sums)
+{
+    const DifferenceRow row = difference_row();
+
+    for(int i = 0; i < columns * rows; i++)
+    {
+        sums[i] = 0;
+    }
+
+    for(int i = 0; i < height; i++)
+    {
+        qint64 *row_sums = sums + (i * rows / height) * columns;
+
+        for(int j = 0; j < columns; j++)
+        {
+            row_sums[j] += row(current + i * stride, background + i * stride, j * width / columns, (j + 1) * width / columns, threshold);
+        }
+    }
+}
+
+/**
+ * @brief FrameDifference::update_background
+ *      Moves the background towards the current frame: each step halves the distance, so with 'shift' steps
+ *      the current frame weights 1 / 2^shift. Changes in the scene become background after about 2^shift frames.
+ * @param current
+ *      Luma of the current frame.
+ * @param background
+ *      Luma of the background, updated in place.
+ * @param stride
+ *      Bytes per line of both images.
+ * @param width
+ *      Width in pixels.
+ * @param height
+ *      Height in pixels.
+ * @param shift
+ *      Weight of the background, 0 replaces it with the current frame.
+ */
+void FrameDifference::update_background(const uchar *current, uchar *background, const int stride, const int width, const int height,
+                                        const int shift)
+{
+    const BackgroundRow row = background_row();
+
+    for(int i = 0; i < height; i++)
+    {
+        row(current + i * stride, background + i * stride, 0, width, shift);
+    }
+}
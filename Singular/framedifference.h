@@ -0,0 +1,47 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEDIFFERENCE_H
+#define FRAMEDIFFERENCE_H
+
+#include <QtGlobal>
+
+/**
+ * @brief The FrameDifference namespace
+ *      Kernels of the motion detector: downsampling to luma, thresholded difference against a background
+ *      summed per region, and the running average of the background.
+ *      All of them work on 8 bit luma images, the scalar and vector versions give the same results.
+ * @remarks
+ *      Averages use the rounding of the SSE2 average instruction, (a + b + 1) / 2, in every version.
+ */
+namespace FrameDifference
+{
+    void downsample_rgb32(const uchar *source, const int source_stride, const int width, const int height,
+                          uchar *destination, const int destination_stride);
+
+    void downsample_grayscale(const uchar *source, const int source_stride, const int width, const int height,
+                              uchar *destination, const int destination_stride);
+
+    void difference(const uchar *current, const uchar *background, const int stride, const int width, const int height,
+                    const int threshold, const int columns, const int rows, qint64 *sums);
+
+    void update_background(const uchar *current, uchar *background, const int stride, const int width, const int height,
+                           const int shift);
+}
+
+#endif // FRAMEDIFFERENCE_H
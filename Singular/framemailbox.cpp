@@ -0,0 +1,141 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "framemailbox.h"
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ */
+namespace
+{
+    const int index_mask = 0x3;
+    const int fresh = 0x4;
+}
+
+/**
+ * @brief FrameMailbox::FrameMailbox
+ *      The producer starts with slot 0, the consumer with slot 1 and slot 2 is exchanged.
+ */
+FrameMailbox::FrameMailbox()
+    : middle(2),
+      posted_count(0),
+      superseded_count(0),
+      back(0),
+      front(1)
+{
+}
+
+/**
+ * @brief FrameMailbox::post
+ *      Publishes a frame. Only called by the producer thread.
+ *      If the previous frame was never taken it is released here, so a slow consumer never holds more than one frame.
+ * @param frame
+ *      The new frame, only its reference is copied.
+ * @return
+ *      True if the new frame replaced one that was never taken.
+ */
+bool FrameMailbox::post(const Frame &frame)
+{
+    slots[back] = frame;
+
+    const int previous = middle.fetchAndStoreOrdered(back | fresh);
+    back = previous & index_mask;
+
+    if(previous & fresh)
+    {
+        superseded_count.ref();
+    }
+
+    //Returns the pool slot of the frame we got back as soon as possible.
+    slots[back] = Frame();
+
+    posted_count.ref();
+
+    return (previous & fresh) != 0;
+}
+
+/**
+ * @brief FrameMailbox::consume
+ *      Frames from a broker, see post.
+ * @param frame
+ *      The new frame.
+ */
+void FrameMailbox::consume(const Frame &frame)
+{
+    post(frame);
+}
+
+/**
+ * @brief FrameMailbox::take
+ *      Gets the newest frame. Only called by the consumer thread.
+ *      The mailbox keeps no reference to a taken frame, the consumer decides how long the pixels live.
+ * @param frame
+ *      Receives the frame, untouched if there is nothing new.
+ * @return
+ *      True if there was a new frame since the last call.
+ */
+bool FrameMailbox::take(Frame &frame)
+{
+    bool result = false;
+
+    if(middle.loadAcquire() & fresh)
+    {
+        front = middle.fetchAndStoreOrdered(front) & index_mask;
+        frame = slots[front];
+
+        //The consumer holds its own copy, an idle consumer must not keep a pool slot alive.
+        slots[front] = Frame();
+
+        result = true;
+    }
+
+    return result;
+}
+
+/**
+ * @brief FrameMailbox::has_frame
+ *      Can be called from any thread, the answer may be outdated as soon as it returns.
+ * @return
+ *      True if there is a frame that was not taken yet.
+ */
+bool FrameMailbox::has_frame() const
+{
+    return (middle.loadAcquire() & fresh) != 0;
+}
+
+/**
+ * @brief FrameMailbox::get_posted_count
+ * @return
+ *      Number of frames posted.
+ */
+int FrameMailbox::get_posted_count() const
+{
+    return posted_count.load();
+}
+
+/**
+ * @brief FrameMailbox::get_superseded_count
+ * @return
+ *      Number of frames that were replaced by a newer one before the consumer took them.
+ */
+int FrameMailbox::get_superseded_count() const
+{
+    return superseded_count.load();
+}
@@ -0,0 +1,63 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEMAILBOX_H
+#define FRAMEMAILBOX_H
+
+#include <QAtomicInt>
+
+#include "defines.h"
+#include "frame.h"
+#include "frameconsumer.h"
+
+/**
+ * @brief The FrameMailbox class
+ *      Single slot, latest frame wins, hand-over between one producer and one consumer thread.
+ *      The producer never waits and the consumer always gets the newest frame, frames that are not taken in time are replaced.
+ * @remarks
+ *      This is a lock-free triple buffer. The producer owns one slot, the consumer owns another and the third is exchanged
+ *      atomically between them. The 'fresh' bit of the exchanged index tells if it holds a frame the consumer has not taken yet.
+ */
+class FrameMailbox : public FrameConsumer
+{
+
+public_construct:
+    FrameMailbox();
+
+public_methods:
+    bool post(const Frame &frame);
+    void consume(const Frame &frame);
+    bool take(Frame &frame);
+    bool has_frame() const;
+
+    int get_posted_count() const;
+    int get_superseded_count() const;
+
+private_members:
+    QAtomicInt middle;
+    QAtomicInt posted_count;
+    QAtomicInt superseded_count;
+    int back;
+    int front;
+
+private_data_members:
+    Frame slots[3];
+
+};
+
+#endif // FRAMEMAILBOX_H
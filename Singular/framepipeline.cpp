@@ -0,0 +1,499 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "framepipeline.h"
+#include "imagestages.h"
+#include "motionstage.h"
+#include "backgroundstage.h"
+#include "statisticsstage.h"
+#include "output.h"
+#include "settingsmanager.h"
+
+#include <QThread>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <cstring>
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Variables
+ *      All the pipelines share one pool of worker threads, by default one per core.
+ */
+namespace
+{
+    QThreadPool *worker_pool()
+    {
+        static QThreadPool pool;
+        static bool initialized = false;
+
+        if(!initialized)
+        {
+            const int threads = SettingsManager::read("Pipeline/Threads", QThread::idealThreadCount()).toInt();
+            pool.setMaxThreadCount(qMax(1, threads));
+            initialized = true;
+        }
+
+        return &pool;
+    }
+}
+
+/**
+ * @brief The FramePipelineTask class
+ *      Runs the pending frames of one pipeline in a worker thread.
+ */
+class FramePipelineTask : public QRunnable
+{
+
+public_construct:
+    explicit FramePipelineTask(FramePipeline *new_pipeline)
+        : pipeline(new_pipeline)
+    {
+    }
+
+public_methods:
+    void run()
+    {
+        pipeline->run();
+    }
+
+private_data_members:
+    FramePipeline *pipeline;
+
+};
+
+/**
+ * @brief FramePipeline::FramePipeline
+ *      Creates an empty pipeline, an empty pipeline is not used by the surface.
+ * @param new_id
+ *      The ID of the camera.
+ * @param parent
+ *      The camera surface.
+ */
+FramePipeline::FramePipeline(const int new_id, QObject *parent)
+    : QObject(parent),
+      id(new_id),
+      processed_frames(0),
+      busy(0),
+      stopping(0),
+      failed_count(0),
+      statistics(0)
+{
+    //The output of the copy stages, held by the consumers the same way as the camera pool.
+    frame_pool = new FramePool(SettingsManager::read("Pipeline/FramePoolSlots", 4).toInt());
+
+    //Period of the timing report, 0 disables it.
+    report_interval = SettingsManager::read("Pipeline/ReportInterval", 10000).toInt();
+
+    worker_pool();
+}
+
+/**
+ * @brief FramePipeline::~FramePipeline
+ *      Waits for the frame in flight, if any, the stages can not be deleted while a worker uses them.
+ */
+FramePipeline::~FramePipeline()
+{
+    stopping.storeRelease(1);
+
+    //A task that was queued but not started still has to run, it returns as soon as it sees 'stopping'.
+    while(busy.loadAcquire() != 0)
+    {
+        QThread::yieldCurrentThread();
+    }
+
+    //The last task may still be finishing after clearing 'busy'.
+    task_mutex.lock();
+    task_mutex.unlock();
+
+    frame_pool->release();
+}
+
+/**
+ * @brief FramePipeline::load
+ *      Creates the stages from a description, for example "crop 0 0 640 480; scale 320 240; convert gray; motion; statistics 5".
+ *      Stages are separated by ';', each one is a name followed by its arguments.
+ * @param description
+ *      The description, usually from the setting Camera/<id>/Pipeline.
+ * @return
+ *      False if a stage is unknown or has invalid arguments, the valid stages are still added.
+ */
+bool FramePipeline::load(const QString &description)
+{
+    bool result = true;
+
+    foreach(const QString &stage_description, description.split(';', QString::SkipEmptyParts))
+    {
+        QStringList arguments = stage_description.simplified().split(' ', QString::SkipEmptyParts);
+
+        if(arguments.isEmpty())
+        {
+            continue;
+        }
+
+        const QString name = arguments.takeFirst().toLower();
+        FrameStage *stage = create_stage(name, arguments);
+
+        if(stage != 0)
+        {
+            append(stage);
+        }
+        else
+        {
+            output("Invalid pipeline stage: " + stage_description.trimmed(), 1);
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief FramePipeline::create_stage
+ *      Stage factory used by 'load'.
+ * @param name
+ *      Name of the stage.
+ * @param arguments
+ *      Arguments of the stage.
+ * @return
+ *      The stage, or 0 if the name or the arguments are invalid.
+ */
+FrameStage *FramePipeline::create_stage(const QString &name, const QStringList &arguments)
+{
+    FrameStage *stage = 0;
+
+    if(name == "crop" && arguments.size() == 4)
+    {
+        const QRect region(arguments.at(0).toInt(), arguments.at(1).toInt(), arguments.at(2).toInt(), arguments.at(3).toInt());
+
+        if(!region.isEmpty())
+        {
+            stage = new CropStage(region);
+        }
+    }
+    else if(name == "scale" && arguments.size() == 2)
+    {
+        const QSize size(arguments.at(0).toInt(), arguments.at(1).toInt());
+
+        if(!size.isEmpty())
+        {
+            stage = new ScaleStage(size);
+        }
+    }
+    else if(name == "motion" && arguments.isEmpty())
+    {
+        stage = new MotionStage(id);
+
+        //Emitted from the worker thread, the receivers decide how to get it to their own thread.
+        connect(stage, SIGNAL(motion(int,QVector<int>,QRect)), this, SIGNAL(motion(int,QVector<int>,QRect)), Qt::DirectConnection);
+    }
+    else if(name == "background" && arguments.isEmpty())
+    {
+        stage = new BackgroundStage(id);
+
+        connect(stage, SIGNAL(presence(int,bool,int)), this, SIGNAL(presence(int,bool,int)), Qt::DirectConnection);
+    }
+    else if(name == "statistics" && arguments.size() <= 1)
+    {
+        //One frame in N, by default every frame.
+        const int interval = arguments.isEmpty() ? SettingsManager::read("ImageStatistics/Interval", 1).toInt() : arguments.first().toInt();
+
+        if(interval > 0)
+        {
+            stage = new StatisticsStage(interval);
+        }
+    }
+    else if(name == "convert" && arguments.size() == 1)
+    {
+        if(arguments.first() == "gray")
+        {
+            stage = new ConvertStage(QImage::Format_Grayscale8);
+        }
+        else if(arguments.first() == "rgb32")
+        {
+            stage = new ConvertStage(QImage::Format_RGB32);
+        }
+    }
+
+    return stage;
+}
+
+/**
+ * @brief FramePipeline::append
+ *      Adds a stage at the end of the chain, the pipeline takes ownership.
+ *      Stages can only be added before the first frame is submitted.
+ * @param stage
+ *      The stage.
+ */
+void FramePipeline::append(FrameStage *stage)
+{
+    stage->setParent(this);
+    connect(stage, SIGNAL(console(QString)), this, SIGNAL(console(QString)));
+
+    stages.append(stage);
+    stage_nsecs.append(0);
+}
+
+/**
+ * @brief FramePipeline::submit
+ *      Hands a frame to the pipeline, called by the capture thread. Never blocks.
+ * @param frame
+ *      The new frame, only its reference is copied.
+ */
+void FramePipeline::submit(const Frame &frame)
+{
+    if(pending.post(frame) && statistics != 0)
+    {
+        statistics->frame_dropped();
+    }
+
+    schedule();
+}
+
+/**
+ * @brief FramePipeline::set_statistics
+ *      Counters of the camera, the pipeline records the processing time and its drops.
+ *      Set before the first frame is submitted.
+ * @param new_statistics
+ *      The statistics, not owned.
+ */
+void FramePipeline::set_statistics(CameraStatistics *new_statistics)
+{
+    statistics = new_statistics;
+}
+
+/**
+ * @brief FramePipeline::schedule
+ *      Starts a worker task, unless one is already running for this pipeline.
+ */
+void FramePipeline::schedule()
+{
+    if(stopping.loadAcquire() == 0 && busy.testAndSetAcquire(0, 1))
+    {
+        worker_pool()->start(new FramePipelineTask(this));
+    }
+}
+
+/**
+ * @brief FramePipeline::run
+ *      Worker task, processes the pending frames until there are none.
+ *      A frame posted just after the last check would be left behind, so the mailbox is checked again after
+ *      'busy' is cleared and the task continues if it wins 'busy' back.
+ */
+void FramePipeline::run()
+{
+    QMutexLocker locker(&task_mutex);
+
+    forever
+    {
+        Frame frame;
+
+        while(stopping.loadAcquire() == 0 && pending.take(frame))
+        {
+            process(frame);
+            frame = Frame();
+        }
+
+        busy.storeRelease(0);
+
+        if(stopping.loadAcquire() != 0 || !pending.has_frame() || !busy.testAndSetAcquire(0, 1))
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief FramePipeline::make_writable
+ *      Makes sure the frame holds the only reference to its pixels, before an in-place stage writes them.
+ *      The image of a pool frame holds one reference to its slot and the buffer of the frame another one, any more are
+ *      other frames, or views, still reading it. A shared frame is copied into a buffer of the pipeline pool.
+ * @param frame
+ *      The frame.
+ * @return
+ *      False if the frame is shared and the pool has no free buffer, the frame is dropped.
+ */
+bool FramePipeline::make_writable(Frame &frame)
+{
+    if(frame.image.isDetached() && (frame.buffer.is_null() || frame.buffer.references() <= 2))
+    {
+        return true;
+    }
+
+    const int line_bytes = (frame.image.width() * frame.image.depth() + 7) / 8;
+    const int stride = FramePool::aligned_bytes_per_line(line_bytes);
+    FrameBuffer buffer = frame_pool->acquire(stride * frame.image.height());
+
+    if(buffer.is_null())
+    {
+        return false;
+    }
+
+    for(int y = 0; y < frame.image.height(); y++)
+    {
+        std::memcpy(buffer.data() + y * stride, frame.image.constScanLine(y), line_bytes);
+    }
+
+    QImage image = buffer.image(frame.image.width(), frame.image.height(), stride, frame.image.format());
+
+    //Indexed formats keep their palette.
+    if(frame.image.colorCount() > 0)
+    {
+        image.setColorTable(frame.image.colorTable());
+    }
+
+    frame.image = image;
+    frame.buffer = buffer;
+
+    return true;
+}
+
+/**
+ * @brief FramePipeline::process
+ *      Runs the stages in order and delivers the frame, each stage is timed.
+ *      A stage that fails drops the frame, the following stages are not run.
+ * @param frame
+ *      The frame.
+ */
+void FramePipeline::process(Frame &frame)
+{
+    QElapsedTimer timer;
+
+    for(int i = 0; i < stages.size(); i++)
+    {
+        timer.start();
+        const bool success = (stages.at(i)->get_kind() != FrameStage::InPlace || make_writable(frame)) &&
+                             stages.at(i)->process(frame, frame_pool);
+        stage_nsecs[i] += timer.nsecsElapsed();
+
+        if(!success || !frame.is_valid())
+        {
+            failed_count.ref();
+
+            if(statistics != 0)
+            {
+                statistics->frame_dropped();
+            }
+
+            return;
+        }
+    }
+
+    processed_frames++;
+    frame.processed_time = Frame::clock();
+
+    if(statistics != 0)
+    {
+        statistics->frame_processed(frame);
+    }
+
+    emit image_data(id, frame);
+
+    report();
+}
+
+/**
+ * @brief FramePipeline::report
+ *      Average time of each stage since the last report.
+ */
+void FramePipeline::report()
+{
+    if(report_interval <= 0 || processed_frames == 0)
+    {
+        return;
+    }
+
+    if(!report_timer.isValid())
+    {
+        report_timer.start();
+    }
+    else if(report_timer.elapsed() >= report_interval)
+    {
+        QStringList timings;
+        qint64 total_nsecs = 0;
+
+        for(int i = 0; i < stages.size(); i++)
+        {
+            timings.append(stages.at(i)->get_name() + " " + QString::number(stage_nsecs.at(i) / processed_frames / 1000000.0, 'f', 2) + " ms");
+            total_nsecs += stage_nsecs.at(i);
+            stage_nsecs[i] = 0;
+        }
+
+        output("Pipeline of camera " + QString::number(id) + ": " + timings.join(", ") +
+               ", total " + QString::number(total_nsecs / processed_frames / 1000000.0, 'f', 2) + " ms per frame, " +
+               QString::number(pending.get_superseded_count()) + " superseded, " +
+               QString::number(failed_count.load()) + " failed.", 3);
+
+        processed_frames = 0;
+        report_timer.restart();
+    }
+}
+
+/**
+ * @brief FramePipeline::is_empty
+ * @return
+ *      True if there are no stages.
+ */
+bool FramePipeline::is_empty() const
+{
+    return stages.isEmpty();
+}
+
+/**
+ * @brief FramePipeline::get_superseded_count
+ * @return
+ *      Number of frames replaced by a newer one while the stages were busy.
+ */
+int FramePipeline::get_superseded_count() const
+{
+    return pending.get_superseded_count();
+}
+
+/**
+ * @brief FramePipeline::get_failed_count
+ * @return
+ *      Number of frames dropped by a stage, usually because the pool of the pipeline had no free buffer.
+ */
+int FramePipeline::get_failed_count() const
+{
+    return failed_count.load();
+}
+
+/**
+ * @brief FramePipeline::output
+ *      Generic function responsible for all the outputs.
+ */
+void FramePipeline::output(const QString &message, const int verbose) const
+{
+    if(Output::get_verbose() >= verbose)
+    {
+        QVariantHash data;
+        data.insert("message", message);
+        data.insert("verbose", verbose);
+        data.insert("load_thread_id", true);
+
+        QString print = Output::builder(data);
+
+        if(!print.isEmpty())
+        {
+            emit console(print);
+        }
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <QObject>
+#include <QList>
+#include <QVector>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QRect>
+
+#include "defines.h"
+#include "frame.h"
+#include "framepool.h"
+#include "framestage.h"
+#include "framemailbox.h"
+#include "camerastatistics.h"
+
+class FramePipelineTask;
+
+/**
+ * @brief The FramePipeline class
+ *      Ordered chain of stages applied to the frames of one camera before they are delivered.
+ *      The surface submits each frame and returns immediately, the stages run in a shared worker pool.
+ *      Frames are passed by reference from stage to stage, copy stages write new pixels into the pool of the pipeline.
+ *      A shared frame is copied into that pool before an in-place stage, the other consumers keep the original pixels.
+ * @remarks
+ *      At most one frame per camera is in flight, so the stages see the frames in order. If a frame arrives while
+ *      the previous one is still being processed it waits in a mailbox, and is replaced if a newer one arrives first.
+ *      The capture thread therefore never waits for the stages.
+ */
+class FramePipeline : public QObject
+{
+    Q_OBJECT
+
+    friend class FramePipelineTask;
+
+public_construct:
+    explicit FramePipeline(const int new_id, QObject *parent = 0);
+    ~FramePipeline();
+
+public_methods:
+    bool load(const QString &description);
+    void append(FrameStage *stage);
+    void set_statistics(CameraStatistics *new_statistics);
+    void submit(const Frame &frame);
+
+    bool is_empty() const;
+    int get_superseded_count() const;
+    int get_failed_count() const;
+
+private_methods:
+    FrameStage *create_stage(const QString &name, const QStringList &arguments);
+    void schedule();
+    void run();
+    void process(Frame &frame);
+    bool make_writable(Frame &frame);
+    void report();
+    void output(const QString &message, const int verbose) const;
+
+private_members:
+    int id;
+    int report_interval;
+    qint64 processed_frames;
+    QAtomicInt busy;
+    QAtomicInt stopping;
+    QAtomicInt failed_count;
+    QElapsedTimer report_timer;
+    QMutex task_mutex;
+
+private_data_members:
+    QList<FrameStage*> stages;
+    QVector<qint64> stage_nsecs;
+    FrameMailbox pending;
+    FramePool* frame_pool;
+    CameraStatistics* statistics;
+
+signals:
+    void console(const QString &message) const;
+    void image_data(const int id, const Frame &new_frame) const;
+    void motion(const int id, const QVector<int> &scores, const QRect &box) const;
+    void presence(const int id, const bool present, const int foreground) const;
+
+};
+
+#endif // FRAMEPIPELINE_H
@@ -0,0 +1,325 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "framepool.h"
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Variables
+ *      The alignment is a cache line, this also satisfies the SSE and AVX load and store requirements.
+ */
+namespace
+{
+    const int alignment = 64;
+}
+
+/**
+ * @brief FrameBuffer::FrameBuffer
+ *      Creates a null buffer.
+ */
+FrameBuffer::FrameBuffer()
+    : slot(0)
+{
+}
+
+/**
+ * @brief FrameBuffer::FrameBuffer
+ *      Takes ownership of a slot that was just acquired from the pool.
+ *      The reference was already counted by the pool.
+ * @param new_slot
+ *      The acquired slot.
+ */
+FrameBuffer::FrameBuffer(FramePoolSlot *new_slot)
+    : slot(new_slot)
+{
+}
+
+/**
+ * @brief FrameBuffer::FrameBuffer
+ *      Shares the slot of another buffer, no data is copied.
+ * @param other
+ *      The buffer to share.
+ */
+FrameBuffer::FrameBuffer(const FrameBuffer &other)
+    : slot(other.slot)
+{
+    if(slot != 0)
+    {
+        slot->references.ref();
+    }
+}
+
+/**
+ * @brief FrameBuffer::~FrameBuffer
+ *      Releases this reference, the slot goes back to the pool if this was the last one.
+ */
+FrameBuffer::~FrameBuffer()
+{
+    if(slot != 0)
+    {
+        FramePool::unref(slot);
+    }
+}
+
+/**
+ * @brief FrameBuffer::operator =
+ *      Shares the slot of another buffer, no data is copied.
+ * @param other
+ *      The buffer to share.
+ * @return
+ *      This buffer.
+ */
+FrameBuffer &FrameBuffer::operator=(const FrameBuffer &other)
+{
+    if(other.slot != 0)
+    {
+        other.slot->references.ref();
+    }
+
+    if(slot != 0)
+    {
+        FramePool::unref(slot);
+    }
+
+    slot = other.slot;
+
+    return *this;
+}
+
+/**
+ * @brief FrameBuffer::is_null
+ * @return
+ *      True if this buffer does not hold a slot, e.g. the pool was exhausted.
+ */
+bool FrameBuffer::is_null() const
+{
+    return slot == 0;
+}
+
+/**
+ * @brief FrameBuffer::data
+ * @return
+ *      The aligned memory of the slot.
+ */
+uchar *FrameBuffer::data() const
+{
+    return slot != 0 ? slot->data : 0;
+}
+
+/**
+ * @brief FrameBuffer::capacity
+ * @return
+ *      The number of bytes available in the slot.
+ */
+int FrameBuffer::capacity() const
+{
+    return slot != 0 ? slot->capacity : 0;
+}
+
+/**
+ * @brief FrameBuffer::references
+ *      Every handle and every QImage created with 'image' hold one reference.
+ * @return
+ *      The number of references to the slot, 0 for a null buffer.
+ */
+int FrameBuffer::references() const
+{
+    return slot != 0 ? slot->references.load() : 0;
+}
+
+/**
+ * @brief FrameBuffer::image
+ *      Wraps the slot in a QImage without copying.
+ *      The image holds its own reference to the slot, so it can be passed around freely (e.g. queued signals)
+ *      and the memory is only recycled once every copy of the image is gone.
+ * @param width
+ *      Width of the image.
+ * @param height
+ *      Height of the image.
+ * @param bytes_per_line
+ *      Stride of the image.
+ * @param format
+ *      Format of the image.
+ * @param offset
+ *      Position of the first pixel in the buffer, used to create views of a region of another image.
+ * @return
+ *      The image, or a null image if the buffer is too small.
+ */
+QImage FrameBuffer::image(const int width, const int height, const int bytes_per_line, const QImage::Format format, const int offset) const
+{
+    const int line_bytes = (width * QImage::toPixelFormat(format).bitsPerPixel() + 7) / 8;
+
+    if(slot == 0 || offset < 0 || offset + bytes_per_line * (height - 1) + line_bytes > slot->capacity)
+    {
+        return QImage();
+    }
+
+    slot->references.ref();
+
+    return QImage(slot->data + offset, width, height, bytes_per_line, format, FramePool::image_cleanup, slot);
+}
+
+/**
+ * @brief FramePool::FramePool
+ *      Creates the slots, the memory is only allocated when first needed since the frame size is not yet known.
+ * @param slot_count
+ *      Number of frames that can be in use at the same time.
+ */
+FramePool::FramePool(const int slot_count)
+    : references(1),
+      exhausted_count(0)
+{
+    for(int i = 0; i < slot_count; i++)
+    {
+        FramePoolSlot *slot = new FramePoolSlot;
+        slot->data = 0;
+        slot->capacity = 0;
+        slot->references.store(0);
+        slot->pool = this;
+
+        slots.append(slot);
+    }
+}
+
+/**
+ * @brief FramePool::~FramePool
+ *      Frees all the slots. Only called once every slot is back in the pool.
+ */
+FramePool::~FramePool()
+{
+    for(int i = 0; i < slots.size(); i++)
+    {
+        qFreeAligned(slots.at(i)->data);
+        delete slots.at(i);
+    }
+}
+
+/**
+ * @brief FramePool::acquire
+ *      Gets a free slot with at least 'bytes' of memory.
+ *      This is lock-free, the slots are claimed with a compare and swap on their reference count.
+ * @param bytes
+ *      Size needed for the frame.
+ * @return
+ *      The buffer, or a null buffer if every slot is in use.
+ *      The caller should drop the frame in that case, the consumers are not keeping up.
+ */
+FrameBuffer FramePool::acquire(const int bytes)
+{
+    for(int i = 0; i < slots.size(); i++)
+    {
+        FramePoolSlot *slot = slots.at(i);
+
+        if(slot->references.testAndSetAcquire(0, 1))
+        {
+            //Only grows, so this happens on the first frames or when the format changes.
+            if(slot->capacity < bytes)
+            {
+                qFreeAligned(slot->data);
+                slot->data = static_cast<uchar*>(qMallocAligned(bytes, alignment));
+                slot->capacity = slot->data != 0 ? bytes : 0;
+            }
+
+            references.ref();
+
+            if(slot->data == 0)
+            {
+                unref(slot);
+                break;
+            }
+
+            return FrameBuffer(slot);
+        }
+    }
+
+    exhausted_count.ref();
+
+    return FrameBuffer();
+}
+
+/**
+ * @brief FramePool::release
+ *      Releases the owner reference. Use this instead of delete.
+ */
+void FramePool::release()
+{
+    if(!references.deref())
+    {
+        delete this;
+    }
+}
+
+/**
+ * @brief FramePool::get_slot_count
+ * @return
+ *      Number of slots of this pool.
+ */
+int FramePool::get_slot_count() const
+{
+    return slots.size();
+}
+
+/**
+ * @brief FramePool::get_exhausted_count
+ * @return
+ *      Number of times a buffer was requested while all the slots were in use.
+ */
+int FramePool::get_exhausted_count() const
+{
+    return exhausted_count.load();
+}
+
+/**
+ * @brief FramePool::aligned_bytes_per_line
+ *      Rounds the stride up to the alignment of the pool, so every line starts aligned.
+ * @param bytes_per_line
+ *      The minimum stride.
+ * @return
+ *      The aligned stride.
+ */
+int FramePool::aligned_bytes_per_line(const int bytes_per_line)
+{
+    return (bytes_per_line + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * @brief FramePool::unref
+ *      Releases a reference to a slot. When the slot is free, the reference it had on the pool is also released.
+ * @param slot
+ *      The slot.
+ */
+void FramePool::unref(FramePoolSlot *slot)
+{
+    if(!slot->references.deref())
+    {
+        slot->pool->release();
+    }
+}
+
+/**
+ * @brief FramePool::image_cleanup
+ *      Called by QImage when the last copy of an image created by FrameBuffer::image is destroyed.
+ * @param info
+ *      The slot.
+ */
+void FramePool::image_cleanup(void *info)
+{
+    unref(static_cast<FramePoolSlot*>(info));
+}
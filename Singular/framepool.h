@@ -0,0 +1,119 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <QImage>
+#include <QVector>
+#include <QAtomicInt>
+
+#include "defines.h"
+
+class FramePool;
+
+/**
+ * @brief The FramePoolSlot struct
+ *      One reusable buffer of the pool.
+ *      A slot is free while its reference count is zero.
+ */
+struct FramePoolSlot
+{
+    uchar *data;
+    int capacity;
+    QAtomicInt references;
+    FramePool *pool;
+};
+
+/**
+ * @brief The FrameBuffer class
+ *      Reference counted handle to a slot of a FramePool.
+ *      Copying a handle only increments the reference count, the slot returns to the pool when the last handle,
+ *      or the last QImage created with 'image', is destroyed.
+ */
+class FrameBuffer
+{
+    friend class FramePool;
+
+public_construct:
+    FrameBuffer();
+    FrameBuffer(const FrameBuffer &other);
+    ~FrameBuffer();
+
+public_methods:
+    bool is_null() const;
+    uchar *data() const;
+    int capacity() const;
+    int references() const;
+
+    QImage image(const int width, const int height, const int bytes_per_line, const QImage::Format format, const int offset = 0) const;
+
+public_operators:
+    FrameBuffer &operator=(const FrameBuffer &other);
+
+private_construct:
+    explicit FrameBuffer(FramePoolSlot *new_slot);
+
+private_data_members:
+    FramePoolSlot *slot;
+
+};
+
+/**
+ * @brief The FramePool class
+ *      Fixed number of aligned buffers that are reused from frame to frame.
+ *      Buffers are only (re)allocated when a frame needs more bytes than the slot already has,
+ *      so after the first frames of a stream there is no heap allocation per frame.
+ * @remarks
+ *      The pool is reference counted by its owner and by every slot in use. The owner calls 'release'
+ *      instead of deleting it, the pool is deleted once the owner and all the consumers are done with it.
+ */
+class FramePool
+{
+
+public_construct:
+    explicit FramePool(const int slot_count);
+
+public_methods:
+    FrameBuffer acquire(const int bytes);
+    void release();
+
+    int get_slot_count() const;
+    int get_exhausted_count() const;
+
+    static int aligned_bytes_per_line(const int bytes_per_line);
+
+private_construct:
+    ~FramePool();
+
+private_methods:
+    static void unref(FramePoolSlot *slot);
+    static void image_cleanup(void *info);
+
+private_members:
+    QAtomicInt references;
+    QAtomicInt exhausted_count;
+
+private_data_members:
+    QVector<FramePoolSlot*> slots;
+
+    friend class FrameBuffer;
+
+};
+
+#endif // FRAMEPOOL_H
@@ -0,0 +1,268 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "framescale.h"
+#include "simd.h"
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Kernels
+ *      The vertical kernels average two whole source lines into a line buffer, the horizontal ones average the pair of
+ *      pixels at each column position of the buffer. SSE2 loads the pairs with one 8 byte load each, AVX2 gathers them.
+ *      The AVX2 kernels clear the upper halves of the registers before handing the rest of the line to the SSE2 kernel.
+ */
+namespace
+{
+    typedef void (*VerticalRow)(const uchar *line0, const uchar *line1, uchar *destination, const int start, const int bytes);
+    typedef void (*HorizontalRow)(const uchar *line, const int *columns, uchar *destination, const int start, const int width);
+
+    inline int average(const int a, const int b)
+    {
+        return (a + b + 1) >> 1;
+    }
+
+    /**
+     * The centre of output pixel i is at (2 i + 1) source_size / (2 size) source pixels, the pair surrounds it.
+     */
+    inline int sample_position(const int i, const int source_size, const int size)
+    {
+        const qint64 position = ((2 * i + 1) * static_cast<qint64>(source_size) - size) / (2 * size);
+
+        return static_cast<int>(qBound(Q_INT64_C(0), position, static_cast<qint64>(source_size - 2)));
+    }
+
+    void vertical_row_scalar(const uchar *line0, const uchar *line1, uchar *destination, const int start, const int bytes)
+    {
+        for(int x = start; x < bytes; x++)
+        {
+            destination[x] = static_cast<uchar>(average(line0[x], line1[x]));
+        }
+    }
+
+    void horizontal_row_scalar(const uchar *line, const int *columns, uchar *destination, const int start, const int width)
+    {
+        for(int x = start; x < width; x++)
+        {
+            const uchar *pair = line + columns[x] * 4;
+
+            for(int channel = 0; channel < 4; channel++)
+            {
+                destination[x * 4 + channel] = static_cast<uchar>(average(pair[channel], pair[channel + 4]));
+            }
+        }
+    }
+
+#if defined(simd_x86)
+    void vertical_row_sse2(const uchar *line0, const uchar *line1, uchar *destination, const int start, const int bytes)
+    {
+        int x = start;
+
+        for(; x + 16 <= bytes; x += 16)
+        {
+            const __m128i value = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(line0 + x)),
+                                               _mm_loadu_si128(reinterpret_cast<const __m128i*>(line1 + x)));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x), value);
+        }
+
+        vertical_row_scalar(line0, line1, destination, x, bytes);
+    }
+
+    /**
+     * 4 output pixels, each pair is loaded at once and the shuffles separate the left and right pixels.
+     */
+    void horizontal_row_sse2(const uchar *line, const int *columns, uchar *destination, const int start, const int width)
+    {
+        int x = start;
+
+        for(; x + 4 <= width; x += 4)
+        {
+            const __m128i first = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(line + columns[x] * 4)),
+                                                     _mm_loadl_epi64(reinterpret_cast<const __m128i*>(line + columns[x + 1] * 4)));
+            const __m128i second = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(line + columns[x + 2] * 4)),
+                                                      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(line + columns[x + 3] * 4)));
+
+            const __m128i left = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(first), _mm_castsi128_ps(second), _MM_SHUFFLE(2, 0, 2, 0)));
+            const __m128i right = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(first), _mm_castsi128_ps(second), _MM_SHUFFLE(3, 1, 3, 1)));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x * 4), _mm_avg_epu8(left, right));
+        }
+
+        horizontal_row_scalar(line, columns, destination, x, width);
+    }
+
+    simd_avx2_target void vertical_row_avx2(const uchar *line0, const uchar *line1, uchar *destination, const int start, const int bytes)
+    {
+        int x = start;
+
+        for(; x + 32 <= bytes; x += 32)
+        {
+            const __m256i value = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(line0 + x)),
+                                                  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line1 + x)));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + x), value);
+        }
+
+        _mm256_zeroupper();
+        vertical_row_sse2(line0, line1, destination, x, bytes);
+    }
+
+    /**
+     * 8 output pixels, the left and right pixels of the pairs are gathered separately.
+     */
+    simd_avx2_target void horizontal_row_avx2(const uchar *line, const int *columns, uchar *destination, const int start, const int width)
+    {
+        const int *pixels = reinterpret_cast<const int*>(line);
+
+        int x = start;
+
+        for(; x + 8 <= width; x += 8)
+        {
+            const __m256i indices = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(columns + x));
+
+            const __m256i left = _mm256_i32gather_epi32(pixels, indices, 4);
+            const __m256i right = _mm256_i32gather_epi32(pixels + 1, indices, 4);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + x * 4), _mm256_avg_epu8(left, right));
+        }
+
+        _mm256_zeroupper();
+        horizontal_row_sse2(line, columns, destination, x, width);
+    }
+#endif
+
+    VerticalRow vertical_row()
+    {
+        VerticalRow row = vertical_row_scalar;
+
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                row = vertical_row_avx2;
+                break;
+            }
+            case Simd::SSE2:
+            {
+                row = vertical_row_sse2;
+                break;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        return row;
+    }
+
+    HorizontalRow horizontal_row()
+    {
+        HorizontalRow row = horizontal_row_scalar;
+
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                row = horizontal_row_avx2;
+                break;
+            }
+            case Simd::SSE2:
+            {
+                row = horizontal_row_sse2;
+                break;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        return row;
+    }
+}
+
+/**
+ * @brief FrameScale::sample_positions
+ *      Position of the first of the two source pixels sampled for each output pixel, along one direction.
+ *      Computed once per source and output size, the same positions serve every frame.
+ * @param source_size
+ *      Source width or height, at least 2.
+ * @param size
+ *      Output width or height.
+ * @param positions
+ *      Receives 'size' positions, from 0 to source_size - 2.
+ */
+void FrameScale::sample_positions(const int source_size, const int size, int *positions)
+{
+    for(int i = 0; i < size; i++)
+    {
+        positions[i] = sample_position(i, source_size, size);
+    }
+}
+
+/**
+ * @brief FrameScale::downscale_rgb32
+ *      Reduces an RGB32 image into a region of another image.
+ * @param source
+ *      RGB32 input, at least 2x2.
+ * @param source_stride
+ *      Bytes per line of the input.
+ * @param source_width
+ *      Width of the input in pixels.
+ * @param source_height
+ *      Height of the input in pixels.
+ * @param destination
+ *      First pixel of the output region.
+ * @param destination_stride
+ *      Bytes per line of the output.
+ * @param width
+ *      Width of the output region, at most the input width.
+ * @param height
+ *      Height of the output region, at most the input height.
+ * @param columns
+ *      Positions from sample_positions(source_width, width), the averaged bytes are clipped to the source line.
+ * @param line
+ *      Line buffer of source_width * 4 bytes.
+ */
+void FrameScale::downscale_rgb32(const uchar *source, const int source_stride, const int source_width, const int source_height,
+                                 uchar *destination, const int destination_stride, const int width, const int height,
+                                 const int *columns, uchar *line)
+{
+    const VerticalRow vertical = vertical_row();
+    const HorizontalRow horizontal = horizontal_row();
+
+    //Only the part of the source lines that is sampled is averaged, never past the end of a source line.
+    const int first_byte = qBound(0, columns[0], source_width - 1) * 4;
+    const int last_byte = qBound(first_byte / 4 + 1, columns[width - 1] + 2, source_width) * 4;
+
+    for(int y = 0; y < height; y++)
+    {
+        const uchar *line0 = source + sample_position(y, source_height, height) * source_stride;
+
+        vertical(line0 + first_byte, line0 + source_stride + first_byte, line + first_byte, 0, last_byte - first_byte);
+        horizontal(line, columns, destination + y * destination_stride, 0, width);
+    }
+}
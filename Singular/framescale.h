@@ -0,0 +1,43 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef FRAMESCALE_H
+#define FRAMESCALE_H
+
+#include <QtGlobal>
+
+/**
+ * @brief The FrameScale namespace
+ *      Fast RGB32 downscaling for previews and mosaics, written directly into a region of a larger image.
+ *      Every output pixel is the average of the 2x2 source pixels closest to its centre, first the two lines and then the two columns.
+ * @remarks
+ *      This is bilinear filtering at the middle of the source pixels: it is exact for a factor of two and
+ *      only samples the source for larger factors, good enough to monitor many cameras at once and cheap enough to do it every frame.
+ *      Averages use the rounding of the SSE2 average instruction, (a + b + 1) / 2, the scalar and vector versions match.
+ */
+namespace FrameScale
+{
+    void sample_positions(const int source_size, const int size, int *positions);
+
+    void downscale_rgb32(const uchar *source, const int source_stride, const int source_width, const int source_height,
+                         uchar *destination, const int destination_stride, const int width, const int height,
+                         const int *columns, uchar *line);
+}
+
+#endif // FRAMESCALE_H
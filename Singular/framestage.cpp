@@ -0,0 +1,100 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "framestage.h"
+#include "output.h"
+
+/**
+ * @brief FrameStage::FrameStage
+ * @param new_name
+ *      Name of the stage, used in the timing reports of the pipeline.
+ * @param new_kind
+ *      View, in-place or copy, see FrameStage.
+ * @param parent
+ *      The pipeline, it owns the stage.
+ */
+FrameStage::FrameStage(const QString &new_name, const Kind new_kind, QObject *parent)
+    : QObject(parent),
+      name(new_name),
+      kind(new_kind)
+{
+}
+
+/**
+ * @brief FrameStage::~FrameStage
+ */
+FrameStage::~FrameStage()
+{
+}
+
+/**
+ * @brief FrameStage::get_name
+ * @return
+ *      Name of the stage.
+ */
+QString FrameStage::get_name() const
+{
+    return name;
+}
+
+/**
+ * @brief FrameStage::get_kind
+ * @return
+ *      View, in-place or copy. The pipeline makes the frame writable before an in-place stage.
+ */
+FrameStage::Kind FrameStage::get_kind() const
+{
+    return kind;
+}
+
+/**
+ * @brief FrameStage::pixels
+ *      Writable pixels of the frame for in-place stages.
+ *      The pipeline hands an in-place stage a frame that holds the only reference to its pixels, so this does not copy.
+ *      Any other stage would get a private copy of the image, detached on the heap.
+ * @param frame
+ *      The frame being processed.
+ * @return
+ *      Pointer to the first pixel.
+ */
+uchar *FrameStage::pixels(Frame &frame)
+{
+    return frame.image.bits();
+}
+
+/**
+ * @brief FrameStage::output
+ *      Generic function responsible for all the outputs.
+ */
+void FrameStage::output(const QString &message, const int verbose) const
+{
+    if(Output::get_verbose() >= verbose)
+    {
+        QVariantHash data;
+        data.insert("message", message);
+        data.insert("verbose", verbose);
+        data.insert("load_thread_id", true);
+
+        QString print = Output::builder(data);
+
+        if(!print.isEmpty())
+        {
+            emit console(print);
+        }
+    }
+}
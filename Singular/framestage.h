@@ -0,0 +1,76 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMESTAGE_H
+#define FRAMESTAGE_H
+
+#include <QObject>
+#include <QString>
+
+#include "defines.h"
+#include "frame.h"
+#include "framepool.h"
+
+/**
+ * @brief The FrameStage class
+ *      One step of a FramePipeline. The pipeline hands the same Frame to every stage in order.
+ *      A view stage only reads the pixels, it may attach data to the frame or make its image a view of other pixels of the slot.
+ *      An in-place stage writes the pixels of the frame, the pipeline first moves a frame shared with other consumers
+ *      (e.g. the pre-roll) into a buffer of its own pool, so the stage always writes pixels nobody else reads.
+ *      A copy stage writes a new image into a buffer of the pool given by the pipeline and replaces the image of the frame,
+ *      the source slot is released as soon as the frame no longer refers to it.
+ * @remarks
+ *      'process' runs in a worker thread of the pipeline, never concurrently for the same stage, so a stage may keep state
+ *      between frames without locking. Signals emitted by a stage are emitted from that worker thread.
+ */
+class FrameStage : public QObject
+{
+    Q_OBJECT
+
+public_enums:
+    enum Kind
+    {
+        View,
+        InPlace,
+        Copy
+    };
+
+public_construct:
+    FrameStage(const QString &new_name, const Kind new_kind, QObject *parent = 0);
+    virtual ~FrameStage();
+
+public_methods:
+    virtual bool process(Frame &frame, FramePool *pool) = 0;
+
+    QString get_name() const;
+    Kind get_kind() const;
+
+protected_methods:
+    static uchar *pixels(Frame &frame);
+    void output(const QString &message, const int verbose) const;
+
+private_data_members:
+    QString name;
+    Kind kind;
+
+signals:
+    void console(const QString &message) const;
+
+};
+
+#endif // FRAMESTAGE_H
@@ -0,0 +1,359 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "glcameraview.h"
+#include "camerawidget.h"
+#include "output.h"
+
+#include <QPainter>
+#include <QOpenGLContext>
+
+#include <cstring>
+
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Variables
+ *      The quad covers the whole view, like the painter renderer the frame is stretched to the widget.
+ *      The first line of the texture is the top of the image.
+ */
+namespace
+{
+    const char *vertex_shader =
+        "attribute highp vec2 position;\n"
+        "attribute highp vec2 coordinate;\n"
+        "varying highp vec2 texture_coordinate;\n"
+        "void main()\n"
+        "{\n"
+        "    texture_coordinate = coordinate;\n"
+        "    gl_Position = vec4(position, 0.0, 1.0);\n"
+        "}\n";
+
+    const char *fragment_shader =
+        "uniform sampler2D frame;\n"
+        "varying highp vec2 texture_coordinate;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_FragColor = vec4(texture2D(frame, texture_coordinate).bgr, 1.0);\n"
+        "}\n";
+
+    const GLfloat positions[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+    const GLfloat coordinates[] = { 0.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f };
+}
+
+/**
+ * @brief GLCameraView::GLCameraView
+ *      Connect the view with the console.
+ * @param parent
+ *      The camera widget, the frames are taken from its mailbox.
+ */
+GLCameraView::GLCameraView(CameraWidget *parent) :
+    QOpenGLWidget(parent),
+    valid(false),
+    unpack_row_length(false),
+    pixel_buffer_index(0),
+    texture(0),
+    camera_widget(parent),
+    program(0)
+{
+    connect(this, SIGNAL(console(QString)), parent, SIGNAL(console(QString)));
+
+    for(int i = 0; i < 2; i++)
+    {
+        pixel_buffers[i] = QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer);
+        pixel_buffer_bytes[i] = 0;
+    }
+}
+
+/**
+ * @brief GLCameraView::~GLCameraView
+ *      Frees the GPU resources.
+ */
+GLCameraView::~GLCameraView()
+{
+    cleanup();
+}
+
+/**
+ * @brief GLCameraView::initializeGL
+ *      Compiles the shaders and creates the texture and the pixel buffers.
+ *      If anything fails, 'failed' is emitted and the camera widget goes back to the painter.
+ */
+void GLCameraView::initializeGL()
+{
+    if(context() == 0 || !context()->isValid())
+    {
+        output("OpenGL context not available.", 1);
+        emit failed();
+        return;
+    }
+
+    connect(context(), SIGNAL(aboutToBeDestroyed()), this, SLOT(cleanup()));
+    initializeOpenGLFunctions();
+
+    program = new QOpenGLShaderProgram(this);
+
+    valid = program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertex_shader) &&
+            program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragment_shader) &&
+            program->link();
+
+    if(!valid)
+    {
+        output("OpenGL shaders failed: " + program->log(), 1);
+        emit failed();
+        return;
+    }
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    //OpenGL ES 2 has neither pixel buffers nor row length, the frames are then uploaded directly.
+    unpack_row_length = !context()->isOpenGLES() || context()->format().majorVersion() >= 3;
+
+    if(unpack_row_length)
+    {
+        for(int i = 0; i < 2; i++)
+        {
+            pixel_buffers[i].setUsagePattern(QOpenGLBuffer::StreamDraw);
+            pixel_buffers[i].create();
+        }
+    }
+
+    output("OpenGL renderer started: " + QString(reinterpret_cast<const char*>(glGetString(GL_RENDERER))), 3);
+}
+
+/**
+ * @brief GLCameraView::paintGL
+ *      Uploads the newest frame, if any, and draws it.
+ *      The frame is released right after the upload, the texture keeps the pixels so no pool slot is held while displaying.
+ */
+void GLCameraView::paintGL()
+{
+    if(!valid)
+    {
+        return;
+    }
+
+    if(camera_widget->take_frame(frame) && frame.is_valid())
+    {
+        //Frames from a pipeline can have other formats, for example grayscale for analytics.
+        if(frame.image.format() == QImage::Format_RGB32 || frame.image.format() == QImage::Format_ARGB32)
+        {
+            upload(frame.image);
+        }
+        else
+        {
+            upload(frame.image.convertToFormat(QImage::Format_RGB32));
+        }
+    }
+
+    frame = Frame();
+
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if(!texture_size.isEmpty())
+    {
+        program->bind();
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        program->setUniformValue("frame", 0);
+
+        program->enableAttributeArray("position");
+        program->enableAttributeArray("coordinate");
+        program->setAttributeArray("position", positions, 2);
+        program->setAttributeArray("coordinate", coordinates, 2);
+
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        program->disableAttributeArray("position");
+        program->disableAttributeArray("coordinate");
+        program->release();
+    }
+
+    //Shows a border with the true size of the frame, the same as the painter renderer.
+    QPainter painter(this);
+    painter.setBrush(Qt::CrossPattern);
+    painter.setPen(Qt::red);
+    painter.drawRect(0, 0, texture_size.width(), texture_size.height());
+
+    camera_widget->draw_overlay(painter);
+}
+
+/**
+ * @brief GLCameraView::upload
+ *      Copies the frame to the texture. The texture is only reallocated when the frame size changes.
+ *      With pixel buffers the frame is copied into a buffer through a mapping and uploaded from it in the same paint,
+ *      the driver copies it to the texture asynchronously. Each buffer is allocated once, for the largest frame,
+ *      and its old content is invalidated by the mapping, so the CPU does not wait for the GPU to finish reading it.
+ *      The two buffers take turns, which keeps the copy from waiting when the driver does not rename invalidated storage.
+ * @param image
+ *      The RGB32 frame.
+ */
+void GLCameraView::upload(const QImage &image)
+{
+    if(!unpack_row_length || !pixel_buffers[0].isCreated() || !pixel_buffers[1].isCreated())
+    {
+        upload_direct(image);
+        return;
+    }
+
+    QOpenGLBuffer &pixel_buffer = pixel_buffers[pixel_buffer_index];
+    const int bytes = image.bytesPerLine() * image.height();
+
+    //The texture is allocated before the buffer is bound, otherwise its null pointer would be an offset into the buffer.
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    if(texture_size != image.size())
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width(), image.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        texture_size = image.size();
+    }
+
+    if(!pixel_buffer.bind())
+    {
+        upload_direct(image);
+        return;
+    }
+
+    if(pixel_buffer_bytes[pixel_buffer_index] < bytes)
+    {
+        pixel_buffer.allocate(bytes);
+        pixel_buffer_bytes[pixel_buffer_index] = bytes;
+    }
+
+    void *mapped = pixel_buffer.mapRange(0, bytes, QOpenGLBuffer::RangeWrite | QOpenGLBuffer::RangeInvalidateBuffer);
+
+    if(mapped != 0)
+    {
+        std::memcpy(mapped, image.constBits(), bytes);
+        pixel_buffer.unmap();
+    }
+    else
+    {
+        pixel_buffer.write(0, image.constBits(), bytes);
+    }
+
+    pixel_buffer_index = 1 - pixel_buffer_index;
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image.bytesPerLine() / 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width(), image.height(), GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    pixel_buffer.release();
+}
+
+/**
+ * @brief GLCameraView::upload_direct
+ *      Copies the frame to the texture from client memory, without pixel buffers.
+ * @param image
+ *      The RGB32 frame.
+ */
+void GLCameraView::upload_direct(const QImage &image)
+{
+    const int width = image.width();
+    const int height = image.height();
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    if(texture_size != image.size())
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        texture_size = image.size();
+    }
+
+    if(unpack_row_length)
+    {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, image.bytesPerLine() / 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+    else if(image.bytesPerLine() == width * 4)
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+    }
+    else
+    {
+        for(int i = 0; i < height; i++)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, i, width, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.constScanLine(i));
+        }
+    }
+}
+
+/**
+ * @brief GLCameraView::cleanup
+ *      Frees the texture, the pixel buffers and the shaders. Called before the context is destroyed.
+ */
+void GLCameraView::cleanup()
+{
+    if(program != 0)
+    {
+        makeCurrent();
+
+        if(texture != 0)
+        {
+            glDeleteTextures(1, &texture);
+            texture = 0;
+        }
+
+        for(int i = 0; i < 2; i++)
+        {
+            pixel_buffers[i].destroy();
+            pixel_buffer_bytes[i] = 0;
+        }
+
+        delete program;
+        program = 0;
+        valid = false;
+
+        doneCurrent();
+    }
+}
+
+/**
+ * @brief GLCameraView::output
+ *      Generic function responsible for all the outputs.
+ */
+void GLCameraView::output(const QString &message, const int verbose) const
+{
+    if(Output::get_verbose() >= verbose)
+    {
+        QVariantHash data;
+        data.insert("message", message);
+        data.insert("verbose", verbose);
+        data.insert("load_thread_id", true);
+
+        QString print = Output::builder(data);
+
+        if(!print.isEmpty())
+        {
+            emit console(print);
+        }
+    }
+}
@@ -0,0 +1,80 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GLCAMERAVIEW_H
+#define GLCAMERAVIEW_H
+
+#include <QOpenGLWidget>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLBuffer>
+
+#include "defines.h"
+#include "frame.h"
+
+class CameraWidget;
+
+/**
+ * @brief The GLCameraView class
+ *      OpenGL renderer of the CameraWidget. The frames are streamed through two pixel buffer objects
+ *      into a persistent texture, and scaled by the GPU when the quad is drawn.
+ * @remarks
+ *      The frames are RGB32 (B, G, R, A in memory), they are uploaded as RGBA and swizzled in the shader,
+ *      this way the same upload works on desktop OpenGL and OpenGL ES, that do not share a BGRA format.
+ */
+class GLCameraView : public QOpenGLWidget, protected QOpenGLFunctions
+{
+    Q_OBJECT
+
+public_construct:
+    explicit GLCameraView(CameraWidget *parent);
+    ~GLCameraView();
+
+protected_methods:
+    void initializeGL();
+    void paintGL();
+
+private_methods:
+    void upload(const QImage &image);
+    void upload_direct(const QImage &image);
+    void output(const QString &message, const int verbose) const;
+
+private_members:
+    bool valid;
+    bool unpack_row_length;
+    int pixel_buffer_index;
+    int pixel_buffer_bytes[2];
+    GLuint texture;
+    QSize texture_size;
+
+private_data_members:
+    CameraWidget *camera_widget;
+    QOpenGLShaderProgram *program;
+    QOpenGLBuffer pixel_buffers[2];
+    Frame frame;
+
+private slots:
+    void cleanup();
+
+signals:
+    void console(const QString &message) const;
+    void failed() const;
+
+};
+
+#endif // GLCAMERAVIEW_H
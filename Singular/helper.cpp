@@ -18,6 +18,13 @@
 
 #include "helper.h"
 
+#if defined(Q_OS_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(Q_OS_WIN)
+#include <qt_windows.h>
+#endif
+
 /**
  * @brief Helper::parse_json_object
  *      Recursive function that inserts into &listings, the keys and values that match &keys.
@@ -200,6 +207,65 @@ QString Helper::get_thread_id()
     return "0x" + QString::number(reinterpret_cast<quintptr>(QThread::currentThreadId()), 16);
 }
 
+/**
+ * @brief Helper::set_thread_affinity
+ *      Pins the calling thread to a single CPU core.
+ *      Only implemented for Linux and Windows, on other systems the scheduler keeps deciding.
+ * @param core
+ *      The core number, starting at 0.
+ * @return
+ *      Success = true; Failed = false
+ */
+bool Helper::set_thread_affinity(const int core)
+{
+    bool result = false;
+
+    if(core >= 0 && core < QThread::idealThreadCount())
+    {
+#if defined(Q_OS_LINUX)
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(core, &cpu_set);
+
+        result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#elif defined(Q_OS_WIN)
+        result = SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << core) != 0;
+#endif
+    }
+
+    return result;
+}
+
+/**
+ * @brief Helper::set_realtime_priority
+ *      Moves the calling thread to the real-time scheduler, so it runs before every normal thread when it wakes up.
+ *      On Linux this is SCHED_FIFO, which needs CAP_SYS_NICE or an RLIMIT_RTPRIO of at least the priority,
+ *      on Windows the thread gets the time critical priority. On other systems nothing changes.
+ * @param priority
+ *      The SCHED_FIFO priority, clamped to the range of the system.
+ * @return
+ *      Success = true; Failed = false
+ */
+bool Helper::set_realtime_priority(const int priority)
+{
+    bool result = false;
+
+#if defined(Q_OS_LINUX)
+    sched_param parameters;
+    parameters.sched_priority = qBound(sched_get_priority_min(SCHED_FIFO), priority, sched_get_priority_max(SCHED_FIFO));
+
+    result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters) == 0;
+#elif defined(Q_OS_WIN)
+    Q_UNUSED(priority)
+
+    result = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+    Q_UNUSED(priority)
+#endif
+
+    return result;
+}
+
 /**
  * @brief Helper::proxy_type
  *      Returns the suported proxy types.
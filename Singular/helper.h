@@ -51,6 +51,8 @@ namespace Helper
     int random_number(const int low, const int high);
 
     QString get_thread_id();
+    bool set_thread_affinity(const int core);
+    bool set_realtime_priority(const int priority);
     QNetworkProxy::ProxyType proxy_type(const QString &type);
 }
 
@@ -0,0 +1,238 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imagestages.h"
+
+#include <QPainter>
+
+/**
+ * @brief CropStage::CropStage
+ * @param new_region
+ *      Region to keep, in pixels of the incoming frame.
+ * @param parent
+ *      The pipeline.
+ */
+CropStage::CropStage(const QRect &new_region, QObject *parent)
+    : FrameStage("crop", View, parent),
+      region(new_region)
+{
+}
+
+/**
+ * @brief CropStage::process
+ *      The region is clipped to the frame. Frames that do not come from a pool, or with less than a byte per pixel,
+ *      can not be viewed at an offset and are copied instead.
+ * @param frame
+ *      The frame to crop.
+ * @return
+ *      False if the region is outside the frame.
+ */
+bool CropStage::process(Frame &frame, FramePool *pool)
+{
+    Q_UNUSED(pool);
+
+    const QRect clipped = region.intersected(frame.image.rect());
+
+    if(clipped.isEmpty())
+    {
+        return false;
+    }
+
+    if(clipped == frame.image.rect())
+    {
+        return true;
+    }
+
+    const int bytes_per_pixel = frame.image.depth() / 8;
+
+    if(!frame.buffer.is_null() && frame.image.depth() % 8 == 0)
+    {
+        //The frame may already be a view, the offset is relative to the start of the slot.
+        const int offset = static_cast<int>(frame.image.constBits() - frame.buffer.data()) +
+                           clipped.y() * frame.image.bytesPerLine() + clipped.x() * bytes_per_pixel;
+
+        frame.image = frame.buffer.image(clipped.width(), clipped.height(), frame.image.bytesPerLine(), frame.image.format(), offset);
+    }
+    else
+    {
+        frame.image = frame.image.copy(clipped);
+        frame.buffer = FrameBuffer();
+    }
+
+    return frame.is_valid();
+}
+
+/**
+ * @brief ScaleStage::ScaleStage
+ * @param new_size
+ *      Bounding size of the output, the aspect ratio of the frame is kept.
+ * @param parent
+ *      The pipeline.
+ */
+ScaleStage::ScaleStage(const QSize &new_size, QObject *parent)
+    : FrameStage("scale", Copy, parent),
+      size(new_size)
+{
+}
+
+/**
+ * @brief ScaleStage::process
+ *      Draws the frame scaled into an RGB32 pool buffer.
+ * @param frame
+ *      The frame to scale.
+ * @param pool
+ *      Pool of the pipeline.
+ * @return
+ *      False if the pool has no free buffer.
+ */
+bool ScaleStage::process(Frame &frame, FramePool *pool)
+{
+    const QSize scaled = frame.image.size().scaled(size, Qt::KeepAspectRatio);
+
+    if(scaled.isEmpty())
+    {
+        return false;
+    }
+
+    if(scaled == frame.image.size())
+    {
+        return true;
+    }
+
+    const int stride = FramePool::aligned_bytes_per_line(scaled.width() * 4);
+    FrameBuffer buffer = pool->acquire(stride * scaled.height());
+
+    if(buffer.is_null())
+    {
+        return false;
+    }
+
+    QImage image = buffer.image(scaled.width(), scaled.height(), stride, QImage::Format_RGB32);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.drawImage(image.rect(), frame.image);
+    painter.end();
+
+    frame.image = image;
+    frame.buffer = buffer;
+
+    return true;
+}
+
+/**
+ * @brief ConvertStage::ConvertStage
+ * @param new_format
+ *      Output format. Grayscale8 has its own conversion, any other format is drawn by QPainter.
+ * @param parent
+ *      The pipeline.
+ */
+ConvertStage::ConvertStage(const QImage::Format new_format, QObject *parent)
+    : FrameStage("convert", Copy, parent),
+      format(new_format)
+{
+}
+
+/**
+ * @brief ConvertStage::process
+ *      Converts the frame into a pool buffer.
+ * @param frame
+ *      The frame to convert.
+ * @param pool
+ *      Pool of the pipeline.
+ * @return
+ *      False if the pool has no free buffer or the format is not supported.
+ */
+bool ConvertStage::process(Frame &frame, FramePool *pool)
+{
+    if(frame.image.format() == format)
+    {
+        return true;
+    }
+
+    const int width = frame.image.width();
+    const int height = frame.image.height();
+    const int depth = format == QImage::Format_Grayscale8 ? 1 : 4;
+
+    if(format != QImage::Format_Grayscale8 && QImage::toPixelFormat(format).bitsPerPixel() != 32)
+    {
+        output("Pipeline conversion to format " + QString::number(format) + " is not supported.", 1);
+        return false;
+    }
+
+    const int stride = FramePool::aligned_bytes_per_line(width * depth);
+    FrameBuffer buffer = pool->acquire(stride * height);
+
+    if(buffer.is_null())
+    {
+        return false;
+    }
+
+    QImage image = buffer.image(width, height, stride, format);
+
+    if(format == QImage::Format_Grayscale8)
+    {
+        if(frame.image.format() == QImage::Format_RGB32 || frame.image.format() == QImage::Format_ARGB32)
+        {
+            rgb32_to_grayscale(frame.image, buffer.data(), stride);
+        }
+        else
+        {
+            rgb32_to_grayscale(frame.image.convertToFormat(QImage::Format_RGB32), buffer.data(), stride);
+        }
+    }
+    else
+    {
+        QPainter painter(&image);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.drawImage(0, 0, frame.image);
+        painter.end();
+    }
+
+    frame.image = image;
+    frame.buffer = buffer;
+
+    return true;
+}
+
+/**
+ * @brief ConvertStage::rgb32_to_grayscale
+ *      BT.601 luma in 8 bit fixed point: (77 R + 150 G + 29 B) / 256.
+ * @param source
+ *      RGB32 image, that is B, G, R, A in memory.
+ * @param destination
+ *      One byte per pixel.
+ * @param destination_stride
+ *      Bytes per line of the destination.
+ */
+void ConvertStage::rgb32_to_grayscale(const QImage &source, uchar *destination, const int destination_stride)
+{
+    const int width = source.width();
+    const int height = source.height();
+
+    for(int i = 0; i < height; i++)
+    {
+        const uchar *line = source.constScanLine(i);
+        uchar *output_line = destination + i * destination_stride;
+
+        for(int j = 0; j < width; j++)
+        {
+            output_line[j] = static_cast<uchar>((29 * line[4 * j] + 150 * line[4 * j + 1] + 77 * line[4 * j + 2]) >> 8);
+        }
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGESTAGES_H
+#define IMAGESTAGES_H
+
+#include <QRect>
+#include <QSize>
+
+#include "defines.h"
+#include "framestage.h"
+
+/**
+ * @brief The CropStage class
+ *      Restricts the frame to a region. A view stage: the new image is a view of the same pool slot, no pixel is copied.
+ */
+class CropStage : public FrameStage
+{
+    Q_OBJECT
+
+public_construct:
+    explicit CropStage(const QRect &new_region, QObject *parent = 0);
+
+public_methods:
+    bool process(Frame &frame, FramePool *pool);
+
+private_data_members:
+    QRect region;
+
+};
+
+/**
+ * @brief The ScaleStage class
+ *      Resizes the frame into a new pool buffer, keeping the aspect ratio.
+ */
+class ScaleStage : public FrameStage
+{
+    Q_OBJECT
+
+public_construct:
+    explicit ScaleStage(const QSize &new_size, QObject *parent = 0);
+
+public_methods:
+    bool process(Frame &frame, FramePool *pool);
+
+private_data_members:
+    QSize size;
+
+};
+
+/**
+ * @brief The ConvertStage class
+ *      Converts the frame to another format into a new pool buffer.
+ *      Grayscale is the input of most analytics, it is a quarter of the RGB32 frame.
+ */
+class ConvertStage : public FrameStage
+{
+    Q_OBJECT
+
+public_construct:
+    explicit ConvertStage(const QImage::Format new_format, QObject *parent = 0);
+
+public_methods:
+    bool process(Frame &frame, FramePool *pool);
+
+private_methods:
+    static void rgb32_to_grayscale(const QImage &source, uchar *destination, const int destination_stride);
+
+private_data_members:
+    QImage::Format format;
+
+};
+
+#endif // IMAGESTAGES_H
@@ -0,0 +1,460 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "imagestatistics.h"
+#include "simd.h"
+
+#include <cstring>
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Kernels
+ *      The luma kernels multiply the channels in 16 bits and add them in pairs (madd), then join the two pairs of each pixel.
+ *      The Laplacian kernels widen the luma to 16 bits, the sums are kept in 32 bit lanes and the squares in 64 bit lanes,
+ *      so a line of any width can not overflow.
+ *      The histograms are counted by the scalar code, from the line that was just converted.
+ *      Even and odd pixels go to separate histograms, merged at the end, a run of equal values would otherwise make
+ *      every increment wait for the previous one.
+ *      The AVX2 kernels clear the upper halves of the registers before handing the rest of the line to the SSE2 kernel.
+ */
+namespace
+{
+    typedef void (*LumaRow)(const uchar *source, uchar *destination, const int start, const int width);
+    typedef void (*LaplacianRow)(const uchar *above, const uchar *line, const uchar *below, const int start, const int end,
+                                 qint64 *sum, qint64 *squares);
+
+    void luma_row_scalar(const uchar *source, uchar *destination, const int start, const int width)
+    {
+        for(int x = start; x < width; x++)
+        {
+            const uchar *pixel = source + x * 4;
+            destination[x] = static_cast<uchar>((29 * pixel[0] + 150 * pixel[1] + 77 * pixel[2]) >> 8);
+        }
+    }
+
+    void laplacian_row_scalar(const uchar *above, const uchar *line, const uchar *below, const int start, const int end,
+                              qint64 *sum, qint64 *squares)
+    {
+        for(int x = start; x < end; x++)
+        {
+            const int laplacian = 4 * line[x] - line[x - 1] - line[x + 1] - above[x] - below[x];
+
+            *sum += laplacian;
+            *squares += laplacian * laplacian;
+        }
+    }
+
+#if defined(simd_x86)
+    /**
+     * Luma of 4 RGB32 pixels, in 32 bit lanes.
+     */
+    inline __m128i luma_sse2(const __m128i pixels)
+    {
+        const __m128i coefficients = _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0);
+
+        const __m128 low = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(pixels, _mm_setzero_si128()), coefficients));
+        const __m128 high = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(pixels, _mm_setzero_si128()), coefficients));
+
+        const __m128i blue_green = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m128i red = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        return _mm_srli_epi32(_mm_add_epi32(blue_green, red), 8);
+    }
+
+    void luma_row_sse2(const uchar *source, uchar *destination, const int start, const int width)
+    {
+        int x = start;
+
+        for(; x + 8 <= width; x += 8)
+        {
+            const __m128i first = luma_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x * 4)));
+            const __m128i second = luma_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x * 4 + 16)));
+
+            const __m128i words = _mm_packs_epi32(first, second);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(destination + x), _mm_packus_epi16(words, words));
+        }
+
+        luma_row_scalar(source, destination, x, width);
+    }
+
+    void laplacian_row_sse2(const uchar *above, const uchar *line, const uchar *below, const int start, const int end,
+                            qint64 *sum, qint64 *squares)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi16(1);
+
+        __m128i sums = _mm_setzero_si128();
+        __m128i square_sums = _mm_setzero_si128();
+
+        int x = start;
+
+        for(; x + 16 <= end; x += 16)
+        {
+            const __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + x));
+            const __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + x - 1));
+            const __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + x + 1));
+            const __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x));
+            const __m128i down = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x));
+
+            const __m128i laplacian_low = _mm_sub_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(center, zero), 2),
+                                                        _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(left, zero), _mm_unpacklo_epi8(right, zero)),
+                                                                      _mm_add_epi16(_mm_unpacklo_epi8(up, zero), _mm_unpacklo_epi8(down, zero))));
+
+            const __m128i laplacian_high = _mm_sub_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(center, zero), 2),
+                                                         _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(left, zero), _mm_unpackhi_epi8(right, zero)),
+                                                                       _mm_add_epi16(_mm_unpackhi_epi8(up, zero), _mm_unpackhi_epi8(down, zero))));
+
+            sums = _mm_add_epi32(sums, _mm_add_epi32(_mm_madd_epi16(laplacian_low, ones), _mm_madd_epi16(laplacian_high, ones)));
+
+            const __m128i square = _mm_add_epi32(_mm_madd_epi16(laplacian_low, laplacian_low), _mm_madd_epi16(laplacian_high, laplacian_high));
+            square_sums = _mm_add_epi64(square_sums, _mm_add_epi64(_mm_unpacklo_epi32(square, zero), _mm_unpackhi_epi32(square, zero)));
+        }
+
+        qint32 lanes[4];
+        qint64 square_lanes[2];
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sums);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(square_lanes), square_sums);
+
+        *sum += static_cast<qint64>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+        *squares += square_lanes[0] + square_lanes[1];
+
+        laplacian_row_scalar(above, line, below, x, end, sum, squares);
+    }
+
+    /**
+     * Luma of 8 RGB32 pixels, in order, the shuffles work within each 128 bit half.
+     */
+    simd_avx2_target inline __m256i luma_avx2(const __m256i pixels)
+    {
+        const __m256i coefficients = _mm256_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0, 29, 150, 77, 0, 29, 150, 77, 0);
+
+        const __m256 low = _mm256_castsi256_ps(_mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, _mm256_setzero_si256()), coefficients));
+        const __m256 high = _mm256_castsi256_ps(_mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, _mm256_setzero_si256()), coefficients));
+
+        const __m256i blue_green = _mm256_castps_si256(_mm256_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m256i red = _mm256_castps_si256(_mm256_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        return _mm256_srli_epi32(_mm256_add_epi32(blue_green, red), 8);
+    }
+
+    simd_avx2_target void luma_row_avx2(const uchar *source, uchar *destination, const int start, const int width)
+    {
+        int x = start;
+
+        for(; x + 16 <= width; x += 16)
+        {
+            const __m256i first = luma_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + x * 4)));
+            const __m256i second = luma_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + x * 4 + 32)));
+
+            const __m128i first_words = _mm_packs_epi32(_mm256_castsi256_si128(first), _mm256_extracti128_si256(first, 1));
+            const __m128i second_words = _mm_packs_epi32(_mm256_castsi256_si128(second), _mm256_extracti128_si256(second, 1));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x), _mm_packus_epi16(first_words, second_words));
+        }
+
+        _mm256_zeroupper();
+        luma_row_sse2(source, destination, x, width);
+    }
+
+    simd_avx2_target void laplacian_row_avx2(const uchar *above, const uchar *line, const uchar *below, const int start, const int end,
+                                             qint64 *sum, qint64 *squares)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ones = _mm256_set1_epi16(1);
+
+        __m256i sums = _mm256_setzero_si256();
+        __m256i square_sums = _mm256_setzero_si256();
+
+        int x = start;
+
+        for(; x + 32 <= end; x += 32)
+        {
+            const __m256i center = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line + x));
+            const __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line + x - 1));
+            const __m256i right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line + x + 1));
+            const __m256i up = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(above + x));
+            const __m256i down = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(below + x));
+
+            const __m256i laplacian_low = _mm256_sub_epi16(_mm256_slli_epi16(_mm256_unpacklo_epi8(center, zero), 2),
+                                                           _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(left, zero), _mm256_unpacklo_epi8(right, zero)),
+                                                                            _mm256_add_epi16(_mm256_unpacklo_epi8(up, zero), _mm256_unpacklo_epi8(down, zero))));
+
+            const __m256i laplacian_high = _mm256_sub_epi16(_mm256_slli_epi16(_mm256_unpackhi_epi8(center, zero), 2),
+                                                            _mm256_add_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(left, zero), _mm256_unpackhi_epi8(right, zero)),
+                                                                             _mm256_add_epi16(_mm256_unpackhi_epi8(up, zero), _mm256_unpackhi_epi8(down, zero))));
+
+            sums = _mm256_add_epi32(sums, _mm256_add_epi32(_mm256_madd_epi16(laplacian_low, ones), _mm256_madd_epi16(laplacian_high, ones)));
+
+            const __m256i square = _mm256_add_epi32(_mm256_madd_epi16(laplacian_low, laplacian_low), _mm256_madd_epi16(laplacian_high, laplacian_high));
+            square_sums = _mm256_add_epi64(square_sums, _mm256_add_epi64(_mm256_unpacklo_epi32(square, zero), _mm256_unpackhi_epi32(square, zero)));
+        }
+
+        qint32 lanes[8];
+        qint64 square_lanes[4];
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sums);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(square_lanes), square_sums);
+
+        for(int i = 0; i < 8; i++)
+        {
+            *sum += lanes[i];
+        }
+
+        *squares += square_lanes[0] + square_lanes[1] + square_lanes[2] + square_lanes[3];
+
+        _mm256_zeroupper();
+        laplacian_row_sse2(above, line, below, x, end, sum, squares);
+    }
+#endif
+
+    /**
+     * Counts a line in the histograms, B, G, R and luma, the even and odd pixels in separate sets.
+     */
+    void count_rgb32(const uchar *pixels, const uchar *line, const int width, quint32 counts[2][4][256])
+    {
+        int x = 0;
+
+        for(; x + 2 <= width; x += 2)
+        {
+            const uchar *even = pixels + x * 4;
+            const uchar *odd = even + 4;
+
+            counts[0][0][even[0]]++;
+            counts[1][0][odd[0]]++;
+            counts[0][1][even[1]]++;
+            counts[1][1][odd[1]]++;
+            counts[0][2][even[2]]++;
+            counts[1][2][odd[2]]++;
+            counts[0][3][line[x]]++;
+            counts[1][3][line[x + 1]]++;
+        }
+
+        for(; x < width; x++)
+        {
+            counts[0][0][pixels[x * 4]]++;
+            counts[0][1][pixels[x * 4 + 1]]++;
+            counts[0][2][pixels[x * 4 + 2]]++;
+            counts[0][3][line[x]]++;
+        }
+    }
+
+    void count_grayscale(const uchar *line, const int width, quint32 counts[2][4][256])
+    {
+        int x = 0;
+
+        for(; x + 2 <= width; x += 2)
+        {
+            counts[0][3][line[x]]++;
+            counts[1][3][line[x + 1]]++;
+        }
+
+        for(; x < width; x++)
+        {
+            counts[0][3][line[x]]++;
+        }
+    }
+
+    LumaRow luma_row()
+    {
+        LumaRow row = luma_row_scalar;
+
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                row = luma_row_avx2;
+                break;
+            }
+            case Simd::SSE2:
+            {
+                row = luma_row_sse2;
+                break;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        return row;
+    }
+
+    LaplacianRow laplacian_row()
+    {
+        LaplacianRow row = laplacian_row_scalar;
+
+#if defined(simd_x86)
+        switch(Simd::get_level())
+        {
+            case Simd::AVX2:
+            {
+                row = laplacian_row_avx2;
+                break;
+            }
+            case Simd::SSE2:
+            {
+                row = laplacian_row_sse2;
+                break;
+            }
+            case Simd::Scalar:
+            {
+                break;
+            }
+        }
+#endif
+
+        return row;
+    }
+}
+
+/**
+ * @brief ImageStatistics::ImageStatistics
+ *      Empty statistics, see 'compute'.
+ */
+ImageStatistics::ImageStatistics()
+    : sequence(0),
+      pixel_count(0),
+      mean(0.0),
+      variance(0.0),
+      sharpness(0.0)
+{
+    std::memset(luma, 0, sizeof(luma));
+    std::memset(red, 0, sizeof(red));
+    std::memset(green, 0, sizeof(green));
+    std::memset(blue, 0, sizeof(blue));
+}
+
+/**
+ * @brief ImageStatistics::compute
+ *      Fills the histograms, the exposure and the focus score from an image.
+ *      RGB32 and grayscale images are read directly, other formats are converted first.
+ *      The colour histograms of a grayscale image are the same as the luma one.
+ * @param image
+ *      The image.
+ * @param lines
+ *      Three lines of luma, reused from call to call by the caller so nothing is allocated per frame.
+ * @return
+ *      False if the image is null.
+ */
+bool ImageStatistics::compute(const QImage &image, QVector<uchar> &lines)
+{
+    if(image.isNull())
+    {
+        return false;
+    }
+
+    const bool grayscale = image.format() == QImage::Format_Grayscale8;
+    const QImage source = grayscale || image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32 ?
+                          image : image.convertToFormat(QImage::Format_RGB32);
+
+    const int width = source.width();
+    const int height = source.height();
+
+    if(!grayscale && lines.size() < 3 * width)
+    {
+        lines.resize(3 * width);
+    }
+
+    const LumaRow luma_kernel = luma_row();
+    const LaplacianRow laplacian_kernel = laplacian_row();
+
+    //The even and the odd pixels, merged at the end.
+    quint32 counts[2][4][256];
+    std::memset(counts, 0, sizeof(counts));
+
+    const uchar *luma_lines[3] = { 0, 0, 0 };
+    qint64 laplacian_sum = 0;
+    qint64 laplacian_squares = 0;
+
+    for(int y = 0; y < height; y++)
+    {
+        const uchar *pixels = source.constScanLine(y);
+        const uchar *line = pixels;
+
+        if(!grayscale)
+        {
+            uchar *destination = lines.data() + (y % 3) * width;
+            luma_kernel(pixels, destination, 0, width);
+            line = destination;
+
+            count_rgb32(pixels, line, width, counts);
+        }
+        else
+        {
+            count_grayscale(line, width, counts);
+        }
+
+        luma_lines[0] = luma_lines[1];
+        luma_lines[1] = luma_lines[2];
+        luma_lines[2] = line;
+
+        if(y >= 2 && width >= 3)
+        {
+            laplacian_kernel(luma_lines[0], luma_lines[1], luma_lines[2], 1, width - 1, &laplacian_sum, &laplacian_squares);
+        }
+    }
+
+    for(int i = 0; i < 256; i++)
+    {
+        blue[i] = counts[0][0][i] + counts[1][0][i];
+        green[i] = counts[0][1][i] + counts[1][1][i];
+        red[i] = counts[0][2][i] + counts[1][2][i];
+        luma[i] = counts[0][3][i] + counts[1][3][i];
+    }
+
+    if(grayscale)
+    {
+        std::memcpy(red, luma, sizeof(luma));
+        std::memcpy(green, luma, sizeof(luma));
+        std::memcpy(blue, luma, sizeof(luma));
+    }
+
+    pixel_count = static_cast<qint64>(width) * height;
+
+    qint64 sum = 0;
+    qint64 squares = 0;
+
+    for(int i = 0; i < 256; i++)
+    {
+        sum += static_cast<qint64>(luma[i]) * i;
+        squares += static_cast<qint64>(luma[i]) * i * i;
+    }
+
+    mean = static_cast<double>(sum) / pixel_count;
+    variance = static_cast<double>(squares) / pixel_count - mean * mean;
+
+    const qint64 laplacian_count = static_cast<qint64>(qMax(0, width - 2)) * qMax(0, height - 2);
+
+    if(laplacian_count > 0)
+    {
+        const double laplacian_mean = static_cast<double>(laplacian_sum) / laplacian_count;
+        sharpness = static_cast<double>(laplacian_squares) / laplacian_count - laplacian_mean * laplacian_mean;
+    }
+    else
+    {
+        sharpness = 0.0;
+    }
+
+    return true;
+}
@@ -0,0 +1,62 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMAGESTATISTICS_H
+#define IMAGESTATISTICS_H
+
+#include <QImage>
+#include <QVector>
+
+#include "defines.h"
+
+/**
+ * @brief The ImageStatistics class
+ *      Histograms, exposure and focus of one frame, computed by the statistics stage and attached to the frame.
+ *      Everything comes from a single pass over the pixels: each line is converted to luma with the vector kernels,
+ *      counted in the histograms while it is still in the cache, and the Laplacian of the previous line is taken from the last three.
+ * @remarks
+ *      Luma is BT.601, (29 B + 150 G + 77 R) >> 8, the same as the motion detector.
+ *      The exposure is the mean and variance of the luma. The focus score is the variance of the 4-neighbour Laplacian
+ *      of the luma over the inner pixels, it grows with the amount of sharp detail.
+ *      The scalar and vector versions give the same results.
+ */
+class ImageStatistics
+{
+
+public_construct:
+    ImageStatistics();
+
+public_methods:
+    bool compute(const QImage &image, QVector<uchar> &lines);
+
+public_data_members:
+    quint32 luma[256];
+    quint32 red[256];
+    quint32 green[256];
+    quint32 blue[256];
+
+    quint64 sequence;
+    qint64 pixel_count;
+    double mean;
+    double variance;
+    double sharpness;
+
+};
+
+#endif // IMAGESTATISTICS_H
@@ -0,0 +1,188 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "latencyhistogram.h"
+
+/**
+ * @brief LatencyHistogram::LatencyHistogram
+ *      Creates an empty histogram.
+ */
+LatencyHistogram::LatencyHistogram()
+    : count(0),
+      sum(0),
+      max(0)
+{
+    for(int i = 0; i < bucket_count; i++)
+    {
+        buckets[i].store(0);
+    }
+}
+
+/**
+ * @brief LatencyHistogram::record
+ *      Adds a duration. Negative durations, from timestamps that were not set, are ignored.
+ * @param nanoseconds
+ *      The duration.
+ */
+void LatencyHistogram::record(const qint64 nanoseconds)
+{
+    if(nanoseconds < 0)
+    {
+        return;
+    }
+
+    buckets[bucket(nanoseconds / 1000)].ref();
+    count.fetchAndAddRelaxed(1);
+    sum.fetchAndAddRelaxed(nanoseconds);
+
+    qint64 current = max.load();
+
+    while(nanoseconds > current && !max.testAndSetRelaxed(current, nanoseconds))
+    {
+        current = max.load();
+    }
+}
+
+/**
+ * @brief LatencyHistogram::percentile
+ * @param percent
+ *      From 0 to 100.
+ * @return
+ *      Upper limit of the bucket that holds the percentile, in nanoseconds, 0 if the histogram is empty.
+ */
+qint64 LatencyHistogram::percentile(const double percent) const
+{
+    const qint64 total = count.load();
+
+    if(total == 0)
+    {
+        return 0;
+    }
+
+    const qint64 target = qMax(Q_INT64_C(1), static_cast<qint64>(total * qBound(0.0, percent, 100.0) / 100.0 + 0.5));
+    qint64 accumulated = 0;
+
+    for(int i = 0; i < bucket_count; i++)
+    {
+        accumulated += buckets[i].load();
+
+        if(accumulated >= target)
+        {
+            return qMin(bucket_limit(i) * 1000, max.load());
+        }
+    }
+
+    return max.load();
+}
+
+/**
+ * @brief LatencyHistogram::get_count
+ * @return
+ *      Number of durations recorded.
+ */
+qint64 LatencyHistogram::get_count() const
+{
+    return count.load();
+}
+
+/**
+ * @brief LatencyHistogram::get_mean
+ * @return
+ *      Average duration in nanoseconds.
+ */
+qint64 LatencyHistogram::get_mean() const
+{
+    const qint64 total = count.load();
+    return total > 0 ? sum.load() / total : 0;
+}
+
+/**
+ * @brief LatencyHistogram::get_max
+ * @return
+ *      Longest duration in nanoseconds.
+ */
+qint64 LatencyHistogram::get_max() const
+{
+    return max.load();
+}
+
+/**
+ * @brief LatencyHistogram::to_json
+ * @return
+ *      Count, mean, usual percentiles and maximum, the durations in microseconds.
+ */
+QJsonObject LatencyHistogram::to_json() const
+{
+    QJsonObject object;
+
+    object.insert("count", static_cast<double>(get_count()));
+    object.insert("mean_us", get_mean() / 1000.0);
+    object.insert("p50_us", percentile(50) / 1000.0);
+    object.insert("p90_us", percentile(90) / 1000.0);
+    object.insert("p99_us", percentile(99) / 1000.0);
+    object.insert("p999_us", percentile(99.9) / 1000.0);
+    object.insert("max_us", get_max() / 1000.0);
+
+    return object;
+}
+
+/**
+ * @brief LatencyHistogram::bucket
+ * @param microseconds
+ *      The duration.
+ * @return
+ *      Index of its bucket, the last bucket takes everything above the range.
+ */
+int LatencyHistogram::bucket(const qint64 microseconds)
+{
+    if(microseconds < sub_buckets)
+    {
+        return static_cast<int>(microseconds);
+    }
+
+    int exponent = 4;
+
+    while(exponent < 62 && (microseconds >> (exponent + 1)) != 0)
+    {
+        exponent++;
+    }
+
+    const int mantissa = static_cast<int>((microseconds >> (exponent - 4)) & (sub_buckets - 1));
+
+    return qMin(sub_buckets + (exponent - 4) * sub_buckets + mantissa, bucket_count - 1);
+}
+
+/**
+ * @brief LatencyHistogram::bucket_limit
+ * @param index
+ *      Index of a bucket.
+ * @return
+ *      Largest duration of the bucket in microseconds.
+ */
+qint64 LatencyHistogram::bucket_limit(const int index)
+{
+    if(index < sub_buckets)
+    {
+        return index;
+    }
+
+    const int exponent = (index - sub_buckets) / sub_buckets + 4;
+    const qint64 mantissa = (index - sub_buckets) % sub_buckets;
+
+    return ((Q_INT64_C(1) << exponent) | (mantissa << (exponent - 4))) + (Q_INT64_C(1) << (exponent - 4)) - 1;
+}
@@ -0,0 +1,70 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QJsonObject>
+
+#include "defines.h"
+
+/**
+ * @brief The LatencyHistogram class
+ *      Histogram of durations with a constant relative precision, in the style of HdrHistogram.
+ *      Values are recorded in microseconds: below 16 us every value has its own bucket, above that each power of two
+ *      is split in 16 buckets, so the error is under 6.25% from 1 us to 17 minutes with 448 buckets.
+ * @remarks
+ *      Recording is lock-free and wait-free except for the maximum, any thread can record while another one reads.
+ *      A reader may see a value in the count before it is in its bucket, the percentiles are approximate anyway.
+ */
+class LatencyHistogram
+{
+
+public_construct:
+    LatencyHistogram();
+
+public_methods:
+    void record(const qint64 nanoseconds);
+
+    qint64 percentile(const double percent) const;
+    qint64 get_count() const;
+    qint64 get_mean() const;
+    qint64 get_max() const;
+
+    QJsonObject to_json() const;
+
+private_methods:
+    static int bucket(const qint64 microseconds);
+    static qint64 bucket_limit(const int index);
+
+private_members:
+    static const int sub_buckets = 16;
+    static const int bucket_count = 448;
+
+    QAtomicInteger<qint64> count;
+    QAtomicInteger<qint64> sum;
+    QAtomicInteger<qint64> max;
+
+private_data_members:
+    QAtomicInt buckets[bucket_count];
+
+};
+
+#endif // LATENCYHISTOGRAM_H
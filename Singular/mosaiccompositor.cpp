@@ -0,0 +1,407 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "mosaiccompositor.h"
+#include "framescale.h"
+#include "output.h"
+#include "settingsmanager.h"
+
+#include <QtMath>
+
+#include <algorithm>
+#include <cstring>
+
+/**
+ * @brief MosaicCompositor::MosaicCompositor
+ *      Reads the mosaic settings and lays out the grid, one tile per camera.
+ * @param camera_count
+ *      Number of cameras, the IDs go from 0 to camera_count - 1.
+ * @param parent
+ *      To parent this class.
+ */
+MosaicCompositor::MosaicCompositor(const int camera_count, QObject *parent)
+    : QObject(parent),
+      visible(false),
+      recording(false),
+      sequence(0),
+      composed_count(0),
+      dropped_count(0),
+      timer(0)
+{
+    size = QSize(qMax(16, SettingsManager::read("Mosaic/Width", 1920).toInt()),
+                 qMax(16, SettingsManager::read("Mosaic/Height", 1080).toInt()));
+
+    frame_rate = qBound(1, SettingsManager::read("Mosaic/FrameRate", 15).toInt(), 120);
+
+    const int count = qMax(1, camera_count);
+    int columns = SettingsManager::read("Mosaic/Columns", 0).toInt();
+
+    if(columns <= 0)
+    {
+        columns = qCeil(qSqrt(count));
+    }
+
+    const int rows = (count + columns - 1) / columns;
+
+    tiles.resize(camera_count);
+
+    for(int i = 0; i < tiles.size(); i++)
+    {
+        const int column = i % columns;
+        const int row = i / columns;
+
+        const int left = column * size.width() / columns;
+        const int top = row * size.height() / rows;
+
+        Tile &tile = tiles[i];
+        tile.area = QRect(left, top, (column + 1) * size.width() / columns - left, (row + 1) * size.height() / rows - top);
+        tile.mailbox = new FrameMailbox();
+    }
+
+    frame_pool = new FramePool(get_pool_slots());
+}
+
+/**
+ * @brief MosaicCompositor::~MosaicCompositor
+ *      Releases the frames still in the mailboxes and the output pool.
+ */
+MosaicCompositor::~MosaicCompositor()
+{
+    for(int i = 0; i < tiles.size(); i++)
+    {
+        delete tiles.at(i).mailbox;
+    }
+
+    previous = Frame();
+    frame_pool->release();
+}
+
+/**
+ * @brief MosaicCompositor::get_pool_slots
+ *      Output frames held at the same time: the one being composed, the previous one, the widget mailbox,
+ *      and the recorder queue when the mosaic is recorded.
+ * @return
+ *      Number of slots of the output pool.
+ */
+int MosaicCompositor::get_pool_slots()
+{
+    int slots = SettingsManager::read("Mosaic/FramePoolSlots", 4).toInt();
+
+    if(SettingsManager::read("Mosaic/Record", false).toBool())
+    {
+        slots += SettingsManager::read("Recorder/QueueFrames", 3).toInt();
+    }
+
+    return slots;
+}
+
+/**
+ * @brief MosaicCompositor::start
+ *      Starts composing at "Mosaic/FrameRate". The timer is created here so it belongs to the thread of the compositor,
+ *      call this with a queued connection after moving it.
+ */
+void MosaicCompositor::start()
+{
+    if(timer == 0)
+    {
+        timer = new QTimer(this);
+        timer->setTimerType(Qt::PreciseTimer);
+        connect(timer, SIGNAL(timeout()), this, SLOT(compose()));
+    }
+
+    timer->start(1000 / frame_rate);
+
+    output("Mosaic of " + QString::number(tiles.size()) + " cameras started, " + QString::number(size.width()) + "x" +
+           QString::number(size.height()) + " at " + QString::number(frame_rate) + " fps.", 2);
+}
+
+/**
+ * @brief MosaicCompositor::stop
+ *      Stops composing, the last output frame stays with the consumers.
+ */
+void MosaicCompositor::stop()
+{
+    if(timer != 0)
+    {
+        timer->stop();
+    }
+}
+
+/**
+ * @brief MosaicCompositor::submit
+ *      Hands the newest frame of a camera to the compositor. Called from the camera thread, it never waits.
+ * @param id
+ *      ID of the camera.
+ * @param frame
+ *      The frame, only its reference is kept until the next one.
+ */
+void MosaicCompositor::submit(const int id, const Frame &frame)
+{
+    if(id >= 0 && id < tiles.size())
+    {
+        tiles.at(id).mailbox->post(frame);
+    }
+}
+
+/**
+ * @brief MosaicCompositor::get_tile
+ *      The mailbox of a tile, to subscribe it to the broker of the camera.
+ * @param id
+ *      ID of the camera.
+ * @return
+ *      The tile, 0 if the camera has no tile.
+ */
+FrameConsumer *MosaicCompositor::get_tile(const int id) const
+{
+    return id >= 0 && id < tiles.size() ? tiles.at(id).mailbox : 0;
+}
+
+/**
+ * @brief MosaicCompositor::set_visible
+ * @param new_visible
+ *      True if the output is shown.
+ */
+void MosaicCompositor::set_visible(const bool new_visible)
+{
+    visible = new_visible;
+}
+
+/**
+ * @brief MosaicCompositor::set_recording
+ * @param new_recording
+ *      True if the output is recorded, it is then composed even while hidden.
+ */
+void MosaicCompositor::set_recording(const bool new_recording)
+{
+    recording = new_recording;
+}
+
+/**
+ * @brief MosaicCompositor::compose
+ *      Builds one output frame from the newest frame of every camera and delivers it.
+ *      If all the output slots are held by the consumers the tick is dropped, the cameras are never held back.
+ */
+void MosaicCompositor::compose()
+{
+    if(!visible && !recording)
+    {
+        return;
+    }
+
+    const int stride = FramePool::aligned_bytes_per_line(size.width() * 4);
+    FrameBuffer buffer = frame_pool->acquire(stride * size.height());
+
+    if(buffer.is_null())
+    {
+        dropped_count.ref();
+        return;
+    }
+
+    uchar *pixels = buffer.data();
+    const uchar *previous_pixels = previous.is_valid() ? previous.image.constBits() : 0;
+
+    for(int i = 0; i < tiles.size(); i++)
+    {
+        Frame frame;
+
+        if(tiles.at(i).mailbox->take(frame))
+        {
+            //An empty frame is posted when a camera is removed.
+            if(!frame.is_valid())
+            {
+                fill(tiles.at(i).area, pixels, stride);
+            }
+            else if(frame.image.format() == QImage::Format_RGB32 || frame.image.format() == QImage::Format_ARGB32)
+            {
+                draw_tile(i, frame.image, pixels, stride);
+            }
+            else
+            {
+                draw_tile(i, frame.image.convertToFormat(QImage::Format_RGB32), pixels, stride);
+            }
+        }
+        else if(previous_pixels != 0)
+        {
+            copy_tile(i, previous_pixels, pixels, stride);
+        }
+        else
+        {
+            fill(tiles.at(i).area, pixels, stride);
+        }
+    }
+
+    Frame new_frame;
+    new_frame.image = buffer.image(size.width(), size.height(), stride, QImage::Format_RGB32);
+    new_frame.buffer = buffer;
+    new_frame.sequence = ++sequence;
+    new_frame.capture_time = Frame::clock();
+    new_frame.processed_time = new_frame.capture_time;
+
+    previous = new_frame;
+    composed_count.ref();
+
+    emit image_data(new_frame);
+}
+
+/**
+ * @brief MosaicCompositor::draw_tile
+ *      Downscales a frame into its tile, centred and with its aspect ratio, the rest of the tile is black.
+ *      Frames smaller than the tile are not enlarged.
+ * @param index
+ *      The tile.
+ * @param image
+ *      RGB32 frame of the camera.
+ * @param pixels
+ *      The output pixels.
+ * @param stride
+ *      Bytes per line of the output.
+ */
+void MosaicCompositor::draw_tile(const int index, const QImage &image, uchar *pixels, const int stride)
+{
+    Tile &tile = tiles[index];
+
+    if(image.width() < 2 || image.height() < 2)
+    {
+        fill(tile.area, pixels, stride);
+        return;
+    }
+
+    if(image.size() != tile.source_size)
+    {
+        const double scale = qMin(1.0, qMin(static_cast<double>(tile.area.width()) / image.width(),
+                                            static_cast<double>(tile.area.height()) / image.height()));
+
+        const QSize fitted(qMax(1, static_cast<int>(image.width() * scale)), qMax(1, static_cast<int>(image.height() * scale)));
+
+        tile.image_area = QRect(tile.area.left() + (tile.area.width() - fitted.width()) / 2,
+                                tile.area.top() + (tile.area.height() - fitted.height()) / 2,
+                                fitted.width(), fitted.height());
+
+        tile.columns.resize(fitted.width());
+        FrameScale::sample_positions(image.width(), fitted.width(), tile.columns.data());
+        tile.source_size = image.size();
+    }
+
+    if(line.size() < image.width() * 4)
+    {
+        line.resize(image.width() * 4);
+    }
+
+    //The bands around the image, nothing is drawn twice.
+    const QRect &area = tile.area;
+    const QRect &image_area = tile.image_area;
+
+    fill(QRect(area.left(), area.top(), area.width(), image_area.top() - area.top()), pixels, stride);
+    fill(QRect(area.left(), image_area.bottom() + 1, area.width(), area.bottom() - image_area.bottom()), pixels, stride);
+    fill(QRect(area.left(), image_area.top(), image_area.left() - area.left(), image_area.height()), pixels, stride);
+    fill(QRect(image_area.right() + 1, image_area.top(), area.right() - image_area.right(), image_area.height()), pixels, stride);
+
+    FrameScale::downscale_rgb32(image.constBits(), image.bytesPerLine(), image.width(), image.height(),
+                                pixels + image_area.top() * stride + image_area.left() * 4, stride,
+                                image_area.width(), image_area.height(), tile.columns.constData(), line.data());
+}
+
+/**
+ * @brief MosaicCompositor::copy_tile
+ *      Copies a tile that has no new frame from the previous output.
+ * @param index
+ *      The tile.
+ * @param previous_pixels
+ *      The pixels of the previous output.
+ * @param pixels
+ *      The output pixels.
+ * @param stride
+ *      Bytes per line of both outputs.
+ */
+void MosaicCompositor::copy_tile(const int index, const uchar *previous_pixels, uchar *pixels, const int stride)
+{
+    const QRect &area = tiles.at(index).area;
+
+    for(int y = area.top(); y <= area.bottom(); y++)
+    {
+        const int offset = y * stride + area.left() * 4;
+        std::memcpy(pixels + offset, previous_pixels + offset, area.width() * 4);
+    }
+}
+
+/**
+ * @brief MosaicCompositor::fill
+ *      Paints an area of the output black.
+ * @param area
+ *      The area, may be empty.
+ * @param pixels
+ *      The output pixels.
+ * @param stride
+ *      Bytes per line of the output.
+ */
+void MosaicCompositor::fill(const QRect &area, uchar *pixels, const int stride)
+{
+    if(area.isEmpty())
+    {
+        return;
+    }
+
+    for(int y = area.top(); y <= area.bottom(); y++)
+    {
+        quint32 *line_pixels = reinterpret_cast<quint32*>(pixels + y * stride) + area.left();
+        std::fill(line_pixels, line_pixels + area.width(), 0xff000000u);
+    }
+}
+
+/**
+ * @brief MosaicCompositor::get_composed_count
+ * @return
+ *      Number of output frames delivered.
+ */
+int MosaicCompositor::get_composed_count() const
+{
+    return composed_count.load();
+}
+
+/**
+ * @brief MosaicCompositor::get_dropped_count
+ * @return
+ *      Number of ticks skipped because no output slot was free.
+ */
+int MosaicCompositor::get_dropped_count() const
+{
+    return dropped_count.load();
+}
+
+/**
+ * @brief MosaicCompositor::output
+ *      Generic function responsible for all the outputs.
+ */
+void MosaicCompositor::output(const QString &message, const int verbose) const
+{
+    if(Output::get_verbose() >= verbose)
+    {
+        QVariantHash data;
+        data.insert("message", message);
+        data.insert("verbose", verbose);
+        data.insert("load_thread_id", true);
+
+        QString print = Output::builder(data);
+
+        if(!print.isEmpty())
+        {
+            emit console(print);
+        }
+    }
+}
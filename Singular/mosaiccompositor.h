@@ -0,0 +1,111 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MOSAICCOMPOSITOR_H
+#define MOSAICCOMPOSITOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+#include <QRect>
+
+#include "defines.h"
+#include "frame.h"
+#include "framepool.h"
+#include "framemailbox.h"
+
+/**
+ * @brief The MosaicCompositor class
+ *      Tiles the frames of all the cameras into one output frame, at a fixed frame rate.
+ *      The output is a normal Frame of its own pool, so it can be shown by a CameraWidget and recorded by a Recorder.
+ * @remarks
+ *      The cameras post their frames to a mailbox per tile, only the reference is kept and the newest frame wins.
+ *      On every tick each new frame is downscaled straight into its tile of the output, keeping its aspect ratio,
+ *      this is the only pass over the source pixels. The tiles without a new frame are copied from the previous output.
+ *      The grid has "Mosaic/Columns" columns, 0 picks the smallest square grid, 3x3 for 9 cameras and 4x4 for 16.
+ *      While the output is hidden and not recorded nothing is composed.
+ */
+class MosaicCompositor : public QObject
+{
+    Q_OBJECT
+
+public_construct:
+    explicit MosaicCompositor(const int camera_count, QObject *parent = 0);
+    ~MosaicCompositor();
+
+public_methods:
+    void submit(const int id, const Frame &frame);
+    FrameConsumer *get_tile(const int id) const;
+
+    int get_composed_count() const;
+    int get_dropped_count() const;
+
+    static int get_pool_slots();
+
+private_methods:
+    void draw_tile(const int index, const QImage &image, uchar *pixels, const int stride);
+    void copy_tile(const int index, const uchar *previous_pixels, uchar *pixels, const int stride);
+    void fill(const QRect &area, uchar *pixels, const int stride);
+    void output(const QString &message, const int verbose) const;
+
+private_members:
+    QSize size;
+    int frame_rate;
+    bool visible;
+    bool recording;
+    quint64 sequence;
+    QAtomicInt composed_count;
+    QAtomicInt dropped_count;
+
+private_data_members:
+    /**
+     * @brief The Tile struct
+     *      Area of a camera in the output, and the sampling positions for the size of its last frame.
+     */
+    struct Tile
+    {
+        QRect area;
+        QRect image_area;
+        QSize source_size;
+        QVector<int> columns;
+        FrameMailbox *mailbox;
+    };
+
+    QVector<Tile> tiles;
+    QVector<uchar> line;
+    FramePool *frame_pool;
+    Frame previous;
+    QTimer *timer;
+
+public slots:
+    void start();
+    void stop();
+    void set_visible(const bool new_visible);
+    void set_recording(const bool new_recording);
+
+private slots:
+    void compose();
+
+signals:
+    void console(const QString &message) const;
+    void image_data(const Frame &new_frame) const;
+
+};
+
+#endif // MOSAICCOMPOSITOR_H
@@ -0,0 +1,185 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "motionstage.h"
+#include "framedifference.h"
+#include "settingsmanager.h"
+
+/**
+ * @brief MotionStage::MotionStage
+ *      Reads the detector settings, shared by all the cameras.
+ * @param new_id
+ *      The ID of the camera, sent with the motion signal.
+ * @param parent
+ *      The pipeline.
+ */
+MotionStage::MotionStage(const int new_id, QObject *parent)
+    : FrameStage("motion", View, parent),
+      id(new_id),
+      active(false)
+{
+    //Differences up to this many luma levels are sensor noise.
+    threshold = qBound(0, SettingsManager::read("Motion/Threshold", 12).toInt(), 255);
+
+    //Minimum score of a region with motion, 50 is an average of half a level above the noise.
+    region_threshold = SettingsManager::read("Motion/RegionThreshold", 50).toInt();
+
+    //The background follows the scene with a weight of 1 / 2^shift per frame.
+    background_shift = qBound(0, SettingsManager::read("Motion/BackgroundShift", 4).toInt(), 8);
+
+    columns = qMax(1, SettingsManager::read("Motion/Columns", 8).toInt());
+    rows = qMax(1, SettingsManager::read("Motion/Rows", 6).toInt());
+
+    sums.resize(columns * rows);
+    scores.resize(columns * rows);
+}
+
+/**
+ * @brief MotionStage::process
+ *      The first frame, and the first after a change of size, only initializes the background.
+ * @param frame
+ *      The frame, not modified.
+ * @return
+ *      False if the frame is too small to be analyzed.
+ */
+bool MotionStage::process(Frame &frame, FramePool *pool)
+{
+    Q_UNUSED(pool);
+
+    const bool same_size = size == QSize(frame.image.width() / 4, frame.image.height() / 4) && !background.isEmpty();
+
+    if(!downsample(frame.image))
+    {
+        return false;
+    }
+
+    if(!same_size)
+    {
+        background = current;
+        active = false;
+        return true;
+    }
+
+    const QRect box = detect();
+
+    FrameDifference::update_background(current.constData(), background.data(), size.width(), size.width(), size.height(), background_shift);
+
+    if(!box.isEmpty() || active)
+    {
+        emit motion(id, scores, box);
+    }
+
+    if(box.isEmpty() == active)
+    {
+        active = !box.isEmpty();
+        output("Motion " + QString(active ? "started" : "stopped") + " on camera " + QString::number(id) + ".", 2);
+    }
+
+    return true;
+}
+
+/**
+ * @brief MotionStage::downsample
+ *      Fills 'current' with the luma of the frame reduced by 4.
+ *      RGB32 and grayscale frames are read directly, other formats are converted first.
+ * @param image
+ *      The frame.
+ * @return
+ *      False if the frame is smaller than the grid.
+ */
+bool MotionStage::downsample(const QImage &image)
+{
+    const QSize new_size(image.width() / 4, image.height() / 4);
+
+    if(new_size.width() < columns || new_size.height() < rows)
+    {
+        return false;
+    }
+
+    if(new_size != size)
+    {
+        size = new_size;
+        current.resize(size.width() * size.height());
+    }
+
+    switch(image.format())
+    {
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32:
+        {
+            FrameDifference::downsample_rgb32(image.constBits(), image.bytesPerLine(), image.width(), image.height(),
+                                              current.data(), size.width());
+            break;
+        }
+        case QImage::Format_Grayscale8:
+        {
+            FrameDifference::downsample_grayscale(image.constBits(), image.bytesPerLine(), image.width(), image.height(),
+                                                  current.data(), size.width());
+            break;
+        }
+        default:
+        {
+            const QImage converted = image.convertToFormat(QImage::Format_RGB32);
+
+            FrameDifference::downsample_rgb32(converted.constBits(), converted.bytesPerLine(), converted.width(), converted.height(),
+                                              current.data(), size.width());
+            break;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief MotionStage::detect
+ *      Scores the regions and joins those above the region threshold.
+ * @return
+ *      Bounding box of the regions with motion in frame coordinates, empty if there is none.
+ */
+QRect MotionStage::detect()
+{
+    const int width = size.width();
+    const int height = size.height();
+
+    FrameDifference::difference(current.constData(), background.constData(), width, width, height,
+                                threshold, columns, rows, sums.data());
+
+    QRect box;
+
+    for(int i = 0; i < rows; i++)
+    {
+        const int top = i * height / rows;
+        const int bottom = (i + 1) * height / rows;
+
+        for(int j = 0; j < columns; j++)
+        {
+            const int left = j * width / columns;
+            const int right = (j + 1) * width / columns;
+
+            const int index = i * columns + j;
+            scores[index] = static_cast<int>(sums.at(index) * 100 / qMax(1, (right - left) * (bottom - top)));
+
+            if(scores.at(index) >= region_threshold)
+            {
+                box |= QRect(left * 4, top * 4, (right - left) * 4, (bottom - top) * 4);
+            }
+        }
+    }
+
+    return box;
+}
@@ -0,0 +1,73 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MOTIONSTAGE_H
+#define MOTIONSTAGE_H
+
+#include <QRect>
+#include <QVector>
+
+#include "defines.h"
+#include "framestage.h"
+
+/**
+ * @brief The MotionStage class
+ *      Motion detector for fixed scenes. The frame is reduced by 4 in both directions to luma and compared with a
+ *      running average of the previous frames, the difference is summed on a grid of regions.
+ *      A view stage, it only reads the pixels and the frame goes on unchanged.
+ * @remarks
+ *      The score of a region is the average difference above the noise threshold, in hundredths of a luma level.
+ *      'motion' is emitted for every frame with at least one region above the region threshold, with the bounding box
+ *      of those regions in frame coordinates, and once more with an empty box when the motion stops.
+ */
+class MotionStage : public FrameStage
+{
+    Q_OBJECT
+
+public_construct:
+    explicit MotionStage(const int new_id, QObject *parent = 0);
+
+public_methods:
+    bool process(Frame &frame, FramePool *pool);
+
+private_methods:
+    bool downsample(const QImage &image);
+    QRect detect();
+
+private_members:
+    int id;
+    int threshold;
+    int region_threshold;
+    int background_shift;
+    int columns;
+    int rows;
+    bool active;
+    QSize size;
+
+private_data_members:
+    QVector<uchar> current;
+    QVector<uchar> background;
+    QVector<qint64> sums;
+    QVector<int> scores;
+
+signals:
+    void motion(const int id, const QVector<int> &scores, const QRect &box) const;
+
+};
+
+#endif // MOTIONSTAGE_H
@@ -0,0 +1,497 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "prerollbuffer.h"
+#include "output.h"
+#include "settingsmanager.h"
+
+#include <QDir>
+#include <QBuffer>
+#include <QDateTime>
+#include <QImageWriter>
+
+#include <cstring>
+#include <climits>
+
+/**
+ * @brief PreRollBuffer::PreRollBuffer
+ *      Reads the pre-roll settings and allocates the arena.
+ *      The arena is written once here so its pages are committed at start, and not the first time the camera sees a busy scene.
+ * @param new_id
+ *      The ID of the camera.
+ * @param parent
+ *      To parent this class.
+ */
+PreRollBuffer::PreRollBuffer(const int new_id, QObject *parent)
+    : QThread(parent),
+      id(new_id),
+      head(0),
+      first(0),
+      count(0),
+      stopping(false),
+      trigger_pending(false),
+      last_submitted(0),
+      live_until(0),
+      event_frames(0),
+      event_count(0),
+      dropped_count(0),
+      arena(0)
+{
+    const int seconds = qMax(1, SettingsManager::read("PreRoll/Seconds", 10).toInt());
+    const int frame_rate = qBound(1, SettingsManager::read("PreRoll/FrameRate", 15).toInt(), 1000);
+
+    window_nsecs = seconds * Q_INT64_C(1000000000);
+    post_nsecs = qMax(0, SettingsManager::read("PreRoll/PostSeconds", 10).toInt()) * Q_INT64_C(1000000000);
+    interval_nsecs = Q_INT64_C(1000000000) / frame_rate;
+
+    arena_size = qMax(1024 * 1024, SettingsManager::read("PreRoll/ArenaSize", 24 * 1024 * 1024).toInt());
+    queue_size = qMax(1, SettingsManager::read("PreRoll/QueueFrames", 2).toInt());
+    quality = qBound(0, SettingsManager::read("PreRoll/Quality", 70).toInt(), 100);
+    direct = SettingsManager::read("Recorder/DirectIO", false).toBool();
+    directory = SettingsManager::read("PreRoll/Directory", SettingsManager::read("Recorder/Directory", QDir::homePath())).toString();
+    buffer_size = SettingsManager::read("PreRoll/WriteBuffer", 4 * 1024 * 1024).toInt();
+
+    arena = static_cast<char*>(qMallocAligned(arena_size, 4096));
+
+    if(arena != 0)
+    {
+        std::memset(arena, 0, arena_size);
+    }
+
+    //Twice the images of the window, the arena is usually what limits the ring.
+    entries.resize(qMax(16, 2 * seconds * frame_rate));
+
+    setObjectName("Pre-roll " + QString::number(id));
+}
+
+/**
+ * @brief PreRollBuffer::~PreRollBuffer
+ *      Stops the thread, an event in progress is closed.
+ */
+PreRollBuffer::~PreRollBuffer()
+{
+    stop();
+    wait();
+
+    qFreeAligned(arena);
+}
+
+/**
+ * @brief PreRollBuffer::submit
+ *      Queues a frame for compression, called from the camera thread. Frames closer than the interval to the last one are ignored.
+ * @param frame
+ *      The frame, only its reference is queued.
+ */
+void PreRollBuffer::submit(const Frame &frame)
+{
+    if(!is_due(frame.capture_time))
+    {
+        return;
+    }
+
+    last_submitted = frame.capture_time;
+
+    QMutexLocker locker(&mutex);
+
+    if(stopping || queue.size() >= queue_size)
+    {
+        dropped_count.ref();
+        return;
+    }
+
+    queue.enqueue(frame);
+    frame_available.wakeOne();
+}
+
+/**
+ * @brief PreRollBuffer::is_due
+ *      Whether a frame captured at this time would be kept by submit, called from the camera thread.
+ *      Lets the camera skip the conversion of the frames in between.
+ * @param capture_time
+ *      The capture time of the frame, see Frame::clock.
+ * @return
+ *      True if at least one interval ("PreRoll/FrameRate") passed since the last frame kept.
+ */
+bool PreRollBuffer::is_due(const qint64 capture_time) const
+{
+    return capture_time - last_submitted >= interval_nsecs;
+}
+
+/**
+ * @brief PreRollBuffer::trigger
+ *      Writes the buffered window to disk and records live for "PreRoll/PostSeconds". Thread safe.
+ * @param reason
+ *      Shown in the console, for example "motion" or "command".
+ */
+void PreRollBuffer::trigger(const QString &reason)
+{
+    QMutexLocker locker(&mutex);
+
+    if(!trigger_pending)
+    {
+        trigger_pending = true;
+        trigger_reason = reason;
+        frame_available.wakeOne();
+    }
+}
+
+/**
+ * @brief PreRollBuffer::motion_detected
+ *      Triggers the buffer while the motion stage reports motion. Use a direct connection, it only takes the lock.
+ * @param camera_id
+ *      The ID of the camera, not used, the buffer belongs to one camera.
+ * @param scores
+ *      Not used.
+ * @param box
+ *      The area with motion, empty when the motion stops.
+ */
+void PreRollBuffer::motion_detected(const int camera_id, const QVector<int> &scores, const QRect &box)
+{
+    Q_UNUSED(camera_id);
+    Q_UNUSED(scores);
+
+    if(!box.isEmpty())
+    {
+        trigger("motion");
+    }
+}
+
+/**
+ * @brief PreRollBuffer::presence_detected
+ *      Triggers the buffer when the background stage reports a presence. Use a direct connection, it only takes the lock.
+ * @param camera_id
+ *      The ID of the camera, not used, the buffer belongs to one camera.
+ * @param present
+ *      True when the presence starts.
+ * @param foreground
+ *      Not used.
+ */
+void PreRollBuffer::presence_detected(const int camera_id, const bool present, const int foreground)
+{
+    Q_UNUSED(camera_id);
+    Q_UNUSED(foreground);
+
+    if(present)
+    {
+        trigger("presence");
+    }
+}
+
+/**
+ * @brief PreRollBuffer::stop
+ *      Asks the thread to finish.
+ */
+void PreRollBuffer::stop()
+{
+    QMutexLocker locker(&mutex);
+
+    stopping = true;
+    frame_available.wakeOne();
+}
+
+/**
+ * @brief PreRollBuffer::run
+ *      Compression loop. Every frame is stored in the ring, and during an event appended to the file as well.
+ *      While an event is live the loop wakes up at least every second, so the file is closed on time even if the camera stops.
+ */
+void PreRollBuffer::run()
+{
+    forever
+    {
+        Frame frame;
+        bool triggered = false;
+        QString reason;
+
+        {
+            QMutexLocker locker(&mutex);
+
+            while(queue.isEmpty() && !stopping && !trigger_pending)
+            {
+                if(!frame_available.wait(&mutex, writer.is_open() ? 1000 : ULONG_MAX))
+                {
+                    break;
+                }
+            }
+
+            if(stopping && queue.isEmpty())
+            {
+                break;
+            }
+
+            if(!queue.isEmpty())
+            {
+                frame = queue.dequeue();
+            }
+
+            triggered = trigger_pending;
+            reason = trigger_reason;
+            trigger_pending = false;
+        }
+
+        if(frame.is_valid() || frame.is_compressed())
+        {
+            if(encode(frame))
+            {
+                store(frame);
+
+                //A trigger of this iteration is handled below, if it opens the event the arena already has this frame.
+                if(writer.is_open())
+                {
+                    if(writer.write(encoded.constData(), encoded.size()))
+                    {
+                        event_frames++;
+                    }
+                    else
+                    {
+                        output("Pre-roll of camera " + QString::number(id) + " failed: " + writer.get_error(), 1);
+                        close_event();
+                    }
+                }
+            }
+            else
+            {
+                dropped_count.ref();
+            }
+        }
+
+        if(triggered)
+        {
+            if(writer.is_open() || start_event(reason))
+            {
+                live_until = Frame::clock() + post_nsecs;
+            }
+        }
+
+        if(writer.is_open() && Frame::clock() >= live_until)
+        {
+            close_event();
+        }
+    }
+
+    close_event();
+}
+
+/**
+ * @brief PreRollBuffer::encode
+ *      Compresses the frame to JPEG into 'encoded'.
+ *      The JPEG of an MJPEG camera is used as it is, 'encoded' then points into the frame and is only valid while the frame is held.
+ * @param frame
+ *      The frame.
+ * @return
+ *      Success = true; Failed = false
+ */
+bool PreRollBuffer::encode(const Frame &frame)
+{
+    if(frame.is_compressed())
+    {
+        encoded = frame.compressed;
+        return true;
+    }
+
+    const QImage image = frame.image.format() == QImage::Format_RGB32 || frame.image.format() == QImage::Format_ARGB32 ?
+                         frame.image : frame.image.convertToFormat(QImage::Format_RGB32);
+
+    encoded.clear();
+
+    QBuffer buffer(&encoded);
+    buffer.open(QIODevice::WriteOnly);
+
+    QImageWriter image_writer(&buffer, "jpeg");
+    image_writer.setQuality(quality);
+
+    if(!image_writer.write(image))
+    {
+        output("JPEG encoding failed: " + image_writer.errorString(), 1);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief PreRollBuffer::store
+ *      Copies 'encoded' to the head of the arena, the oldest images in the way are evicted.
+ *      The images always follow each other in the arena in the order of the ring, so the oldest one, the first of the ring,
+ *      is the only one that can be in the way. When the image does not fit before the end, the images left there are
+ *      the oldest ones, they are evicted and the head goes back to the beginning.
+ * @param frame
+ *      The frame that was encoded.
+ */
+void PreRollBuffer::store(const Frame &frame)
+{
+    const int size = encoded.size();
+
+    if(arena == 0 || size > arena_size)
+    {
+        dropped_count.ref();
+        return;
+    }
+
+    if(head + size > arena_size)
+    {
+        while(count > 0 && entries.at(first).offset >= head)
+        {
+            evict();
+        }
+
+        head = 0;
+    }
+
+    while(count > 0 && (count == entries.size() ||
+                        (entries.at(first).offset < head + size && entries.at(first).offset + entries.at(first).size > head)))
+    {
+        evict();
+    }
+
+    std::memcpy(arena + head, encoded.constData(), size);
+
+    Entry &entry = entries[(first + count) % entries.size()];
+    entry.offset = head;
+    entry.size = size;
+    entry.sequence = frame.sequence;
+    entry.capture_time = frame.capture_time;
+
+    count++;
+    head += size;
+}
+
+/**
+ * @brief PreRollBuffer::evict
+ *      Drops the oldest image of the ring.
+ */
+void PreRollBuffer::evict()
+{
+    first = (first + 1) % entries.size();
+    count--;
+}
+
+/**
+ * @brief PreRollBuffer::start_event
+ *      Creates the event file and writes the images of the last "PreRoll/Seconds" to it, oldest first.
+ * @param reason
+ *      What triggered the event.
+ * @return
+ *      Success = true; Failed = false
+ */
+bool PreRollBuffer::start_event(const QString &reason)
+{
+    QDir().mkpath(directory);
+
+    const QString path = QDir(directory).filePath("camera" + QString::number(id) + "_event_" +
+                                                  QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss") + ".mjpeg");
+
+    if(!writer.open(path, buffer_size, direct))
+    {
+        output("Could not create the pre-roll " + path + ": " + writer.get_error(), 1);
+        return false;
+    }
+
+    event_frames = 0;
+    event_count.ref();
+
+    qint64 first_time = 0;
+    qint64 last_time = 0;
+
+    if(count > 0)
+    {
+        last_time = entries.at((first + count - 1) % entries.size()).capture_time;
+        first_time = last_time;
+    }
+
+    for(int i = 0; i < count; i++)
+    {
+        const Entry &entry = entries.at((first + i) % entries.size());
+
+        if(entry.capture_time < last_time - window_nsecs)
+        {
+            continue;
+        }
+
+        if(!writer.write(arena + entry.offset, entry.size))
+        {
+            output("Pre-roll of camera " + QString::number(id) + " failed: " + writer.get_error(), 1);
+            close_event();
+            return false;
+        }
+
+        first_time = qMin(first_time, entry.capture_time);
+        event_frames++;
+    }
+
+    output("Pre-roll of camera " + QString::number(id) + " triggered by " + reason + ", " + QString::number(event_frames) + " frames (" +
+           QString::number((last_time - first_time) / 1000000000.0, 'f', 1) + " s) written to " + path + ".", 2);
+
+    return true;
+}
+
+/**
+ * @brief PreRollBuffer::close_event
+ *      Flushes and closes the event file, if any.
+ */
+void PreRollBuffer::close_event()
+{
+    if(writer.is_open())
+    {
+        writer.close();
+
+        output("Pre-roll event of camera " + QString::number(id) + " closed, " + QString::number(event_frames) + " frames recorded.", 2);
+    }
+}
+
+/**
+ * @brief PreRollBuffer::get_event_count
+ * @return
+ *      Number of events written.
+ */
+int PreRollBuffer::get_event_count() const
+{
+    return event_count.load();
+}
+
+/**
+ * @brief PreRollBuffer::get_dropped_count
+ * @return
+ *      Number of frames that were not buffered, because the queue was full or the image could not be encoded.
+ */
+int PreRollBuffer::get_dropped_count() const
+{
+    return dropped_count.load();
+}
+
+/**
+ * @brief PreRollBuffer::output
+ *      Generic function responsible for all the outputs.
+ */
+void PreRollBuffer::output(const QString &message, const int verbose) const
+{
+    if(Output::get_verbose() >= verbose)
+    {
+        QVariantHash data;
+        data.insert("message", message);
+        data.insert("verbose", verbose);
+        data.insert("load_thread_id", true);
+
+        QString print = Output::builder(data);
+
+        if(!print.isEmpty())
+        {
+            emit console(print);
+        }
+    }
+}
@@ -0,0 +1,129 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PREROLLBUFFER_H
+#define PREROLLBUFFER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QVector>
+#include <QRect>
+#include <QAtomicInt>
+#include <QByteArray>
+
+#include "defines.h"
+#include "frame.h"
+#include "sequentialwriter.h"
+
+/**
+ * @brief The PreRollBuffer class
+ *      Keeps the last seconds of a camera compressed in memory, so that when something happens the moments before it are not lost.
+ *      When triggered, the buffered window is written to an MJPEG file and the recording goes on live for a while,
+ *      every new trigger meanwhile extends it.
+ * @remarks
+ *      The JPEG images are kept in an arena of fixed size allocated once, used as a ring: a new image overwrites the oldest ones.
+ *      The memory of a camera is the arena plus the queue frames, whatever the resolution or the scene, 16 cameras at HD
+ *      with the default settings use 16 x 24 MiB of arena.
+ *      Only one frame per interval ("PreRoll/FrameRate") is compressed, on the thread of the buffer, the camera thread
+ *      only queues the frame and drops it if the encoder is behind.
+ */
+class PreRollBuffer : public QThread
+{
+    Q_OBJECT
+
+public_construct:
+    explicit PreRollBuffer(const int new_id, QObject *parent = 0);
+    ~PreRollBuffer();
+
+public_methods:
+    void submit(const Frame &frame);
+    bool is_due(const qint64 capture_time) const;
+    void trigger(const QString &reason);
+    void stop();
+
+    int get_event_count() const;
+    int get_dropped_count() const;
+
+protected_methods:
+    void run();
+
+private_methods:
+    bool encode(const Frame &frame);
+    void store(const Frame &frame);
+    void evict();
+    bool start_event(const QString &reason);
+    void close_event();
+    void output(const QString &message, const int verbose) const;
+
+private_members:
+    int id;
+    int arena_size;
+    int head;
+    int first;
+    int count;
+    int queue_size;
+    int quality;
+    int buffer_size;
+    bool direct;
+    bool stopping;
+    bool trigger_pending;
+    qint64 window_nsecs;
+    qint64 post_nsecs;
+    qint64 interval_nsecs;
+    qint64 last_submitted;
+    qint64 live_until;
+    int event_frames;
+    QAtomicInt event_count;
+    QAtomicInt dropped_count;
+
+private_data_members:
+    /**
+     * @brief The Entry struct
+     *      One JPEG image in the arena.
+     */
+    struct Entry
+    {
+        int offset;
+        int size;
+        quint64 sequence;
+        qint64 capture_time;
+    };
+
+    char *arena;
+    QVector<Entry> entries;
+    QString directory;
+    QString trigger_reason;
+    QMutex mutex;
+    QWaitCondition frame_available;
+    QQueue<Frame> queue;
+    SequentialWriter writer;
+    QByteArray encoded;
+
+public slots:
+    void motion_detected(const int camera_id, const QVector<int> &scores, const QRect &box);
+    void presence_detected(const int camera_id, const bool present, const int foreground);
+
+signals:
+    void console(const QString &message) const;
+
+};
+
+#endif // PREROLLBUFFER_H
@@ -0,0 +1,363 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "recorder.h"
+#include "output.h"
+#include "settingsmanager.h"
+#include "colorconversion.h"
+
+#include <QDir>
+#include <QBuffer>
+#include <QDateTime>
+#include <QImageWriter>
+
+/**
+ * @brief Recorder::Recorder
+ *      Reads the recorder settings, the file is only created with the first frame.
+ * @param new_id
+ *      The ID of the camera.
+ * @param new_name
+ *      Name used in the console and, without spaces, in the file names. By default "camera <id>".
+ * @param parent
+ *      To parent this class.
+ */
+Recorder::Recorder(const int new_id, const QString &new_name, QObject *parent)
+    : QThread(parent),
+      id(new_id),
+      stopping(false),
+      failed(false),
+      recorded_count(0),
+      dropped_count(0)
+{
+    format = SettingsManager::read("Recorder/Format", "y4m").toString().toLower() == "mjpeg" ? MJPEG : Y4M;
+    queue_size = qMax(1, SettingsManager::read("Recorder/QueueFrames", 3).toInt());
+    frame_rate = qMax(1, SettingsManager::read("Recorder/FrameRate", 30).toInt());
+    quality = qBound(0, SettingsManager::read("Recorder/Quality", 80).toInt(), 100);
+    direct = SettingsManager::read("Recorder/DirectIO", false).toBool();
+    directory = SettingsManager::read("Recorder/Directory", QDir::homePath()).toString();
+
+    //Large writes keep the disk streaming, a few frames of raw 1080p.
+    buffer_size = SettingsManager::read("Recorder/WriteBuffer", 8 * 1024 * 1024).toInt();
+
+    name = new_name.isEmpty() ? "camera " + QString::number(id) : new_name;
+
+    setObjectName("Recorder " + QString::number(id));
+}
+
+/**
+ * @brief Recorder::~Recorder
+ *      Stops the thread, the frames still in the queue are written first.
+ */
+Recorder::~Recorder()
+{
+    stop();
+    wait();
+}
+
+/**
+ * @brief Recorder::submit
+ *      Queues a frame for encoding. Called from the camera thread, it never waits for the encoder.
+ * @param frame
+ *      The frame, only its reference is queued.
+ */
+void Recorder::submit(const Frame &frame)
+{
+    QMutexLocker locker(&mutex);
+
+    if(stopping || queue.size() >= queue_size)
+    {
+        dropped_count.ref();
+        return;
+    }
+
+    queue.enqueue(frame);
+    frame_available.wakeOne();
+}
+
+/**
+ * @brief Recorder::consume
+ *      Frames from the broker of the camera, see submit.
+ * @param frame
+ *      The frame.
+ */
+void Recorder::consume(const Frame &frame)
+{
+    submit(frame);
+}
+
+/**
+ * @brief Recorder::stop
+ *      Asks the thread to finish, after writing the queued frames.
+ */
+void Recorder::stop()
+{
+    QMutexLocker locker(&mutex);
+
+    stopping = true;
+    frame_available.wakeOne();
+}
+
+/**
+ * @brief Recorder::set_frame_rate
+ *      Frame rate written to the Y4M header, for sources with a rate of their own. Call it before starting the thread.
+ * @param new_frame_rate
+ *      Frames per second, by default "Recorder/FrameRate".
+ */
+void Recorder::set_frame_rate(const int new_frame_rate)
+{
+    frame_rate = qMax(1, new_frame_rate);
+}
+
+/**
+ * @brief Recorder::run
+ *      Encoder loop, takes the frames from the queue until stopped.
+ *      The frame is released right after encoding so its pool slot goes back to the camera.
+ */
+void Recorder::run()
+{
+    forever
+    {
+        Frame frame;
+
+        {
+            QMutexLocker locker(&mutex);
+
+            while(queue.isEmpty() && !stopping)
+            {
+                frame_available.wait(&mutex);
+            }
+
+            if(queue.isEmpty())
+            {
+                break;
+            }
+
+            frame = queue.dequeue();
+        }
+
+        if(!frame.is_valid() && !frame.is_compressed())
+        {
+            continue;
+        }
+
+        //The JPEGs of an MJPEG camera are written as they are, whatever the format, the file is MJPEG then.
+        const bool passthrough = frame.is_compressed();
+        const QSize size = passthrough ? QSize(-1, -1) : frame.image.size();
+
+        //After a disk error the recording stays off, instead of creating a new file for every frame.
+        if(failed || (size != file_size && !open_file(size)))
+        {
+            failed = true;
+            dropped_count.ref();
+            continue;
+        }
+
+        bool success = false;
+
+        if(passthrough)
+        {
+            success = writer.write(frame.compressed.constData(), frame.compressed.size());
+            frame = Frame();
+        }
+        else
+        {
+            const QImage image = frame.image.format() == QImage::Format_RGB32 || frame.image.format() == QImage::Format_ARGB32 ?
+                                 frame.image : frame.image.convertToFormat(QImage::Format_RGB32);
+
+            frame = Frame();
+
+            success = format == Y4M ? encode_y4m(image) : encode_mjpeg(image);
+        }
+
+        if(success)
+        {
+            recorded_count.ref();
+        }
+        else
+        {
+            output("Recording of " + name + " failed: " + writer.get_error(), 1);
+            close_file();
+            failed = true;
+            dropped_count.ref();
+        }
+    }
+
+    close_file();
+}
+
+/**
+ * @brief Recorder::open_file
+ *      Starts a new file, named after the camera and the current time.
+ * @param size
+ *      Size of the frames, invalid for the JPEGs of an MJPEG camera, they are written to an MJPEG file as they are.
+ * @return
+ *      Success = true; Failed = false
+ */
+bool Recorder::open_file(const QSize &size)
+{
+    close_file();
+
+    QDir().mkpath(directory);
+
+    const bool y4m = format == Y4M && size.isValid();
+    const QString path = QDir(directory).filePath(QString(name).remove(' ') + "_" +
+                                                  QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss") +
+                                                  (y4m ? ".y4m" : ".mjpeg"));
+
+    if(!writer.open(path, buffer_size, direct))
+    {
+        output("Could not create the recording " + path + ": " + writer.get_error(), 1);
+        return false;
+    }
+
+    if(y4m)
+    {
+        const QByteArray header = "YUV4MPEG2 W" + QByteArray::number(size.width()) + " H" + QByteArray::number(size.height()) +
+                                  " F" + QByteArray::number(frame_rate) + ":1 Ip A1:1 C420jpeg\n";
+
+        if(!writer.write(header.constData(), header.size()))
+        {
+            output("Could not write the header of " + path + ": " + writer.get_error(), 1);
+            writer.close();
+            return false;
+        }
+    }
+
+    file_size = size;
+
+    output("Recording " + name + " to " + path + (writer.is_direct() ? " (direct I/O)." : "."), 2);
+
+    return true;
+}
+
+/**
+ * @brief Recorder::close_file
+ *      Flushes and closes the current file, if any.
+ */
+void Recorder::close_file()
+{
+    if(writer.is_open())
+    {
+        writer.close();
+
+        output("Recording of " + name + " closed, " + QString::number(recorded_count.load()) + " frames recorded, " +
+               QString::number(dropped_count.load()) + " dropped.", 2);
+    }
+
+    file_size = QSize();
+}
+
+/**
+ * @brief Recorder::encode_y4m
+ *      Converts the frame to YUV 4:2:0 and writes it with its frame header.
+ * @param image
+ *      RGB32 frame.
+ * @return
+ *      Success = true; Failed = false
+ */
+bool Recorder::encode_y4m(const QImage &image)
+{
+    static const char frame_header[] = "FRAME\n";
+
+    const int width = image.width();
+    const int height = image.height();
+    const int chroma_width = (width + 1) / 2;
+    const int chroma_height = (height + 1) / 2;
+    const int luma_bytes = width * height;
+    const int chroma_bytes = chroma_width * chroma_height;
+
+    encoded.resize(luma_bytes + 2 * chroma_bytes);
+    uchar *planes = reinterpret_cast<uchar*>(encoded.data());
+
+    ColorConversion::rgb32_to_yuv420p(image.constBits(), image.bytesPerLine(),
+                                      planes, width,
+                                      planes + luma_bytes, planes + luma_bytes + chroma_bytes, chroma_width,
+                                      width, height);
+
+    return writer.write(frame_header, sizeof(frame_header) - 1) &&
+           writer.write(encoded.constData(), encoded.size());
+}
+
+/**
+ * @brief Recorder::encode_mjpeg
+ *      Compresses the frame to JPEG and appends it.
+ * @param image
+ *      RGB32 frame.
+ * @return
+ *      Success = true; Failed = false
+ */
+bool Recorder::encode_mjpeg(const QImage &image)
+{
+    encoded.clear();
+
+    QBuffer buffer(&encoded);
+    buffer.open(QIODevice::WriteOnly);
+
+    QImageWriter image_writer(&buffer, "jpeg");
+    image_writer.setQuality(quality);
+
+    if(!image_writer.write(image))
+    {
+        output("JPEG encoding failed: " + image_writer.errorString(), 1);
+        return false;
+    }
+
+    return writer.write(encoded.constData(), encoded.size());
+}
+
+/**
+ * @brief Recorder::get_recorded_count
+ * @return
+ *      Number of frames written.
+ */
+int Recorder::get_recorded_count() const
+{
+    return recorded_count.load();
+}
+
+/**
+ * @brief Recorder::get_dropped_count
+ * @return
+ *      Number of frames dropped because the queue was full or the file could not be written.
+ */
+int Recorder::get_dropped_count() const
+{
+    return dropped_count.load();
+}
+
+/**
+ * @brief Recorder::output
+ *      Generic function responsible for all the outputs.
+ */
+void Recorder::output(const QString &message, const int verbose) const
+{
+    if(Output::get_verbose() >= verbose)
+    {
+        QVariantHash data;
+        data.insert("message", message);
+        data.insert("verbose", verbose);
+        data.insert("load_thread_id", true);
+
+        QString print = Output::builder(data);
+
+        if(!print.isEmpty())
+        {
+            emit console(print);
+        }
+    }
+}
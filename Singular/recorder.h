@@ -0,0 +1,108 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QAtomicInt>
+#include <QByteArray>
+
+#include "defines.h"
+#include "frame.h"
+#include "frameconsumer.h"
+#include "sequentialwriter.h"
+
+/**
+ * @brief The Recorder class
+ *      Writes the frames of one camera to disk, encoding them on its own thread.
+ *      The camera thread only appends the frame to a bounded queue. When the queue is full, because the encoder
+ *      or the disk can not keep up, the frame is dropped and counted, the capture is never held back.
+ * @remarks
+ *      Y4M is raw YUV 4:2:0 and can be read by most tools. MJPEG is a plain sequence of JPEG images,
+ *      encoded with the JPEG plugin bundled with Qt.
+ *      The queue holds the frames themselves, that is slots of the camera pool, CameraSurface adds the queue size to its pool.
+ *      A new file is started when the size of the frames changes.
+ *      The frames of an MJPEG camera are recorded without transcoding, their JPEGs are written as they are to an MJPEG file.
+ */
+class Recorder : public QThread, public FrameConsumer
+{
+    Q_OBJECT
+
+public_enums:
+    enum Format
+    {
+        Y4M,
+        MJPEG
+    };
+
+public_construct:
+    explicit Recorder(const int new_id, const QString &new_name = QString(), QObject *parent = 0);
+    ~Recorder();
+
+public_methods:
+    void submit(const Frame &frame);
+    void consume(const Frame &frame);
+    void stop();
+    void set_frame_rate(const int new_frame_rate);
+
+    int get_recorded_count() const;
+    int get_dropped_count() const;
+
+protected_methods:
+    void run();
+
+private_methods:
+    bool open_file(const QSize &size);
+    void close_file();
+    bool encode_y4m(const QImage &image);
+    bool encode_mjpeg(const QImage &image);
+    void output(const QString &message, const int verbose) const;
+
+private_members:
+    int id;
+    Format format;
+    int queue_size;
+    int frame_rate;
+    int quality;
+    int buffer_size;
+    bool direct;
+    bool stopping;
+    bool failed;
+    QSize file_size;
+    QAtomicInt recorded_count;
+    QAtomicInt dropped_count;
+
+private_data_members:
+    QString name;
+    QString directory;
+    QMutex mutex;
+    QWaitCondition frame_available;
+    QQueue<Frame> queue;
+    SequentialWriter writer;
+    QByteArray encoded;
+
+signals:
+    void console(const QString &message) const;
+
+};
+
+#endif // RECORDER_H
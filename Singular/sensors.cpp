@@ -18,9 +18,35 @@
 
 #include "sensors.h"
 #include "helper.h"
+#include "output.h"
+#include "benchmark.h"
+#include "settingsmanager.h"
 
+#include <QThread>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
 #include <QCameraInfo>
 #include <QAudioDeviceInfo>
+#include <QVBoxLayout>
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ */
+namespace
+{
+    QSize read_size(const QString &key)
+    {
+        const QStringList values = SettingsManager::read(key, "").toString().split('x');
+
+        return values.size() == 2 ? QSize(values.at(0).toInt(), values.at(1).toInt()) : QSize();
+    }
+}
 
 /**
  * @brief Sensors::Sensors
@@ -30,60 +56,541 @@
  *      Parent this class and to use signals and slots.
  */
 Sensors::Sensors(QWidget *parent) :
-    QWidget(parent)
+    QWidget(parent),
+    statistics_timer(0),
+    mosaic(0),
+    mosaic_widget(0),
+    mosaic_recorder(0),
+    mosaic_thread(0),
+    device_watcher(0),
+    device_watcher_thread(0),
+    audio_input_thread(0),
+    spectrum(0),
+    spectrum_thread(0)
 {
     connect(this, SIGNAL(add_camera(QString, QWidget*, bool)), parent, SLOT(add_camera(QString, QWidget*, bool)));
+    connect(this, SIGNAL(add_output_camera(QString, QWidget*, bool)), parent, SLOT(add_output_camera(QString, QWidget*, bool)));
     connect(this, SIGNAL(add_microphone(QString, QWidget*, bool)), parent, SLOT(add_microphone(QString, QWidget*, bool)));
+    connect(this, SIGNAL(remove_camera(QWidget*)), parent, SLOT(remove_camera(QWidget*)));
+    connect(this, SIGNAL(remove_microphone(QString)), parent, SLOT(remove_microphone(QString)));
     connect(this, SIGNAL(console(QString)), parent, SLOT(console(QString)));
     connect(parent, SIGNAL(get_text(QString)), this, SIGNAL(get_text(QString)));
 
+    qRegisterMetaType<Frame>("Frame");
+    qRegisterMetaType<QVector<int> >("QVector<int>");
+    qRegisterMetaType<QVector<float> >("QVector<float>");
+
+    //Before any sensor starts, the benchmarks limit the SIMD level of every kernel while they run.
+    if(SettingsManager::read("Debug/Benchmark", false).toBool())
+    {
+        start_benchmark();
+    }
+
     start_cameras();
     start_textstream();
+    start_spectrum();
     start_microphones();
 //    start_speakers();
+    start_device_watcher();
+}
+
+/**
+ * @brief Sensors::~Sensors
+ *      Stops the camera threads, the surfaces are deleted by their threads once the event loops end.
+ *      The recorders are stopped after the cameras, so they get every frame, and finish writing their queues.
+ *      The mosaic is stopped after the cameras as well, they post their frames to it.
+ *      The entries of removed cameras are null. The statistics are exported before the microphone is stopped, they include it.
+ *      The microphone is removed from the spectrum analyzer before the analyzer thread is stopped.
+ */
+Sensors::~Sensors()
+{
+    if(device_watcher_thread != 0)
+    {
+        device_watcher_thread->quit();
+        device_watcher_thread->wait();
+    }
+
+    for(int i = 0; i < camera_threads.size(); i++)
+    {
+        if(camera_threads.at(i) != 0)
+        {
+            camera_threads.at(i)->quit();
+            camera_threads.at(i)->wait();
+        }
+    }
+
+    if(mosaic_thread != 0)
+    {
+        mosaic_thread->quit();
+        mosaic_thread->wait();
+    }
+
+    delete mosaic_recorder;
+
+    for(int i = 0; i < recorders.size(); i++)
+    {
+        delete recorders.at(i);
+    }
+
+    for(int i = 0; i < camera_brokers.size(); i++)
+    {
+        delete camera_brokers.at(i);
+    }
+
+    export_statistics();
+    stop_microphone();
+
+    if(spectrum_thread != 0)
+    {
+        spectrum_thread->quit();
+        spectrum_thread->wait();
+    }
+
+    for(int i = 0; i < camera_statistics.size(); i++)
+    {
+        delete camera_statistics.at(i);
+    }
 }
 
 /**
  * @brief Sensors::start_cameras
- *      Initializes the available cameras.
- *      Initializes the widgets for the cameras.
- *      Initializes the surfaces to transmit the data.
- *      Adds the camera widget to the UI.
+ *      Initializes the available cameras, see start_camera.
+ *      Cameras plugged in later are started by the device watcher.
+ * @remarks
+ *      The setting "Camera/<id>/Core" pins the thread of a camera to a CPU core, -1 leaves it to the scheduler.
+ *      The setting "Camera/<id>/Roi", as "x,y,width,height", only copies and processes that region of the camera,
+ *      it can be changed by dragging over the camera widget.
+ *      Every consumer subscribes to the broker of the camera with its own limits, see start_camera.
+ *      The setting "Camera/<id>/JpegScale", by default "Camera/JpegScale", decodes the frames of an MJPEG camera at 1/2, 1/4 or 1/8 of their size.
+ *      The setting "Camera/<id>/Record", by default "Recorder/Enabled", records the camera to disk.
+ *      The setting "Camera/<id>/PreRoll", by default "PreRoll/Enabled", keeps the last seconds of the camera in memory,
+ *      written to disk on motion or with the "trigger" text command.
+ *      The setting "Mosaic/Enabled" tiles all the cameras into one output, see start_mosaic.
+ *      The setting "Synthetic/Count" adds that many synthetic cameras, for load tests without devices.
+ *      The settings "Statistics/ExportFile" and "Statistics/ExportInterval" (ms, 0 disables) write the statistics
+ *      of all the cameras to a JSON file periodically.
  */
 void Sensors::start_cameras()
 {
     QString default_device = QCameraInfo::defaultCamera().deviceName();
     QList<QCameraInfo> cameras_info = QCameraInfo::availableCameras();
 
+    //Synthetic cameras have no device, they come after the real ones.
+    const int synthetic_count = SettingsManager::read("Synthetic/Count", 0).toInt();
+
+    for(int i = 0; i < synthetic_count; i++)
+    {
+        cameras_info.append(QCameraInfo());
+    }
+
+    //Before the cameras start, they post to it from their threads.
+    start_mosaic(cameras_info.size());
+
     for (int i = 0; i < cameras_info.size(); i++)
     {
-        camera_widgets.append(new CameraWidget(this));
-        camera_surfaces.append(new CameraSurface(i, cameras_info.at(i), this));
-        camera_surfaces.at(i)->start();
+        start_camera(cameras_info.at(i), !cameras_info.at(i).isNull() && cameras_info.at(i).deviceName() == default_device);
+    }
+
+    const int export_interval = SettingsManager::read("Statistics/ExportInterval", 0).toInt();
+
+    if(export_interval > 0)
+    {
+        statistics_timer = new QTimer(this);
+        connect(statistics_timer, SIGNAL(timeout()), this, SLOT(export_statistics()));
+        statistics_timer->start(export_interval);
+    }
+}
+
+/**
+ * @brief Sensors::start_camera
+ *      Initializes one camera.
+ *      Initializes the widget for the camera.
+ *      Initializes the surface to transmit the data, on its own thread so that the capture
+ *      and processing of a camera never competes with the UI or with the other cameras.
+ *      Adds the camera widget to the UI.
+ *      Only the camera that is shown converts and delivers every frame, see CameraSurface::set_visible.
+ * @remarks
+ *      The ID of a camera is its position in the lists, the ID of a removed camera is never reused.
+ *      The entries are appended under the write lock, the camera threads read the lists in image_data.
+ *      The widget, the recorder and the mosaic tile subscribe to the broker of the camera:
+ *      "Camera/DisplayFrameRate" and "Camera/DisplayMaxResolution" (e.g. "1280x720") limit what the widget paints,
+ *      "Recorder/MaxFrameRate", by default "Recorder/FrameRate", and "Recorder/MaxResolution" what is recorded,
+ *      and the mosaic takes RGB32 at "Mosaic/FrameRate". The recorder gets the JPEGs of an MJPEG camera as they are.
+ * @param camera_info
+ *      The device, a null info for a synthetic camera.
+ * @param selected
+ *      Show this camera.
+ */
+void Sensors::start_camera(const QCameraInfo &camera_info, const bool selected)
+{
+    const int id = camera_surfaces.size();
+
+    CameraWidget *widget = new CameraWidget(this);
+    CameraSurface *surface = new CameraSurface(id, camera_info);
+    QThread *thread = new QThread(this);
+    CameraStatistics *statistics = new CameraStatistics(id);
+    FrameBroker *broker = new FrameBroker(id);
+    Recorder *recorder = 0;
+
+    surface->set_statistics(statistics);
+    widget->set_statistics(statistics);
+
+    connect(surface, SIGNAL(image_data(int, Frame)), this, SLOT(image_data(int, Frame)), Qt::DirectConnection);
+    connect(surface, SIGNAL(console(QString)), this, SIGNAL(console(QString)));
+    connect(widget, SIGNAL(visibility_changed(bool)), surface, SLOT(set_visible(bool)));
+    connect(widget, SIGNAL(roi_selected(QRect)), surface, SLOT(set_roi(QRect)));
+    connect(thread, SIGNAL(finished()), surface, SLOT(deleteLater()));
+    connect(broker, SIGNAL(console(QString)), this, SIGNAL(console(QString)));
+
+    broker->subscribe(widget, "display", SettingsManager::read("Camera/DisplayFrameRate", 0).toInt(),
+                      QImage::Format_Invalid, read_size("Camera/DisplayMaxResolution"));
+    widget->set_broker(broker);
+
+    if(SettingsManager::read("Camera/" + QString::number(id) + "/Record", SettingsManager::read("Recorder/Enabled", false)).toBool())
+    {
+        recorder = new Recorder(id);
+        connect(recorder, SIGNAL(console(QString)), this, SIGNAL(console(QString)));
+        recorder->start();
+
+        broker->subscribe(recorder, "recorder", SettingsManager::read("Recorder/MaxFrameRate", SettingsManager::read("Recorder/FrameRate", 30)).toInt(),
+                          QImage::Format_RGB32, read_size("Recorder/MaxResolution"), true);
+    }
+
+    //Cameras plugged in after the start have no tile.
+    if(mosaic != 0 && mosaic->get_tile(id) != 0)
+    {
+        broker->subscribe(mosaic->get_tile(id), "mosaic", SettingsManager::read("Mosaic/FrameRate", 15).toInt(), QImage::Format_RGB32);
+    }
+
+    {
+        QWriteLocker locker(&cameras_lock);
+
+        camera_widgets.append(widget);
+        camera_surfaces.append(surface);
+        camera_threads.append(thread);
+        camera_statistics.append(statistics);
+        camera_brokers.append(broker);
+        camera_devices.append(camera_info.deviceName());
+        recorders.append(recorder);
+    }
+
+    thread->setObjectName("Camera " + QString::number(id));
+    surface->moveToThread(thread);
+    thread->start();
+
+    const int core = SettingsManager::read("Camera/" + QString::number(id) + "/Core", -1).toInt();
+
+    if(core >= 0)
+    {
+        QMetaObject::invokeMethod(surface, "set_affinity", Qt::QueuedConnection, Q_ARG(int, core));
+    }
 
-        if(cameras_info.at(i).deviceName() == default_device)
+    if(recorder != 0)
+    {
+        QMetaObject::invokeMethod(surface, "set_recording", Qt::QueuedConnection, Q_ARG(bool, true));
+    }
+
+    QMetaObject::invokeMethod(surface, "start", Qt::QueuedConnection);
+
+    if(camera_info.isNull())
+    {
+        emit add_camera("Synthetic " + QString::number(id), widget);
+    }
+    else
+    {
+        emit add_camera(camera_info.deviceName(), widget, selected);
+    }
+}
+
+/**
+ * @brief Sensors::stop_camera
+ *      Tears down one camera, used when its device is removed. The other cameras are not touched.
+ *      The thread is stopped first, so no frame is in flight when the entries are cleared.
+ * @param id
+ *      ID of the camera.
+ */
+void Sensors::stop_camera(const int id)
+{
+    if(id < 0 || id >= camera_threads.size() || camera_threads.at(id) == 0)
+    {
+        return;
+    }
+
+    QThread *thread = camera_threads.at(id);
+    thread->quit();
+    thread->wait();
+
+    CameraWidget *widget = camera_widgets.at(id);
+    Recorder *recorder = recorders.at(id);
+    CameraStatistics *statistics = camera_statistics.at(id);
+    FrameBroker *broker = camera_brokers.at(id);
+
+    {
+        QWriteLocker locker(&cameras_lock);
+
+        camera_widgets[id] = 0;
+        camera_surfaces[id] = 0;
+        camera_threads[id] = 0;
+        camera_statistics[id] = 0;
+        camera_brokers[id] = 0;
+        camera_devices[id].clear();
+        recorders[id] = 0;
+    }
+
+    //The tile of the camera goes black instead of showing its last frame.
+    if(mosaic != 0)
+    {
+        mosaic->submit(id, Frame());
+    }
+
+    emit remove_camera(widget);
+
+    delete broker;
+    delete widget;
+    delete recorder;
+    delete statistics;
+    thread->deleteLater();
+
+    output("Camera " + QString::number(id) + " stopped.", 2);
+}
+
+/**
+ * @brief Sensors::start_device_watcher
+ *      Starts watching for devices plugged in or removed, on its own thread, every "Devices/PollInterval" ms (0 disables it).
+ */
+void Sensors::start_device_watcher()
+{
+    if(SettingsManager::read("Devices/PollInterval", 2000).toInt() <= 0)
+    {
+        return;
+    }
+
+    QStringList cameras;
+    QStringList microphones;
+
+    for(int i = 0; i < camera_devices.size(); i++)
+    {
+        if(!camera_devices.at(i).isEmpty())
         {
-            emit add_camera(cameras_info.at(i).deviceName(), camera_widgets.at(i), true);
+            cameras.append(camera_devices.at(i));
         }
-        else
+    }
+
+    for(int i = 0; i < audio_input_info.size(); i++)
+    {
+        microphones.append(audio_input_info.at(i).deviceName());
+    }
+
+    device_watcher = new DeviceWatcher(cameras, microphones);
+    device_watcher_thread = new QThread(this);
+
+    connect(device_watcher, SIGNAL(console(QString)), this, SIGNAL(console(QString)));
+    connect(device_watcher, SIGNAL(devices_changed()), this, SLOT(devices_changed()));
+    connect(device_watcher_thread, SIGNAL(finished()), device_watcher, SLOT(deleteLater()));
+
+    device_watcher_thread->setObjectName("Device watcher");
+    device_watcher->moveToThread(device_watcher_thread);
+    device_watcher_thread->start();
+
+    QMetaObject::invokeMethod(device_watcher, "start", Qt::QueuedConnection);
+}
+
+/**
+ * @brief Sensors::devices_changed
+ *      Applies the changes found by the device watcher: removed devices are torn down first, then the new ones are started.
+ *      Only the affected cameras and microphones, and their entries in the UI, are touched.
+ */
+void Sensors::devices_changed()
+{
+    const DeviceWatcher::Changes changes = device_watcher->take_changes();
+
+    for(int i = 0; i < changes.removed_cameras.size(); i++)
+    {
+        stop_camera(camera_devices.indexOf(changes.removed_cameras.at(i)));
+    }
+
+    for(int i = 0; i < changes.added_cameras.size(); i++)
+    {
+        output("Starting camera " + changes.added_cameras.at(i).deviceName() + ".", 2);
+        start_camera(changes.added_cameras.at(i), false);
+    }
+
+    for(int i = 0; i < changes.removed_microphones.size(); i++)
+    {
+        remove_microphone_device(changes.removed_microphones.at(i));
+    }
+
+    for(int i = 0; i < changes.added_microphones.size(); i++)
+    {
+        audio_input_info.append(changes.added_microphones.at(i));
+        emit add_microphone(changes.added_microphones.at(i).deviceName());
+    }
+}
+
+/**
+ * @brief Sensors::remove_microphone_device
+ *      Removes a microphone from the list, and stops it if it is the one in use.
+ * @param device_name
+ *      Name of the device.
+ */
+void Sensors::remove_microphone_device(const QString &device_name)
+{
+    for(int i = 0; i < audio_input_info.size(); i++)
+    {
+        if(audio_input_info.at(i).deviceName() == device_name)
         {
-            emit add_camera(cameras_info.at(i).deviceName(), camera_widgets.at(i));
+            if(active_microphone == device_name)
+            {
+                stop_microphone();
+            }
+
+            //Removing the entry can select another microphone, the list must be up to date before.
+            audio_input_info.removeAt(i);
+            emit remove_microphone(device_name);
+            break;
         }
     }
 }
 
+/**
+ * @brief Sensors::start_mosaic
+ *      Initializes the compositor that tiles all the cameras into one frame, shown in the output cameras.
+ *      The compositor has its own thread, the cameras only post their frames to it.
+ * @param camera_count
+ *      Number of cameras, one tile each.
+ * @remarks
+ *      Enabled with "Mosaic/Enabled", "Mosaic/Record" records the mosaic like a camera.
+ *      See MosaicCompositor for the size, frame rate and grid settings.
+ */
+void Sensors::start_mosaic(const int camera_count)
+{
+    if(camera_count == 0 || !SettingsManager::read("Mosaic/Enabled", false).toBool())
+    {
+        return;
+    }
+
+    mosaic = new MosaicCompositor(camera_count);
+    mosaic_widget = new CameraWidget(this);
+    mosaic_thread = new QThread(this);
+
+    connect(mosaic, SIGNAL(image_data(Frame)), this, SLOT(mosaic_data(Frame)), Qt::DirectConnection);
+    connect(mosaic, SIGNAL(console(QString)), this, SIGNAL(console(QString)));
+    connect(mosaic_widget, SIGNAL(visibility_changed(bool)), mosaic, SLOT(set_visible(bool)));
+    connect(mosaic_thread, SIGNAL(finished()), mosaic, SLOT(deleteLater()));
+
+    if(SettingsManager::read("Mosaic/Record", false).toBool())
+    {
+        mosaic_recorder = new Recorder(camera_count, "mosaic");
+        mosaic_recorder->set_frame_rate(SettingsManager::read("Mosaic/FrameRate", 15).toInt());
+        connect(mosaic_recorder, SIGNAL(console(QString)), this, SIGNAL(console(QString)));
+        mosaic_recorder->start();
+
+        QMetaObject::invokeMethod(mosaic, "set_recording", Qt::QueuedConnection, Q_ARG(bool, true));
+    }
+
+    mosaic_thread->setObjectName("Mosaic");
+    mosaic->moveToThread(mosaic_thread);
+    mosaic_thread->start();
+
+    QMetaObject::invokeMethod(mosaic, "start", Qt::QueuedConnection);
+
+    emit add_output_camera("Mosaic", mosaic_widget, true);
+}
+
+/**
+ * @brief Sensors::export_statistics
+ *      Writes the statistics of every camera and of the microphone to the file set by "Statistics/ExportFile", replacing it atomically,
+ *      so a monitoring script never reads a partial file. Nothing is written if the setting is empty.
+ *      The glitches of the microphone are the callbacks that came later than the device buffer lasts, see AudioInputSurface::writeData.
+ */
+void Sensors::export_statistics() const
+{
+    const QString file_name = SettingsManager::read("Statistics/ExportFile", "").toString();
+
+    if(file_name.isEmpty() || (camera_statistics.isEmpty() && audio_input_surfaces.isEmpty()))
+    {
+        return;
+    }
+
+    QJsonArray cameras;
+
+    for(int i = 0; i < camera_statistics.size(); i++)
+    {
+        if(camera_statistics.at(i) != 0)
+        {
+            camera_statistics.at(i)->sample(CameraStatistics::Export);
+            cameras.append(camera_statistics.at(i)->to_json());
+        }
+    }
+
+    QJsonArray microphones;
+
+    for(int i = 0; i < audio_input_surfaces.size(); i++)
+    {
+        const AudioInputSurface *surface = audio_input_surfaces.at(i);
+
+        QJsonObject microphone;
+        microphone.insert("device", active_microphone);
+        microphone.insert("thread", audio_input_thread != 0);
+        microphone.insert("realtime", surface->is_realtime());
+        microphone.insert("glitches", surface->get_glitch_count());
+        microphone.insert("longest_gap_ms", surface->get_longest_gap() / 1000.0);
+
+        if(surface->get_ring() != 0)
+        {
+            microphone.insert("ring_overruns", surface->get_ring()->get_overrun_count());
+            microphone.insert("ring_dropped_frames", static_cast<double>(surface->get_ring()->get_dropped_frames()));
+        }
+
+        microphones.append(microphone);
+    }
+
+    QJsonObject root;
+    root.insert("time", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    root.insert("cameras", cameras);
+    root.insert("microphones", microphones);
+
+    QSaveFile file(file_name);
+
+    if(!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(root).toJson()) < 0 || !file.commit())
+    {
+        output("Could not export the statistics to " + file_name + ": " + file.errorString(), 1);
+    }
+}
+
 /**
  * @brief Sensors::image_data
  *      Get image data from the image sensors.
- *      Updates the widget and sends the data to the network.
+ *      Publishes the frame to the broker of the camera, which hands it to the widget, the recorder and the mosaic.
+ *      This runs in the camera thread (direct connection), the widget takes the frame through its mailbox
+ *      and the recorder through its queue, neither of them blocks.
  * @param id
- *      ID of the surface, this is needed to update the correct camerawidget.
+ *      ID of the surface, this is needed to get the broker of the camera.
  * @param new_frame
  *      The new frame.
  */
-void Sensors::image_data(const int id, const QImage new_frame) const
+void Sensors::image_data(const int id, const Frame &new_frame) const
 {
-    camera_widgets.at(id)->update_frame(new_frame);
+    QReadLocker locker(&cameras_lock);
+
+    camera_brokers.at(id)->publish(new_frame);
+}
+
+/**
+ * @brief Sensors::mosaic_data
+ *      Get the frames of the mosaic, this runs in the thread of the compositor (direct connection).
+ *      Updates the output widget and the recorder of the mosaic.
+ * @param new_frame
+ *      The new mosaic frame.
+ */
+void Sensors::mosaic_data(const Frame &new_frame) const
+{
+    mosaic_widget->update_frame(new_frame);
+
+    if(mosaic_recorder != 0)
+    {
+        mosaic_recorder->submit(new_frame);
+    }
 }
 
 /**
@@ -91,21 +598,36 @@ void Sensors::image_data(const int id, const QImage new_frame) const
  *      Initializes only the default microphone and one widget.
  *      Although this is a QList only a single device will be active, probably change this in the future.
  *      Adds the camera widget to the UI.
+ *      The list of devices is kept in the same order as the entries of the UI, the device watcher updates both.
  */
 void Sensors::start_microphones()
 { 
     QString default_device = QAudioDeviceInfo::defaultInputDevice().deviceName();
-    QList<QAudioDeviceInfo> audio_input_info = QAudioDeviceInfo::availableDevices(QAudio::AudioInput);
+    audio_input_info = QAudioDeviceInfo::availableDevices(QAudio::AudioInput);
 
     for (int i = 0; i < audio_input_info.size(); i++)
     {
         if(audio_input_info.at(i).deviceName() == default_device)
         {
-            audio_input_widgets.append(new AudioWidget(this));
-            audio_input_surfaces.append(new AudioInputSurface(audio_input_surfaces.size(), audio_input_info.at(i), audio_input_info.at(i).preferredFormat(), this));
-            audio_input_surfaces.last()->start();
+            AudioWidget *level = new AudioWidget(this);
+            QWidget *microphone = level;
+            audio_input_widgets.append(level);
+
+            //The spectrum goes under the level bar, the widgets are created with this parent for their console.
+            if(spectrum != 0)
+            {
+                spectrum_widgets.append(new SpectrumWidget(this));
 
-            emit add_microphone(audio_input_info.at(i).deviceName(), audio_input_widgets.last(), true);
+                microphone = new QWidget(this);
+                QVBoxLayout *layout = new QVBoxLayout(microphone);
+                layout->setContentsMargins(0, 0, 0, 0);
+                layout->addWidget(level);
+                layout->addWidget(spectrum_widgets.last(), 1);
+            }
+
+            start_microphone(i);
+
+            emit add_microphone(audio_input_info.at(i).deviceName(), microphone, true);
         }
         else
         {
@@ -118,32 +640,178 @@ void Sensors::start_microphones()
  * @brief Sensors::update_microphones
  *      Since we only have one device initialized at any given moment, this method will remove the current and create the new device.
  * @param id
+ *      Index of the device in the list, the same as in the UI.
  */
 void Sensors::update_microphones(const int id)
 {
-    QList<QAudioDeviceInfo> audio_input_info = QAudioDeviceInfo::availableDevices(QAudio::AudioInput);
+    stop_microphone();
+
+    if(id < 0 || id >= audio_input_info.size())
+    {
+        return;
+    }
+
+    start_microphone(id);
+}
+
+/**
+ * @brief Sensors::start_microphone
+ *      Starts the surface of a microphone. With "Audio/Thread", the default, the surface captures in its own thread,
+ *      which the surface moves to the real-time scheduler, so the GUI never delays the device callbacks.
+ *      Only the levels come back to the GUI, queued, the samples stay in the ring of the surface.
+ *      Without it the surface runs in the GUI thread as before, to compare the glitches of both.
+ *      The spectrum analyzer, if enabled, reads the samples from the ring of the surface.
+ * @param index
+ *      Index of the device in the list, the same as in the UI.
+ */
+void Sensors::start_microphone(const int index)
+{
+    AudioInputSurface *surface = new AudioInputSurface(audio_input_surfaces.size(), audio_input_info.at(index), audio_input_info.at(index).preferredFormat());
+
+    connect(surface, SIGNAL(console(QString)), this, SIGNAL(console(QString)));
+    connect(surface, SIGNAL(microphone_data(int, int)), this, SLOT(microphone_data(int, int)));
+    connect(surface, SIGNAL(microphone_rms(int, int)), this, SLOT(microphone_rms(int, int)));
+
+    if(SettingsManager::read("Audio/Thread", true).toBool())
+    {
+        audio_input_thread = new QThread(this);
+        connect(audio_input_thread, SIGNAL(finished()), surface, SLOT(deleteLater()));
+
+        audio_input_thread->setObjectName("Audio " + QString::number(audio_input_surfaces.size()));
+        surface->moveToThread(audio_input_thread);
+        audio_input_thread->start();
+    }
+
+    //Attached before the surface starts, the spectrum gets every sample.
+    if(spectrum != 0 && surface->get_ring() != 0)
+    {
+        spectrum->add_input(audio_input_surfaces.size(), surface->get_ring(), surface->get_sample_rate());
+    }
+
+    audio_input_surfaces.append(surface);
+    active_microphone = audio_input_info.at(index).deviceName();
+
+    QMetaObject::invokeMethod(surface, "start", Qt::QueuedConnection);
+}
+
+/**
+ * @brief Sensors::stop_microphone
+ *      Stops the microphone in use, if any. A surface in its own thread is stopped in that thread and deleted when the thread ends,
+ *      the levels it queued before are still delivered, the widget is kept.
+ *      The spectrum analyzer lets go of the ring first, the ring is deleted with the surface.
+ */
+void Sensors::stop_microphone()
+{
+    if(!audio_input_surfaces.isEmpty())
+    {
+        if(spectrum != 0)
+        {
+            spectrum->remove_input(audio_input_surfaces.size() - 1);
+        }
+
+        if(audio_input_thread != 0)
+        {
+            QMetaObject::invokeMethod(audio_input_surfaces.last(), "stop", Qt::BlockingQueuedConnection);
+
+            audio_input_thread->quit();
+            audio_input_thread->wait();
+
+            delete audio_input_thread;
+            audio_input_thread = 0;
+        }
+        else
+        {
+            audio_input_surfaces.last()->stop();
+            audio_input_surfaces.last()->deleteLater();
+        }
+
+        audio_input_surfaces.clear();
+    }
+
+    active_microphone.clear();
+}
+
+/**
+ * @brief Sensors::start_spectrum
+ *      Starts the spectrum analyzer of the microphones on its own thread, all the microphones share it.
+ *      Enabled with "Spectrum/Enabled", "Spectrum/Core" pins its thread to a core. See SpectrumAnalyzer for the other settings.
+ */
+void Sensors::start_spectrum()
+{
+    if(!SettingsManager::read("Spectrum/Enabled", true).toBool())
+    {
+        return;
+    }
+
+    spectrum = new SpectrumAnalyzer();
+    spectrum_thread = new QThread(this);
 
-    audio_input_surfaces.last()->stop();
-    audio_input_surfaces.last()->deleteLater();
-    audio_input_surfaces.clear();
+    connect(spectrum, SIGNAL(console(QString)), this, SIGNAL(console(QString)));
+    connect(spectrum, SIGNAL(spectrum(int, QVector<float>)), this, SLOT(spectrum_data(int, QVector<float>)));
+    connect(spectrum_thread, SIGNAL(finished()), spectrum, SLOT(deleteLater()));
 
-    audio_input_surfaces.append(new AudioInputSurface(audio_input_surfaces.size(), audio_input_info.at(id), audio_input_info.at(id).preferredFormat(), this));
-    audio_input_surfaces.last()->start();
+    spectrum_thread->setObjectName("Spectrum");
+    spectrum->moveToThread(spectrum_thread);
+    spectrum_thread->start();
+
+    const int core = SettingsManager::read("Spectrum/Core", -1).toInt();
+
+    if(core >= 0)
+    {
+        QMetaObject::invokeMethod(spectrum, "set_affinity", Qt::QueuedConnection, Q_ARG(int, core));
+    }
+
+    QMetaObject::invokeMethod(spectrum, "start", Qt::QueuedConnection);
 }
 
 /**
  * @brief Sensors::microphone_data
- *      Recives the data from the sensors.
- *      Updates the widget and sends the data to the network.
+ *      Recives the level from the sensors and updates the widget.
+ *      The samples are read from the ring of the surface, see AudioInputSurface::get_ring.
  * @param id
  *      ID of the surface, this is needed to update the correct audiowidget.
  * @param level
  *      Level to display the audio volume.
  */
-void Sensors::microphone_data(const int id, const char *data, const int level) const
+void Sensors::microphone_data(const int id, const int level) const
 {
-    Q_UNUSED(data);
-    audio_input_widgets.at(id)->update_level(level);
+    //Without a default device at start there is no widget.
+    if(id < audio_input_widgets.size())
+    {
+        audio_input_widgets.at(id)->update_level(level);
+    }
+}
+
+/**
+ * @brief Sensors::microphone_rms
+ *      Recives the RMS level of the loudest channel, sent just before the peak level of the same buffer.
+ * @param id
+ *      ID of the surface.
+ * @param level
+ *      RMS level, on the scale of the peak level.
+ */
+void Sensors::microphone_rms(const int id, const int level) const
+{
+    if(id < audio_input_widgets.size())
+    {
+        audio_input_widgets.at(id)->update_rms(level);
+    }
+}
+
+/**
+ * @brief Sensors::spectrum_data
+ *      Receives the spectrum of a microphone from the analyzer and updates its widget.
+ * @param id
+ *      ID of the surface, this is needed to update the correct spectrum widget.
+ * @param levels
+ *      The level of each band in dB.
+ */
+void Sensors::spectrum_data(const int id, const QVector<float> &levels) const
+{
+    if(id < spectrum_widgets.size())
+    {
+        spectrum_widgets.at(id)->update_spectrum(levels);
+    }
 }
 
 void Sensors::start_speakers()
@@ -170,6 +838,25 @@ void Sensors::speakers_data(const int id, const int level) const
     Q_UNUSED(level);
 }
 
+/**
+ * @brief Sensors::start_benchmark
+ *      Runs the kernel benchmarks and prints the results.
+ *      This blocks the UI while running, it is only meant for debugging.
+ *      It runs before the cameras and microphones start, so the results are not measured on a loaded machine
+ *      and no live kernel is limited to a lower SIMD level, see Simd::set_level_limit.
+ */
+void Sensors::start_benchmark()
+{
+    output("Running benchmarks.", 1);
+
+    const QStringList results = Benchmark::run();
+
+    for(int i = 0; i < results.size(); i++)
+    {
+        output(results.at(i), 1);
+    }
+}
+
 /**
  * @brief Sensors::start_textstream
  *      Start the textstream
@@ -177,4 +864,50 @@ void Sensors::speakers_data(const int id, const int level) const
 void Sensors::start_textstream()
 {
     text = new TextStream(this);
+    connect(text, SIGNAL(trigger(int)), this, SLOT(trigger_preroll(int)));
+}
+
+/**
+ * @brief Sensors::trigger_preroll
+ *      Writes the pre-roll of a camera to disk, the cameras without a pre-roll buffer ignore it.
+ * @param id
+ *      ID of the camera, -1 for all the cameras.
+ */
+void Sensors::trigger_preroll(const int id) const
+{
+    if(id >= camera_surfaces.size())
+    {
+        output("Camera " + QString::number(id) + " does not exist.", 1);
+        return;
+    }
+
+    for(int i = 0; i < camera_surfaces.size(); i++)
+    {
+        if((id < 0 || id == i) && camera_surfaces.at(i) != 0)
+        {
+            camera_surfaces.at(i)->trigger_preroll("command");
+        }
+    }
+}
+
+/**
+ * @brief Sensors::output
+ *      Generic function responsible for all the outputs.
+ */
+void Sensors::output(const QString &message, const int verbose) const
+{
+    if(Output::get_verbose() >= verbose)
+    {
+        QVariantHash data;
+        data.insert("message", message);
+        data.insert("verbose", verbose);
+        data.insert("load_thread_id", true);
+
+        QString print = Output::builder(data);
+
+        if(!print.isEmpty())
+        {
+            emit console(print);
+        }
+    }
 }
@@ -20,11 +20,22 @@
 #define SENSORS_H
 
 #include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QReadWriteLock>
 
 #include "defines.h"
 #include "textstream.h"
 #include "audiowidget.h"
+#include "spectrumwidget.h"
+#include "spectrumanalyzer.h"
 #include "camerawidget.h"
+#include "camerasurface.h"
+#include "recorder.h"
+#include "framebroker.h"
+#include "mosaiccompositor.h"
+#include "devicewatcher.h"
+#include "camerastatistics.h"
 #include "audioinputsurface.h"
 #include "audiooutputsurface.h"
 
@@ -34,21 +45,56 @@ class Sensors : public QWidget
 
 public_construct:
     explicit Sensors(QWidget *parent = 0);
+    ~Sensors();
 
 public_methods:
     void start_cameras();
+    void start_camera(const QCameraInfo &camera_info, const bool selected);
+    void stop_camera(const int id);
+    void start_mosaic(const int camera_count);
+    void start_device_watcher();
     void start_textstream();
     void start_microphones();
+    void start_microphone(const int index);
+    void start_spectrum();
     void start_speakers();
+    void start_benchmark();
 
     void update_microphones(const int id);
+    void stop_microphone();
+    void remove_microphone_device(const QString &device_name);
+
+private_methods:
+    void output(const QString &message, const int verbose) const;
 
 private_data_members:
     QList<CameraWidget*> camera_widgets;
     QList<CameraSurface*> camera_surfaces;
+    QList<QThread*> camera_threads;
+    QList<Recorder*> recorders;
+    QList<CameraStatistics*> camera_statistics;
+    QList<FrameBroker*> camera_brokers;
+    QStringList camera_devices;
+    mutable QReadWriteLock cameras_lock;
+    QTimer *statistics_timer;
+
+    MosaicCompositor *mosaic;
+    CameraWidget *mosaic_widget;
+    Recorder *mosaic_recorder;
+    QThread *mosaic_thread;
+
+    DeviceWatcher *device_watcher;
+    QThread *device_watcher_thread;
 
     QList<AudioWidget*> audio_input_widgets;
     QList<AudioInputSurface*> audio_input_surfaces;
+    QThread *audio_input_thread;
+
+    QList<SpectrumWidget*> spectrum_widgets;
+    SpectrumAnalyzer *spectrum;
+    QThread *spectrum_thread;
+    QList<QAudioDeviceInfo> audio_input_info;
+    QString active_microphone;
 
     QList<AudioWidget*> audio_output_widgets;
     QList<AudioOutputSurface*> audio_output_surfaces;
@@ -56,14 +102,25 @@ private_data_members:
     TextStream* text;
 
 public slots:
-    void image_data(const int id, const QImage new_frame) const;
-    void microphone_data(const int id, const char *data, const int level) const;
+    void image_data(const int id, const Frame &new_frame) const;
+    void mosaic_data(const Frame &new_frame) const;
+    void microphone_data(const int id, const int level) const;
+    void microphone_rms(const int id, const int level) const;
+    void spectrum_data(const int id, const QVector<float> &levels) const;
     void speakers_data(const int id, const int level) const;
+    void export_statistics() const;
+    void trigger_preroll(const int id) const;
+
+private slots:
+    void devices_changed();
 
 signals:
     void console(const QString &message) const;
     void add_camera(const QString &camera_name, QWidget *camera = 0, const bool selected = false) const;
+    void add_output_camera(const QString &camera_name, QWidget *camera = 0, const bool selected = false) const;
     void add_microphone(const QString &microphone_name, QWidget *microphone = 0, const bool selected = false) const;
+    void remove_camera(QWidget *camera) const;
+    void remove_microphone(const QString &microphone_name) const;
     void get_text(const QString &message) const;
 
 };
@@ -0,0 +1,349 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sequentialwriter.h"
+
+#include <cstring>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Variables
+ *      Direct I/O needs the buffer address, the file offset and the size aligned to the logical block size of the device,
+ *      4096 bytes covers all the current disks.
+ */
+namespace
+{
+    const int block_size = 4096;
+}
+
+/**
+ * @brief SequentialWriter::SequentialWriter
+ *      Creates a closed writer.
+ */
+SequentialWriter::SequentialWriter()
+    : descriptor(-1),
+      direct(false),
+      buffer_size(0),
+      buffer_used(0),
+      written(0),
+      buffer(0)
+{
+}
+
+/**
+ * @brief SequentialWriter::~SequentialWriter
+ *      Flushes and closes the file.
+ */
+SequentialWriter::~SequentialWriter()
+{
+    close();
+}
+
+/**
+ * @brief SequentialWriter::open
+ *      Creates, or truncates, the file.
+ * @param path
+ *      Path of the file.
+ * @param new_buffer_size
+ *      Size of the write buffer, rounded up to whole blocks.
+ * @param new_direct
+ *      Bypass the page cache, only on Linux. If the file system does not support it the file is opened normally.
+ * @return
+ *      Success = true; Failed = false, see get_error.
+ */
+bool SequentialWriter::open(const QString &path, const int new_buffer_size, const bool new_direct)
+{
+    close();
+
+    buffer_size = qMax(1, (new_buffer_size + block_size - 1) / block_size) * block_size;
+    buffer = static_cast<char*>(qMallocAligned(buffer_size, block_size));
+    buffer_used = 0;
+    written = 0;
+    direct = false;
+    error.clear();
+
+    if(buffer == 0)
+    {
+        error = "Could not allocate a write buffer of " + QString::number(buffer_size) + " bytes.";
+        return false;
+    }
+
+#if defined(Q_OS_LINUX)
+    const QByteArray file_name = QFile::encodeName(path);
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+    if(new_direct)
+    {
+        descriptor = ::open(file_name.constData(), flags | O_DIRECT, 0644);
+        direct = descriptor >= 0;
+    }
+
+    if(descriptor < 0)
+    {
+        descriptor = ::open(file_name.constData(), flags, 0644);
+    }
+
+    if(descriptor < 0)
+    {
+        error = QString::fromLocal8Bit(std::strerror(errno));
+    }
+#else
+    Q_UNUSED(new_direct);
+
+    file.setFileName(path);
+
+    if(file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+    {
+        descriptor = file.handle();
+    }
+    else
+    {
+        error = file.errorString();
+    }
+#endif
+
+    if(descriptor < 0)
+    {
+        qFreeAligned(buffer);
+        buffer = 0;
+    }
+
+    return descriptor >= 0;
+}
+
+/**
+ * @brief SequentialWriter::write
+ *      Appends data, the file is only written when the buffer is full.
+ * @param data
+ *      The data.
+ * @param bytes
+ *      Number of bytes.
+ * @return
+ *      Success = true; Failed = false, the disk is full or failed.
+ */
+bool SequentialWriter::write(const char *data, const qint64 bytes)
+{
+    if(descriptor < 0)
+    {
+        return false;
+    }
+
+    qint64 offset = 0;
+
+    while(offset < bytes)
+    {
+        const qint64 length = qMin(bytes - offset, buffer_size - buffer_used);
+
+        std::memcpy(buffer + buffer_used, data + offset, length);
+        buffer_used += length;
+        offset += length;
+
+        if(buffer_used == buffer_size && !flush(buffer_size))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief SequentialWriter::close
+ *      Writes what is left in the buffer and closes the file.
+ *      The tail is not a whole number of blocks, so direct I/O is turned off before writing it.
+ * @return
+ *      Success = true; Failed = false
+ */
+bool SequentialWriter::close()
+{
+    if(descriptor < 0)
+    {
+        return true;
+    }
+
+    bool result = true;
+
+    if(buffer_used > 0)
+    {
+        const qint64 aligned = (buffer_used / block_size) * block_size;
+
+        if(aligned > 0)
+        {
+            result = flush(aligned);
+        }
+
+        disable_direct();
+
+        if(result && buffer_used > 0)
+        {
+            result = flush(buffer_used);
+        }
+    }
+
+#if defined(Q_OS_LINUX)
+    ::close(descriptor);
+#else
+    file.close();
+#endif
+
+    descriptor = -1;
+
+    qFreeAligned(buffer);
+    buffer = 0;
+
+    return result;
+}
+
+/**
+ * @brief SequentialWriter::flush
+ *      Writes the start of the buffer and moves the rest, if any, to the beginning.
+ * @param bytes
+ *      Bytes to write, a multiple of the block size with direct I/O.
+ * @return
+ *      Success = true; Failed = false
+ */
+bool SequentialWriter::flush(const qint64 bytes)
+{
+    const bool result = write_file(buffer, bytes);
+
+    if(result)
+    {
+        written += bytes;
+    }
+
+    //On failure the data is discarded, keeping it would only delay the next error.
+    std::memmove(buffer, buffer + bytes, buffer_used - bytes);
+    buffer_used -= bytes;
+
+    return result;
+}
+
+/**
+ * @brief SequentialWriter::write_file
+ *      Writes to the file, retrying partial writes.
+ *      After a partial write the rest of the data is no longer aligned, so direct I/O is turned off before retrying,
+ *      as for the tail in 'close'.
+ * @param data
+ *      The data.
+ * @param bytes
+ *      Number of bytes.
+ * @return
+ *      Success = true; Failed = false
+ */
+bool SequentialWriter::write_file(const char *data, const qint64 bytes)
+{
+    qint64 offset = 0;
+
+    while(offset < bytes)
+    {
+#if defined(Q_OS_LINUX)
+        const ssize_t result = ::write(descriptor, data + offset, bytes - offset);
+
+        if(result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if(result <= 0)
+        {
+            error = QString::fromLocal8Bit(std::strerror(errno));
+            return false;
+        }
+#else
+        const qint64 result = file.write(data + offset, bytes - offset);
+
+        if(result <= 0)
+        {
+            error = file.errorString();
+            return false;
+        }
+#endif
+
+        offset += result;
+
+        if(offset < bytes)
+        {
+            disable_direct();
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief SequentialWriter::disable_direct
+ *      Goes through the page cache for the rest of the file, the writes no longer need to be aligned.
+ */
+void SequentialWriter::disable_direct()
+{
+#if defined(Q_OS_LINUX)
+    if(direct)
+    {
+        fcntl(descriptor, F_SETFL, fcntl(descriptor, F_GETFL) & ~O_DIRECT);
+        direct = false;
+    }
+#endif
+}
+
+/**
+ * @brief SequentialWriter::is_open
+ * @return
+ *      True if a file is open.
+ */
+bool SequentialWriter::is_open() const
+{
+    return descriptor >= 0;
+}
+
+/**
+ * @brief SequentialWriter::is_direct
+ * @return
+ *      True if the file is written with direct I/O.
+ */
+bool SequentialWriter::is_direct() const
+{
+    return direct;
+}
+
+/**
+ * @brief SequentialWriter::get_written
+ * @return
+ *      Bytes written to the file so far, without the ones still in the buffer.
+ */
+qint64 SequentialWriter::get_written() const
+{
+    return written;
+}
+
+/**
+ * @brief SequentialWriter::get_error
+ * @return
+ *      Description of the last error.
+ */
+QString SequentialWriter::get_error() const
+{
+    return error;
+}
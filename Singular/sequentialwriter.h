@@ -0,0 +1,73 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SEQUENTIALWRITER_H
+#define SEQUENTIALWRITER_H
+
+#include <QFile>
+#include <QString>
+
+#include "defines.h"
+
+/**
+ * @brief The SequentialWriter class
+ *      Append-only file for streams. The data is gathered in a large aligned buffer and written a whole buffer at a time,
+ *      so the disk sees few, large and sequential writes whatever the size of the frames.
+ * @remarks
+ *      On Linux the file can be opened with O_DIRECT, bypassing the page cache: recordings are never read back
+ *      while recording, and the cache would otherwise fill with them and push out memory of the application.
+ *      Direct writes must be multiples of the block size, the buffer is always flushed in whole blocks
+ *      and only the tail, when closing, is written through the cache.
+ */
+class SequentialWriter
+{
+
+public_construct:
+    SequentialWriter();
+    ~SequentialWriter();
+
+public_methods:
+    bool open(const QString &path, const int new_buffer_size, const bool direct);
+    bool write(const char *data, const qint64 bytes);
+    bool close();
+
+    bool is_open() const;
+    bool is_direct() const;
+    qint64 get_written() const;
+    QString get_error() const;
+
+private_methods:
+    bool flush(const qint64 bytes);
+    bool write_file(const char *data, const qint64 bytes);
+    void disable_direct();
+
+private_members:
+    int descriptor;
+    bool direct;
+    int buffer_size;
+    qint64 buffer_used;
+    qint64 written;
+    QString error;
+
+private_data_members:
+    char *buffer;
+    QFile file;
+
+};
+
+#endif // SEQUENTIALWRITER_H
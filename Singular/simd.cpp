@@ -0,0 +1,139 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "simd.h"
+
+#include <QAtomicInt>
+
+#if defined(simd_x86) && defined(Q_CC_MSVC)
+#include <intrin.h>
+#endif
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Variables
+ *      The limit is used by the benchmarks to compare the implementations, and can be used to rule out a kernel when debugging.
+ */
+namespace
+{
+    QAtomicInt level_limit(Simd::AVX2);
+
+    Simd::Level detect()
+    {
+        Simd::Level level = Simd::Scalar;
+
+#if defined(simd_x86)
+        level = Simd::SSE2;
+
+#if defined(Q_CC_MSVC)
+        int info[4];
+        __cpuidex(info, 7, 0);
+
+        const bool avx2 = (info[1] & (1 << 5)) != 0;
+
+        __cpuid(info, 1);
+
+        //The OS must also save the AVX registers.
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+
+        if(avx2 && osxsave && (_xgetbv(0) & 6) == 6)
+        {
+            level = Simd::AVX2;
+        }
+#elif defined(Q_CC_GNU)
+        __builtin_cpu_init();
+
+        if(__builtin_cpu_supports("avx2"))
+        {
+            level = Simd::AVX2;
+        }
+#endif
+#endif
+
+        return level;
+    }
+}
+
+/**
+ * @brief Simd::get_level
+ *      Gets the instruction set to use, the best one supported by the CPU within the limit.
+ * @return
+ *      The level.
+ */
+Simd::Level Simd::get_level()
+{
+    return static_cast<Level>(qMin(static_cast<int>(get_supported_level()), level_limit.load()));
+}
+
+/**
+ * @brief Simd::get_supported_level
+ *      Detects the best instruction set of the CPU, this is only done once.
+ * @return
+ *      The level.
+ */
+Simd::Level Simd::get_supported_level()
+{
+    static const Level supported = detect();
+    return supported;
+}
+
+/**
+ * @brief Simd::set_level_limit
+ *      Limits the instruction set, the kernels will not use anything above this level.
+ * @param level
+ *      The highest level allowed.
+ */
+void Simd::set_level_limit(const Level level)
+{
+    level_limit.store(level);
+}
+
+/**
+ * @brief Simd::level_name
+ * @param level
+ *      The level.
+ * @return
+ *      Display name of the level.
+ */
+QString Simd::level_name(const Level level)
+{
+    QString name;
+
+    switch(level)
+    {
+        case Scalar:
+        {
+            name = "Scalar";
+            break;
+        }
+        case SSE2:
+        {
+            name = "SSE2";
+            break;
+        }
+        case AVX2:
+        {
+            name = "AVX2";
+            break;
+        }
+    }
+
+    return name;
+}
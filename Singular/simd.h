@@ -0,0 +1,63 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <QtGlobal>
+#include <QString>
+
+/**
+ * @brief SIMD defines
+ *      simd_x86 is defined when the SSE2 intrinsics are available at compile time, this is always true on x86-64.
+ *      simd_avx2_target marks a function that uses AVX2 intrinsics, the rest of the file is still compiled for the baseline.
+ *      Functions marked with it must only be called when Simd::get_level() returns Simd::AVX2.
+ */
+#if defined(Q_PROCESSOR_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define simd_x86
+#include <immintrin.h>
+#endif
+
+#if defined(Q_CC_GNU)
+#define simd_avx2_target __attribute__((target("avx2")))
+#else
+#define simd_avx2_target
+#endif
+
+/**
+ * @brief The Simd namespace
+ *      Runtime detection of the vector instruction sets used by the image and audio kernels.
+ *      The kernels ask for the level once per buffer and dispatch to the matching implementation.
+ */
+namespace Simd
+{
+    enum Level
+    {
+        Scalar = 0,
+        SSE2 = 1,
+        AVX2 = 2
+    };
+
+    Level get_level();
+    Level get_supported_level();
+    void set_level_limit(const Level level);
+
+    QString level_name(const Level level);
+}
+
+#endif // SIMD_H
@@ -42,11 +42,15 @@ Singular::Singular(QWidget *parent) :
 /**
  * @brief Singular::~Singular
  *      Saves the UI settings on exit.
+ *      The sensors are deleted before the UI, their threads post frames to the camera and mosaic widgets until they are stopped.
  */
 Singular::~Singular()
 {
     save_settings();
 
+    delete sensors;
+    sensors = 0;
+
     delete ui;
 }
 
@@ -58,8 +62,8 @@ void Singular::load_settings()
 {
     ui->sw_cameras->removeWidget(ui->page);
     ui->sw_cameras->removeWidget(ui->page_2);
-    ui->sw_cameras->removeWidget(ui->page_3);
-    ui->sw_cameras->removeWidget(ui->page_4);
+    ui->sw_output_cameras->removeWidget(ui->page_3);
+    ui->sw_output_cameras->removeWidget(ui->page_4);
 
     //Window
 
@@ -142,6 +146,33 @@ void Singular::add_camera(const QString &camera_name, QWidget *camera, const boo
     }
 }
 
+/**
+ * @brief Singular::add_output_camera
+ *      Adds a new entry or widget to the output cameras, e.g. the mosaic of all the cameras.
+ * @param camera_name
+ *      Name of the output.
+ * @param camera
+ *      The custom widget.
+ * @param selected
+ *      Auto-select this widget.
+ */
+void Singular::add_output_camera(const QString &camera_name, QWidget *camera, const bool selected) const
+{
+    int id = 0;
+    ui->cb_output_cameras->addItem(camera_name);
+
+    if(camera != 0)
+    {
+        id = ui->sw_output_cameras->addWidget(camera);
+    }
+
+    if(selected)
+    {
+        ui->sw_output_cameras->setCurrentIndex(id);
+        ui->cb_output_cameras->setCurrentText(camera_name);
+    }
+}
+
 /**
  * @brief Singular::add_microphone
  *      Adds a new entry or microphone widget to the UI.
@@ -169,6 +200,41 @@ void Singular::add_microphone(const QString &microphone_name, QWidget *microphon
     }
 }
 
+/**
+ * @brief Singular::remove_camera
+ *      Removes the entry and the widget of a camera that was unplugged.
+ *      The entries and the widgets are added in the same order, so they share the index.
+ * @param camera
+ *      The custom widget.
+ */
+void Singular::remove_camera(QWidget *camera) const
+{
+    const int index = ui->sw_cameras->indexOf(camera);
+
+    if(index >= 0)
+    {
+        ui->sw_cameras->removeWidget(camera);
+        ui->cb_cameras->removeItem(index);
+    }
+}
+
+/**
+ * @brief Singular::remove_microphone
+ *      Removes the entry of a microphone that was unplugged.
+ *      If it was selected, the next entry is selected and started, see on_cb_microphones_currentIndexChanged.
+ * @param microphone_name
+ *      Name of the device.
+ */
+void Singular::remove_microphone(const QString &microphone_name) const
+{
+    const int index = ui->cb_microphones->findText(microphone_name);
+
+    if(index >= 0)
+    {
+        ui->cb_microphones->removeItem(index);
+    }
+}
+
 /**
  * @brief Singular::on_cb_cameras_currentIndexChanged
  *      Changes the current camera widget.
@@ -180,6 +246,17 @@ void Singular::on_cb_cameras_currentIndexChanged(int index)
     ui->sw_cameras->setCurrentIndex(index);
 }
 
+/**
+ * @brief Singular::on_cb_output_cameras_currentIndexChanged
+ *      Changes the current output camera widget.
+ * @param index
+ *      Index of the output.
+ */
+void Singular::on_cb_output_cameras_currentIndexChanged(int index)
+{
+    ui->sw_output_cameras->setCurrentIndex(index);
+}
+
 /**
  * @brief Singular::on_cb_microphones_currentIndexChanged
  *      Invokes updates to the microphone class.
@@ -48,10 +48,14 @@ private_data_members:
 public slots:
     void console(const QString &message) const;
     void add_camera(const QString &camera_name, QWidget *camera = 0, const bool selected = false) const;
+    void add_output_camera(const QString &camera_name, QWidget *camera = 0, const bool selected = false) const;
     void add_microphone(const QString &microphone_name, QWidget *microphone = 0, const bool selected = false) const;
+    void remove_camera(QWidget *camera) const;
+    void remove_microphone(const QString &microphone_name) const;
 
 private slots:
     void on_cb_cameras_currentIndexChanged(int index);
+    void on_cb_output_cameras_currentIndexChanged(int index);
     void on_cb_microphones_currentIndexChanged(int index);
     void on_txt_input_textChanged();
 
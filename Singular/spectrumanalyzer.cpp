@@ -0,0 +1,389 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "spectrumanalyzer.h"
+#include "output.h"
+#include "helper.h"
+#include "frame.h"
+#include "settingsmanager.h"
+
+#include <QMutexLocker>
+
+#include <cmath>
+#include <cstring>
+
+/**
+ * @brief SpectrumAnalyzer::SpectrumAnalyzer
+ *      Reads the settings and computes the plan of the FFT, once for all the inputs.
+ *      "Spectrum/Bands" bands, spaced logarithmically from "Spectrum/MinFrequency" to "Spectrum/MaxFrequency" Hz.
+ * @param parent
+ *      To parent this class. Leave it empty when the analyzer is moved to a worker thread, in that case
+ *      the owner connects the signals and slots.
+ */
+SpectrumAnalyzer::SpectrumAnalyzer(QObject *parent)
+    : QObject(parent),
+      fft(SettingsManager::read("Spectrum/Size", 2048).toInt()),
+      timer(0)
+{
+    const int overlap = qBound(0, SettingsManager::read("Spectrum/Overlap", 75).toInt(), 95);
+
+    hop = qMax(1, fft.get_size() * (100 - overlap) / 100);
+    bands = qBound(1, SettingsManager::read("Spectrum/Bands", 32).toInt(), 256);
+    display_interval = qMax(0, SettingsManager::read("Spectrum/DisplayInterval", 33).toInt());
+    poll_interval = qMax(1, SettingsManager::read("Spectrum/PollInterval", 10).toInt());
+    minimum_frequency = SettingsManager::read("Spectrum/MinFrequency", 40).toDouble();
+    maximum_frequency = SettingsManager::read("Spectrum/MaxFrequency", 16000).toDouble();
+
+    power.resize(fft.get_bins());
+}
+
+/**
+ * @brief SpectrumAnalyzer::~SpectrumAnalyzer
+ *      Detaches the inputs left.
+ */
+SpectrumAnalyzer::~SpectrumAnalyzer()
+{
+    for(int i = 0; i < inputs.size(); i++)
+    {
+        inputs.at(i)->ring->detach();
+        delete inputs.at(i);
+    }
+}
+
+/**
+ * @brief SpectrumAnalyzer::start
+ *      Starts polling the rings. The timer is created here so it belongs to the thread of the analyzer,
+ *      call this with a queued connection after moving it.
+ */
+void SpectrumAnalyzer::start()
+{
+    if(timer == 0)
+    {
+        timer = new QTimer(this);
+        connect(timer, SIGNAL(timeout()), this, SLOT(poll()));
+    }
+
+    timer->start(poll_interval);
+
+    output("Spectrum analyzer started: " + QString::number(fft.get_size()) + " points, hop " + QString::number(hop) +
+           ", " + QString::number(bands) + " bands.", 3);
+}
+
+/**
+ * @brief SpectrumAnalyzer::stop
+ *      Stops polling.
+ */
+void SpectrumAnalyzer::stop()
+{
+    if(timer != 0)
+    {
+        timer->stop();
+    }
+}
+
+/**
+ * @brief SpectrumAnalyzer::set_affinity
+ *      Pins the thread of the analyzer to a CPU core.
+ *      This must run in the thread of the analyzer, call it with a queued connection.
+ * @param core
+ *      The core number, starting at 0.
+ */
+void SpectrumAnalyzer::set_affinity(const int core) const
+{
+    if(Helper::set_thread_affinity(core))
+    {
+        output("Spectrum thread pinned to core " + QString::number(core) + ".", 3);
+    }
+    else
+    {
+        output("Could not pin the spectrum thread to core " + QString::number(core) + ".", 1);
+    }
+}
+
+/**
+ * @brief SpectrumAnalyzer::add_input
+ *      Attaches the analyzer to the ring of a microphone, the spectrum starts with the next samples written. Thread safe.
+ * @param id
+ *      ID of the microphone, sent with its spectrum.
+ * @param ring
+ *      The ring of the surface, see AudioInputSurface::get_ring.
+ * @param sample_rate
+ *      Samples per second of the microphone, for the bands.
+ */
+void SpectrumAnalyzer::add_input(const int id, AudioRing *ring, const int sample_rate)
+{
+    Input *input = new Input;
+    input->id = id;
+    input->ring = ring;
+    input->channels = ring->get_channels();
+    input->filled = 0;
+    input->pending = false;
+    input->last_display = 0;
+    input->history.resize(fft.get_size());
+    input->edges.resize(bands + 1);
+    input->levels.fill(-120.0f, bands);
+
+    band_edges(fft.get_size(), qMax(1, sample_rate), bands, minimum_frequency, maximum_frequency, input->edges.data());
+
+    QMutexLocker locker(&mutex);
+
+    ring->attach();
+    inputs.append(input);
+}
+
+/**
+ * @brief SpectrumAnalyzer::remove_input
+ *      Detaches the analyzer from the ring of a microphone. Thread safe, once this returns the ring is not read anymore.
+ * @param id
+ *      ID of the microphone.
+ */
+void SpectrumAnalyzer::remove_input(const int id)
+{
+    QMutexLocker locker(&mutex);
+
+    for(int i = 0; i < inputs.size(); i++)
+    {
+        if(inputs.at(i)->id == id)
+        {
+            inputs.at(i)->ring->detach();
+            delete inputs.takeAt(i);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief SpectrumAnalyzer::get_size
+ * @return
+ *      Number of samples per transform.
+ */
+int SpectrumAnalyzer::get_size() const
+{
+    return fft.get_size();
+}
+
+/**
+ * @brief SpectrumAnalyzer::get_hop
+ * @return
+ *      Number of new samples between two transforms.
+ */
+int SpectrumAnalyzer::get_hop() const
+{
+    return hop;
+}
+
+/**
+ * @brief SpectrumAnalyzer::get_bands
+ * @return
+ *      Number of bands of the spectrum.
+ */
+int SpectrumAnalyzer::get_bands() const
+{
+    return bands;
+}
+
+/**
+ * @brief SpectrumAnalyzer::band_edges
+ *      Splits the bins of the spectrum in bands of the same width on a log-frequency scale.
+ *      Every band has at least one bin, so the narrow low bands take the next bins, until the bins run out.
+ * @param size
+ *      Number of samples per transform.
+ * @param sample_rate
+ *      Samples per second.
+ * @param bands
+ *      Number of bands.
+ * @param minimum_frequency
+ *      Lower frequency of the first band, at least one bin.
+ * @param maximum_frequency
+ *      Upper frequency of the last band, at most half the sample rate.
+ * @param edges
+ *      Output, bands + 1 bins, band b is [edges[b], edges[b + 1]).
+ */
+void SpectrumAnalyzer::band_edges(const int size, const int sample_rate, const int bands, const double minimum_frequency,
+                                  const double maximum_frequency, int *edges)
+{
+    const int bins = size / 2 + 1;
+    const double bin_width = static_cast<double>(sample_rate) / size;
+    const double maximum = qBound(bin_width * 2.0, maximum_frequency, sample_rate / 2.0);
+    const double minimum = qBound(bin_width, minimum_frequency, maximum / 2.0);
+
+    edges[0] = qBound(1, qRound(minimum / bin_width), bins - 1);
+
+    for(int i = 1; i <= bands; i++)
+    {
+        const double frequency = minimum * std::pow(maximum / minimum, static_cast<double>(i) / bands);
+
+        edges[i] = qBound(qMin(edges[i - 1] + 1, bins), qRound(frequency / bin_width), bins);
+    }
+}
+
+/**
+ * @brief SpectrumAnalyzer::band_levels
+ *      Raises the levels of the bands to the loudest bin of each band in the power spectrum, in dB.
+ *      The levels are relative to a full scale sine, down to -120 dB.
+ * @param power
+ *      Power spectrum, see Fft::power.
+ * @param edges
+ *      Bands, see 'band_edges'.
+ * @param bands
+ *      Number of bands.
+ * @param levels
+ *      The level of each band, only raised.
+ */
+void SpectrumAnalyzer::band_levels(const float *power, const int *edges, const int bands, float *levels)
+{
+    for(int b = 0; b < bands; b++)
+    {
+        float peak = 0.0f;
+
+        for(int k = edges[b]; k < edges[b + 1]; k++)
+        {
+            peak = qMax(peak, power[k]);
+        }
+
+        levels[b] = qMax(levels[b], 10.0f * std::log10(qMax(peak, 1e-12f)));
+    }
+}
+
+/**
+ * @brief SpectrumAnalyzer::poll
+ *      Reads the new samples of every input and sends the spectra that are due.
+ */
+void SpectrumAnalyzer::poll()
+{
+    QMutexLocker locker(&mutex);
+
+    const qint64 now = Frame::clock();
+
+    for(int i = 0; i < inputs.size(); i++)
+    {
+        Input *input = inputs.at(i);
+
+        process(input);
+
+        if(input->pending && now - input->last_display >= static_cast<qint64>(display_interval) * 1000000)
+        {
+            emit spectrum(input->id, input->levels);
+
+            input->levels.fill(-120.0f);
+            input->pending = false;
+            input->last_display = now;
+        }
+    }
+}
+
+/**
+ * @brief SpectrumAnalyzer::process
+ *      Moves the samples of the ring to the history of the input, mixed to mono, and runs a transform every time the history is full.
+ *      After a transform the oldest hop of samples is dropped, the rest is the overlap with the next window.
+ * @param input
+ *      The input.
+ */
+void SpectrumAnalyzer::process(Input *input)
+{
+    AudioRing::Span spans[2];
+
+    const int frames = input->ring->readable(spans[0], spans[1]);
+    const int size = fft.get_size();
+    const int channels = input->channels;
+    const float gain = 1.0f / channels;
+
+    float *history = input->history.data();
+
+    for(int s = 0; s < 2; s++)
+    {
+        const float *samples = spans[s].samples;
+        int remaining = spans[s].frames;
+
+        while(remaining > 0)
+        {
+            const int count = qMin(remaining, size - input->filled);
+            float *destination = history + input->filled;
+
+            if(channels == 1)
+            {
+                std::memcpy(destination, samples, count * sizeof(float));
+            }
+            else
+            {
+                for(int i = 0; i < count; i++)
+                {
+                    float sum = 0.0f;
+
+                    for(int c = 0; c < channels; c++)
+                    {
+                        sum += samples[i * channels + c];
+                    }
+
+                    destination[i] = sum * gain;
+                }
+            }
+
+            samples += count * channels;
+            remaining -= count;
+            input->filled += count;
+
+            if(input->filled == size)
+            {
+                transform(input);
+
+                std::memmove(history, history + hop, (size - hop) * sizeof(float));
+                input->filled = size - hop;
+            }
+        }
+    }
+
+    input->ring->release(frames);
+}
+
+/**
+ * @brief SpectrumAnalyzer::transform
+ *      Computes the spectrum of the history of the input and raises its band levels.
+ * @param input
+ *      The input, with a full history.
+ */
+void SpectrumAnalyzer::transform(Input *input)
+{
+    fft.power(input->history.constData(), power.data());
+    band_levels(power.constData(), input->edges.constData(), bands, input->levels.data());
+
+    input->pending = true;
+}
+
+/**
+ * @brief SpectrumAnalyzer::output
+ *      Generic function responsible for all the outputs.
+ */
+void SpectrumAnalyzer::output(const QString &message, const int verbose) const
+{
+    if(Output::get_verbose() >= verbose)
+    {
+        QVariantHash data;
+        data.insert("message", message);
+        data.insert("verbose", verbose);
+        data.insert("load_thread_id", true);
+
+        QString print = Output::builder(data);
+
+        if(!print.isEmpty())
+        {
+            emit console(print);
+        }
+    }
+}
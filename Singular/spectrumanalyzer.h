@@ -0,0 +1,115 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SPECTRUMANALYZER_H
+#define SPECTRUMANALYZER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QMutex>
+#include <QVector>
+#include <QList>
+
+#include "defines.h"
+#include "fft.h"
+#include "audioring.h"
+
+/**
+ * @brief The SpectrumAnalyzer class
+ *      Real-time spectrum of the microphones, in log-frequency bands, computed on the thread of the analyzer.
+ *      Every input reads the canonical samples from the ring of its surface, mixes the channels to mono and runs a windowed FFT
+ *      of "Spectrum/Size" samples every time "Spectrum/Overlap" percent of the last window is left, 75 by default.
+ *      The bands hold the loudest level in dB of each band since the last 'spectrum' signal, sent at most every "Spectrum/DisplayInterval" ms.
+ * @remarks
+ *      One plan is shared by all the inputs, the tables are computed once, and the inputs are processed one after the other
+ *      on one thread. The inputs are added and removed from the owner thread, remove an input before its surface is deleted.
+ */
+class SpectrumAnalyzer : public QObject
+{
+    Q_OBJECT
+
+public_construct:
+    explicit SpectrumAnalyzer(QObject *parent = 0);
+    ~SpectrumAnalyzer();
+
+public_methods:
+    void add_input(const int id, AudioRing *ring, const int sample_rate);
+    void remove_input(const int id);
+
+    int get_size() const;
+    int get_hop() const;
+    int get_bands() const;
+
+    static void band_edges(const int size, const int sample_rate, const int bands, const double minimum_frequency,
+                           const double maximum_frequency, int *edges);
+    static void band_levels(const float *power, const int *edges, const int bands, float *levels);
+
+private_data_members:
+    /**
+     * @brief The Input struct
+     *      State of one microphone, the history holds the last window of mono samples.
+     */
+    struct Input
+    {
+        int id;
+        AudioRing *ring;
+        int channels;
+        int filled;
+        bool pending;
+        qint64 last_display;
+        QVector<float> history;
+        QVector<int> edges;
+        QVector<float> levels;
+    };
+
+private_methods:
+    void process(Input *input);
+    void transform(Input *input);
+    void output(const QString &message, const int verbose) const;
+
+private_members:
+    int hop;
+    int bands;
+    int display_interval;
+    int poll_interval;
+    double minimum_frequency;
+    double maximum_frequency;
+
+private_data_members:
+    Fft fft;
+    QVector<float> power;
+    QList<Input*> inputs;
+    QMutex mutex;
+    QTimer *timer;
+
+public slots:
+    void start();
+    void stop();
+    void set_affinity(const int core) const;
+
+private slots:
+    void poll();
+
+signals:
+    void console(const QString &message) const;
+    void spectrum(const int id, const QVector<float> &levels) const;
+
+};
+
+#endif // SPECTRUMANALYZER_H
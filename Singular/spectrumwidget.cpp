@@ -0,0 +1,108 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "spectrumwidget.h"
+#include "output.h"
+#include "settingsmanager.h"
+
+/**
+ * @brief SpectrumWidget::SpectrumWidget
+ *      Starts the spectrum widget, sets the size and color.
+ * @param parent
+ *      To parent this class and to use signals and slots.
+ */
+SpectrumWidget::SpectrumWidget(QWidget *parent) :
+    QWidget(parent)
+{
+    connect(this, SIGNAL(console(QString)), parent, SIGNAL(console(QString)));
+    output("Spectrum widget started.", 1);
+
+    setBackgroundRole(QPalette::Base);
+    setAutoFillBackground(true);
+
+    floor = qMin(-10.0f, SettingsManager::read("Spectrum/Floor", -90).toFloat());
+    setMinimumHeight(100);
+    setMinimumWidth(200);
+}
+
+/**
+ * @brief SpectrumWidget::update_spectrum
+ *      Saves the new levels and updates the widget.
+ * @param new_levels
+ *      The level of each band in dB, lowest frequency first.
+ */
+void SpectrumWidget::update_spectrum(const QVector<float> &new_levels)
+{
+    levels = new_levels;
+    update();
+}
+
+/**
+ * @brief SpectrumWidget::paintEvent
+ *      Paints one bar per band, side by side, with the lowest frequency on the left.
+ * @param event
+ */
+void SpectrumWidget::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+
+    QPainter painter(this);
+
+    const int width = painter.viewport().width() - 2;
+    const int height = painter.viewport().height() - 2;
+
+    painter.setPen(Qt::black);
+
+    painter.drawRect(0, 0, width + 1, height + 1);
+
+    for (int i = 0; i < levels.size(); i++)
+    {
+        const int left = 1 + i * width / levels.size();
+        const int right = 1 + (i + 1) * width / levels.size();
+        const int bar = qBound(0, static_cast<int>((levels.at(i) - floor) / -floor * height), height);
+
+        if (bar > 0)
+        {
+            //One pixel between the bars when they are wide enough.
+            painter.fillRect(left, 1 + height - bar, qMax(1, right - left - 1), bar, Qt::darkGreen);
+        }
+    }
+}
+
+/**
+ * @brief TextStream::output
+ *      Generic function responsible for all the outputs.
+ */
+void SpectrumWidget::output(const QString &message, const int verbose) const
+{
+    if(Output::get_verbose() >= verbose)
+    {
+        QVariantHash data;
+        data.insert("message", message);
+        data.insert("verbose", verbose);
+        data.insert("load_thread_id", true);
+
+        QString print = Output::builder(data);
+
+        if(!print.isEmpty())
+        {
+            emit console(print);
+        }
+    }
+}
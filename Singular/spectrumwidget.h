@@ -0,0 +1,61 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SPECTRUMWIDGET_H
+#define SPECTRUMWIDGET_H
+
+#include <QWidget>
+#include <QPainter>
+#include <QVector>
+
+#include "defines.h"
+
+/**
+ * @brief The SpectrumWidget class
+ *      Draws the bands of a spectrum as bars, the bands are already on a log-frequency scale, see SpectrumAnalyzer.
+ *      The height of a bar goes from "Spectrum/Floor" dB, -90 by default, to 0 dB, a full scale sine.
+ */
+class SpectrumWidget : public QWidget
+{
+    Q_OBJECT
+
+public_construct:
+    explicit SpectrumWidget(QWidget *parent = 0);
+
+public_methods:
+    void update_spectrum(const QVector<float> &new_levels);
+
+protected_methods:
+    void paintEvent(QPaintEvent *event);
+
+private_methods:
+    void output(const QString &message, const int verbose) const;
+
+private_members:
+    float floor;
+
+private_data_members:
+    QVector<float> levels;
+
+signals:
+    void console(const QString &message) const;
+
+};
+
+#endif // SPECTRUMWIDGET_H
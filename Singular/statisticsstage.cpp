@@ -0,0 +1,63 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "statisticsstage.h"
+
+/**
+ * @brief StatisticsStage::StatisticsStage
+ * @param new_interval
+ *      The statistics are computed for one frame in this many, 1 for every frame.
+ * @param parent
+ *      The pipeline.
+ */
+StatisticsStage::StatisticsStage(const int new_interval, QObject *parent)
+    : FrameStage("statistics", View, parent),
+      interval(qMax(1, new_interval)),
+      frame_count(0)
+{
+}
+
+/**
+ * @brief StatisticsStage::process
+ * @param frame
+ *      The frame, only its statistics are set.
+ * @return
+ *      False if the frame has no image.
+ */
+bool StatisticsStage::process(Frame &frame, FramePool *pool)
+{
+    Q_UNUSED(pool);
+
+    if(frame_count++ % interval == 0)
+    {
+        QSharedPointer<ImageStatistics> statistics(new ImageStatistics());
+
+        if(!statistics->compute(frame.image, lines))
+        {
+            return false;
+        }
+
+        statistics->sequence = frame.sequence;
+        last = statistics;
+    }
+
+    frame.image_statistics = last;
+
+    return true;
+}
@@ -0,0 +1,57 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef STATISTICSSTAGE_H
+#define STATISTICSSTAGE_H
+
+#include <QVector>
+#include <QSharedPointer>
+
+#include "defines.h"
+#include "framestage.h"
+#include "imagestatistics.h"
+
+/**
+ * @brief The StatisticsStage class
+ *      Computes the ImageStatistics of one frame every interval and attaches them to the frame.
+ *      A view stage, it only reads the pixels and the frame goes on unchanged.
+ * @remarks
+ *      The frames in between carry the last statistics computed, their sequence tells which frame they belong to.
+ */
+class StatisticsStage : public FrameStage
+{
+    Q_OBJECT
+
+public_construct:
+    explicit StatisticsStage(const int new_interval, QObject *parent = 0);
+
+public_methods:
+    bool process(Frame &frame, FramePool *pool);
+
+private_members:
+    int interval;
+    quint64 frame_count;
+
+private_data_members:
+    QVector<uchar> lines;
+    QSharedPointer<const ImageStatistics> last;
+
+};
+
+#endif // STATISTICSSTAGE_H
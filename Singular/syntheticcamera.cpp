@@ -0,0 +1,505 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "syntheticcamera.h"
+#include "output.h"
+#include "settingsmanager.h"
+#include "colorconversion.h"
+
+#include <cstring>
+#include <QVideoSurfaceFormat>
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Variables
+ *      The 75% color bars in BT.601 YUV: white, yellow, cyan, green, magenta, red, blue and black.
+ *      The band is white, it moves down by a tenth of the frame per second.
+ */
+namespace
+{
+    const uchar bars[8][3] =
+    {
+        { 180, 128, 128 },
+        { 162,  44, 142 },
+        { 131, 156,  44 },
+        { 112,  72,  58 },
+        {  84, 184, 198 },
+        {  65, 100, 212 },
+        {  35, 212, 114 },
+        {  16, 128, 128 }
+    };
+
+    const uchar white_y = 235;
+    const uchar neutral_uv = 128;
+}
+
+/**
+ * @brief SyntheticCamera::SyntheticCamera
+ *      Reads the settings, the frame is only created by 'start'.
+ * @param new_id
+ *      The ID of the camera.
+ * @param new_surface
+ *      The surface that receives the frames.
+ * @param parent
+ *      To parent this class, usually the surface.
+ */
+SyntheticCamera::SyntheticCamera(const int new_id, QAbstractVideoSurface *new_surface, QObject *parent)
+    : QObject(parent),
+      id(new_id),
+      frame_bytes(0),
+      band_position(0),
+      first_frame(true),
+      generated_frames(0),
+      rejected_frames(0),
+      surface(new_surface)
+{
+    //4:2:0 and 4:2:2 formats need an even size. The moving band is at least 2 rows and must leave room to move.
+    width = qMax(2, SettingsManager::read("Synthetic/Width", 1280).toInt()) & ~1;
+    height = qMax(4, SettingsManager::read("Synthetic/Height", 720).toInt()) & ~1;
+    frame_rate = qBound(1, SettingsManager::read("Synthetic/FrameRate", 30).toInt(), 1000);
+    format = pixel_format(SettingsManager::read("Synthetic/PixelFormat", "yuyv").toString());
+
+    file.setFileName(SettingsManager::read("Synthetic/File", "").toString());
+
+    timer = new QTimer(this);
+    timer->setTimerType(Qt::PreciseTimer);
+    timer->setInterval(qMax(1, qRound(1000.0 / frame_rate)));
+
+    connect(timer, SIGNAL(timeout()), this, SLOT(next_frame()));
+}
+
+/**
+ * @brief SyntheticCamera::start
+ *      Starts the surface with the configured format and the frame timer.
+ *      Must be called in the thread of the surface.
+ */
+void SyntheticCamera::start()
+{
+    if(!prepare())
+    {
+        return;
+    }
+
+    if(!surface->start(QVideoSurfaceFormat(QSize(width, height), format)))
+    {
+        output("Synthetic camera " + QString::number(id) + ": the surface does not support the format.", 1);
+        return;
+    }
+
+    output("Synthetic camera " + QString::number(id) + " started: " + QString::number(width) + "x" + QString::number(height) +
+           " at " + QString::number(frame_rate) + " fps" + (file.fileName().isEmpty() ? "." : ", replaying " + file.fileName() + "."), 2);
+
+    first_frame = true;
+    report_timer.start();
+    timer->start();
+}
+
+/**
+ * @brief SyntheticCamera::stop
+ *      Stops the frames, and the surface if it is still active.
+ */
+void SyntheticCamera::stop()
+{
+    timer->stop();
+
+    if(surface->isActive())
+    {
+        surface->stop();
+    }
+}
+
+/**
+ * @brief SyntheticCamera::prepare
+ *      Creates the frame and the plane layout of the format, and opens the file or draws the pattern.
+ * @return
+ *      Success = true; Failed = false
+ */
+bool SyntheticCamera::prepare()
+{
+    const int luma_bytes = width * height;
+    const int chroma_bytes = (width / 2) * (height / 2);
+    const int first_stride = format == QVideoFrame::Format_RGB32 ? width * 4 :
+                             (format == QVideoFrame::Format_YUYV || format == QVideoFrame::Format_UYVY ? width * 2 : width);
+
+    planes.clear();
+
+    Plane plane;
+    plane.offset = 0;
+    plane.stride = first_stride;
+    plane.vertical = 1;
+
+    switch(format)
+    {
+        case QVideoFrame::Format_RGB32:
+        {
+            plane.fill = QByteArray(4, char(0xff));
+            planes.append(plane);
+            frame_bytes = luma_bytes * 4;
+            break;
+        }
+        case QVideoFrame::Format_YUYV:
+        case QVideoFrame::Format_UYVY:
+        {
+            plane.fill.append(char(format == QVideoFrame::Format_YUYV ? white_y : neutral_uv));
+            plane.fill.append(char(format == QVideoFrame::Format_YUYV ? neutral_uv : white_y));
+            planes.append(plane);
+            frame_bytes = luma_bytes * 2;
+            break;
+        }
+        case QVideoFrame::Format_NV12:
+        case QVideoFrame::Format_NV21:
+        {
+            plane.fill = QByteArray(1, char(white_y));
+            planes.append(plane);
+
+            plane.offset = luma_bytes;
+            plane.vertical = 2;
+            plane.fill = QByteArray(1, char(neutral_uv));
+            planes.append(plane);
+
+            frame_bytes = luma_bytes + 2 * chroma_bytes;
+            break;
+        }
+        default:
+        {
+            plane.fill = QByteArray(1, char(white_y));
+            planes.append(plane);
+
+            plane.offset = luma_bytes;
+            plane.stride = width / 2;
+            plane.vertical = 2;
+            plane.fill = QByteArray(1, char(neutral_uv));
+            planes.append(plane);
+
+            plane.offset = luma_bytes + chroma_bytes;
+            planes.append(plane);
+
+            frame_bytes = luma_bytes + 2 * chroma_bytes;
+            break;
+        }
+    }
+
+    frame = QVideoFrame(frame_bytes, QSize(width, height), first_stride, format);
+
+    if(!file.fileName().isEmpty())
+    {
+        if(!file.open(QIODevice::ReadOnly) || file.size() < frame_bytes)
+        {
+            output("Synthetic camera " + QString::number(id) + ": can not replay " + file.fileName() + ", it needs at least one frame of " +
+                   QString::number(frame_bytes) + " bytes.", 1);
+            return false;
+        }
+    }
+    else
+    {
+        create_pattern();
+    }
+
+    return true;
+}
+
+/**
+ * @brief SyntheticCamera::create_pattern
+ *      Draws the color bars, with a luma ramp on the bottom quarter, in planar YUV and packs them into the format.
+ */
+void SyntheticCamera::create_pattern()
+{
+    const int chroma_width = width / 2;
+    const int chroma_height = height / 2;
+
+    QByteArray y_plane(width * height, 0);
+    QByteArray u_plane(chroma_width * chroma_height, 0);
+    QByteArray v_plane(chroma_width * chroma_height, 0);
+
+    for(int i = 0; i < height; i++)
+    {
+        for(int x = 0; x < width; x++)
+        {
+            const int bar = x * 8 / width;
+            y_plane[i * width + x] = char(i < height * 3 / 4 ? bars[bar][0] : 16 + x * 219 / width);
+        }
+    }
+
+    for(int i = 0; i < chroma_height; i++)
+    {
+        for(int x = 0; x < chroma_width; x++)
+        {
+            const int bar = x * 8 / chroma_width;
+            const bool ramp = i >= chroma_height * 3 / 4;
+
+            u_plane[i * chroma_width + x] = char(ramp ? neutral_uv : bars[bar][1]);
+            v_plane[i * chroma_width + x] = char(ramp ? neutral_uv : bars[bar][2]);
+        }
+    }
+
+    const uchar *y = reinterpret_cast<const uchar*>(y_plane.constData());
+    const uchar *u = reinterpret_cast<const uchar*>(u_plane.constData());
+    const uchar *v = reinterpret_cast<const uchar*>(v_plane.constData());
+
+    pattern = QByteArray(frame_bytes, 0);
+    uchar *destination = reinterpret_cast<uchar*>(pattern.data());
+
+    switch(format)
+    {
+        case QVideoFrame::Format_RGB32:
+        {
+            ColorConversion::yuv420p_to_rgb32(y, width, u, v, chroma_width, destination, width * 4, width, height);
+            break;
+        }
+        case QVideoFrame::Format_YUYV:
+        case QVideoFrame::Format_UYVY:
+        {
+            const bool uyvy = format == QVideoFrame::Format_UYVY;
+
+            for(int i = 0; i < height; i++)
+            {
+                for(int x = 0; x < chroma_width; x++)
+                {
+                    uchar *macropixel = destination + i * width * 2 + x * 4;
+                    const int chroma = (i / 2) * chroma_width + x;
+
+                    macropixel[uyvy ? 1 : 0] = y[i * width + 2 * x];
+                    macropixel[uyvy ? 3 : 2] = y[i * width + 2 * x + 1];
+                    macropixel[uyvy ? 0 : 1] = u[chroma];
+                    macropixel[uyvy ? 2 : 3] = v[chroma];
+                }
+            }
+            break;
+        }
+        case QVideoFrame::Format_NV12:
+        case QVideoFrame::Format_NV21:
+        {
+            const bool nv21 = format == QVideoFrame::Format_NV21;
+
+            std::memcpy(destination, y, width * height);
+
+            for(int i = 0; i < chroma_width * chroma_height; i++)
+            {
+                destination[width * height + 2 * i + (nv21 ? 1 : 0)] = u[i];
+                destination[width * height + 2 * i + (nv21 ? 0 : 1)] = v[i];
+            }
+            break;
+        }
+        default:
+        {
+            const bool yv12 = format == QVideoFrame::Format_YV12;
+
+            std::memcpy(destination, y, width * height);
+            std::memcpy(destination + width * height, yv12 ? v : u, chroma_width * chroma_height);
+            std::memcpy(destination + width * height + chroma_width * chroma_height, yv12 ? u : v, chroma_width * chroma_height);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief SyntheticCamera::next_frame
+ *      Updates the frame and presents it. The surface copies the frame before 'present' returns,
+ *      so the same frame can be written again on the next tick.
+ */
+void SyntheticCamera::next_frame()
+{
+    if(!frame.map(QAbstractVideoBuffer::WriteOnly))
+    {
+        output("Synthetic camera " + QString::number(id) + ": could not map the frame.", 1);
+        stop();
+        return;
+    }
+
+    uchar *bits = frame.bits();
+
+    if(file.isOpen())
+    {
+        if(!read_file(bits))
+        {
+            frame.unmap();
+            stop();
+            return;
+        }
+    }
+    else
+    {
+        const int band_rows = qMax(2, height / 10) & ~1;
+        const int step = qMax(2, height / (10 * frame_rate)) & ~1;
+
+        if(first_frame)
+        {
+            std::memcpy(bits, pattern.constData(), frame_bytes);
+            first_frame = false;
+        }
+        else
+        {
+            draw_band(bits, band_position, band_rows, true);
+            band_position = (band_position + step) % (height - band_rows);
+        }
+
+        draw_band(bits, band_position, band_rows, false);
+    }
+
+    frame.unmap();
+
+    if(!surface->present(frame))
+    {
+        rejected_frames++;
+    }
+
+    generated_frames++;
+    report();
+}
+
+/**
+ * @brief SyntheticCamera::draw_band
+ *      Draws, or erases by copying back the pattern, a band of whole rows in every plane.
+ * @param bits
+ *      The mapped frame.
+ * @param top
+ *      First row of the band, even.
+ * @param rows
+ *      Height of the band, even.
+ * @param erase
+ *      True to restore the pattern.
+ */
+void SyntheticCamera::draw_band(uchar *bits, const int top, const int rows, const bool erase) const
+{
+    for(int i = 0; i < planes.size(); i++)
+    {
+        const Plane &plane = planes.at(i);
+        const int offset = plane.offset + (top / plane.vertical) * plane.stride;
+        const int bytes = (rows / plane.vertical) * plane.stride;
+
+        if(erase)
+        {
+            std::memcpy(bits + offset, pattern.constData() + offset, bytes);
+        }
+        else
+        {
+            for(int j = 0; j < bytes; j++)
+            {
+                bits[offset + j] = static_cast<uchar>(plane.fill.at(j % plane.fill.size()));
+            }
+        }
+    }
+}
+
+/**
+ * @brief SyntheticCamera::read_file
+ *      Reads the next frame of the raw file, going back to the start at the end.
+ * @param bits
+ *      The mapped frame.
+ * @return
+ *      Success = true; Failed = false
+ */
+bool SyntheticCamera::read_file(uchar *bits)
+{
+    if(file.bytesAvailable() < frame_bytes)
+    {
+        file.seek(0);
+    }
+
+    if(file.read(reinterpret_cast<char*>(bits), frame_bytes) != frame_bytes)
+    {
+        output("Synthetic camera " + QString::number(id) + ": read failed, " + file.errorString(), 1);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief SyntheticCamera::report
+ *      Prints the rate of frames delivered every 10 seconds, to compare with the configured rate.
+ *      The timer runs in the thread of the surface, a rate below the target means the camera thread is saturated.
+ */
+void SyntheticCamera::report()
+{
+    if(report_timer.elapsed() >= 10000)
+    {
+        const double seconds = report_timer.nsecsElapsed() / 1000000000.0;
+
+        output("Synthetic camera " + QString::number(id) + ": " + QString::number(generated_frames / seconds, 'f', 1) + " fps of " +
+               QString::number(frame_rate) + ", " + QString::number(rejected_frames) + " rejected by the surface.", 3);
+
+        generated_frames = 0;
+        rejected_frames = 0;
+        report_timer.restart();
+    }
+}
+
+/**
+ * @brief SyntheticCamera::pixel_format
+ * @param name
+ *      Name of the format in the settings.
+ * @return
+ *      The format, YUYV if the name is unknown.
+ */
+QVideoFrame::PixelFormat SyntheticCamera::pixel_format(const QString &name)
+{
+    const QString format_name = name.toLower();
+    QVideoFrame::PixelFormat result = QVideoFrame::Format_YUYV;
+
+    if(format_name == "rgb32")
+    {
+        result = QVideoFrame::Format_RGB32;
+    }
+    else if(format_name == "uyvy")
+    {
+        result = QVideoFrame::Format_UYVY;
+    }
+    else if(format_name == "nv12")
+    {
+        result = QVideoFrame::Format_NV12;
+    }
+    else if(format_name == "nv21")
+    {
+        result = QVideoFrame::Format_NV21;
+    }
+    else if(format_name == "yuv420p")
+    {
+        result = QVideoFrame::Format_YUV420P;
+    }
+    else if(format_name == "yv12")
+    {
+        result = QVideoFrame::Format_YV12;
+    }
+
+    return result;
+}
+
+/**
+ * @brief SyntheticCamera::output
+ *      Generic function responsible for all the outputs.
+ */
+void SyntheticCamera::output(const QString &message, const int verbose) const
+{
+    if(Output::get_verbose() >= verbose)
+    {
+        QVariantHash data;
+        data.insert("message", message);
+        data.insert("verbose", verbose);
+        data.insert("load_thread_id", true);
+
+        QString print = Output::builder(data);
+
+        if(!print.isEmpty())
+        {
+            emit console(print);
+        }
+    }
+}
@@ -0,0 +1,98 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SYNTHETICCAMERA_H
+#define SYNTHETICCAMERA_H
+
+#include <QFile>
+#include <QTimer>
+#include <QVector>
+#include <QVideoFrame>
+#include <QElapsedTimer>
+#include <QAbstractVideoSurface>
+
+#include "defines.h"
+
+/**
+ * @brief The SyntheticCamera class
+ *      Camera without a device, for load tests on machines without cameras.
+ *      Generates color bars with a moving band, or replays a raw file, and presents the frames to the surface
+ *      the same way QCamera does, so the whole frame path is exercised.
+ * @remarks
+ *      Configured with the "Synthetic/*" settings: Width, Height, PixelFormat (rgb32, yuyv, uyvy, nv12, nv21, yuv420p, yv12),
+ *      FrameRate and File. A raw file holds frames of exactly that size and format back to back, it is replayed in a loop.
+ *      The same frame is reused, only the rows of the band are rewritten, so generating a frame costs almost nothing.
+ */
+class SyntheticCamera : public QObject
+{
+    Q_OBJECT
+
+public_construct:
+    SyntheticCamera(const int new_id, QAbstractVideoSurface *new_surface, QObject *parent = 0);
+
+public_methods:
+    void start();
+    void stop();
+
+private_methods:
+    bool prepare();
+    void create_pattern();
+    void draw_band(uchar *bits, const int top, const int rows, const bool erase) const;
+    bool read_file(uchar *bits);
+    void report();
+    static QVideoFrame::PixelFormat pixel_format(const QString &name);
+    void output(const QString &message, const int verbose) const;
+
+private_members:
+    int id;
+    int width;
+    int height;
+    int frame_rate;
+    int frame_bytes;
+    int band_position;
+    bool first_frame;
+    qint64 generated_frames;
+    qint64 rejected_frames;
+    QElapsedTimer report_timer;
+    QVideoFrame::PixelFormat format;
+
+private_data_members:
+    struct Plane
+    {
+        int offset;
+        int stride;
+        int vertical;
+        QByteArray fill;
+    };
+
+    QAbstractVideoSurface *surface;
+    QTimer *timer;
+    QVideoFrame frame;
+    QByteArray pattern;
+    QVector<Plane> planes;
+    QFile file;
+
+private slots:
+    void next_frame();
+
+signals:
+    void console(const QString &message) const;
+
+};
+
+#endif // SYNTHETICCAMERA_H
@@ -0,0 +1,42 @@
+#-------------------------------------------------
+#
+# Unit tests of the motion detector, on synthetic frames.
+#
+#-------------------------------------------------
+
+QT       += core gui network testlib
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = tst_motiondetection
+TEMPLATE = app
+
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+
+INCLUDEPATH += ../..
+DEPENDPATH += ../..
+
+SOURCES += tst_motiondetection.cpp \
+    ../../framedifference.cpp \
+    ../../motionstage.cpp \
+    ../../framestage.cpp \
+    ../../frame.cpp \
+    ../../framepool.cpp \
+    ../../imagestatistics.cpp \
+    ../../simd.cpp \
+    ../../output.cpp \
+    ../../helper.cpp \
+    ../../settingsmanager.cpp
+
+HEADERS  += ../../framedifference.h \
+    ../../motionstage.h \
+    ../../framestage.h \
+    ../../frame.h \
+    ../../framepool.h \
+    ../../imagestatistics.h \
+    ../../simd.h \
+    ../../output.h \
+    ../../helper.h \
+    ../../settingsmanager.h \
+    ../../defines.h
@@ -0,0 +1,344 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <QtTest>
+#include <QSignalSpy>
+
+#include "framedifference.h"
+#include "motionstage.h"
+#include "simd.h"
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Scenes
+ *      The frames are 320x240 RGB32, gray pixels have the luma of their value, so the reduced frame is 80x60
+ *      and the default 8x6 grid has regions of 10x10 reduced pixels, 40x40 pixels of the frame.
+ *      The scene is a gray of 100, the block a gray of 200. With the default noise threshold of 12 every reduced pixel
+ *      of the block scores 88 levels, a region fully covered by it scores 8800.
+ */
+namespace
+{
+    const int frame_width = 320;
+    const int frame_height = 240;
+    const int scene_level = 100;
+    const int block_level = 200;
+    const int covered_score = (block_level - scene_level - 12) * 100;
+
+    /**
+     * A frame of the scene with a block in it, an empty block for none.
+     * Noise adds up to 'noise' levels of deterministic noise to each pixel, from 'seed'.
+     */
+    Frame scene(const QRect &block, const int noise = 0, const uint seed = 0)
+    {
+        QImage image(frame_width, frame_height, QImage::Format_RGB32);
+        uint state = seed * 2654435761u + 1;
+
+        for(int y = 0; y < frame_height; y++)
+        {
+            QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(y));
+
+            for(int x = 0; x < frame_width; x++)
+            {
+                int value = block.contains(x, y) ? block_level : scene_level;
+
+                if(noise > 0)
+                {
+                    state = state * 1664525u + 1013904223u;
+                    value += static_cast<int>((state >> 16) % (2 * noise + 1)) - noise;
+                }
+
+                line[x] = qRgb(value, value, value);
+            }
+        }
+
+        Frame frame;
+        frame.image = image;
+
+        return frame;
+    }
+
+    /**
+     * Rows of the tests, one per level the CPU supports.
+     */
+    void add_levels()
+    {
+        QTest::addColumn<int>("level");
+
+        for(int level = Simd::Scalar; level <= Simd::get_supported_level(); level++)
+        {
+            QTest::newRow(qPrintable(Simd::level_name(static_cast<Simd::Level>(level)))) << level;
+        }
+    }
+}
+
+/**
+ * @brief The TestMotionDetection class
+ *      Runs the kernels of FrameDifference and the MotionStage on synthetic frames, at every SIMD level.
+ * @remarks
+ *      The detector reads its settings from "config.ini" next to the test, without one it uses the defaults:
+ *      threshold 12, region threshold 50, background shift 4 and an 8x6 grid.
+ */
+class TestMotionDetection : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanup();
+
+    void difference_data();
+    void difference();
+    void update_background_data();
+    void update_background();
+    void moving_block_data();
+    void moving_block();
+    void static_scene_data();
+    void static_scene();
+    void block_becomes_background_data();
+    void block_becomes_background();
+
+};
+
+/**
+ * @brief TestMotionDetection::initTestCase
+ *      The motion signal is only spied, it is never queued.
+ */
+void TestMotionDetection::initTestCase()
+{
+    qRegisterMetaType<QVector<int> >("QVector<int>");
+}
+
+/**
+ * @brief TestMotionDetection::cleanup
+ *      Every test sets its level, the next one starts with all of them allowed.
+ */
+void TestMotionDetection::cleanup()
+{
+    Simd::set_level_limit(Simd::AVX2);
+}
+
+void TestMotionDetection::difference_data()
+{
+    add_levels();
+}
+
+/**
+ * @brief TestMotionDetection::difference
+ *      A block covering 2x2 regions is summed in those regions only, every pixel above the threshold by 88.
+ */
+void TestMotionDetection::difference()
+{
+    QFETCH(int, level);
+    Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+    const int width = 80;
+    const int height = 60;
+
+    QVector<uchar> background(width * height, scene_level);
+    QVector<uchar> current(background);
+    QVector<qint64> sums(8 * 6);
+
+    for(int y = 10; y < 30; y++)
+    {
+        for(int x = 20; x < 40; x++)
+        {
+            current[y * width + x] = block_level;
+        }
+    }
+
+    FrameDifference::difference(current.constData(), background.constData(), width, width, height, 12, 8, 6, sums.data());
+
+    for(int i = 0; i < 6; i++)
+    {
+        for(int j = 0; j < 8; j++)
+        {
+            const bool covered = (i == 1 || i == 2) && (j == 2 || j == 3);
+            QCOMPARE(sums.at(i * 8 + j), covered ? Q_INT64_C(100) * (block_level - scene_level - 12) : Q_INT64_C(0));
+        }
+    }
+
+    //Differences within the threshold are noise.
+    FrameDifference::difference(current.constData(), current.constData(), width, width, height, 12, 8, 6, sums.data());
+
+    for(int i = 0; i < sums.size(); i++)
+    {
+        QCOMPARE(sums.at(i), Q_INT64_C(0));
+    }
+}
+
+void TestMotionDetection::update_background_data()
+{
+    add_levels();
+}
+
+/**
+ * @brief TestMotionDetection::update_background
+ *      Each step of the shift halves the distance to the background, rounding up.
+ *      The row is wider than the vector registers, so the vector kernels and their tails are both covered.
+ */
+void TestMotionDetection::update_background()
+{
+    QFETCH(int, level);
+    Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+    const int width = 77;
+    const int expected[5] = {200, 150, 125, 113, 107};
+
+    const QVector<uchar> current(width, block_level);
+
+    for(int shift = 0; shift < 5; shift++)
+    {
+        QVector<uchar> background(width, scene_level);
+
+        FrameDifference::update_background(current.constData(), background.data(), width, width, 1, shift);
+
+        for(int x = 0; x < width; x++)
+        {
+            QCOMPARE(static_cast<int>(background.at(x)), expected[shift]);
+        }
+    }
+}
+
+void TestMotionDetection::moving_block_data()
+{
+    add_levels();
+}
+
+/**
+ * @brief TestMotionDetection::moving_block
+ *      The first frame only sets the background. A block appearing in the empty scene covers 2x2 regions,
+ *      the box and the scores are exactly those regions. When it moves right by two regions only the new place scores,
+ *      the old place is within the threshold of the updated background (107).
+ */
+void TestMotionDetection::moving_block()
+{
+    QFETCH(int, level);
+    Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+    MotionStage stage(0);
+    QSignalSpy spy(&stage, SIGNAL(motion(int,QVector<int>,QRect)));
+
+    Frame empty = scene(QRect());
+    QVERIFY(stage.process(empty, 0));
+    QCOMPARE(spy.count(), 0);
+
+    const QRect places[2] = {QRect(80, 40, 80, 80), QRect(160, 40, 80, 80)};
+
+    for(int k = 0; k < 2; k++)
+    {
+        Frame frame = scene(places[k]);
+        QVERIFY(stage.process(frame, 0));
+        QCOMPARE(spy.count(), k + 1);
+
+        const QList<QVariant> arguments = spy.at(k);
+        const QVector<int> scores = arguments.at(1).value<QVector<int> >();
+
+        QCOMPARE(arguments.at(0).toInt(), 0);
+        QCOMPARE(arguments.at(2).toRect(), places[k]);
+        QCOMPARE(scores.size(), 8 * 6);
+
+        for(int i = 0; i < 6; i++)
+        {
+            for(int j = 0; j < 8; j++)
+            {
+                const bool covered = places[k].intersects(QRect(j * 40, i * 40, 40, 40));
+                QCOMPARE(scores.at(i * 8 + j), covered ? covered_score : 0);
+            }
+        }
+    }
+}
+
+void TestMotionDetection::static_scene_data()
+{
+    add_levels();
+}
+
+/**
+ * @brief TestMotionDetection::static_scene
+ *      A static scene with up to 5 levels of noise per pixel never exceeds the threshold, no motion is reported.
+ */
+void TestMotionDetection::static_scene()
+{
+    QFETCH(int, level);
+    Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+    MotionStage stage(0);
+    QSignalSpy spy(&stage, SIGNAL(motion(int,QVector<int>,QRect)));
+
+    for(uint i = 0; i < 30; i++)
+    {
+        Frame frame = scene(QRect(), 5, i);
+        QVERIFY(stage.process(frame, 0));
+    }
+
+    QCOMPARE(spy.count(), 0);
+}
+
+void TestMotionDetection::block_becomes_background_data()
+{
+    add_levels();
+}
+
+/**
+ * @brief TestMotionDetection::block_becomes_background
+ *      A block that stops moving is absorbed by the background: it scores less on every frame, and once it is within
+ *      the threshold the motion stops with an empty box and nothing more is reported.
+ */
+void TestMotionDetection::block_becomes_background()
+{
+    QFETCH(int, level);
+    Simd::set_level_limit(static_cast<Simd::Level>(level));
+
+    MotionStage stage(0);
+    QSignalSpy spy(&stage, SIGNAL(motion(int,QVector<int>,QRect)));
+
+    Frame empty = scene(QRect());
+    QVERIFY(stage.process(empty, 0));
+
+    const QRect place(80, 40, 80, 80);
+    int previous_score = covered_score + 1;
+
+    for(int i = 0; i < 100; i++)
+    {
+        Frame frame = scene(place);
+        QVERIFY(stage.process(frame, 0));
+    }
+
+    QVERIFY(spy.count() > 1);
+    QVERIFY(spy.count() < 100);
+
+    for(int i = 0; i < spy.count() - 1; i++)
+    {
+        const QList<QVariant> arguments = spy.at(i);
+        const int score = arguments.at(1).value<QVector<int> >().at(1 * 8 + 2);
+
+        QCOMPARE(arguments.at(2).toRect(), place);
+        QVERIFY(score < previous_score);
+
+        previous_score = score;
+    }
+
+    QVERIFY(spy.last().at(2).toRect().isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestMotionDetection)
+
+#include "tst_motiondetection.moc"
@@ -20,6 +20,7 @@
 #include "output.h"
 
 #include <QTimer>
+#include <QStringList>
 
 #define use_timer false
 
@@ -47,11 +48,29 @@ TextStream::TextStream(QObject *parent) :
  * @brief TextStream::get_text
  *      Outputs a message from the UI.
  *      Either called from a signal or the timer.
+ *      The command "trigger [id]" triggers the pre-roll of a camera, or of all of them without an ID.
  * @param message
  */
 void TextStream::get_text(const QString &message) const
 {
     output("Text Stream: " + message, 1);
+
+    const QStringList words = message.simplified().split(' ', QString::SkipEmptyParts);
+
+    if(!words.isEmpty() && words.first().toLower() == "trigger")
+    {
+        bool valid = true;
+        const int id = words.size() > 1 ? words.at(1).toInt(&valid) : -1;
+
+        if(valid)
+        {
+            emit trigger(id);
+        }
+        else
+        {
+            output("Usage: trigger [camera id]", 1);
+        }
+    }
 }
 
 /**
@@ -38,6 +38,7 @@ public slots:
 
 signals:
     void console(const QString &message) const;
+    void trigger(const int id) const;
 
 };
 
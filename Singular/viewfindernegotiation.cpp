@@ -0,0 +1,357 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "viewfindernegotiation.h"
+#include "framepool.h"
+#include "colorconversion.h"
+
+#include <QHash>
+#include <QImage>
+#include <QBuffer>
+#include <QMutex>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QRegExp>
+
+#include <cstring>
+
+/**
+ *@brief Anonymous namespace
+ *      This namespace is used as a "private section".
+ *      It is anonymous and therefore can only accessed within file scope.
+ *@remarks Variables
+ *      The cost per pixel of each format is measured once, on a VGA frame, and shared by all the cameras.
+ *      Formats the surface copies without conversion cost a memcpy of their size.
+ *      MJPEG costs the decoding of a textured frame, the frames are decoded whenever the camera is shown.
+ */
+namespace
+{
+    QMutex cost_mutex;
+    QHash<int, double> cost_cache;
+
+    const int measure_width = 640;
+    const int measure_height = 480;
+    const int measure_iterations = 10;
+
+    struct FormatName
+    {
+        QVideoFrame::PixelFormat format;
+        const char *name;
+    };
+
+    const FormatName format_names[] =
+    {
+        { QVideoFrame::Format_YUYV, "YUYV" },
+        { QVideoFrame::Format_UYVY, "UYVY" },
+        { QVideoFrame::Format_NV12, "NV12" },
+        { QVideoFrame::Format_NV21, "NV21" },
+        { QVideoFrame::Format_YUV420P, "YUV420P" },
+        { QVideoFrame::Format_YV12, "YV12" },
+        { QVideoFrame::Format_Jpeg, "MJPEG" },
+        { QVideoFrame::Format_ARGB32, "ARGB32" },
+        { QVideoFrame::Format_ARGB32_Premultiplied, "ARGB32P" },
+        { QVideoFrame::Format_RGB32, "RGB32" },
+        { QVideoFrame::Format_RGB24, "RGB24" },
+        { QVideoFrame::Format_RGB565, "RGB565" },
+        { QVideoFrame::Format_RGB555, "RGB555" }
+    };
+
+    QString format_name(const QVideoFrame::PixelFormat pixel_format)
+    {
+        for(uint i = 0; i < sizeof(format_names) / sizeof(format_names[0]); i++)
+        {
+            if(format_names[i].format == pixel_format)
+            {
+                return format_names[i].name;
+            }
+        }
+
+        return QString::number(pixel_format);
+    }
+
+    QVideoFrame::PixelFormat format_from_name(const QString &name)
+    {
+        for(uint i = 0; i < sizeof(format_names) / sizeof(format_names[0]); i++)
+        {
+            if(name == format_names[i].name)
+            {
+                return format_names[i].format;
+            }
+        }
+
+        return QVideoFrame::Format_Invalid;
+    }
+
+    double measure(const QVideoFrame::PixelFormat pixel_format)
+    {
+        const int pixels = measure_width * measure_height;
+        const int stride = FramePool::aligned_bytes_per_line(measure_width * 4);
+
+        QVector<uchar> source(pixels * 4, 128);
+        QVector<uchar> destination(stride * measure_height);
+        QByteArray jpeg;
+
+        if(pixel_format == QVideoFrame::Format_Jpeg)
+        {
+            //A flat frame would decode much faster than a real scene.
+            for(int i = 0; i < source.size(); i++)
+            {
+                source[i] = static_cast<uchar>((i * 7) ^ (i >> 9));
+            }
+
+            QBuffer buffer(&jpeg);
+            buffer.open(QIODevice::WriteOnly);
+            QImage(source.constData(), measure_width, measure_height, measure_width * 4, QImage::Format_RGB32).save(&buffer, "jpeg", 75);
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+
+        for(int i = 0; i < measure_iterations; i++)
+        {
+            switch(pixel_format)
+            {
+                case QVideoFrame::Format_YUYV:
+                case QVideoFrame::Format_UYVY:
+                {
+                    ColorConversion::yuyv_to_rgb32(source.constData(), measure_width * 2, pixel_format == QVideoFrame::Format_UYVY,
+                                                   destination.data(), stride, measure_width, measure_height);
+                    break;
+                }
+                case QVideoFrame::Format_NV12:
+                case QVideoFrame::Format_NV21:
+                {
+                    ColorConversion::nv12_to_rgb32(source.constData(), measure_width, source.constData() + pixels, measure_width,
+                                                   pixel_format == QVideoFrame::Format_NV21,
+                                                   destination.data(), stride, measure_width, measure_height);
+                    break;
+                }
+                case QVideoFrame::Format_YUV420P:
+                case QVideoFrame::Format_YV12:
+                {
+                    ColorConversion::yuv420p_to_rgb32(source.constData(), measure_width,
+                                                      source.constData() + pixels, source.constData() + pixels * 5 / 4, measure_width / 2,
+                                                      destination.data(), stride, measure_width, measure_height);
+                    break;
+                }
+                case QVideoFrame::Format_Jpeg:
+                {
+                    QImage image(destination.data(), measure_width, measure_height, stride, QImage::Format_RGB32);
+                    image.loadFromData(jpeg, "jpeg");
+                    break;
+                }
+                case QVideoFrame::Format_RGB24:
+                {
+                    std::memcpy(destination.data(), source.constData(), pixels * 3);
+                    break;
+                }
+                case QVideoFrame::Format_RGB565:
+                case QVideoFrame::Format_RGB555:
+                {
+                    std::memcpy(destination.data(), source.constData(), pixels * 2);
+                    break;
+                }
+                default:
+                {
+                    std::memcpy(destination.data(), source.constData(), pixels * 4);
+                    break;
+                }
+            }
+        }
+
+        return static_cast<double>(timer.nsecsElapsed()) / measure_iterations / pixels;
+    }
+
+    int resolution_distance(const QSize &resolution, const QSize &target)
+    {
+        const int pixels = resolution.width() * resolution.height();
+        const int target_pixels = target.width() * target.height();
+
+        //Smaller resolutions lose detail, they count twice as far as larger ones.
+        return pixels >= target_pixels ? pixels - target_pixels : 2 * (target_pixels - pixels);
+    }
+
+    bool better(const QCameraViewfinderSettings &a, const QCameraViewfinderSettings &b, const QString &policy, const QSize &target)
+    {
+        const double cost_a = ViewfinderNegotiation::cost(a);
+        const double cost_b = ViewfinderNegotiation::cost(b);
+        const int distance_a = target.isEmpty() ? 0 : resolution_distance(a.resolution(), target);
+        const int distance_b = target.isEmpty() ? 0 : resolution_distance(b.resolution(), target);
+        const int pixels_a = a.resolution().width() * a.resolution().height();
+        const int pixels_b = b.resolution().width() * b.resolution().height();
+
+        if(policy == "cost")
+        {
+            const bool reaches_a = target.isEmpty() || pixels_a >= target.width() * target.height();
+            const bool reaches_b = target.isEmpty() || pixels_b >= target.width() * target.height();
+
+            if(reaches_a != reaches_b)
+            {
+                return reaches_a;
+            }
+
+            if(cost_a != cost_b)
+            {
+                return cost_a < cost_b;
+            }
+
+            return a.maximumFrameRate() > b.maximumFrameRate();
+        }
+
+        if(policy == "resolution")
+        {
+            if(distance_a != distance_b)
+            {
+                return distance_a < distance_b;
+            }
+
+            if(a.maximumFrameRate() != b.maximumFrameRate())
+            {
+                return a.maximumFrameRate() > b.maximumFrameRate();
+            }
+
+            return cost_a < cost_b;
+        }
+
+        //fps
+        if(a.maximumFrameRate() != b.maximumFrameRate())
+        {
+            return a.maximumFrameRate() > b.maximumFrameRate();
+        }
+
+        if(distance_a != distance_b)
+        {
+            return target.isEmpty() ? pixels_a > pixels_b : distance_a < distance_b;
+        }
+
+        return cost_a < cost_b;
+    }
+}
+
+/**
+ * @brief ViewfinderNegotiation::nanoseconds_per_pixel
+ *      Cost of copying one pixel of the format into the pool, converting it if needed.
+ *      Measured the first time a format is asked for, with the instruction set in use.
+ * @param pixel_format
+ *      The format.
+ * @return
+ *      Nanoseconds per pixel.
+ */
+double ViewfinderNegotiation::nanoseconds_per_pixel(const QVideoFrame::PixelFormat pixel_format)
+{
+    QMutexLocker locker(&cost_mutex);
+
+    if(!cost_cache.contains(pixel_format))
+    {
+        cost_cache.insert(pixel_format, measure(pixel_format));
+    }
+
+    return cost_cache.value(pixel_format);
+}
+
+/**
+ * @brief ViewfinderNegotiation::cost
+ * @param settings
+ *      A candidate.
+ * @return
+ *      CPU time of the surface per second of video at the maximum frame rate, in nanoseconds.
+ */
+double ViewfinderNegotiation::cost(const QCameraViewfinderSettings &settings)
+{
+    const double pixels = static_cast<double>(settings.resolution().width()) * settings.resolution().height();
+
+    return nanoseconds_per_pixel(settings.pixelFormat()) * pixels * settings.maximumFrameRate();
+}
+
+/**
+ * @brief ViewfinderNegotiation::choose
+ *      Picks the best candidate for the policy.
+ * @param candidates
+ *      Settings supported by the device and by the surface.
+ * @param policy
+ *      "cost", "fps" or "resolution".
+ * @param target
+ *      Target resolution, empty for none.
+ * @param minimum_frame_rate
+ *      Candidates below this rate are only used when there is nothing else.
+ * @return
+ *      The chosen settings, null if there are no candidates.
+ */
+QCameraViewfinderSettings ViewfinderNegotiation::choose(const QList<QCameraViewfinderSettings> &candidates, const QString &policy,
+                                                        const QSize &target, const double minimum_frame_rate)
+{
+    QCameraViewfinderSettings best;
+    bool best_fast = false;
+
+    foreach(const QCameraViewfinderSettings &candidate, candidates)
+    {
+        const bool fast = candidate.maximumFrameRate() + 0.5 >= minimum_frame_rate;
+
+        if(best.isNull() || (fast && !best_fast) || (fast == best_fast && better(candidate, best, policy, target)))
+        {
+            best = candidate;
+            best_fast = fast;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @brief ViewfinderNegotiation::to_string
+ * @param settings
+ *      The settings.
+ * @return
+ *      Text form, for example "1280x720@30 YUYV", used in the logs and in the settings file.
+ */
+QString ViewfinderNegotiation::to_string(const QCameraViewfinderSettings &settings)
+{
+    return QString::number(settings.resolution().width()) + "x" + QString::number(settings.resolution().height()) + "@" +
+           QString::number(settings.maximumFrameRate()) + " " + format_name(settings.pixelFormat());
+}
+
+/**
+ * @brief ViewfinderNegotiation::from_string
+ * @param text
+ *      Text form, as written by to_string.
+ * @return
+ *      The settings, null if the text is invalid.
+ */
+QCameraViewfinderSettings ViewfinderNegotiation::from_string(const QString &text)
+{
+    QCameraViewfinderSettings settings;
+
+    const QStringList parts = text.split(QRegExp("[x@ ]"), QString::SkipEmptyParts);
+
+    if(parts.size() == 4)
+    {
+        const QVideoFrame::PixelFormat pixel_format = format_from_name(parts.at(3));
+        const QSize resolution(parts.at(0).toInt(), parts.at(1).toInt());
+        const double frame_rate = parts.at(2).toDouble();
+
+        if(pixel_format != QVideoFrame::Format_Invalid && !resolution.isEmpty() && frame_rate > 0)
+        {
+            settings.setResolution(resolution);
+            settings.setMaximumFrameRate(frame_rate);
+            settings.setPixelFormat(pixel_format);
+        }
+    }
+
+    return settings;
+}
@@ -0,0 +1,51 @@
+/*
+ * Singular
+ * Copyright (C) 2015 Filipe Carvalho
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VIEWFINDERNEGOTIATION_H
+#define VIEWFINDERNEGOTIATION_H
+
+#include <QList>
+#include <QSize>
+#include <QString>
+#include <QVideoFrame>
+#include <QCameraViewfinderSettings>
+
+/**
+ * @brief The ViewfinderNegotiation namespace
+ *      Chooses the viewfinder settings of a camera among the ones the device supports.
+ *      The cost of a candidate is the CPU time per second the surface spends copying and converting its frames,
+ *      from the measured cost per pixel of its pixel format times the pixels per second.
+ * @remarks Policies
+ *      "cost": lowest cost that still meets the target resolution and the minimum frame rate.
+ *      "fps": highest frame rate, then the resolution closest to the target, then the lowest cost.
+ *      "resolution": closest resolution to the target, preferring larger ones, then the highest frame rate, then the lowest cost.
+ *      Candidates below the minimum frame rate are only used if no candidate reaches it.
+ */
+namespace ViewfinderNegotiation
+{
+    double cost(const QCameraViewfinderSettings &settings);
+    double nanoseconds_per_pixel(const QVideoFrame::PixelFormat pixel_format);
+
+    QCameraViewfinderSettings choose(const QList<QCameraViewfinderSettings> &candidates, const QString &policy,
+                                     const QSize &target, const double minimum_frame_rate);
+
+    QString to_string(const QCameraViewfinderSettings &settings);
+    QCameraViewfinderSettings from_string(const QString &text);
+}
+
+#endif // VIEWFINDERNEGOTIATION_H